@@ -3,9 +3,6 @@
  * @headerfile bcon.h <bcon.h>
  * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
  * <br />For license information, please refer to ../LICENSE.md
- * @todo This unit contains duplicated code from src/tx.c involving
- * TXPOS and txpos_compare(). This code has not been refactored into
- * a common header file or source file due to future planned deprecation.
 */
 
 /* include guard */
@@ -40,23 +37,61 @@ static word8 Maddr[ADDR_TAG_LEN] = {
    0x26, 0x01, 0x17, 0xa7, 0x2b, 0x7d, 0xe9, 0xf5, 0xca, 0x59
 };
 
+/* Block candidate policy (see b_select()) */
+word32 Bcmaxtx = MAXBLTX;        /* max transactions in a candidate */
+word32 Bcmaxbytes = MAXBLBYTES;  /* max transaction bytes in a candidate */
+word32 Bcminfee[2] = { MFEE };   /* min transaction fee in a candidate */
+word8 Bcspec = 1;                /* build speculative candidates */
+
+/**
+ * @private
+ * Comparison function to sort BCTXPOS objects by source address.
+*/
+static int bctxpos_compare(const void *va, const void *vb)
+{
+   BCTXPOS *a = (BCTXPOS *) va;
+   BCTXPOS *b = (BCTXPOS *) vb;
+
+   return memcmp(a->src, b->src, sizeof(a->src));
+}
+
 /**
- * @private Transaction Position structure.
- * Contains a source and file position type pair.
+ * @private
+ * Comparison function to sort BCTXPOS objects by source address, then
+ * by descending fee (so the highest fee of a source sorts first).
 */
-typedef struct {
-   word8 src[ADDR_LEN];
-   fpos_t pos;
-} TXPOS;
+static int bctxpos_compare_src(const void *va, const void *vb)
+{
+   BCTXPOS *a = (BCTXPOS *) va;
+   BCTXPOS *b = (BCTXPOS *) vb;
+   int cmp;
+
+   cmp = memcmp(a->src, b->src, sizeof(a->src));
+   if (cmp) return cmp;
+
+   return cmp64(b->fee, a->fee);
+}
 
 /**
  * @private
- * Comparison function to sort TXPOS objects by id.
+ * Comparison function to sort BCTXPOS objects by descending fee per
+ * byte, then by descending fee, then by source address.
 */
-static int txpos_compare(const void *va, const void *vb)
+static int bctxpos_compare_fee(const void *va, const void *vb)
 {
-   TXPOS *a = (TXPOS *) va;
-   TXPOS *b = (TXPOS *) vb;
+   BCTXPOS *a = (BCTXPOS *) va;
+   BCTXPOS *b = (BCTXPOS *) vb;
+   long double arate, brate;
+   word64 afee, bfee;
+   int cmp;
+
+   put64(&afee, a->fee);
+   put64(&bfee, b->fee);
+   arate = (long double) afee / (a->size ? a->size : 1);
+   brate = (long double) bfee / (b->size ? b->size : 1);
+   if (arate != brate) return (arate < brate) ? 1 : -1;
+   cmp = cmp64(b->fee, a->fee);
+   if (cmp) return cmp;
 
    return memcmp(a->src, b->src, sizeof(a->src));
 }
@@ -142,6 +177,8 @@ ERROR_CLEANUP:
 /**
  * Generate a neogenesis block. Uses a block trailer (MUST BE 0x..ff) and
  * a ledger file as input to create a output neogenesis file (0x..00).
+ * Leaf hashes are read from the ledger's leaf-hash sidecar, if valid,
+ * and written to the sidecar of the output neogenesis file.
  * @param prev_bt Pointer to previous block trailer data
  * @param lefile Filename of ledger to convert to neogenesis block
  * @param output Filename of output block (typically "ngblock.dat")
@@ -154,14 +191,14 @@ int neogen(const BTRAILER *prev_bt, const char *lefile, const char *output)
    LENTRY le;           /* ledger entry */
    BTRAILER bt;         /* block trailer */
    NGHEADER ngh;        /* neogenesis header data */
-   FILE *fp, *lfp;
+   FILE *fp, *lfp, *lhfp;
    word8 *mtree;        /* malloc'd merkle tree */
    size_t mcount;       /* merkle tree count */
    size_t j;            /* loop counter */
    long long llen;      /* ledger length */
 
    /* init */
-   fp = lfp = NULL;
+   fp = lfp = lhfp = NULL;
    mtree = NULL;
    mcount = 0;
 
@@ -213,6 +250,9 @@ int neogen(const BTRAILER *prev_bt, const char *lefile, const char *output)
     * doesn't require the entire list to be in memory at once.
     */
 
+   /* leaf hashes maintained by le_update() save hashing the ledger */
+   lhfp = le_lhopen(lefile, 0LL, mcount);
+
    /* Cue ledger.dat to beginning and copy it to neo-gen block
     * header whilst collecting merkle tree nodes.
     */
@@ -226,6 +266,9 @@ int neogen(const BTRAILER *prev_bt, const char *lefile, const char *output)
       }
       /* write to neogenesis file and update merkle list */
       if (fwrite(&le, sizeof(LENTRY), 1, fp) != 1) goto ERROR_CLEANUP;
+      if (lhfp && fread(mtree + (j * HASHLEN), HASHLEN, 1, lhfp) == 1) {
+         continue;
+      }
       sha256(&le, sizeof(LENTRY), mtree + (j * HASHLEN));
    }
 
@@ -250,6 +293,9 @@ int neogen(const BTRAILER *prev_bt, const char *lefile, const char *output)
    /* cleanup */
    fclose(fp);
    fclose(lfp);
+   if (lhfp) fclose(lhfp);
+   /* leaf hashes of neogenesis block, for le_extract() (optional) */
+   le_lhwrite(output, mtree, mcount);
    free(mtree);
 
    return VEOK;
@@ -257,6 +303,7 @@ int neogen(const BTRAILER *prev_bt, const char *lefile, const char *output)
    /* cleanup / error handling */
 ERROR_CLEANUP:
    if (mtree) free(mtree);
+   if (lhfp) fclose(lhfp);
    if (lfp) fclose(lfp);
    if (fp) {
       fclose(fp);
@@ -340,19 +387,80 @@ ERROR_CLEANUP:
 }  /* end b_adjust_maddr_fp() */
 
 /**
- * Construct a candidate block from "txclean.dat". Uses node state
- * (Cblocknum, Cblockhash, Mfee, Difficulty, Time0) for block data.
- * @param output Filename of output block (typically "cblock.dat")
+ * Select the transactions of a candidate block. Transactions below the
+ * minimum fee, and all but the highest fee transaction of any duplicate
+ * source address, are excluded. Where the remaining transactions exceed
+ * either limit, transactions are chosen greedily by fee per byte (then
+ * by fee) to maximize the fees collected within limits. The selected
+ * transactions are moved to the front of @a txp, in the source address
+ * order required for block construction.
+ * @param txp Pointer to array of transaction references
+ * @param count Number of transaction references in array
+ * @param maxtx Maximum number of transactions (capped to MAXBLTX)
+ * @param maxbytes Maximum number of transaction bytes, or zero for none
+ * @param minfee Pointer to 64-bit minimum transaction fee, or NULL
+ * @return (size_t) number of selected transactions
+*/
+size_t b_select(BCTXPOS *txp, size_t count,
+   word32 maxtx, word32 maxbytes, const void *minfee)
+{
+   size_t bytes, j, n;
+
+   /* apply consensus limit on transaction count */
+   if (maxtx == 0 || maxtx > MAXBLTX) maxtx = MAXBLTX;
+
+   /* sort by source (highest fee first) */
+   qsort(txp, count, sizeof(BCTXPOS), bctxpos_compare_src);
+   /* drop duplicate sources and fees below minimum */
+   for (bytes = j = n = 0; j < count; j++) {
+      if (minfee && cmp64(txp[j].fee, minfee) < 0) continue;
+      if (n > 0 && memcmp(txp[j].src, txp[n - 1].src, ADDR_LEN) == 0) {
+         continue;
+      }
+      if (n != j) txp[n] = txp[j];
+      bytes += txp[n++].size;
+   }
+
+   /* choose most profitable transactions where limits are exceeded */
+   if (n > maxtx || (maxbytes && bytes > maxbytes)) {
+      qsort(txp, n, sizeof(BCTXPOS), bctxpos_compare_fee);
+      count = n;
+      for (bytes = j = n = 0; j < count && n < maxtx; j++) {
+         /* skip transactions that don't fit, smaller ones might */
+         if (maxbytes && bytes + txp[j].size > maxbytes) continue;
+         if (n != j) txp[n] = txp[j];
+         bytes += txp[n++].size;
+      }
+      /* restore source address order */
+      qsort(txp, n, sizeof(BCTXPOS), bctxpos_compare);
+   }
+
+   return n;
+}  /* end b_select() */
+
+/**
+ * @private
+ * Construct a candidate block from a clean transaction queue file, to
+ * follow a block of the given block number, block hash, solve time and
+ * (next) difficulty. See b_con().
+ * @param txfname Filename of clean transaction queue
+ * @param bnum Block number of previous block
+ * @param phash Block hash of previous block
+ * @param time0 Solve time of previous block (time0 of candidate)
+ * @param difficulty Difficulty of candidate
+ * @param output Filename of output block
  * @return (int) value representing operation result
  * @retval VERROR on error; check errno for details
  * @retval VEOK on success
 */
-int b_con(const char *output)
+static int b_con__build(const char *txfname, const word8 bnum[8],
+   const word8 phash[HASHLEN], word32 time0, word32 difficulty,
+   const char *output)
 {
    TXENTRY txc;            /* for holding transaction data */
    BTRAILER bt;            /* block trailers are fixed length */
    BHEADER bh;             /* the minimal length block header */
-   TXPOS *tx;              /* malloc'd transaction positions */
+   BCTXPOS *tx;            /* malloc'd transaction positions */
    FILE *fp, *fpout;       /* to read txclean file and write cblock */
    void *ptr;              /* realloc pointer */
    word8 *mtree;           /* malloc'd merkle tree list */
@@ -361,6 +469,7 @@ int b_con(const char *output)
    size_t count, tcount;   /* malloc'd space and transaction count */
    size_t j, actual;       /* loop counter and txclean count */
    int cond;               /* loop condition */
+   char tmpname[FILENAME_MAX]; /* temporary output filename */
 
    /* init pointers */
    fpout = fp = NULL;
@@ -372,8 +481,8 @@ int b_con(const char *output)
 
    /* BEGIN TRANSACTION SORT */
 
-   /* open the clean TX queue (txclean.dat) and create a sorted index */
-   fp = fopen("txclean.dat", "rb");
+   /* open the clean TX queue (txfname) and create a sorted index */
+   fp = fopen(txfname, "rb");
    if (fp == NULL) return VERROR;
 
    /* obtain EOF offset and check */
@@ -396,7 +505,7 @@ int b_con(const char *output)
    /* loop to check allocated space is sufficient (+32 TXs/loop) */
    for (actual = 0, cond = 1, count = 32; cond; count += 32) {
       /* (re)allocate memory space for 32 TXs at a time */
-      ptr = realloc(tx, count * sizeof(TXPOS));
+      ptr = realloc(tx, count * sizeof(BCTXPOS));
       if (ptr == NULL) goto ERROR_CLEANUP;
       tx = ptr;
       /* loop to store source and associated fpos_t value in array */
@@ -411,6 +520,8 @@ int b_con(const char *output)
          }
          /* set source reference data */
          memcpy(&(tx[actual].src), txc.src_addr, ADDR_LEN);
+         memcpy(&(tx[actual].fee), txc.tx_fee, 8);
+         tx[actual].size = txc.tx_sz;
          tx[actual++].pos = pos;
       }  /* end while() */
    }  /* end for() */
@@ -419,18 +530,24 @@ int b_con(const char *output)
       set_errno(EMCM_FILEDATA);
       goto ERROR_CLEANUP;
    }
-   /* sort the txid reference array */
-   qsort(tx, actual, sizeof(TXPOS), txpos_compare);
+   /* select transactions per block candidate policy (sorted) */
+   actual = b_select(tx, actual, Bcmaxtx, Bcmaxbytes, Bcminfee);
+   if (actual == 0) {
+      /* no transactions within policy */
+      set_errno(EMCM_TX0);
+      goto ERROR_CLEANUP;
+   }
 
    /* BEGIN BLOCK CONSTRUCTION */
 
    /* open output for writing */
-   fpout = fopen("cblock.tmp", "wb");
+   snprintf(tmpname, sizeof(tmpname), "%s.tmp", output);
+   fpout = fopen(tmpname, "wb");
    if (fpout == NULL) goto ERROR_CLEANUP;
 
    /* init block trailer (zero) and compute bnum */
    memset(&bt, 0, sizeof(BTRAILER));
-   if (add64(Cblocknum, ONE64, bt.bnum)) {
+   if (add64(bnum, ONE64, bt.bnum)) {
       set_errno(EMCM_MATH64_OVERFLOW);
       goto ERROR_CLEANUP;
    }
@@ -456,7 +573,7 @@ int b_con(const char *output)
     * doesn't require the entire list to be in memory at once.
     */
 
-   /* read transactions from txclean.dat using sorted TXPOS array */
+   /* read transactions from txclean.dat using sorted BCTXPOS array */
    for (j = tcount = 0; j < actual; j++) {
       /* seek to transaction position */
       if (fsetpos(fp, &tx[j].pos) != 0) {
@@ -467,15 +584,10 @@ int b_con(const char *output)
          if (!ferror(fp)) set_errno(EMCM_EOF);
          goto ERROR_CLEANUP;
       }
-      /* skip duplicate source address */
-      if (j > 0) {
-         if (memcmp(txc.src_addr, tx[j - 1].src, HASHLEN) == 0) {
-            continue;
-         }
-      }
       /* set appropriate nonce and hash */
       memset(txc.tlr->nonce, 0, sizeof(txc.tlr->nonce));
-      tx_hash(&txc, TX_HASH_ID, txc.tx_id);
+      tx_digest(&txc);
+      memcpy(txc.tx_id, txc.digest_id, HASHLEN);
       /* add transaction id to merkel tree (++ prefix for miner) */
       memcpy(&mtree[(++tcount) * HASHLEN], txc.tx_id, HASHLEN);
       /* write transaction to block */
@@ -485,12 +597,12 @@ int b_con(const char *output)
    }  /* end for() */
 
    /* finalize block trailer data */
-   memcpy(bt.phash, Cblockhash, HASHLEN);
+   memcpy(bt.phash, phash, HASHLEN);
    /* ... bt.bnum set earlier via add64() */
    put64(bt.mfee, Mfee);
    put32(bt.tcount, tcount);
-   put32(bt.time0, Time0);
-   put32(bt.difficulty, Difficulty);
+   put32(bt.time0, time0);
+   put32(bt.difficulty, difficulty);
    /* compute merkel root hash straight into the trailer */
    merkle_root(mtree, tcount + 1, bt.mroot);
    /* ... bt.nonce left zero'd (not known) */
@@ -510,7 +622,7 @@ int b_con(const char *output)
 
    /* move temporary output (*.tmp) to working output (*.dat) */
    remove(output);
-   if (rename("cblock.tmp", output) != 0) {
+   if (rename(tmpname, output) != 0) {
       return VERROR;
    }
 
@@ -521,14 +633,152 @@ int b_con(const char *output)
 ERROR_CLEANUP:
    if (fpout) {
       fclose(fpout);
-      remove("cblock.tmp");
+      remove(tmpname);
    }
    if (fp) fclose(fp);
    if (mtree) free(mtree);
    if (tx) free(tx);
 
    return VERROR;
+}  /* end b_con__build() */
+
+/**
+ * Construct a candidate block from "txclean.dat". Uses node state
+ * (Cblocknum, Cblockhash, Mfee, Difficulty, Time0) for block data, and
+ * the block candidate policy (Bcmaxtx, Bcmaxbytes, Bcminfee) to select
+ * transactions (see b_select()).
+ * @param output Filename of output block (typically "cblock.dat")
+ * @return (int) value representing operation result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+*/
+int b_con(const char *output)
+{
+   return b_con__build("txclean.dat", Cblocknum, Cblockhash, Time0,
+      Difficulty, output);
 }  /* end b_con() */
 
+/**
+ * Construct a speculative candidate block, to follow a validated block
+ * that is yet to be applied to the ledger. The ledger transactions of
+ * the block are layered over the ledger (see le_ovl_init()), and only
+ * transactions of "txclean.dat" whose source ledger entry is untouched
+ * by the block are kept, as they remain valid after the update. The
+ * block candidate policy applies as per b_con().
+ * @param bcfname Filename of validated block
+ * @param ltfname Filename of ledger transactions of validated block
+ * @param output Filename of output block (typically "cblock.spec")
+ * @return (int) value representing operation result
+ * @retval VEBAD2 on invalid ledger transactions; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ * @exception errno=EMCM_BNUM if a neogenesis block follows the block
+*/
+int b_spec(const char *bcfname, const char *ltfname, const char *output)
+{
+   TXENTRY txc;
+   BTRAILER bt;
+   LENTRY le, ovle;
+   LEOVL ovl;
+   LTRAN *lt;
+   FILE *fp, *ltfp, *tfp;
+   long long len;
+   size_t count;
+   int ecode;
+
+   /* read block trailer -- neogenesis blocks are not speculated */
+   if (read_trailer(&bt, bcfname) != VEOK) return VERROR;
+   if (bt.bnum[0] == 0xff) {
+      set_errno(EMCM_BNUM);
+      return VERROR;
+   }
+
+   /* layer ledger transactions of block over ledger, in one pass */
+   if (le_ovl_init(&ovl) != VEOK) return VERROR;
+   fp = ltfp = tfp = NULL;
+   lt = NULL;
+   ecode = VERROR;
+   ltfp = fopen(ltfname, "rb");
+   if (ltfp == NULL) goto CLEANUP;
+   if (fseek64(ltfp, 0LL, SEEK_END) != 0) goto CLEANUP;
+   len = ftell64(ltfp);
+   if (len == (-1) || fseek64(ltfp, 0LL, SEEK_SET) != 0) goto CLEANUP;
+   if (len % sizeof(LTRAN) != 0) {
+      set_errno(EMCM_FILELEN);
+      goto CLEANUP;
+   }
+   count = (size_t) len / sizeof(LTRAN);
+   if (count) {
+      lt = malloc(count * sizeof(LTRAN));
+      if (lt == NULL) goto CLEANUP;
+      if (fread(lt, sizeof(LTRAN), count, ltfp) != count) goto CLEANUP;
+   }
+   ecode = le_ovl_addv(&ovl, lt, count);
+   if (ecode != VEOK) goto CLEANUP;
+   ecode = VERROR;
+
+   /* keep transactions with an untouched source ledger entry */
+   fp = fopen("txclean.dat", "rb");
+   if (fp == NULL) goto CLEANUP;
+   tfp = fopen("txspec.tmp", "wb");
+   if (tfp == NULL) goto CLEANUP;
+   while (tx_fread(&txc, fp) == VEOK) {
+      if (le_ovl_find(&ovl, txc.src_addr, &ovle, ADDR_LEN) == 0) continue;
+      if (le_snap_find(ovl.base, txc.src_addr, &le, ADDR_LEN) == 0) continue;
+      if (memcmp(&le, &ovle, sizeof(LENTRY)) != 0) continue;
+      if (tx_fwrite(&txc, tfp) != VEOK) goto CLEANUP;
+   }
+   if (ferror(fp)) goto CLEANUP;
+   fclose(tfp);
+   tfp = NULL;
+
+   /* construct candidate as it would follow the block */
+   ecode = b_con__build("txspec.tmp", bt.bnum, bt.bhash, get32(bt.stime),
+      next_difficulty(&bt), output);
+
+CLEANUP:
+   if (lt) free(lt);
+   if (tfp) fclose(tfp);
+   if (fp) fclose(fp);
+   if (ltfp) fclose(ltfp);
+   remove("txspec.tmp");
+   le_ovl_discard(&ovl);
+
+   return ecode;
+}  /* end b_spec() */
+
+/**
+ * Start a child process to construct a speculative candidate block,
+ * "cblock.spec", with b_spec(). The ledger transactions, @a ltfname,
+ * are copied first, as the parent may sort them during le_update().
+ * @param bcfname Filename of validated block
+ * @param ltfname Filename of ledger transactions of validated block
+ * @return (pid_t) process id of child, or zero on error
+*/
+pid_t b_spec_start(const char *bcfname, const char *ltfname)
+{
+   pid_t pid;
+
+   remove("cblock.spec");
+   if (fcopy((char *) ltfname, "ltran.spec") != VEOK) return 0;
+   pid = fork();
+   if (pid == -1) {
+      perr("Cannot fork() for b_spec()");
+      remove("ltran.spec");
+      return 0;
+   } else if (pid == 0) {
+      /* in child */
+      if (b_spec(bcfname, "ltran.spec", "cblock.spec") != VEOK) {
+         pdebug("b_spec() abandoned");
+         remove("ltran.spec");
+         exit(1);  /* child exits */
+      }
+      remove("ltran.spec");
+      exit(0);  /* child exits */
+   }
+
+   return pid;
+}  /* end b_spec_start() */
+
 /* end include guard */
 #endif
@@ -12,6 +12,26 @@
 
 #include "types.h"
 
+/* system support */
+#include <stdio.h>
+
+/**
+ * Block candidate transaction reference. Holds the source, fee, size and
+ * file position of a transaction considered by b_select().
+*/
+typedef struct {
+   word8 src[ADDR_LEN];    /* transaction source address */
+   word8 fee[8];           /* transaction fee */
+   size_t size;            /* transaction size, in bytes */
+   fpos_t pos;             /* transaction file position */
+} BCTXPOS;
+
+/* global variables */
+extern word32 Bcmaxtx;
+extern word32 Bcmaxbytes;
+extern word32 Bcminfee[2];
+extern word8 Bcspec;
+
 /* C/C++ compatible function prototypes */
 #ifdef __cplusplus
 extern "C" {
@@ -22,7 +42,11 @@ void set_maddr(const void *maddr);
 int pseudo(const char *output);
 int neogen(const BTRAILER *bt, const char *lefile, const char *output);
 int b_adjust_maddr_fp(FILE *fp);
+size_t b_select(BCTXPOS *txp, size_t count,
+   word32 maxtx, word32 maxbytes, const void *minfee);
 int b_con(const char *output);
+int b_spec(const char *bcfname, const char *ltfname, const char *output);
+pid_t b_spec_start(const char *bcfname, const char *ltfname);
 
 #ifdef __cplusplus
 }  /* end extern "C" */
@@ -66,10 +66,16 @@
 #include "error.h"
 #include "bup.h"
 #include "bcon.h"
+#include "local.h"
+#include "rpc.h"
 
 char *Opt_cplistfile = "coreip.lst";
 char *Opt_rplistfile = "recent.lst";
 char *Opt_eplistfile = "epink.lst";
+char *Opt_pdbfile = "peers.dat";
+char *Opt_localsock = NULL;  /* local interface socket path */
+char *Opt_rpcaddr = "127.0.0.1";  /* JSON-RPC interface address */
+word16 Opt_rpcport = 0;           /* JSON-RPC interface port (0 = none) */
 
 #ifdef _WIN32
 #include <windows.h>
@@ -195,6 +201,13 @@ int print_stats(void)
    printf("   txq1 count:      %u\n", Txcount);
    printf("   Balances sent:   %u\n", Nbalance);
    printf("   Sends blocked:   %u\n", Nsenderrs);
+   for (int rlc = 0; rlc < RLCLASSES; rlc++) {
+      printf("   Throttled %-7s %u\n", rlclass2str(rlc), Nthrottled[rlc]);
+   }
+   printf("   Crowded low/high %u/%u\n",
+      Ncrowded[SLOT_LOW], Ncrowded[SLOT_HIGH]);
+   printf("   Evicted low/high %u/%u\n",
+      Nevicted[SLOT_LOW], Nevicted[SLOT_HIGH]);
    printf("   Blocks updated:  %u\n\n", Nupdated);
 
    printf("Current block: 0x%s\n", bnum2hex(Cblocknum, NULL));
@@ -268,6 +281,8 @@ void monitor(void)
          print_ipl(Rplist, RPLISTLEN);
          printf("Pinklisted:\n");
          print_ipl(Epinklist, EPINKLEN);
+         printf("Peer chain tips:\n\n");
+         print_tips();
          continue;
       } else if (*buff == '\0') {   /* ENTER to continue server */
          Monitor = runmode;
@@ -310,7 +325,7 @@ int init(void)
    char dir[FILENAME_MAX], fname[FILENAME_MAX];
    char bcfname[FILENAME_MAX], copyfile[FILENAME_MAX];
    char weighthex[65], bnumhex[17];
-   word32 qlen, quorum[MAXQUORUM];
+   word32 qlen, quorum[MAXQUORUM], j;
    word8 nethash[HASHLEN], peerhash[HASHLEN];
    word8 netweight[32], netbnum[8], bnum[8];
    BTRAILER bt;
@@ -325,7 +340,7 @@ int init(void)
    plog("Init core...");
    /* prepare mochimo filesystem structure */
    if (check_directory(Bcdir) || check_directory(Spdir)) return VERROR;
-   if (ftouch("mq.lck")) return VERROR;
+   if (ftouch("mq.lck") || ftouch("txq1.lck")) return VERROR;
 
    /* (ALWAYS) update core peer list and mining address file */
    path_join(copyfile, "..", Opt_cplistfile);
@@ -367,16 +382,31 @@ int init(void)
    count = read_ipl(Opt_eplistfile, Epinklist, EPINKLEN, &Epinkidx);
    if (count > 0) plog(" - added %" P32u " pinklisted peers", count);
    count = read_ipl(Opt_cplistfile, Rplist, RPLISTLEN, &Rplistidx);
+   /* sample peer database, known good peers first */
+   if (pdb_load(Opt_pdbfile) == VEOK) {
+      qlen = (word32) pdb_sample(quorum, MAXQUORUM);
+      for (j = 0; j < qlen; j++) {
+         if (addrecent(quorum[j])) count++;
+      }
+   }
    count += read_ipl(Opt_rplistfile, Rplist, RPLISTLEN, &Rplistidx);
    if (count > 0) plog(" - added %" P32u " recent peers", count);
+   /* ... and remember listed peers */
+   for (j = 0; j < RPLISTLEN && Rplist[j]; j++) pdb_add(Rplist[j], 0);
 
    /* scan entire network of peers */
    while (Running) {
       /* ensure recent peers list is shuffled */
       shuffle32(Rplist, RPLISTLEN);
-      /* scan network for quorum and highest hash/weight/bnum */
-      plog("Init network...");
-      qlen = scan_quorum(quorum, MAXQUORUM, nethash, netweight, netbnum);
+      /* use recent peer chain tips for quorum, where sufficient... */
+      qlen = tip_quorum(quorum, MAXQUORUM, nethash, netweight, netbnum,
+         TIPMAXAGE);
+      if (qlen >= Quorum) plog("Init network (recent peer tips)...");
+      else {
+         /* ... else scan network for quorum and highest hash/weight/bnum */
+         plog("Init network...");
+         qlen = scan_quorum(quorum, MAXQUORUM, nethash, netweight, netbnum);
+      }
       plog(" - %d/%d 0x%s 0x...%s", qlen, MAXQUORUM,
          bnum2hex(netbnum, bnumhex), weight2hex(netweight, weighthex));
       if (qlen == 0) break; /* all alone... */
@@ -477,6 +507,9 @@ int init(void)
       plog("Resync failure: try again...\n\n");
    }
 
+   /* save peer database of network scan */
+   pdb_save(Opt_pdbfile);
+
    /* check state of v3.0 reboot */
    if (cmp64(Cblocknum, CL64_32(V30TRIGGER)) < 0) {
       /* Legacy neogenesis blocks are reconstructed by converting the
@@ -623,14 +656,19 @@ int server(int reuse_addr)
    static time_t nsd_time;  /* event timers */
    static time_t bctime, mtime, mqtime, sftime, vtime;
    static time_t ipltime;
+   static time_t lstime;   /* ledger state resync time */
    static SOCKET lsd, nsd;
    static NODE *np, node;
    static struct sockaddr_in addr;
    static int status;   /* child return status */
+   static int early;    /* OP_FOUND relayed before block update */
+   static int retry;    /* retries of getting an early relayed block */
+   static int lsdiverged;  /* ledger state differs from most peers */
    static pid_t pid;    /* child pid */
    static int lfd;      /* for lock() */
    static word16 opcode;
    char fname[FILENAME_MAX];
+   BTRAILER sbt;  /* speculative candidate trailer */
 
    /* passive mining stuff */
    BTRAILER bt;
@@ -680,6 +718,16 @@ int server(int reuse_addr)
    listen(lsd, LQLEN);  /* LQSIZ */
    nsd = INVALID_SOCKET;
 
+   /* open local interface, if requested */
+   if (Opt_localsock && local_init(Opt_localsock) != VEOK) {
+      perrno("local interface unavailable at %s", Opt_localsock);
+   }
+   /* open JSON-RPC interface, if requested */
+   if (Opt_rpcport && rpc_init(Opt_rpcaddr, Opt_rpcport) != VEOK) {
+      perrno("JSON-RPC interface unavailable at %s:%u",
+         Opt_rpcaddr, (unsigned) Opt_rpcport);
+   }
+
    if (Safemode && !iszero(Cblocknum, 8)) {
       plog("\nSafemode...\n");
       send_found();
@@ -714,15 +762,31 @@ int server(int reuse_addr)
          status = child_status(np, pid, status);
          if(opcode == OP_FOUND) {
             if(Blockfound == 0) perr("line %d", __LINE__);
-            else {
+            else if(status != VEOK) {
+               /* download failed -- nothing to relay or update */
+               pdebug("OP_FOUND download failure");
+               remove("rblock.dat");
+               Blockfound = 0;
+            } else {
                /* exit services */
                stop_bcon();
                stop_found();
+               /* relay recv'd block early, on valid trailer and PoW */
+               early = (send_found_early("rblock.dat") == VEOK);
                /* update recv'd block */
-               if(b_update("rblock.dat") == VEOK) {
-                  send_found();  /* start send_found() child */
+               status = b_update_spec("rblock.dat");
+               if(status == VEOK) {
+                  /* announce the updated block, even if relayed early,
+                   * as peers without early relay support do not retry */
+                  send_found();
                   addrecent(np->ip);   /* v.28 */
                   Stime = Ltime + 20;  /* hold status display */
+               } else {
+                  if (early) stop_found();  /* cease relay of bad block */
+                  if (status == VEBAD || status == VEBAD2) {
+                     /* relayer of invalid block */
+                     pinklist(np->ip);
+                  }
                }
                /* check txclean.dat contains transactions */
                if (fexistsnz("txclean.dat")) start_bcon();
@@ -740,9 +804,24 @@ int server(int reuse_addr)
       /* Reap a send_found() child.  If she is done, pid != 0. */
       if(Found_pid > 0) {
          pid = waitpid(Found_pid, &status, WNOHANG);
-         if(pid > 0) Found_pid = 0;
+         if(pid > 0) {
+            Found_pid = 0;
+            /* VEBAD: ledger state differs from most peers */
+            if (WIFEXITED(status) && WEXITSTATUS(status) == VEBAD &&
+                  !lsdiverged) {
+               palert("ledger state diverged -- mining stopped, resync...");
+               lsdiverged = 1;
+               lstime = Ltime;
+               stop_bcon();
+               remove("cblock.dat");
+            }
+         }
       }
 
+      /* Serve local and JSON-RPC sessions, without a child per request */
+      local_service();
+      rpc_service();
+
       /* Check for new connection with accept() and set nsd. */
       if(nsd == INVALID_SOCKET) {
          if((nsd = accept(lsd, NULL, NULL)) != INVALID_SOCKET) {
@@ -778,10 +857,23 @@ int server(int reuse_addr)
                         sock_close(np->sd);  /* close initial connection */
                         status =
                            get_file(np->ip, np->tx.cblock, "rblock.dat");
+                        /* an early relayer serves the block once updated */
+                        retry = found_early(&np->tx) ? FOUNDRETRY : 0;
+                        while (status != VEOK && retry-- > 0) {
+                           millisleep(1000);
+                           status =
+                              get_file(np->ip, np->tx.cblock, "rblock.dat");
+                        }
+                        /* never leave a partial download for update */
+                        if (status != VEOK) remove("rblock.dat");
                         break;
                      case OP_GET_BLOCK:
-                        /* send np->tx.blocknum to peer */
-                        status = send_file(np, NULL);
+                        /* send np->tx.blocknum to peer... */
+                        if ((Cxbits & CX_RANGE) &&
+                              get16(np->tx.len) == 8 + HASHLEN) {
+                           /* ... resuming a partial download */
+                           status = send_file_range(np);
+                        } else status = send_file(np, NULL);
                         break;
                      case OP_GET_TFILE:
                         /* send out tfile.dat to peer */
@@ -813,6 +905,14 @@ int server(int reuse_addr)
                         /* send tfile.dat section to peer */
                         status = send_tf(np);
                         break;
+                     case OP_NG_LAYER:
+                        /* send neogenesis Merkle layer to peer */
+                        status = send_nglayer(np);
+                        break;
+                     case OP_GET_NGCHUNK:
+                        /* send neogenesis chunk to peer */
+                        status = send_ngchunk(np);
+                        break;
                      default:
                         Nbadlogs++;  /* bad OP's */
                         pdebug("bad opcode: %d", opcode);
@@ -864,7 +964,7 @@ int server(int reuse_addr)
             stop_bcon();
             stop_found();
             /* We found a pushed block! Update... */
-            if (b_update("mblock.dat") == VEOK) {
+            if (b_update_spec("mblock.dat") == VEOK) {
                send_found();  /* start send_found() child */
                Stime = Ltime + 20;  /* hold status display */
             }
@@ -898,7 +998,7 @@ int server(int reuse_addr)
          if (bctime < (Time0 + BCONFREQ)) bctime = Time0 + BCONFREQ;
          if (Txcount >= TXQUEBIG) bctime = Ltime;
 
-         if (Blockfound == 0 && Ltime >= bctime) {
+         if (Blockfound == 0 && !lsdiverged && Ltime >= bctime) {
             /* check conditions for Transaction Bot processor */
             if (tx_bot_is_active() && cmp64(Lblock, Cblocknum) != 0) {
                if (tx_bot_process() == VEOK) {
@@ -908,18 +1008,37 @@ int server(int reuse_addr)
                }
             }
             /* check conditions for Transaction Queue processor */
-            if (Bcon_pid == 0 && Txcount > 0) {
+            if (Bcon_pid == 0 && Txcount > 0 &&
+                  (lfd = lock("txq1.lck", 10)) != -1) {
                pdebug("spawning bcon with %d more transactions", Txcount);
                /* append txq1.dat to txclean.dat */
                system("cat txq1.dat >>txclean.dat 2>/dev/null");
                remove("txq1.dat");
                Txcount = 0;  /* txq1.dat is empty now */
+               unlock(lfd);
                start_bcon();  /* start child */
                bctime = Ltime + BCONFREQ;
             }
          }
       }
 
+      /* Publish a speculative candidate as soon as she is 'done', while
+       * bcon constructs the (validated) candidate to replace it.
+       */
+      if(Bspec_pid > 0) {
+         pid = waitpid(Bspec_pid, &status, WNOHANG);
+         if(pid > 0) {
+            Bspec_pid = 0;
+            if (Bcon_pid > 0 && !fexists("cblock.dat")
+                  && read_trailer(&sbt, "cblock.spec") == VEOK
+                  && memcmp(sbt.phash, Cblockhash, HASHLEN) == 0) {
+               pdebug("publishing speculative candidate...");
+               rename("cblock.spec", "cblock.dat");
+            }
+            remove("cblock.spec");
+         }
+      }
+
       /* Collect bcon status when she is 'done'.  pid == 0 means she
        * is still busy.
        */
@@ -935,7 +1054,7 @@ int server(int reuse_addr)
                } else peach_init(&bt);
             }
          }
-      } else if (mtime != Ltime && fexistsnz("cblock.dat")) {
+      } else if (mtime != Ltime && !lsdiverged && fexistsnz("cblock.dat")) {
          mtime = Ltime;
          /* perform passive mining once every second */
          if (peach_solve(&bt, bt.difficulty[0], bt.nonce) == VEOK) {
@@ -998,8 +1117,19 @@ int server(int reuse_addr)
        */
       if(Monitor && !Bgflag) monitor();
 
+      /* resync a diverged ledger state, from recent peer tips */
+      if (lsdiverged && Blockfound == 0 && Ltime >= lstime) {
+         if (resync_tips(0) == VEOK) {
+            plog("ledger state resync is good!");
+            lsdiverged = 0;
+            Utime = Ltime;
+         } else lstime = Ltime + 60;  /* try again */
+      }
+
       if(Watchdog && (Ltime - Utime) >= Watchdog) {
-         restart("watchdog");
+         /* stalled -- resync to recent peer tips of a heavier chain */
+         if (Blockfound || resync_tips(1) != VEOK) restart("watchdog");
+         Utime = Ltime;
       }
 
       /* Check for restart signal from Verisimility every 4 seconds */
@@ -1026,6 +1156,8 @@ int server(int reuse_addr)
    /* cleanup */
    plog("Server exiting, please wait...");
    sock_close(lsd);  /* close listening socket */
+   local_close();    /* close local interface */
+   rpc_close();      /* close JSON-RPC interface */
 
    return 0;
 } /* end server() */
@@ -1127,8 +1259,47 @@ int usage(void)
       "\n\nOPTIONS (advanced):"
       "\n -m, --maddr <ADDR>"
       "\n       set mining address to ADDR (Mochimo Wallet Address)"
+      "\n   --assume-valid <HASH>"
+      "\n       skip PoW and signature checks of the block with (hex) HASH"
+      "\n       and its ancestors during resync (0 = none)"
+      "\n   --bcon-max-tx <N>"
+      "\n       limit candidate blocks to N transactions (0 = max, 32768)"
+      "\n   --bcon-max-bytes <N>"
+      "\n       limit candidate blocks to N bytes of transactions (0 = none)"
+      "\n   --bcon-min-fee <N>"
+      "\n       exclude transactions with a fee below N from candidate blocks"
+      "\n   --full-verify"
+      "\n       verify PoW and signatures of all blocks (ignore assume-valid)"
+      "\n   --local-socket <PATH>"
+      "\n       serve local clients on a UNIX domain socket at PATH"
+      "\n       (access is restricted to the owner and group of PATH)"
+      "\n   --no-batch"
+      "\n       disable batched balance queries (OP_BALANCE_BATCH)"
+      "\n   --no-compress"
+      "\n       disable compressed file transfers (CX_COMPRESS)"
+      "\n   --no-mmr"
+      "\n       disable serving MMR proofs of trailers (OP_GET_MMRPROOF)"
+      "\n   --no-oneshot"
+      "\n       disable answering single-shot requests (CX_ONESHOT)"
+      "\n   --no-range"
+      "\n       disable resumable (ranged) block downloads (CX_RANGE)"
+      "\n   --no-ngchunk"
+      "\n       disable serving chunked neogenesis blocks (OP_GET_NGCHUNK)"
+      "\n   --no-rate-limit"
+      "\n       disable per-peer rate limiting of requests"
+      "\n   --no-spec"
+      "\n       disable speculative candidate blocks during block updates"
+      "\n   --rate-limit <CLASS>,<QUOTA>,<BURST>[,<CONCURRENCY>]"
+      "\n       set requests per minute, burst size and concurrent children"
+      "\n       for a CLASS of requests (tx, balance, ipl, hash, tf, block,"
+      "\n       mmr);"
+      "\n       a zero QUOTA or CONCURRENCY removes the limit"
       "\n   --reuse-addr"
       "\n       enable listening server socket option SO_REUSEADDR"
+      "\n   --rpc-addr <ADDR>"
+      "\n       listen for JSON-RPC requests on ADDR (default 127.0.0.1)"
+      "\n   --rpc-port <PORT>"
+      "\n       serve JSON-RPC requests over HTTP/1.1 on PORT (0 = none)"
       "\n   --txbot"
       "\n       enable local transaction bot (REQUIRES FUNDING)"
 #ifdef BX_MYSQL
@@ -1146,12 +1317,13 @@ int usage(void)
 int main(int argc, char **argv)
 {
    char *argp;          /* argument pointer (for argv) */
-/* unsigned long argu;     argument unsigned value */
+   unsigned long argu;  /* argument unsigned value */
 
    unsigned seeds[8];   /* random seed values */
+   word64 fee;          /* argument fee value */
    int reuse_addr;
    char *cp;
-   int j;
+   int i, j;
 
    {
       /* ensure little endian check -- executed in isolation */
@@ -1183,6 +1355,13 @@ int main(int argc, char **argv)
    /* local init */
    reuse_addr = 0;
    Cbits |= C_OPTIN;  /* default to opt-in for Node */
+   Cbits |= C_BATCH;  /* default to batched balance queries */
+   Cbits |= C_NGCHUNK;  /* default to serving neogenesis chunks */
+   Cbits |= C_LSTATE;  /* default to exchanging ledger state commitments */
+   Cxbits |= CX_COMPRESS;  /* default to compressed file transfers */
+   Cxbits |= CX_MMR;       /* default to serving MMR proofs */
+   Cxbits |= CX_ONESHOT;   /* default to answering single-shot requests */
+   Cxbits |= CX_RANGE;     /* default to resumable block downloads */
 
    /* Parse command line arguments. */
    pdebug("... skipping 0th argument (program name): %s", argv[0]);
@@ -1218,11 +1397,161 @@ int main(int argc, char **argv)
                maddr_chk[16], maddr_chk[17], maddr_chk[18], maddr_chk[19]);
             continue; /* next arg */
          }
+         if (argument(argv[j], NULL, "--assume-valid")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            memset(Assumevalid, 0, HASHLEN);
+            if (strcmp(argp, "0") == 0) continue;
+            /* check length and hex digits, before parsing pairs */
+            for (i = 0; isxdigit((unsigned char) argp[i]); i++);
+            if (strlen(argp) != HASHLEN * 2 || argp[i] != '\0') {
+               perr("invalid assume-valid block hash, %s", argp);
+               return EXIT_FAILURE;
+            }
+            for (i = 0; i < HASHLEN; i++) {
+               sscanf(&argp[i * 2], "%2hhx", &Assumevalid[i]);
+            }
+            continue;
+         }
+         if (argument(argv[j], NULL, "--bcon-max-tx")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            errno = 0;
+            argu = strtoul(argp, &cp, 10);
+            if (*argp < '0' || *argp > '9' || *cp || errno == ERANGE ||
+                  argu > MAXBLTX) {
+               perr("invalid candidate transaction limit, %s", argp);
+               return EXIT_FAILURE;
+            }
+            Bcmaxtx = argu ? (word32) argu : MAXBLTX;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--bcon-max-bytes")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            errno = 0;
+            argu = strtoul(argp, &cp, 10);
+            if (*argp < '0' || *argp > '9' || *cp || errno == ERANGE ||
+                  argu > WORD32_MAX) {
+               perr("invalid candidate byte limit, %s", argp);
+               return EXIT_FAILURE;
+            }
+            Bcmaxbytes = (word32) argu;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--bcon-min-fee")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            errno = 0;
+            fee = (word64) strtoull(argp, &cp, 10);
+            if (*argp < '0' || *argp > '9' || *cp || errno == ERANGE) {
+               perr("invalid minimum fee, %s", argp);
+               return EXIT_FAILURE;
+            }
+            put64(Bcminfee, &fee);
+            if (cmp64(Bcminfee, Mfee) < 0) put64(Bcminfee, Mfee);
+            continue;
+         }
+         if (argument(argv[j], NULL, "--full-verify")) {
+            /* disable assume-valid checkpoint and continue */
+            Fullverify = 1;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--local-socket")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            Opt_localsock = argp;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-batch")) {
+            /* disable batched balance queries and continue */
+            Cbits &= ~C_BATCH;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-compress")) {
+            /* disable compressed file transfers and continue */
+            Cxbits &= ~CX_COMPRESS;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-mmr")) {
+            /* disable serving MMR proofs and continue */
+            Cxbits &= ~CX_MMR;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-oneshot")) {
+            /* disable answering single-shot requests and continue */
+            Cxbits &= ~CX_ONESHOT;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-spec")) {
+            /* disable speculative candidate blocks and continue */
+            Bcspec = 0;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-range")) {
+            /* disable resumable block downloads and continue */
+            Cxbits &= ~CX_RANGE;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-ngchunk")) {
+            /* disable serving neogenesis chunks and continue */
+            Cbits &= ~C_NGCHUNK;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--no-rate-limit")) {
+            /* disable rate limiting and continue */
+            Norlimit = 1;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--rate-limit")) {
+            unsigned quota, burst, concur;
+            char name[16];
+            int count, rlc;
+            /* obtain rate limit class and parameters */
+            argp = argvalue(&j, argc, argv);
+            count = argp ? sscanf(argp, "%15[^,],%u,%u,%u",
+               name, &quota, &burst, &concur) : 0;
+            if (count < 3 || burst == 0) {
+               perr("invalid rate limit, %s", argp ? argp : "(null)");
+               return EXIT_FAILURE;
+            }
+            for (rlc = 0; rlc < RLCLASSES; rlc++) {
+               if (strcmp(name, rlclass2str(rlc)) == 0) break;
+            }
+            if (rlc >= RLCLASSES) {
+               perr("unknown rate limit class, %s", name);
+               return EXIT_FAILURE;
+            }
+            /* set rate limit parameters -- concurrency is optional */
+            Rlquota[rlc] = quota;
+            Rlburst[rlc] = burst;
+            if (count > 3) Rlconcur[rlc] = concur;
+            continue;
+         }
          if (argument(argv[j], NULL, "--reuse-addr")) {
             /* set reuse_addr option and continue */
             reuse_addr = 1;
             continue;
          }
+         if (argument(argv[j], NULL, "--rpc-addr")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            Opt_rpcaddr = argp;
+            continue;
+         }
+         if (argument(argv[j], NULL, "--rpc-port")) {
+            argp = argvalue(&j, argc, argv);
+            if (argp == NULL) exit(usage());
+            errno = 0;
+            argu = strtoul(argp, &cp, 10);
+            if (*argp < '0' || *argp > '9' || *cp || errno == ERANGE ||
+                  argu > WORD16_MAX) {
+               perr("invalid JSON-RPC port, %s", argp);
+               return EXIT_FAILURE;
+            }
+            Opt_rpcport = (word16) argu;
+            continue;
+         }
          if (argument(argv[j], NULL, "--txbot")) {
             /* set tx-bot option and continue */
             if (tx_bot_activate(seeds, sizeof(seeds)) != VEOK) {
@@ -1350,6 +1679,7 @@ EOA:  /* end of arguments */
          /* save dynamic peer lists */
          save_ipl(Opt_rplistfile, Rplist, RPLISTLEN);
          save_ipl(Opt_eplistfile, Epinklist, EPINKLEN);
+         pdb_save(Opt_pdbfile);
       }
    }
 
@@ -53,7 +53,11 @@ unsigned sleep(unsigned seconds);
 #define OP_TX             3
 #define OP_GET_IPL         6
 #define OP_BALANCE        12
+#define OP_SEND_BAL       13
 #define OP_RESOLVE        14
+#define OP_BALANCE_BATCH  20
+
+#define C_BATCH  32   /* server answers OP_BALANCE_BATCH */
 
 #define W_TAG    1
 #define W_SEC    2
@@ -83,10 +87,17 @@ unsigned sleep(unsigned seconds);
 
 #define ADDR_TAG_PTR(addr) (((word8 *) addr) + 2196)
 #define TXTAGLEN 12
+
+/* hash-based ledger addresses for OP_BALANCE_BATCH */
+#define LADDRLEN   40             /* ledger address length */
+#define LENTRYLEN  (LADDRLEN + 8) /* ledger address and balance */
+#define BATCHLEN   (TRANLEN / LENTRYLEN)
 #define ADDR_HAS_TAG(addr) \
    (((word8 *) (addr))[2196] != 0x42 && ((word8 *) (addr))[2196] != 0x00)
 
 #include "crypto/hash/cpu/sha256.h"      /* also defines word32 */
+#include "crypto/hash/cpu/sha3.h"
+#include "crypto/hash/cpu/ripemd160.h"
 #include "crypto/wots/wots.h"   /* TXWOTSLEN */
 
 
@@ -121,6 +132,20 @@ typedef struct {
 } WINDEX;
 
 
+/* In-core wallet storage data, parallel to Windex[].
+ * Never written to disk.
+ */
+typedef struct {
+   word8 xkey[64];   /* derived XO4 key of entry (see shy_derive()) */
+   word8 addr[8];    /* address prefix for hash lookup */
+   word8 dirty;      /* WS_* bits of data needing write-back */
+   WENTRY *pending;  /* encrypted entry awaiting write-back, or NULL */
+} WSTORE;
+
+#define WS_BAL    1   /* Windex[] balance needs write-back */
+#define WS_ENTRY  2   /* pending entry needs write-back */
+
+
 /* Multi-byte numbers are little-endian.
  * Structure is checked on start-up for byte-alignment.
  * HASHLEN is checked to be 32.
@@ -192,6 +217,14 @@ XO4CTX Xo4ctx;
 WHEADER Whdr;        /* wallet header */
 WINDEX *Windex;      /* wallet index */
 word32 Nindex;       /* number of addresses in wallet */
+FILE *Wfp;           /* wallet file, held open while in use */
+WSTORE *Wstore;      /* in-core storage data parallel to Windex[] */
+word32 *Wtagtab;     /* tag hash table of 1-based Windex[] indexes */
+word32 *Waddrtab;    /* address hash table of 1-based Windex[] indexes */
+word32 Wtablen;      /* hash table length (power of 2) */
+word32 Wtabused;     /* used hash table slots, including stale slots */
+word32 Wcap;         /* allocated entries in Windex[] and Wstore[] */
+word8 Wloaded;       /* non-zero when Windex[] is loaded from disk */
 word8 Needcleanup;    /* for Winsock */
 word32 Mfee[2] = { MFEE, 0 };
 word8 Zeros[8];
@@ -203,6 +236,8 @@ word8 Verbose;       /* output trace messages */
 word8 Default_tag[TXTAGLEN]
    = { 0x42, 0, 0, 0, 0x0e, 0, 0, 0, 1, 0, 0, 0 };
 word8 Cblocknum[8];  /* set from network */
+word8 Peercbits;     /* capability bits of last server called */
+word8 Batchoff;      /* set to disable OP_BALANCE_BATCH */
 
 #define CORELISTLEN 9
 
@@ -606,6 +641,7 @@ bad:
       goto bad;
    }
    put64(Cblocknum, np->tx.cblock);
+   Peercbits = np->tx.version[1];
    return VEOK;
 }  /* end callserver() */
 
@@ -693,18 +729,32 @@ int send_tx(TX *tx, word32 ip, char *addrstr)
 }  /* end send_tx() */
 
 
-/* Very special for Shylock: */
-void shy_setkey(XO4CTX *ctx, word8 *salt, word8 *password, unsigned len)
+/* Very special for Shylock:
+ * Derive the 64-byte XO4 key for salt and password into key[64].
+ * Costs two sha256() -- cache the result where it is used often.
+ */
+void shy_derive(word8 *key, word8 *salt, word8 *password, unsigned len)
 {
-   word8 key[256];
+   word8 buff[256];
 
-   memset(key, 0, 256);
+   memset(buff, 0, 256);
    if(len > 188) len = 188;   /* 256-64-4 */
-   memcpy(&key[64], salt, 4);
-   memcpy(&key[68], password, len);
-   sha256(&key[64], (256-64), key);
-   sha256(key, 256, &key[32]);
+   memcpy(&buff[64], salt, 4);
+   memcpy(&buff[68], password, len);
+   sha256(&buff[64], (256-64), buff);
+   sha256(buff, 256, &buff[32]);
+   memcpy(key, buff, 64);
+   memset(buff, 0, 256);  /* security */
+}
+
+
+void shy_setkey(XO4CTX *ctx, word8 *salt, word8 *password, unsigned len)
+{
+   word8 key[64];
+
+   shy_derive(key, salt, password, len);
    xo4_init(ctx, key, 64);
+   memset(key, 0, 64);  /* security */
 }
 
 
@@ -946,23 +996,268 @@ get_name:
 /* Delete in-core wallet index and free memory. */
 void delete_windex(void)
 {
+   word32 j;
+
+   for(j = 0; Wstore && j < Nindex; j++) {
+      if(Wstore[j].pending) {
+         memset(Wstore[j].pending, 0, sizeof(WENTRY));  /* security */
+         free(Wstore[j].pending);
+      }
+   }
    if(Windex) {
       if(Nindex)
          memset(Windex, 0, Nindex * sizeof(WINDEX));  /* security */
       free(Windex);
       Windex = NULL;
    }
+   if(Wstore) {
+      if(Nindex)
+         memset(Wstore, 0, Nindex * sizeof(WSTORE));  /* security */
+      free(Wstore);
+      Wstore = NULL;
+   }
+   if(Wtagtab) free(Wtagtab);
+   if(Waddrtab) free(Waddrtab);
+   Wtagtab = Waddrtab = NULL;
+   Wtablen = Wtabused = Wcap = 0;
+   Wloaded = 0;
    Nindex = 0;
 }
 
 
+/* Return the wallet file handle, opening Wfname on first use.
+ * The handle stays open until close_wallet().
+ * Calls fatal() if wallet cannot be opened.
+ */
+FILE *wfile(void)
+{
+   if(Wfp == NULL) Wfp = fopen2(Wfname, "r+b", 1);
+   return Wfp;
+}
+
+
+/* FNV-1a hash of len bytes at p. */
+word32 whash(word8 *p, int len)
+{
+   word32 h;
+
+   for(h = 2166136261UL; len; len--) {
+      h ^= *p++;
+      h *= 16777619UL;
+   }
+   return h;
+}
+
+
+/* Insert 1-based index idx1 into hash table tab[Wtablen] with hash h.
+ * Return 1 if a free slot was used, or 0 if idx1 was already there.
+ */
+int wtab_insert(word32 *tab, word32 h, word32 idx1)
+{
+   for(h &= (Wtablen - 1); tab[h]; h = (h + 1) & (Wtablen - 1))
+      if(tab[h] == idx1) return 0;
+   tab[h] = idx1;
+   return 1;
+}
+
+
+/* Insert Windex[idx] and Wstore[idx] in both hash tables,
+ * counting the used slots in Wtabused.
+ */
+void wtab_put(word32 idx)
+{
+   int used;
+
+   used = wtab_insert(Wtagtab, whash(Windex[idx].tag, TXTAGLEN), idx + 1);
+   used |= wtab_insert(Waddrtab, whash(Wstore[idx].addr, 8), idx + 1);
+   Wtabused += used;
+}
+
+
+/* Add Windex[idx] and Wstore[idx] to the hash tables,
+ * growing (and rebuilding) the tables to keep them half empty.
+ * Stale slots of a re-written entry are harmless to lookups,
+ * which verify each hit against Windex[] and Wstore[], but
+ * are counted as used, so a rebuild drops them before the
+ * tables can fill (and probing could never end).
+ */
+void wtab_add(word32 idx)
+{
+   word32 j, len;
+
+   if(Wtablen == 0 || (Wtabused + 1) * 2 > Wtablen) {
+      for(len = 1024; len < Nindex * 4; len <<= 1);
+      if(Wtagtab) free(Wtagtab);
+      if(Waddrtab) free(Waddrtab);
+      Wtagtab = calloc(len, sizeof(word32));
+      Waddrtab = calloc(len, sizeof(word32));
+      if(!Wtagtab || !Waddrtab) fatal("No memory for wallet index!");
+      Wtablen = len;
+      Wtabused = 0;
+      /* rebuild tables */
+      for(j = 0; j < Nindex; j++) wtab_put(j);
+   }
+   wtab_put(idx);
+}
+
+
+/* Find the first wallet entry with tag.
+ * Return its 1-based index, or 0 if not found.
+ */
+unsigned lookup_tag(word8 *tag)
+{
+   word32 h, idx1, found;
+
+   if(Wtablen == 0) return 0;
+   found = 0;
+   h = whash(tag, TXTAGLEN) & (Wtablen - 1);
+   for( ; (idx1 = Wtagtab[h]) != 0; h = (h + 1) & (Wtablen - 1)) {
+      if(memcmp(tag, Windex[idx1 - 1].tag, TXTAGLEN) == 0)
+         if(found == 0 || idx1 < found) found = idx1;
+   }
+   return found;
+}
+
+
+int read_wentry(WENTRY *entry, unsigned idx);
+
+/* Find the first wallet entry with an address matching addr
+ * (tag excluded).  Copy the entry to outentry (may be NULL).
+ * Return its 1-based index, or 0 if not found.
+ */
+unsigned lookup_addr(word8 *addr, WENTRY *outentry)
+{
+   word32 h, idx1, found;
+   WENTRY entry;
+
+   if(Wtablen == 0) return 0;
+   found = 0;
+   h = whash(addr, 8) & (Wtablen - 1);
+   for( ; (idx1 = Waddrtab[h]) != 0; h = (h + 1) & (Wtablen - 1)) {
+      if(memcmp(addr, Wstore[idx1 - 1].addr, 8) != 0) continue;
+      if(found && idx1 > found) continue;
+      if(read_wentry(&entry, idx1 - 1) != VEOK) fatal("bad disk read");
+      if(memcmp(addr, entry.addr, TXWOTSLEN - TXTAGLEN) == 0) {
+         found = idx1;
+         if(outentry) memcpy(outentry, &entry, sizeof(WENTRY));
+      }
+   }
+   memset(&entry, 0, sizeof(WENTRY));  /* security */
+   return found;
+}
+
+
+/* Set in-core index and storage data of idx from de-crypted entry.
+ * Index is grown as needed for idx == Nindex (append).
+ * xkey[64] is the derived key of entry, or NULL to keep the current.
+ */
+void set_widx(unsigned idx, WENTRY *entry, word8 *xkey)
+{
+   WINDEX *ip;
+   WSTORE *sp;
+   void *ptr;
+
+   if(idx >= Wcap) {
+      Wcap = Wcap ? Wcap * 2 : 1024;
+      while(Wcap <= idx) Wcap *= 2;
+      ptr = realloc(Windex, Wcap * sizeof(WINDEX));
+      if(!ptr) fatal("No memory to read wallet index!");
+      Windex = ptr;
+      ptr = realloc(Wstore, Wcap * sizeof(WSTORE));
+      if(!ptr) fatal("No memory to read wallet index!");
+      Wstore = ptr;
+      memset(&Wstore[Nindex], 0, (Wcap - Nindex) * sizeof(WSTORE));
+   }
+   if(idx >= Nindex) Nindex = idx + 1;
+   ip = &Windex[idx];
+   sp = &Wstore[idx];
+   memcpy(ip->key, entry->key, sizeof(ip->key));
+   ip->flags[0] = entry->flags[0];
+   memcpy(ip->balance, entry->balance, sizeof(ip->balance));
+   memcpy(ip->name, entry->name, sizeof(ip->name));
+   memcpy(ip->tag, ADDR_TAG_PTR(entry->addr), TXTAGLEN);
+   ip->flags[0] &= ~(W_TAG);
+   if(ADDR_HAS_TAG(entry->addr)) ip->flags[0] |= W_TAG;
+   if(cmp64(ip->balance, Zeros)) {
+      ip->flags[0] |= W_BAL;
+      ip->flags[0] &= ~(W_DEL);
+   }
+   else ip->flags[0] &= ~(W_BAL);
+   if(!iszero(entry->secret, 32)) ip->flags[0] |= W_SEC;
+   else ip->flags[0] &= ~(W_SEC);
+   if(xkey) memcpy(sp->xkey, xkey, 64);
+   memcpy(sp->addr, entry->addr, 8);
+   sp->dirty &= ~(WS_BAL);
+   wtab_add(idx);
+}  /* end set_widx() */
+
+
+/* Write back all dirty entries of Windex[] to disk in one pass.
+ * Pending entries are written whole, then only the encrypted
+ * balance field of entries with a changed balance is re-written.
+ * Returns VEOK on success, else VERROR.
+ */
+int flush_widx(void)
+{
+   word8 buff[1 + 8];  /* flags and balance */
+   WSTORE *sp;
+   word32 j;
+   FILE *fp;
+   int ecode;
+
+   ecode = VEOK;
+   for(j = 0; j < Nindex; j++) {
+      sp = &Wstore[j];
+      if(!sp->dirty) continue;
+      fp = wfile();
+      if(sp->dirty & WS_ENTRY) {
+         if(fseek(fp, sizeof(WHEADER) + (j * sizeof(WENTRY)), SEEK_SET) != 0
+            || fwrite(sp->pending, 1, sizeof(WENTRY), fp) != sizeof(WENTRY)) {
+               ecode = VERROR;
+               continue;
+         }
+         memset(sp->pending, 0, sizeof(WENTRY));  /* security */
+         free(sp->pending);
+         sp->pending = NULL;
+         sp->dirty &= ~(WS_ENTRY);
+      }
+      if(!(sp->dirty & WS_BAL)) continue;
+      /* XO4 is a keystream -- encrypt from start of entry->flags */
+      buff[0] = 0;
+      memcpy(&buff[1], Windex[j].balance, 8);
+      xo4_init(&Xo4ctx, Wstore[j].xkey, 64);
+      xo4_crypt(&Xo4ctx, buff, buff, sizeof(buff));
+      if(fseek(fp, sizeof(WHEADER) + (j * sizeof(WENTRY))
+               + sizeof(((WENTRY *) 0)->key) + 1, SEEK_SET) != 0
+         || fwrite(&buff[1], 1, 8, fp) != 8) {
+            ecode = VERROR;
+            continue;
+      }
+      sp->dirty = 0;
+   }
+   if(Wfp) fflush(Wfp);
+   memset(buff, 0, sizeof(buff));  /* security */
+   if(ecode != VEOK) printf("\nI/O error\n");
+   return ecode;
+}  /* end flush_widx() */
+
+
+/* Write back dirty entries and close the wallet file. */
+void close_wallet(void)
+{
+   if(Wloaded) flush_widx();
+   if(Wfp) fclose(Wfp);
+   Wfp = NULL;
+}
+
+
 int read_wheader(WHEADER *whdr)
 {
    FILE *fp;
-   fp = fopen2(Wfname, "rb", 1);
-   if(fread(whdr, 1, sizeof(WHEADER), fp) != sizeof(WHEADER))
+   fp = wfile();
+   if(fseek(fp, 0, SEEK_SET) != 0
+      || fread(whdr, 1, sizeof(WHEADER), fp) != sizeof(WHEADER))
       fatal("Cannot read %s", Wfname);
-   fclose(fp);
    return 0;
 }  /* end read_wheader() */
 
@@ -987,69 +1282,98 @@ int read_wentry(WENTRY *entry, unsigned idx)
    FILE *fp;
 
    if(idx >= Nindex) return VERROR;
-   fp = fopen2(Wfname, "rb", 1);
+   /* entry not yet written back */
+   if(Wloaded && Wstore[idx].pending) {
+      memcpy(entry, Wstore[idx].pending, sizeof(WENTRY));
+      goto decrypt;
+   }
+   fp = wfile();
    if(fseek(fp, sizeof(WHEADER) + (idx * sizeof(WENTRY)), SEEK_SET) != 0) {
 bad:
       printf("\nI/O error\n");
-      fclose(fp);
       return VERROR;
    }
    if(fread(entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY)) goto bad;
-   shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
+decrypt:
+   /* use cached key of loaded index */
+   if(Wloaded) xo4_init(&Xo4ctx, Wstore[idx].xkey, 64);
+   else shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
    /* entry->flags is first field after entry.key salt */
    xo4_crypt(&Xo4ctx, entry->flags, entry->flags,
              sizeof(WENTRY) - sizeof(entry->key));
    unfuzzname(entry->name, sizeof(entry->name));
-   fclose(fp);
+   /* balance not yet written back */
+   if(Wloaded && (Wstore[idx].dirty & WS_BAL))
+      memcpy(entry->balance, Windex[idx].balance, 8);
    return VEOK;
 }  /* end read_wentry() */
 
 
 /* Encrypt and write wallet entry to disk.
+ * With a loaded index, the encrypted entry is kept pending for
+ * write-back by flush_widx(), with other dirty entries.
  * Returns VEOK on success with entry left encrypted,
  * else error code and entry indeterminate.
  * idx is zero based here.
  */
 int write_wentry(WENTRY *entry, unsigned idx)
 {
+   WSTORE *sp;
    FILE *fp;
 
    if(idx >= Nindex) return VERROR;
-   fp = fopen2(Wfname, "r+b", 1);
-   if(fseek(fp, sizeof(WHEADER) + (idx * sizeof(WENTRY)), SEEK_SET) != 0) {
-bad:
-      printf("\nI/O error\n");
-      fclose(fp);
-      return VERROR;
-   }
+   /* keep loaded index in step with entry */
+   if(Wloaded) {
+      set_widx(idx, entry, NULL);
+      sp = &Wstore[idx];
+      if(sp->pending == NULL) {
+         sp->pending = malloc(sizeof(WENTRY));
+         if(sp->pending == NULL) fatal("No memory for wallet entry!");
+      }
+      xo4_init(&Xo4ctx, sp->xkey, 64);
+   } else shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
    fuzzname(entry->name, sizeof(entry->name));
-   shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
    /* entry->flags is first field after entry.key salt */
    xo4_crypt(&Xo4ctx, entry->flags, entry->flags,
              sizeof(WENTRY) - sizeof(entry->key));
-   if(fwrite(entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY)) goto bad;
-   fclose(fp);
+   if(Wloaded) {
+      memcpy(sp->pending, entry, sizeof(WENTRY));
+      sp->dirty |= WS_ENTRY;
+      return VEOK;
+   }
+   fp = wfile();
+   if(fseek(fp, sizeof(WHEADER) + (idx * sizeof(WENTRY)), SEEK_SET) != 0
+      || fwrite(entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY)) {
+         printf("\nI/O error\n");
+         return VERROR;
+   }
+   fflush(fp);
    return VEOK;
 }  /* end write_wentry() */
 
 
 /* Open and read wallet entries to build malloc'd index Windex[].
  * Addresses and secrets are left encrypted on disk.
- * Only tag is read into core.
+ * Only tag, address prefix and derived key are kept in core.
+ * The index is read once and kept in step with disk thereafter,
+ * so repeat calls return immediately.
  */
 word32 read_widx(void)
 {
    FILE *fp;
    long fsize;
-   word32 j;
-   WINDEX *ip;
+   word32 j, count;
    WENTRY entry;
+   word8 xkey[64];
+
+   /* index is kept in step with disk once loaded */
+   if(Wloaded) return Nindex;
 
    /* If index already exists, delete it. */
    delete_windex();
    Nindex = 0;
 
-   fp = fopen2(Wfname, "rb", 1);  /* open file or fatal() */
+   fp = wfile();  /* open file or fatal() */
    fseek(fp, 0, SEEK_END);
    fsize = ftell(fp);   
    fseek(fp, sizeof(WHEADER), SEEK_SET);
@@ -1057,43 +1381,38 @@ word32 read_widx(void)
    if(((fsize - sizeof(WHEADER)) % sizeof(WENTRY)) != 0)
       fatal("Invalid wallet file size on %s", Wfname);
    /* compute number of address entries in wallet */
-   Nindex = (fsize - sizeof(WHEADER)) / sizeof(WENTRY);
-   if(Nindex == 0) return Nindex;  /* new file has no entries */
-
-   /* allocate array of WINDEX struct's */
-   Windex = malloc(Nindex * sizeof(WINDEX));
-   if(!Windex) fatal("No memory to read wallet index!");
+   count = (fsize - sizeof(WHEADER)) / sizeof(WENTRY);
 
-   for(j = 0, ip = Windex; j < Nindex; j++, ip++) {
+   for(j = 0; j < count; j++) {
       if(fread(&entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY)) break;
-      shy_setkey(&Xo4ctx, entry.key, (word8 *) Password, PASSWLEN);
+      shy_derive(xkey, entry.key, (word8 *) Password, PASSWLEN);
+      xo4_init(&Xo4ctx, xkey, 64);
       /* entry.flags is first field after entry.key salt */
       xo4_crypt(&Xo4ctx, entry.flags, entry.flags,
                 sizeof(WENTRY) - sizeof(entry.key));
       unfuzzname(entry.name, sizeof(entry.name));
-      memcpy(ip->key, entry.key, sizeof(ip->key));
-      ip->flags[0] = entry.flags[0];
-      memcpy(ip->balance, entry.balance, sizeof(ip->balance));
-      memcpy(ip->name, entry.name, sizeof(ip->name));
-      memcpy(ip->tag, ADDR_TAG_PTR(entry.addr), TXTAGLEN);
-      ip->flags[0] &= ~(W_TAG);
-      if(ADDR_HAS_TAG(entry.addr)) ip->flags[0] |= W_TAG;
-      if(cmp64(ip->balance, Zeros)) {
-         ip->flags[0] |= W_BAL;
-         ip->flags[0] &= ~(W_DEL);
-      }
-      else ip->flags[0] &= ~(W_BAL);
-      if(!iszero(entry.secret, 32)) ip->flags[0] |= W_SEC;
-      else ip->flags[0] &= ~(W_SEC);
+      set_widx(j, &entry, xkey);
    }  /* end for j */
-   if(j != Nindex || ferror(fp))
+   if(j != count || ferror(fp))
       fatal("I/O error reading wallet index");
-   fclose(fp);
    memset(&entry, 0, sizeof(WENTRY));  /* security */
+   memset(xkey, 0, sizeof(xkey));
+   Wloaded = 1;
    return Nindex;
 }  /* end read_widx() */
 
 
+/* Write back dirty entries, then discard the loaded index and
+ * read it again from disk.  Returns the number of entries.
+ */
+word32 reload_widx(void)
+{
+   flush_widx();
+   delete_windex();  /* clears Wloaded */
+   return read_widx();
+}  /* end reload_widx() */
+
+
 /* Find a duplicate of addr or its tag in wallet,
  * copy the entry to outentry, and return its 1-based index.
  * If not found, return 0 with addr and outentry unchanged.
@@ -1101,23 +1420,24 @@ word32 read_widx(void)
  */
 unsigned find_dup(word8 *addr, WENTRY *outentry)
 {
-   WINDEX *ip;
-   unsigned idx;
-   word8 *tag;
+   unsigned tidx, aidx;
    WENTRY entry;
 
    read_widx();
-   tag = NULL;
-   if(ADDR_HAS_TAG(addr)) tag = ADDR_TAG_PTR(addr);
-   for(idx = 0, ip = Windex; idx < Nindex; idx++, ip++) {
-      if(read_wentry(&entry, idx) != VEOK) fatal("bad disk read");
-      if((tag && memcmp(tag, ADDR_TAG_PTR(entry.addr), TXTAGLEN) == 0)
-         || memcmp(addr, entry.addr, TXWOTSLEN - TXTAGLEN) == 0) {
-            memcpy(outentry, &entry, sizeof(WENTRY));
-            return idx + 1;
-      }
+   /* hash lookup by tag and by address -- lowest index wins */
+   tidx = 0;
+   if(ADDR_HAS_TAG(addr)) tidx = lookup_tag(ADDR_TAG_PTR(addr));
+   aidx = lookup_addr(addr, &entry);
+   if(aidx && (tidx == 0 || aidx < tidx)) {
+      memcpy(outentry, &entry, sizeof(WENTRY));
+      memset(&entry, 0, sizeof(WENTRY));  /* security */
+      return aidx;
    }
    memset(&entry, 0, sizeof(WENTRY));  /* security */
+   if(tidx) {
+      if(read_wentry(outentry, tidx - 1) != VEOK) fatal("bad disk read");
+      return tidx;
+   }
    return 0;  /* not found */
 }  /* end find_dup() */
 
@@ -1129,19 +1449,13 @@ unsigned find_dup(word8 *addr, WENTRY *outentry)
  */
 unsigned find_tag(word8 *addr, WENTRY *entry)
 {
-   WINDEX *ip;
    unsigned idx;
-   word8 *tag;
 
    read_widx();
-   tag = ADDR_TAG_PTR(addr);
-   for(idx = 0, ip = Windex; idx < Nindex; idx++, ip++) {
-      if(memcmp(tag, ip->tag, TXTAGLEN) == 0) {
-         if(read_wentry(entry, idx) != VEOK) return 0;  /* error */
-         return idx + 1;
-      }
-   }
-   return 0;  /* not found */
+   idx = lookup_tag(ADDR_TAG_PTR(addr));
+   if(idx == 0) return 0;  /* not found */
+   if(read_wentry(entry, idx - 1) != VEOK) return 0;  /* error */
+   return idx;
 }  /* end find_tag() */
 
 
@@ -1209,8 +1523,10 @@ int update_wheader(WHEADER *whdr)
    static word8 salt[4];
    WHEADER whout;
 
-   /* open wallet header */
-   fp = fopen2(Wfname, "r+b", 1);
+   /* seek wallet header */
+   fp = wfile();
+   if(fseek(fp, 0, SEEK_SET) != 0)
+      fatal("Cannot update wallet header");
    /* encrypt it for write to disk */
    memcpy(&whout, whdr, sizeof(WHEADER));
    fuzzname(whout.name, 25);
@@ -1218,7 +1534,7 @@ int update_wheader(WHEADER *whdr)
    xo4_crypt(&Xo4ctx, &whout, &whout, sizeof(WHEADER));
    if(fwrite(&whout, 1, sizeof(WHEADER), fp) != sizeof(WHEADER))
       fatal("Cannot update wallet header");
-   fclose(fp);
+   fflush(fp);
    return 0;
 }  /* end update_wheader() */
 
@@ -1256,6 +1572,28 @@ int get_tag(word8 *addr, word8 found[1])
 }  /* end get_tag() */
 
 
+/* Encrypt and write new entry at end of wallet file as index idx.
+ * The loaded index, if any, is extended with entry.
+ * On return, entry is left encrypted.  Calls fatal() on I/O error.
+ */
+void append_wentry(WENTRY *entry, unsigned idx)
+{
+   word8 xkey[64];
+
+   shy_derive(xkey, entry->key, (word8 *) Password, PASSWLEN);
+   if(Wloaded) set_widx(idx, entry, xkey);
+   fuzzname(entry->name, sizeof(entry->name));
+   xo4_init(&Xo4ctx, xkey, 64);
+   /* entry->flags is first field after entry->key salt */
+   xo4_crypt(&Xo4ctx, entry->flags, entry->flags,
+             sizeof(WENTRY) - sizeof(entry->key));
+   if(fwrite(entry, 1, sizeof(WENTRY), Wfp) != sizeof(WENTRY))
+      fatal("I/O error");
+   fflush(Wfp);
+   memset(xkey, 0, sizeof(xkey));  /* security */
+}  /* end append_wentry() */
+
+
 /* Add address to wallet.  Call after successful read_wheader().
  * If name is not NULL, entry is appended to wallet.
  * Set name to NULL to create import dummy entry.
@@ -1268,7 +1606,7 @@ int add_addr(WENTRY *entry, char *name)
    char buff[80];
    long last_idx;
 
-   fp = fopen2(Wfname, "ab", 1);  /* open file or fatal() */
+   fp = wfile();  /* open file or fatal() */
    memset(entry, 0, sizeof(WENTRY));
 
    if(name) {  /* not import dummy */
@@ -1293,18 +1631,12 @@ int add_addr(WENTRY *entry, char *name)
    put32(entry->key, lastkey);
    if(name)
       memcpy(entry->name, name, sizeof(entry->name));
-   fuzzname(entry->name, sizeof(entry->name));
-   shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
-   /* entry->flags is first field after entry->key salt */
-   xo4_crypt(&Xo4ctx, entry->flags, entry->flags,
-             sizeof(WENTRY) - sizeof(entry->key));
-   if(fwrite(entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY))
-      fatal("I/O error");
+   if(fseek(fp, 0, SEEK_END) != 0) fatal("I/O error");
    last_idx = ftell(fp);
    last_idx = (last_idx - sizeof(WHEADER)) / sizeof(WENTRY);
-   fclose(fp);
+   append_wentry(entry, last_idx);
    update_wheader(&Whdr);
-   return last_idx;
+   return last_idx + 1;
 }  /* end add_addr() */
 
 
@@ -1352,7 +1684,7 @@ int add_tag_addr(void)
    if((idx = find_tag(addr, entry)) != 0) {
       /* tag already in wallet so just update address: */
       memcpy(entry->addr, addr, TXWOTSLEN);
-      if(write_wentry(entry, idx-1) != VEOK) {
+      if(write_wentry(entry, idx-1) != VEOK || flush_widx() != VEOK) {
          printf("*** Disk write error.\n");
          return VERROR;
       }
@@ -1364,7 +1696,7 @@ int add_tag_addr(void)
    printf("Enter address name: ");
    tgets(buff, 80);
 
-   fp = fopen2(Wfname, "ab", 1);  /* open file or fatal() */
+   fp = wfile();  /* open file or fatal() */
    memset(entry, 0, sizeof(WENTRY));
    strncpy((char *) entry->name, buff, 16);
    memcpy(entry->addr, addr, TXWOTSLEN);
@@ -1372,14 +1704,8 @@ int add_tag_addr(void)
    lastkey++;
    put32(Whdr.lastkey, lastkey);   /* save updated salt */
    put32(entry->key, lastkey);
-   fuzzname(entry->name, sizeof(entry->name));
-   shy_setkey(&Xo4ctx, entry->key, (word8 *) Password, PASSWLEN);
-   /* entry->flags is first field after entry->key salt */
-   xo4_crypt(&Xo4ctx, entry->flags, entry->flags,
-             sizeof(WENTRY) - sizeof(entry->key));
-   if(fwrite(entry, 1, sizeof(WENTRY), fp) != sizeof(WENTRY))
-      fatal("I/O error");
-   fclose(fp);
+   if(fseek(fp, 0, SEEK_END) != 0) fatal("I/O error");
+   append_wentry(entry, (ftell(fp) - sizeof(WHEADER)) / sizeof(WENTRY));
    update_wheader(&Whdr);
    printf("Address imported.\n");
    return VEOK;
@@ -1603,6 +1929,7 @@ int archive_addr(void)
    put64(entry.balance, Zeros);
    entry.flags[0] |= W_DEL;
    ecode = write_wentry(&entry, idx-1);
+   if(ecode == VEOK) ecode = flush_widx();
    return ecode;
 }  /* end archive_addr() */
 
@@ -1632,18 +1959,117 @@ int bad_tag(word8 *addr)
 }  /* bad_tag() */
 
 
-/* Check and address balance with network.
+/* Set balance of 1-based index idx in the in-core index.
+ * A changed balance is marked dirty for write-back by flush_widx().
+ */
+void set_bal(unsigned idx, word8 *balance)
+{
+   WINDEX *ip;
+
+   ip = &Windex[idx-1];
+   if(cmp64(ip->balance, balance) != 0) {
+      put64(ip->balance, balance);
+      Wstore[idx-1].dirty |= WS_BAL;
+   }
+   if(cmp64(ip->balance, Zeros) != 0) {
+      ip->flags[0] &= ~(W_SPENT | W_DEL);
+      ip->flags[0] |= W_BAL;
+   }
+}  /* end set_bal() */
+
+
+/* Convert WOTS+ address to hash-based (implicit) ledger address:
+ * tag and hash are both ripemd160(sha3-512(public key)).
+ */
+void wots2addr(word8 *wots, word8 *addr)
+{
+   word8 hash[64];
+
+   sha3(wots, TXSIGLEN, hash, 64);
+   ripemd160(hash, 64, addr);
+   memcpy(&addr[LADDRLEN / 2], addr, LADDRLEN / 2);
+}
+
+
+/* Query balances of count wallet entries, from 0-based index first,
+ * with one OP_BALANCE_BATCH request.  count must not exceed BATCHLEN.
+ * Balances are marked dirty for write-back by flush_widx().
+ * Return VEOK on success, VEBAD if server cannot batch,
+ * else VERROR.
+ */
+int query_batch(unsigned first, unsigned count)
+{
+   NODE node;
+   WENTRY entry;
+   word8 *bp, *hp, *mp;
+   word8 laddr[LADDRLEN], bal[8];
+   unsigned j, nfound;
+   int cond;
+
+   if(count == 0) return VEOK;
+   if(count > BATCHLEN || first + count > Nindex) return VERROR;
+   if(callserver(&node, 0, Peeraddr) != VEOK) return VERROR;
+   if(!(Peercbits & C_BATCH)) {
+      sock_close(node.sd);
+      return VEBAD;
+   }
+   /* pack ledger addresses of entries */
+   bp = TRANBUFF(&node.tx);
+   memset(bp, 0, TRANLEN);
+   for(j = 0; j < count; j++) {
+      if(read_wentry(&entry, first + j) != VEOK) {
+         memset(&entry, 0, sizeof(WENTRY));  /* security */
+         sock_close(node.sd);
+         return VERROR;
+      }
+      wots2addr(entry.addr, &bp[j * LADDRLEN]);
+   }
+   memset(&entry, 0, sizeof(WENTRY));  /* security */
+   put16(node.tx.len, count * LADDRLEN);
+   send_op(&node, OP_BALANCE_BATCH);
+   if(rx2(&node, 1) != VEOK) {
+      sock_close(node.sd);
+      return VERROR;
+   }
+   sock_close(node.sd);
+   if(get16(node.tx.opcode) != OP_SEND_BAL
+      || get16(node.tx.len) > TRANLEN
+      || (get16(node.tx.len) % LENTRYLEN) != 0) return VERROR;
+   nfound = get16(node.tx.len) / LENTRYLEN;
+
+   /* reply is sorted by address -- re-derive each and search */
+   for(j = 0; j < count; j++) {
+      if(read_wentry(&entry, first + j) != VEOK) break;
+      wots2addr(entry.addr, laddr);
+      memset(bal, 0, 8);
+      bp = TRANBUFF(&node.tx);
+      for(hp = bp + (nfound * LENTRYLEN); bp < hp; ) {
+         mp = bp + (((hp - bp) / LENTRYLEN) / 2) * LENTRYLEN;
+         cond = memcmp(laddr, mp, LADDRLEN);
+         if(cond == 0) { memcpy(bal, mp + LADDRLEN, 8); break; }
+         if(cond < 0) hp = mp; else bp = mp + LENTRYLEN;
+      }
+      set_bal(first + j + 1, bal);
+   }
+   memset(&entry, 0, sizeof(WENTRY));  /* security */
+   if(j != count) return VERROR;
+   return VEOK;
+}  /* end query_batch() */
+
+
+/* Query an address balance from network and update the in-core index.
+ * The balance is marked dirty for write-back by flush_widx().
  * Parameter idx is 1-based wallet index.
  * Return VEOK on success, else error code.
  */
-int check_bal(unsigned idx)
+int query_bal(unsigned idx)
 {
    int ecode;
    WENTRY entry;
-   WINDEX *ip;
    TX tx;
 
    if(badidx(idx)) return VERROR;
+   read_widx();
    ecode = read_wentry(&entry, idx-1);
    if(ecode != VEOK) goto out;
    memset(&tx, 0, sizeof(TX));
@@ -1651,20 +2077,27 @@ int check_bal(unsigned idx)
    tx.send_total[0] = 1;
    ecode = get_tx(&tx, 0, Peeraddr, OP_BALANCE);
    if(ecode != VEOK) goto out;
-   ip = &Windex[idx-1];
-   put64(ip->balance, tx.send_total);
-   put64(entry.balance, tx.send_total);
-   if(cmp64(ip->balance, Zeros) != 0) {
-      ip->flags[0] &= ~(W_SPENT | W_DEL);
-      ip->flags[0] |= W_BAL;
-   }
-   ecode = write_wentry(&entry, idx-1);
+   set_bal(idx, tx.send_total);
 out:
    if(ecode != VEOK)
       printf("*** Balance check failed.\n");
    memset(&tx, 0, sizeof(TX));         /* security */
    memset(&entry, 0, sizeof(WENTRY));
    return ecode;
+}  /* end query_bal() */
+
+
+/* Check and address balance with network.
+ * Parameter idx is 1-based wallet index.
+ * Return VEOK on success, else error code.
+ */
+int check_bal(unsigned idx)
+{
+   int ecode;
+
+   ecode = query_bal(idx);
+   if(ecode == VEOK) ecode = flush_widx();
+   return ecode;
 }  /* end check_bal() */
 
 
@@ -1861,6 +2294,7 @@ notsent:
    if(didx)
       ecode |= write_wentry(&dentry, didx-1);
    ecode |= write_wentry(&centry, cidx-1);
+   if(ecode == VEOK) ecode = flush_widx();  /* write back all in one pass */
    if(ecode != VEOK) goto ioerror;
    goto out;
 }  /* end spend_addr(void) */
@@ -1932,6 +2366,7 @@ out:
    if(fp) fclose(fp);
    if(ecode == VEOK) {
       ecode = write_wentry(&newentry, idx-1);   /* update wallet */
+      if(ecode == VEOK) ecode = flush_widx();
       printf("Address imported.\n");
    } else
       printf("*** Not imported\n");
@@ -1944,19 +2379,35 @@ out:
 /* Check all balances. */
 int query_all(void)
 {
-   unsigned j;
+   unsigned j, k, n;
    int ecode;
-   WINDEX *ip;
 
    printf("\nChecking balances, press ctrl-c to stop...\n\n");
 
+   read_widx();
    Sigint = 0;
    ecode = VEOK;
-   for(ip = Windex, j = 1; j <= Nindex; ip++, j++) {
+   for(j = 0; j < Nindex; j += n) {
       if(Sigint) break;
-      ecode = check_bal(j);
+      n = Nindex - j;
+      if(n > BATCHLEN) n = BATCHLEN;
+      if(!Batchoff) {
+         ecode = query_batch(j, n);
+         if(ecode == VEOK) continue;
+         if(ecode != VEBAD) {
+            printf("*** Balance check failed.\n");
+            break;
+         }
+         Batchoff = 1;  /* server cannot batch -- one at a time */
+      }
+      for(k = j + 1; k <= j + n && !Sigint; k++) {
+         ecode = query_bal(k);
+         if(ecode != VEOK) break;
+      }
       if(ecode != VEOK) break;
    }
+   /* write back all changed balances at once */
+   if(flush_widx() != VEOK && ecode == VEOK) ecode = VERROR;
    return ecode;
 }  /* end query_all(() */
 
@@ -1985,6 +2436,7 @@ int edit_name(void)
    if(lbuff[0])
       memcpy(entry.name, lbuff, 25);
    ecode = write_wentry(&entry, idx-1);
+   if(ecode == VEOK) ecode = flush_widx();
    if(ecode == VEOK)
       disp_ecode(VEOK);
    return ecode;
@@ -2144,11 +2596,11 @@ void mainmenu(void)
          case '2': CLEARSCR();  printf("\nMy addresses:\n");
                    display_wallet(0, 0);   break;
          case '3': import2();
-                   read_widx();            break;
+                   reload_widx();          break;
          case '4': add_addr2(1);
                    break;
          case '5': spend_addr();
-                   read_widx();
+                   reload_widx();
                    break;
          case '6': query_all();
                    printf("\n");
@@ -2171,6 +2623,8 @@ void usage(void)
       "           -aS      set address string to S\n"
       "           -pN      set TCP port to N\n"
       "           -v       verbose output\n"
+      "           -b       check all balances and exit\n"
+      "           -B       disable batched balance queries\n"
       "           -n       create new wallet\n\n"
    );
    exit(1);
@@ -2180,7 +2634,7 @@ void usage(void)
 int main(int argc, char **argv)
 {
    int j;
-   static word8 newflag;
+   static word8 newflag, balflag;
 
 #ifdef _WINSOCKAPI_
    static WORD wsaVerReq;
@@ -2210,6 +2664,10 @@ int main(int argc, char **argv)
                     break;
          case 'n':  newflag = 1;
                     break;
+         case 'b':  balflag = 1;
+                    break;
+         case 'B':  Batchoff = 1;
+                    break;
          default:   usage();
       }  /* end switch */
    }  /* end for j */
@@ -2224,11 +2682,19 @@ int main(int argc, char **argv)
       tgets(Password, PASSWLEN);
       CLEARSCR();
       decrypt_wheader();
-      printf("Press RETURN to continue or ctrl-c to cancel...\n");
-      getchar();
-      mainmenu();
+      if(balflag) {
+         /* non-interactive balance check */
+         query_all();
+         printf("\n");
+         display_wallet(0, 0);
+      } else {
+         printf("Press RETURN to continue or ctrl-c to cancel...\n");
+         getchar();
+         mainmenu();
+      }
    } else usage();
 
+   close_wallet();
    delete_windex();
    memset(&Whdr, 0, sizeof(Whdr));
 
@@ -44,6 +44,7 @@ static int accept_block(BTRAILER *bt, char *fname)
    FILENAME block_fname;
    FILEPATH block_fpath;
    FILEPATH split_fpath;
+   char ixfile[FILENAME_MAX], ixfile2[FILENAME_MAX];
    char bnumhex[17];
 
    /* derive filenames for accept routine */
@@ -63,14 +64,21 @@ static int accept_block(BTRAILER *bt, char *fname)
       if (memcmp(existing_bt.bhash, bt->bhash, HASHLEN) != 0) {
          remove(split_fpath);
          rename(block_fpath, split_fpath);
+         remove(tx_ixname(split_fpath, ixfile));
+         rename(tx_ixname(block_fpath, ixfile2), ixfile);
       }
    }
-   /* accept new block into chain */
+   /* accept new block into chain -- with any transaction offset-table */
    remove(block_fpath);
+   remove(tx_ixname(block_fpath, ixfile));
    if (rename(fname, block_fpath) != 0) {
       perrno("failed to rename %s to %s", fname, block_fpath);
       return VERROR;
-   } else if (append_tfile(bt, 1, "tfile.dat") != VEOK) {
+   } else if (rename(tx_ixname(fname, ixfile2), ixfile) != 0) {
+      /* offset-table is optional -- may not exist (e.g. pseudo-block) */
+      remove(ixfile2);
+   }
+   if (append_tfile(bt, 1, "tfile.dat") != VEOK) {
       perrno("failed to append_tfile()");
       return VERROR;
    }
@@ -116,21 +124,18 @@ void print_bup(BTRAILER *bt)
 }  /* end print_bup() */
 
 /**
- * Perform a block validate and update with a blockchain file. Performs
- * txclean() on successfully updated blocks. If block validation fails,
- * or the block does not contain transactions, txclean() is performed
- * without a blockchain file. Ledger updates are performed by taking
- * the ledger transaction file, generated by b_val(), and applying it
- * to the ledger. The ledger file is kept sorted on address.
+ * @private
+ * Perform a block validate and update, see b_update().
  * @param fname File name of block to validate/update
+ * @param spec Non-zero to speculate the next candidate block
  * @returns VEOK on success, else error code
 */
-int b_update(char *fname)
+static int update_block(char *fname, int spec)
 {
    BTRAILER bt;
    FILENAME block_fname;
    FILENAME clean_fname;
-   int ecode;
+   int ecode, lockfd;
 
    pdebug("updating block...");
 
@@ -155,10 +160,17 @@ int b_update(char *fname)
       goto CLEANUP;
    }
 
+   /* speculate the next candidate block while the ledger merge runs */
+   stop_bspec();
+   if (spec && Bcspec && Ininit == 0 && Insyncup == 0) {
+      Bspec_pid = b_spec_start(fname, "ltran.dat");
+   }
+
    /* update ledger with (ledger) transactions */
    ecode = le_update("ltran.dat");
    if (ecode != VEOK) {
       perrno("ledger update FAILURE");
+      stop_bspec();
       remove("ltran.fail");
       rename(fname, "ltran.fail");
       fname = NULL;
@@ -260,6 +272,7 @@ CLEANUP:
     */
 
    /* ... combine transaction queues before a clean */
+   lockfd = lock("txq1.lck", 20);
    if (fexists("txq1.dat")) {
       system("cat txq1.dat >>txclean.dat 2>/dev/null");
       remove("txq1.dat");
@@ -274,9 +287,38 @@ CLEANUP:
          remove("txclean.dat");
       }
    }
+   if (lockfd != -1) unlock(lockfd);
 
    return ecode;
+}  /* end update_block() */
+
+/**
+ * Perform a block validate and update with a blockchain file. Performs
+ * txclean() on successfully updated blocks. If block validation fails,
+ * or the block does not contain transactions, txclean() is performed
+ * without a blockchain file. Ledger updates are performed by taking
+ * the ledger transaction file, generated by b_val(), and applying it
+ * to the ledger. The ledger file is kept sorted on address.
+ * @param fname File name of block to validate/update
+ * @returns VEOK on success, else error code
+*/
+int b_update(char *fname)
+{
+   return update_block(fname, 0);
 }  /* end b_update() */
 
+/**
+ * Perform a block validate and update with a blockchain file, as with
+ * b_update(). While the ledger update runs, a speculative candidate block
+ * is constructed by a child process (see b_spec_start()). For the single
+ * block updates of the server loop, outside of init and syncup.
+ * @param fname File name of block to validate/update
+ * @returns VEOK on success, else error code
+*/
+int b_update_spec(char *fname)
+{
+   return update_block(fname, 1);
+}  /* end b_update_spec() */
+
 /* end include guard */
 #endif
@@ -18,6 +18,7 @@ extern "C" {
 
 void print_bup(BTRAILER *bt);
 int b_update(char *fname);
+int b_update_spec(char *fname);
 
 #ifdef __cplusplus
 }  /* end extern "C" */
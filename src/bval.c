@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include "sha256.h"
 #include "extmath.h"
+#include "extio.h"
 
 /**
  * Validate a neogenesis-block containing a hash-based ledger.
@@ -36,6 +37,9 @@
  * Checks block size matches neogenesis format.
  * Checks block trailer matches Tfile entry.
  * Checks sum of amounts do not exceed "expected" rewards.
+ * Every ledger entry is hashed, as the block is untrusted; on success,
+ * leaf hashes are written to the block's leaf-hash sidecar for use by
+ * le_extract(), else any existing sidecar is removed.
  * NOTE: Tfile should have been verified before neogenesis validation.
  * @param ngfile Filename of neogenesis block to validate
  * @param bnum Pointer to expected block number, or NULL to ignore
@@ -58,11 +62,13 @@ int ng_val(const char *ngfile, const word8 bnum[8])
    word8 amounts[8];
    word8 rewards[8];
    word8 *mtree;
+   char lhfile[FILENAME_MAX];
    FILE *fp;
    int ecode;
 
-   /* init */
+   /* init -- remove any (untrusted) leaf-hash sidecar */
    mtree = NULL;
+   remove(le_lhname(ngfile, lhfile));
 
    /* open file for validation */
    fp = fopen(ngfile, "rb");
@@ -157,12 +163,18 @@ int ng_val(const char *ngfile, const word8 bnum[8])
       goto DROP_CLEANUP;
    }
 
+   /* save leaf hashes for le_extract() */
+   le_lhwrite(ngfile, mtree, lcount);
+
    /* cleanup */
    free(mtree);
    fclose(fp);
 
    /* check accurate sum of Tfile rewards against ledger amounts */
-   if (get_tfrewards("tfile.dat", rewards, bt.bnum) != VEOK) return VERROR;
+   if (get_tfrewards("tfile.dat", rewards, bt.bnum) != VEOK) {
+      remove(lhfile);
+      return VERROR;
+   }
    /* ... get_tfile_rewards() cannot calculate supply burn where a
     * balance is less than the transaction fee, so we only check the
     * Neogenesis amounts do not exceed our expected rewards...
@@ -170,6 +182,7 @@ int ng_val(const char *ngfile, const word8 bnum[8])
 
    /* check calculated rewards against ledger amounts */
    if (cmp64(amounts, rewards) > 0) {
+      remove(lhfile);
       set_errno(EMCM_LESUM);
       return VEBAD2;
    }
@@ -189,12 +202,31 @@ DROP_CLEANUP:
 CLEANUP:
    if (mtree) free(mtree);
    fclose(fp);
+   remove(lhfile);
 
    return ecode;
 }  /* end ng_val() */
 
+/**
+ * Check a Block Trailer is an assume-valid block or one of its ancestors,
+ * as extracted from the validated Tfile during resync().
+ * @param bt Pointer to Block Trailer to check
+ * @return (int) non-zero if block is assumed valid, else zero
+ */
+static int b_val__assumed(const BTRAILER *bt)
+{
+   BTRAILER avt;
+
+   if (Fullverify) return 0;
+   if (read_tfile(&avt, bt->bnum, 1, "tfile.av") != 1) return 0;
+
+   return (memcmp(&avt, bt, sizeof(BTRAILER)) == 0);
+}  /* end b_val__assumed() */
+
 /**
  * Validate a transaction block file and create ledger transaction file.
+ * On success, the transaction offset-table sidecar of the block file is
+ * written for random access to its transactions; see tx_ixopen().
  * @param bcfile Filename of block file to validate
  * @param ltfile Filename of ledger transactions file to write
  * @return (int) value representing operation result
@@ -210,6 +242,9 @@ int b_val(const char *bcfile, const char *ltfile)
    BTRAILER bt;            /* fixed length block trailer */
    BHEADER bh;             /* fixed length block header */
    LTRAN lt;               /* ledger transaction */
+   TXIDX *txidx;           /* transaction offset-table (sidecar) */
+   char ixfile[FILENAME_MAX];
+   long long offset;
    long len;
    word8 *mtree;
    FILE *fp, *ltfp;        /* input fname, output file ltran.tmp */
@@ -219,12 +254,16 @@ int b_val(const char *bcfile, const char *ltfile)
    word32 mdstlen, tcount; /* multi-destination and transaction count */
    word32 j, k;            /* loop counters */
    int ecode, overflow;
-   int pseudo;
+   int pseudo, assumed;
 
    /* init NULL for error handling */
    fp = ltfp = NULL;
+   txidx = NULL;
    mtree = NULL;
 
+   /* remove stale transaction offset-table */
+   remove(tx_ixname(bcfile, ixfile));
+
    /* open block file and extract metadata */
    fp = fopen(bcfile, "rb");
    if (fp == NULL) goto ERROR_CLEANUP;
@@ -277,11 +316,18 @@ int b_val(const char *bcfile, const char *ltfile)
    /* validate block trailer (incl. PoW) against tfile trailer */
    if (read_trailer(&tft, "tfile.dat") != VEOK) goto ERROR_CLEANUP;
    if (validate_trailer(&bt, &tft) != VEOK) goto DROP_CLEANUP;
-   if (!pseudo && validate_pow(&bt) != VEOK) goto DROP_CLEANUP;
+   /* ... PoW and signatures of assume-valid ancestors are skipped */
+   assumed = b_val__assumed(&bt);
+   if (!pseudo && !assumed && validate_pow(&bt) != VEOK) goto DROP_CLEANUP;
 
    /* malloc merkle tree (+1 for miner) */
    mtree = malloc((tcount + 1) * HASHLEN);
    if (mtree == NULL) goto ERROR_CLEANUP;
+   /* malloc transaction offset-table */
+   if (tcount > 0) {
+      txidx = malloc(tcount * sizeof(TXIDX));
+      if (txidx == NULL) goto ERROR_CLEANUP;
+   }
 
    /* begin merkel hash with mining address + reward */
    sha256(bh.maddr /* + bh.mreward */, sizeof(bh.maddr) + 8, mtree);
@@ -293,6 +339,8 @@ int b_val(const char *bcfile, const char *ltfile)
    /* Validate each transaction */
    for (j = 0; j < tcount; j++) {
       /* read transaction data for validation */
+      offset = ftell64(fp);
+      if (offset == (-1)) goto ERROR_CLEANUP;
       if (tx_fread(&txe, fp) != VEOK) goto RDERR_CLEANUP;
 
       /* ... TRANSACTION PROCESSING ... */
@@ -306,12 +354,15 @@ int b_val(const char *bcfile, const char *ltfile)
          }
       }
       /* validate transaction */
-      ecode = txe_val(&txe, bt.bnum, bt.mfee);
+      ecode = txe_val(&txe, bt.bnum, bt.mfee, assumed);
       if (ecode != VEOK) goto CLEANUP;
 
       /* add transaction id to merkel tree, store src_addr */
       memcpy(&mtree[(j + 1) * HASHLEN], txe.tx_id, HASHLEN);
       memcpy(prev, txe.src_addr, ADDR_LEN);
+      /* add transaction offset and id to offset-table */
+      put64(txidx[j].offset, &offset);
+      memcpy(txidx[j].tx_id, txe.tx_id, HASHLEN);
 
       /* sum fees for (additional) miner credit */
       if (add64(mreward, txe.tx_fee, mreward)) {
@@ -396,7 +447,13 @@ int b_val(const char *bcfile, const char *ltfile)
       goto ERROR_CLEANUP;
    }
 
+   /* write transaction offset-table -- optional, for local readers */
+   if (tcount > 0 && tx_ixwrite(bcfile, txidx, tcount) != VEOK) {
+      pwarn("failed to write transaction offset-table of %s", bcfile);
+   }
+
    /* cleanup */
+   if (txidx) free(txidx);
    free(mtree);
    fclose(fp);
    fclose(ltfp);
@@ -415,6 +472,7 @@ ERROR_CLEANUP:
 DROP_CLEANUP:
    ecode = VEBAD2;
 CLEANUP:
+   if (txidx) free(txidx);
    if (mtree) free(mtree);
    if (fp) fclose(fp);
    if (ltfp) {
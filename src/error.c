@@ -225,6 +225,10 @@ char *op2str(unsigned op)
       case OP_HASH: return "OP_HASH";
       case OP_TF: return "OP_TF";
       case OP_IDENTIFY: return "OP_IDENTIFY";
+      case OP_BALANCE_BATCH: return "OP_BALANCE_BATCH";
+      case OP_NG_LAYER: return "OP_NG_LAYER";
+      case OP_GET_NGCHUNK: return "OP_GET_NGCHUNK";
+      case OP_GET_MMRPROOF: return "OP_GET_MMRPROOF";
       default: return "OP_UNKNOWN";
    }  /* end switch (op) */
 }  /* end op2str() */
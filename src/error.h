@@ -164,6 +164,8 @@ typedef char FILENAME[FILENAME_MAX];
    EMCM__ITEM(EMCM_MADDR, "Bad miner address") \
    EMCM__ITEM(EMCM_MFEE, "Bad miner fee") \
    EMCM__ITEM(EMCM_MFEES_OVERFLOW, "Overflow of miner fees") \
+   EMCM__ITEM(EMCM_MMRPROOF, "Bad MMR proof of trailer") \
+   EMCM__ITEM(EMCM_MMRSTALE, "Stale MMR sidecar of Tfile") \
    EMCM__ITEM(EMCM_MREWARD, "Bad miner reward") \
    EMCM__ITEM(EMCM_MREWARDS_OVERFLOW, "Overflow of miner rewards") \
    EMCM__ITEM(EMCM_MROOT, "Bad merkle root") \
@@ -183,6 +185,7 @@ typedef char FILENAME[FILENAME_MAX];
    EMCM__ITEM(EMCM_LEEMPTY, "No records written to ledger file") \
    EMCM__ITEM(EMCM_LEEXTRACT, "Ledger cannot be extracted from a non-NG block") \
    EMCM__ITEM(EMCM_LESORT, "Bad ledger sort") \
+   EMCM__ITEM(EMCM_LESTALE, "Ledger overlay base is not the current ledger version") \
    EMCM__ITEM(EMCM_LESUM, "Bad sum of ledger amounts") \
    EMCM__ITEM(EMCM_LETAG, "Bad tag reference to ledger entry") \
 /* ledger transaction related errors... */ \
@@ -54,7 +54,9 @@ char *Spdir = SPDIR; /* split chain directory */
 time_t Utime;        /* update time for watchdog */
 word8 Allowpush;     /* set by -P flag in mochimo.c */
 word8 Cbits = CBITS; /* 8 capability bits */
+word8 Cxbits = CXBITS; /* 8 extended capability bits */
 word8 Safemode;      /* Safe mode enable */
+word8 Fullverify;    /* verify PoW and signatures of all blocks */
 word8 Ininit;        /* non-zero when init() runs */
 word8 Insyncup;      /* non-zero when syncup() runs */
 word8 Betabait;      /* betabait() display */
@@ -67,17 +69,20 @@ word32 Myfee[2] = { MFEE, 0 };
 word32 Mfee[2] = { MFEE, 0 };
 word8 Cblocknum[8];
 word8 Cblockhash[HASHLEN];
+word8 Assumevalid[HASHLEN] = ASSUMEVALID;  /* trusted block hash */
 word8 Prevhash[HASHLEN];
 word8 Weight[HASHLEN];
 
 /* lock files    writes   reads     deletes
  * mq.lck        gomochi            gomochi
+ * txq1.lck      gomochi            gomochi
  * neofail.lck   neogen   bupdata   bupdata
 */
 
 /* Global semaphores */
 pid_t Bcon_pid;         /* bcon process id */
 word8 Bcbnum[8];        /* Cblocknum at time of execl bcon */
+pid_t Bspec_pid;        /* speculative bcon process id */
 pid_t Found_pid;
 pid_t Mqpid;            /* mirror() */
 int Mqcount;            /* count of mq.dat records */
@@ -92,6 +97,7 @@ void kill_services_exit(int ecode)
 {
    if (Found_pid) kill(Found_pid, SIGTERM);
    if (Bcon_pid) kill(Bcon_pid, SIGTERM);
+   if (Bspec_pid) kill(Bspec_pid, SIGTERM);
    if (Mqpid) kill(Mqpid, SIGTERM);
    sock_cleanup();
    Running = 0;
@@ -121,6 +127,21 @@ int stop_bcon(void)
    return status;
 }
 
+/* kill the speculative block constructor */
+int stop_bspec(void)
+{
+   int status = VETIMEOUT;
+
+   if (Bspec_pid) {
+      pdebug("   Waiting for b_spec() to exit");
+      kill(Bspec_pid, SIGTERM);
+      waitpid(Bspec_pid, NULL, 0);
+      Bspec_pid = 0;
+   }
+
+   return status;
+}
+
 /* kill send_found() */
 int stop_found(void)
 {
@@ -49,7 +49,9 @@ extern char *Spdir;         /* block chain directory */
 extern time_t Utime;        /* update time for watchdog */
 extern word8 Allowpush;     /* set by -P flag in mochimo.c */
 extern word8 Cbits;         /* 8 capability bits */
+extern word8 Cxbits;        /* 8 extended capability bits */
 extern word8 Safemode;      /* Safe mode enable */
+extern word8 Fullverify;    /* verify PoW and signatures of all blocks */
 extern word8 Ininit;        /* non-zero when init() runs */
 extern word8 Insyncup;      /* non-zero when syncup() runs */
 extern word8 Betabait;      /* betabait() display */
@@ -62,6 +64,7 @@ extern word32 Myfee[2];
 extern word32 Mfee[2];
 extern word8 Cblocknum[8];
 extern word8 Cblockhash[HASHLEN];
+extern word8 Assumevalid[HASHLEN];
 extern word8 Prevhash[HASHLEN];
 extern word8 Weight[HASHLEN];
 
@@ -73,6 +76,7 @@ extern word8 Weight[HASHLEN];
 /* Global semaphores */
 extern pid_t Bcon_pid;              /* bcon process id */
 extern word8 Bcbnum[8];           /* Cblocknum at time of execl bcon */
+extern pid_t Bspec_pid;             /* speculative bcon process id */
 extern pid_t Found_pid;
 extern pid_t Mqpid;              /* mirror() */
 extern int Mqcount;              /* count of mq.dat records */
@@ -87,6 +91,7 @@ extern "C" {
 void kill_services_exit(int ecode);
 char *show(char *state);
 int stop_bcon(void);
+int stop_bspec(void);
 int stop_found(void);
 void stop_mirror(void);
 
@@ -18,11 +18,16 @@
 
 /* external support */
 #include <string.h>
+#include "sha256.h"
 #include "sha3.h"
 #include "ripemd160.h"
 #include "extmath.h"
 #include "extlib.h"
+#include "extio.h"
+#include "extthrd.h"
 #include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>  /* for stat() */
 
 /* LEGACY WOTS+ ledger entry struct */
 typedef struct {
@@ -30,8 +35,15 @@ typedef struct {
    word8 balance[8];
 } WOTS_LENTRY;
 
-static FILE *Lefp;
-static long long Nledger;
+static LESNAP *Lesnap;        /* current ledger version */
+static LESNAP *Leretired;     /* retired versions awaiting readers */
+static Mutex Lesnaplock = MUTEX_INITIALIZER;
+static word32 Leversion;
+static struct {
+   word8 bnum[8];
+   word8 lstate[HASHLEN];
+} Lestate[LESTATELEN];        /* ledger state commitments, by bnum */
+static unsigned Lestatelen;
 static char Lefile[FILENAME_MAX] = "ledger.dat";
 word32 Sanctuary;
 word32 Lastday;
@@ -238,22 +250,327 @@ static int lt_compare(const void *a, const void *b)
 }
 
 /**
- * Open ledger file for internal operations. Ledger file is read-only.
+ * @private
+ * Add (or subtract) a leaf hash to (or from) a ledger state commitment.
+ * Both are treated as little-endian 256-bit integers, modulo 2^256.
+ * @param lstate Pointer to ledger state commitment to update
+ * @param hash Pointer to leaf hash of a ledger entry
+ * @param sub Set non-zero to subtract, else add
+ */
+static void lstate_update(word8 *lstate, const word8 *hash, int sub)
+{
+   unsigned sum;
+   int j, carry;
+
+   for (carry = 0, j = 0; j < HASHLEN; j++) {
+      if (sub) {
+         sum = (unsigned) lstate[j] - hash[j] - carry;
+         carry = (sum >> 8) & 1;
+      } else {
+         sum = (unsigned) lstate[j] + hash[j] + carry;
+         carry = (int) (sum >> 8);
+      }
+      lstate[j] = (word8) sum;
+   }
+}  /* end lstate_update() */
+
+/**
+ * @private
+ * Record the ledger state commitment of a block number. Commitments of
+ * the same, or later, block numbers are dropped, as those blocks have
+ * been replaced. Lesnaplock MUST be held by caller.
+ * @param bnum Block number the ledger reflects
+ * @param lstate Ledger state commitment
+ */
+static void lstate_record(const word8 *bnum, const word8 *lstate)
+{
+   while (Lestatelen && cmp64(Lestate[Lestatelen - 1].bnum, bnum) >= 0) {
+      Lestatelen--;
+   }
+   if (Lestatelen == LESTATELEN) {
+      memmove(Lestate, Lestate + 1, sizeof(Lestate[0]) * --Lestatelen);
+   }
+   put64(Lestate[Lestatelen].bnum, bnum);
+   memcpy(Lestate[Lestatelen].lstate, lstate, HASHLEN);
+   Lestatelen++;
+}  /* end lstate_record() */
+
+/**
+ * Get the leaf-hash sidecar filename of a ledger (or neogenesis) file.
+ * @param fname Filename of ledger (or neogenesis) file
+ * @param lhfile Pointer to buffer of FILENAME_MAX for sidecar filename
+ * @return (char *) lhfile
+ */
+char *le_lhname(const char *fname, char *lhfile)
+{
+   snprintf(lhfile, FILENAME_MAX, "%s%s", fname, LEHASH_EXT);
+   return lhfile;
+}
+
+/**
+ * @private
+ * Bind a leaf-hash sidecar digest to its ledger (or neogenesis) file, by
+ * the size and modification time of the file. Any replacement of the
+ * file, since the sidecar was written, so invalidates the sidecar.
+ * @param ctx Pointer to sidecar digest context, of leaf hashes
+ * @param fname Filename of ledger (or neogenesis) file
+ * @return (int) VEOK on success, else VERROR
+ */
+static int le_lhbind(SHA256_CTX *ctx, const char *fname)
+{
+   struct stat st;
+   word8 bind[16];
+   word64 val;
+
+   if (stat(fname, &st) != 0) return VERROR;
+   val = (word64) st.st_size;
+   put64(bind, &val);
+   val = (word64) st.st_mtime;
+   put64(bind + 8, &val);
+   sha256_update(ctx, bind, sizeof(bind));
+
+   return VEOK;
+}  /* end le_lhbind() */
+
+/**
+ * Open the leaf-hash sidecar of a ledger (or neogenesis) file, for reading
+ * leaf hashes in ledger order. Sidecar size, and the first and last leaf
+ * hashes, are checked against count ledger entries of the file, and the
+ * digest of the sidecar is checked against all leaf hashes, and the size
+ * and modification time of the file (see le_lhbind()).
+ * @param fname Filename of ledger (or neogenesis) file
+ * @param offset Offset of the first ledger entry in fname
+ * @param count Number of ledger entries in fname
+ * @return (FILE *) sidecar positioned at the first leaf hash, or NULL
+ * if the sidecar does not exist or does not match
+ */
+FILE *le_lhopen(const char *fname, long long offset, size_t count)
+{
+   SHA256_CTX ctx;
+   LENTRY le;
+   char lhfile[FILENAME_MAX];
+   word8 hash[HASHLEN], lhash[HASHLEN];
+   FILE *fp, *lhfp;
+   size_t j;
+   int ok;
+
+   if (count == 0) return NULL;
+   lhfp = fopen(le_lhname(fname, lhfile), "rb");
+   if (lhfp == NULL) return NULL;
+   fp = fopen(fname, "rb");
+   if (fp == NULL) goto FAIL;
+
+   /* check sidecar size, then first and last leaf hashes */
+   ok = (fseek64(lhfp, 0LL, SEEK_END) == 0 &&
+      ftell64(lhfp) == (long long) ((count + 1) * HASHLEN));
+   for (j = 0; ok && j < count; j += (count - 1)) {
+      ok = (fseek64(fp, offset + (long long) (j * sizeof(LENTRY)),
+               SEEK_SET) == 0 &&
+         fread(&le, sizeof(LENTRY), 1, fp) == 1 &&
+         fseek64(lhfp, (long long) (j * HASHLEN), SEEK_SET) == 0 &&
+         fread(lhash, HASHLEN, 1, lhfp) == 1);
+      if (ok) {
+         sha256(&le, sizeof(LENTRY), hash);
+         ok = (memcmp(hash, lhash, HASHLEN) == 0);
+      }
+      if (count == 1) break;
+   }
+   fclose(fp);
+   /* check digest of all leaf hashes */
+   sha256_init(&ctx);
+   if (ok && fseek64(lhfp, 0LL, SEEK_SET) == 0) {
+      for (j = 0; ok && j < count; j++) {
+         ok = (fread(lhash, HASHLEN, 1, lhfp) == 1);
+         if (ok) sha256_update(&ctx, lhash, HASHLEN);
+      }
+      ok = ok && le_lhbind(&ctx, fname) == VEOK;
+      sha256_final(&ctx, hash);
+      ok = ok && fread(lhash, HASHLEN, 1, lhfp) == 1 &&
+         memcmp(hash, lhash, HASHLEN) == 0;
+   }
+   if (ok && fseek64(lhfp, 0LL, SEEK_SET) == 0) return lhfp;
+
+FAIL:
+   fclose(lhfp);
+
+   return NULL;
+}  /* end le_lhopen() */
+
+/**
+ * Write the leaf-hash sidecar of a ledger (or neogenesis) file, and its
+ * digest. The file MUST be complete, as the digest is bound to it (see
+ * le_lhbind()). A partially written sidecar is removed.
+ * @param fname Filename of ledger (or neogenesis) file
+ * @param hashes Pointer to count leaf hashes, in ledger order
+ * @param count Number of leaf hashes
+ * @return (int) value representing write result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int le_lhwrite(const char *fname, const word8 *hashes, size_t count)
+{
+   SHA256_CTX ctx;
+   char lhfile[FILENAME_MAX];
+   word8 digest[HASHLEN];
+   FILE *lhfp;
+
+   sha256_init(&ctx);
+   sha256_update(&ctx, hashes, count * HASHLEN);
+   if (le_lhbind(&ctx, fname) != VEOK) return VERROR;
+   sha256_final(&ctx, digest);
+   lhfp = fopen(le_lhname(fname, lhfile), "wb");
+   if (lhfp == NULL) return VERROR;
+   if (fwrite(hashes, HASHLEN, count, lhfp) != count ||
+         fwrite(digest, HASHLEN, 1, lhfp) != 1) {
+      fclose(lhfp);
+      remove(lhfile);
+      return VERROR;
+   }
+   fclose(lhfp);
+
+   return VEOK;
+}  /* end le_lhwrite() */
+
+/**
+ * @private
+ * Copy the leaf hashes of an open, valid, leaf-hash sidecar to the
+ * sidecar of a ledger file, with a digest bound to the ledger file.
+ * A partially written sidecar is removed.
+ * @param lhfp Sidecar positioned at the first leaf hash (see le_lhopen())
+ * @param fname Filename of ledger file
+ * @param count Number of leaf hashes
+ * @return (int) VEOK on success, else VERROR
+ */
+static int le_lhcopy(FILE *lhfp, const char *fname, size_t count)
+{
+   SHA256_CTX ctx;
+   char lhfile[FILENAME_MAX];
+   word8 lh[HASHLEN];
+   FILE *lhout;
+   size_t j;
+
+   lhout = fopen(le_lhname(fname, lhfile), "wb");
+   if (lhout == NULL) return VERROR;
+   sha256_init(&ctx);
+   for (j = 0; j < count; j++) {
+      if (fread(lh, HASHLEN, 1, lhfp) != 1) goto FAIL;
+      if (fwrite(lh, HASHLEN, 1, lhout) != 1) goto FAIL;
+      sha256_update(&ctx, lh, HASHLEN);
+   }
+   if (le_lhbind(&ctx, fname) != VEOK) goto FAIL;
+   sha256_final(&ctx, lh);
+   if (fwrite(lh, HASHLEN, 1, lhout) != 1) goto FAIL;
+   if (fclose(lhout) != 0) {
+      remove(lhfile);
+      return VERROR;
+   }
+
+   return VEOK;
+
+FAIL:
+   fclose(lhout);
+   remove(lhfile);
+   return VERROR;
+}  /* end le_lhcopy() */
+
+/**
+ * @private
+ * Free a ledger snapshot. Snapshot MUST have no remaining references.
+ * @param snap Pointer to ledger snapshot to free
+ */
+static void le_snap_free(LESNAP *snap)
+{
+   fclose(snap->fp);
+   mutex_destroy(&(snap->lock));
+   free(snap);
+}
+
+/**
+ * @private
+ * Publish a ledger snapshot as the current ledger version. The previous
+ * version is retired, and freed once its last reader releases it.
+ * @param snap Pointer to ledger snapshot to publish, or NULL to close
+ */
+static void le_publish(LESNAP *snap)
+{
+   LESNAP *prev;
+
+   mutex_lock(&Lesnaplock);
+   prev = Lesnap;
+   Lesnap = snap;
+   if (prev && --(prev->refs) > 0) {
+      /* readers remain -- retire until drained */
+      prev->next = Leretired;
+      Leretired = prev;
+      prev = NULL;
+   }
+   mutex_unlock(&Lesnaplock);
+   if (prev) le_snap_free(prev);
+}
+
+/**
+ * @private
+ * Compute the ledger state commitment of a ledger file, from the sum of
+ * its leaf hashes. The leaf-hash sidecar is used only if it matches its
+ * digest (see le_lhopen()), else the ledger entries are hashed.
+ * @param fp Ledger file pointer
+ * @param lefile Filename of the ledger file
+ * @param count Number of ledger entries
+ * @param lstate Pointer to place ledger state commitment
+ * @return (int) VEOK on success, else VERROR
+ */
+static int le_lstate_compute(FILE *fp, const char *lefile, long long count,
+   word8 *lstate)
+{
+   LENTRY le;
+   FILE *lhfp;
+   word8 lh[HASHLEN];
+   long long j;
+
+   memset(lstate, 0, HASHLEN);
+   lhfp = le_lhopen(lefile, 0LL, (size_t) count);
+   if (fseek64(fp, 0LL, SEEK_SET) != 0) goto FAIL;
+   for (j = 0; j < count; j++) {
+      if (lhfp && fread(lh, HASHLEN, 1, lhfp) != 1) {
+         /* sidecar unreadable -- hash remaining ledger entries */
+         fclose(lhfp);
+         lhfp = NULL;
+         if (fseek64(fp, j * (long long) sizeof(LENTRY), SEEK_SET) != 0) {
+            goto FAIL;
+         }
+      }
+      if (lhfp == NULL) {
+         if (fread(&le, sizeof(LENTRY), 1, fp) != 1) goto FAIL;
+         sha256(&le, sizeof(LENTRY), lh);
+      }
+      lstate_update(lstate, lh, 0);
+   }
+   if (lhfp) fclose(lhfp);
+
+   return VEOK;
+
+FAIL:
+   if (lhfp) fclose(lhfp);
+   return VERROR;
+}  /* end le_lstate_compute() */
+
+/**
+ * @private
+ * Open a ledger file and publish it as the current ledger version.
  * @param lefile Filename of the ledger file to open
+ * @param bnum Block number the ledger file reflects
+ * @param lstate Ledger state commitment of the ledger file, or NULL to
+ * compute it from the ledger file
  * @return (int) value representing open result
  * @retval VERROR on error; check errno for details
  * @retval VEOK on success
  */
-int le_open(const char *lefile)
+static int le_load(const char *lefile, const void *bnum, const word8 *lstate)
 {
+   LESNAP *snap;
    FILE *fp;
    long long offset;
-
-   /* Already open? */
-   if (Lefp) {
-      if (strcmp(lefile, Lefile) == 0) return VEOK;
-      /* ... no, opening different ledger */
-   }
+   word8 state[HASHLEN];
 
    /* open ledger and seek to EOF */
    fp = fopen(lefile, "rb");
@@ -270,17 +587,40 @@ int le_open(const char *lefile)
       goto ERROR_CLEANUP;
    }
 
+   /* commitment is carried over from le_update(), else computed */
+   if (lstate == NULL) {
+      if (le_lstate_compute(fp, lefile, offset / sizeof(LENTRY), state)) {
+         goto ERROR_CLEANUP;
+      }
+      lstate = state;
+   }
+
+   /* build snapshot of ledger version */
+   snap = malloc(sizeof(LESNAP));
+   if (snap == NULL) goto ERROR_CLEANUP;
+   if (mutex_init(&(snap->lock)) != 0) {
+      free(snap);
+      goto ERROR_CLEANUP;
+   }
+   snap->fp = fp;
+   snap->count = offset / sizeof(LENTRY);
+   put64(snap->bnum, bnum);
+   memcpy(snap->lstate, lstate, HASHLEN);
+   snap->version = ++Leversion;
+   snap->refs = 1;  /* held while current */
+   snap->next = NULL;
+
    /* replace existing ledger */
-   le_close();
-   Lefp = fp;
-   /* update static ledger unit values */
-   Nledger = offset / sizeof(LENTRY);
    if (Lefile != lefile) {
       /* ... C standard states that the behavior of strcpy is undefined
        * when the source and destination objects overlap
        */
       strncpy(Lefile, lefile, sizeof(Lefile) - 1);
    }
+   mutex_lock(&Lesnaplock);
+   lstate_record(bnum, lstate);
+   mutex_unlock(&Lesnaplock);
+   le_publish(snap);
 
    return VEOK;
 
@@ -289,40 +629,143 @@ ERROR_CLEANUP:
    fclose(fp);
 
    return VERROR;
+}  /* end le_load() */
+
+/**
+ * Open ledger file for internal operations. Ledger file is read-only.
+ * @param lefile Filename of the ledger file to open
+ * @return (int) value representing open result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int le_open(const char *lefile)
+{
+   /* Already open? */
+   if (Lesnap) {
+      if (strcmp(lefile, Lefile) == 0) return VEOK;
+      /* ... no, opening different ledger */
+   }
+
+   return le_load(lefile, Cblocknum, NULL);
 }  /* end le_open() */
 
 /**
  * Close the internal ledger file. No operation if ledger was not opened
- * with le_open().
+ * with le_open(). Acquired snapshots remain valid until released.
  */
 void le_close(void)
 {
-   if(Lefp == NULL) return;
-   fclose(Lefp);
-   Lefp = NULL;
-   Nledger = 0;
+   if (Lesnap == NULL) return;
+   le_publish(NULL);
 }
 
 /**
- * Binary search for ledger address. If found, le is filled with the found
- * ledger entry data. Ledger must have been opened with le_open().
+ * Acquire a reference to the current ledger version. The snapshot, and
+ * its ledger file, remain valid and unchanged by le_update() until the
+ * reference is released with le_release().
+ * @return (LESNAP *) pointer to ledger snapshot, or NULL if not open
+ */
+LESNAP *le_acquire(void)
+{
+   LESNAP *snap;
+
+   mutex_lock(&Lesnaplock);
+   snap = Lesnap;
+   if (snap) snap->refs++;
+   mutex_unlock(&Lesnaplock);
+
+   return snap;
+}  /* end le_acquire() */
+
+/**
+ * Release a reference to a ledger snapshot, acquired with le_acquire().
+ * A retired snapshot is freed with its last reference.
+ * @param snap Pointer to ledger snapshot to release
+ */
+void le_release(LESNAP *snap)
+{
+   LESNAP **spp;
+
+   if (snap == NULL) return;
+   mutex_lock(&Lesnaplock);
+   if (--(snap->refs) > 0) snap = NULL;
+   else {
+      /* unlink drained snapshot from retired list */
+      for (spp = &Leretired; *spp; spp = &((*spp)->next)) {
+         if (*spp == snap) {
+            *spp = snap->next;
+            break;
+         }
+      }
+   }
+   mutex_unlock(&Lesnaplock);
+   if (snap) le_snap_free(snap);
+}  /* end le_release() */
+
+/**
+ * @private
+ * Binary search for ledger address within part of a ledger snapshot.
+ * Snapshot lock MUST be held by caller.
+ * @param snap Pointer to ledger snapshot to search
+ * @param addr Address data to search for
+ * @param le Pointer to place found ledger entry
+ * @param len Length of address data to search
+ * @param low Pointer to first ledger entry index to search; updated
+ * with the found index, or the insertion index if not found
+ * @return (int) 1 if found, else 0; check errno for details
+*/
+static int le_snap_search(LESNAP *snap, const word8 *addr, LENTRY *le,
+   word16 len, long long *low)
+{
+   LENTRY lentry;
+   long long mid, hi;
+   int cond;
+
+   hi = snap->count - 1;
+   while (*low <= hi) {
+      mid = (hi + *low) / 2;
+      if (fseek64(snap->fp, mid * sizeof(LENTRY), SEEK_SET) != 0) return 0;
+      if (fread(&lentry, sizeof(LENTRY), 1, snap->fp) != 1) {
+         if (!ferror(snap->fp)) set_errno(EMCM_EOF);
+         return 0;
+      }
+      cond = memcmp(addr, lentry.addr, len);
+      if (cond == 0) {
+         /* found target addr */
+         memcpy(le, &lentry, sizeof(LENTRY));
+         *low = mid;
+         return 1;
+      }
+      if (cond < 0) hi = mid - 1; else *low = mid + 1;
+   }  /* end while */
+
+   /* indicate successful operation in the absence of a result */
+   set_errno(0);
+
+   return 0;  /* not found */
+}  /* end le_snap_search() */
+
+/**
+ * Binary search for ledger address in a ledger snapshot. If found, le is
+ * filled with the found ledger entry data. Safe for concurrent use.
+ * @param snap Pointer to ledger snapshot, acquired with le_acquire()
  * @param addr Address data to search for
  * @param le Pointer to place found ledger entry
  * @param len Length of address data to search
  * @return (int) value representing found result
  * @retval 0 on not found; check errno for details
  * @retval 1 on found; check le pointer for ledger data
- * @exception errno=EMCM_LECLOSED if ledger is not open
+ * @exception errno=EMCM_LECLOSED if snap is NULL
  * @exception errno=EINVAL if address or le is NULL, or len is zero
  * @exception errno=0 if address is not found
 */
-int le_find(const word8 *addr, LENTRY *le, word16 len)
+int le_snap_find(LESNAP *snap, const word8 *addr, LENTRY *le, word16 len)
 {
-   long long mid, hi, low;
-   int cond;
+   long long low;
+   int found;
 
-   /* ledger must be open */
-   if (Lefp == NULL) {
+   /* snapshot must be acquired */
+   if (snap == NULL) {
       set_errno(EMCM_LECLOSED);
       return 0;
    }
@@ -337,25 +780,528 @@ int le_find(const word8 *addr, LENTRY *le, word16 len)
    if (len > ADDR_LEN) len = ADDR_LEN;
 
    low = 0;
-   hi = Nledger - 1;
+   mutex_lock(&(snap->lock));
+   found = le_snap_search(snap, addr, le, len, &low);
+   mutex_unlock(&(snap->lock));
 
-   while(low <= hi) {
-      mid = (hi + low) / 2;
-      if (fseek64(Lefp, mid * sizeof(LENTRY), SEEK_SET) != 0) return 0;
-      if (fread(le, sizeof(LENTRY), 1, Lefp) != 1) {
-         if (!ferror(Lefp)) set_errno(EMCM_EOF);
-         return 0;
+   return found;
+}  /* end le_snap_find() */
+
+/**
+ * Binary search for ledger address. If found, le is filled with the found
+ * ledger entry data. Ledger must have been opened with le_open().
+ * @param addr Address data to search for
+ * @param le Pointer to place found ledger entry
+ * @param len Length of address data to search
+ * @return (int) value representing found result
+ * @retval 0 on not found; check errno for details
+ * @retval 1 on found; check le pointer for ledger data
+ * @exception errno=EMCM_LECLOSED if ledger is not open
+ * @exception errno=EINVAL if address or le is NULL, or len is zero
+ * @exception errno=0 if address is not found
+*/
+int le_find(const word8 *addr, LENTRY *le, word16 len)
+{
+   LESNAP *snap;
+   int found;
+
+   snap = le_acquire();
+   found = le_snap_find(snap, addr, le, len);
+   le_release(snap);
+
+   return found;
+}  /* end le_find() */
+
+/**
+ * Get the ledger state commitment of a block number. The commitment is
+ * the sum, modulo 2^256, of the sha256() leaf hashes of all ledger
+ * entries, as the ledger stood after the block was applied. It is
+ * updated from the exact deltas applied by le_update(), so nodes with
+ * equal ledgers report equal commitments, for every block.
+ * @param bnum Block number of ledger state
+ * @param lstate Pointer to place ledger state commitment
+ * @return (int) value representing the result
+ * @retval VERROR if the commitment of bnum is not known
+ * @retval VEOK on success
+ */
+int le_lstate(const word8 *bnum, word8 *lstate)
+{
+   unsigned j;
+   int ecode;
+
+   ecode = VERROR;
+   mutex_lock(&Lesnaplock);
+   /* bnum MUST NOT be beyond the current ledger version */
+   if (Lesnap && cmp64(bnum, Lesnap->bnum) <= 0) {
+      /* latest commitment at, or before, bnum */
+      for (j = Lestatelen; j > 0; j--) {
+         if (cmp64(Lestate[j - 1].bnum, bnum) <= 0) {
+            memcpy(lstate, Lestate[j - 1].lstate, HASHLEN);
+            ecode = VEOK;
+            break;
+         }
       }
-      cond = memcmp(addr, le->addr, len);
-      if(cond == 0) return 1;  /* found target addr */
-      if(cond < 0) hi = mid - 1; else low = mid + 1;
-   }  /* end while */
+   }
+   mutex_unlock(&Lesnaplock);
+
+   return ecode;
+}  /* end le_lstate() */
+
+/**
+ * Binary search for many ledger addresses in one pass. Addresses in
+ * le[].addr MUST be sorted in ascending order; each search begins where
+ * the previous ended. An address with a zero hash is searched by tag
+ * only. Found entries are filled with ledger entry data, else balance
+ * is set to zero. Ledger must have been opened with le_open().
+ * @param le Pointer to array of ledger entries with addresses to search
+ * @param count Number of ledger entries in array
+ * @return (size_t) number of addresses found
+ * @exception errno=EMCM_LECLOSED if ledger is not open
+ * @exception errno=EINVAL if le is NULL
+*/
+size_t le_findv(LENTRY *le, size_t count)
+{
+   static const word8 zeros[ADDR_HASH_LEN];
+   LESNAP *snap;
+   long long low;
+   size_t j, found;
+   word16 len;
+
+   if (le == NULL) {
+      set_errno(EINVAL);
+      return 0;
+   }
+   /* ledger must be open */
+   snap = le_acquire();
+   if (snap == NULL) {
+      set_errno(EMCM_LECLOSED);
+      return 0;
+   }
 
-   /* indicate successful operation in the absence of a result */
    set_errno(0);
+   mutex_lock(&(snap->lock));
+   for (low = 0, found = j = 0; j < count; j++) {
+      len = ADDR_LEN;
+      if (memcmp(ADDR_HASH_PTR(le[j].addr), zeros, ADDR_HASH_LEN) == 0) {
+         len = ADDR_TAG_LEN;
+      }
+      memset(le[j].balance, 0, sizeof(le[j].balance));
+      /* search remaining ledger -- low is the previous insertion point */
+      if (le_snap_search(snap, le[j].addr, &le[j], len, &low)) found++;
+      else if (errno) break;
+   }  /* end for */
+   mutex_unlock(&(snap->lock));
+   le_release(snap);
 
-   return 0;  /* not found */
-}  /* end le_find() */
+   return found;
+}  /* end le_findv() */
+
+/**
+ * @private
+ * Binary search for the first ledger transaction in an overlay delta that
+ * compares greater than (or equal to, if eq is set) a ledger transaction.
+ * @param ovl Pointer to ledger overlay to search
+ * @param lt Pointer to ledger transaction to compare against
+ * @param eq Set non-zero to include equal ledger transactions
+ * @return (size_t) index of insertion point in delta
+*/
+static size_t le_ovl_bound(const LEOVL *ovl, const LTRAN *lt, int eq)
+{
+   size_t low, mid, hi;
+   int cond;
+
+   for (low = 0, hi = ovl->count; low < hi; ) {
+      mid = low + ((hi - low) / 2);
+      cond = lt_compare(&(ovl->delta[mid]), lt);
+      if (cond < 0 || (cond == 0 && !eq)) low = mid + 1;
+      else hi = mid;
+   }
+
+   return low;
+}  /* end le_ovl_bound() */
+
+/**
+ * @private
+ * Build the ledger entry of a tag, as le_update() would leave it after
+ * applying the overlay delta to the base ledger snapshot.
+ * @param ovl Pointer to ledger overlay
+ * @param tag Pointer to address tag of ledger entry
+ * @param le Pointer to place resulting ledger entry
+ * @return (int) value representing the result
+ * @retval VEBAD2 on invalid delta; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success; le->addr is zero if no entry exists
+*/
+static int le_ovl_entry(LEOVL *ovl, const word8 *tag, LENTRY *le)
+{
+   LTRAN key;
+   size_t idx;
+   int exists;
+
+   /* base ledger entry */
+   exists = le_snap_find(ovl->base, tag, le, ADDR_TAG_LEN);
+   if (!exists) {
+      if (errno) return VERROR;
+      memset(le, 0, sizeof(LENTRY));
+   }
+
+   /* apply delta of tag, in order -- as le_update() */
+   memset(&key, 0, sizeof(key));
+   memcpy(ADDR_TAG_PTR(key.addr), tag, ADDR_TAG_LEN);
+   idx = le_ovl_bound(ovl, &key, 1);
+   for ( ; idx < ovl->count; idx++) {
+      if (!addr_tag_equal(ovl->delta[idx].addr, tag)) break;
+      if (!exists) {
+         /* "brand new" address MUST begin with CREDIT ('A') code */
+         if (ovl->delta[idx].trancode[0] != 'A') {
+            set_errno(EMCM_LTCREDIT);
+            return VEBAD2;
+         }
+         addr_from_implicit(tag, le->addr);
+         exists = 1;
+      }
+      switch (ovl->delta[idx].trancode[0]) {
+         case 'H':
+            memcpy(ADDR_HASH_PTR(le->addr),
+               ADDR_HASH_PTR(ovl->delta[idx].addr), ADDR_HASH_LEN);
+            /* fallthrough */
+         case 'A':
+            if (add64(le->balance, ovl->delta[idx].amount, le->balance)) {
+               memset(le->balance, 0, sizeof(le->balance));
+            }
+            break;
+         case '-':
+            if (cmp64(le->balance, ovl->delta[idx].amount) != 0) {
+               set_errno(EMCM_LTDEBIT);
+               return VEBAD2;
+            }
+            memset(le->balance, 0, sizeof(le->balance));
+            break;
+         default:
+            set_errno(EMCM_LTCODE);
+            return VEBAD2;
+      }
+   }  /* end for */
+
+   return VEOK;
+}  /* end le_ovl_entry() */
+
+/**
+ * @private
+ * Merge two sorted arrays of ledger transactions. Merging is stable, with
+ * transactions of a placed before equal transactions of b.
+ * @param a Pointer to first sorted array
+ * @param na Number of ledger transactions in a
+ * @param b Pointer to second sorted array
+ * @param nb Number of ledger transactions in b
+ * @param out Pointer to place na + nb merged ledger transactions
+*/
+static void le_ovl_merge(const LTRAN *a, size_t na, const LTRAN *b,
+   size_t nb, LTRAN *out)
+{
+   while (na && nb) {
+      if (lt_compare(a, b) <= 0) {
+         memcpy(out++, a++, sizeof(LTRAN));
+         na--;
+      } else {
+         memcpy(out++, b++, sizeof(LTRAN));
+         nb--;
+      }
+   }
+   if (na) memcpy(out, a, na * sizeof(LTRAN));
+   if (nb) memcpy(out, b, nb * sizeof(LTRAN));
+}  /* end le_ovl_merge() */
+
+/**
+ * @private
+ * Stable (bottom-up merge) sort of ledger transactions, by tag+code.
+ * @param lt Pointer to ledger transactions to sort
+ * @param tmp Pointer to scratch space of count ledger transactions
+ * @param count Number of ledger transactions
+*/
+static void le_ovl_sort(LTRAN *lt, LTRAN *tmp, size_t count)
+{
+   LTRAN *src, *dst, *swap;
+   size_t width, lo, mid, hi;
+
+   src = lt;
+   dst = tmp;
+   for (width = 1; width < count; width *= 2) {
+      for (lo = 0; lo < count; lo = hi) {
+         mid = (count - lo > width) ? lo + width : count;
+         hi = (count - mid > width) ? mid + width : count;
+         le_ovl_merge(&src[lo], mid - lo, &src[mid], hi - mid, &dst[lo]);
+      }
+      swap = src;
+      src = dst;
+      dst = swap;
+   }
+   if (src != lt) memcpy(lt, src, count * sizeof(LTRAN));
+}  /* end le_ovl_sort() */
+
+/**
+ * Initialize a ledger overlay over the current ledger version.
+ * Ledger must have been opened with le_open().
+ * @param ovl Pointer to ledger overlay to initialize
+ * @return (int) value representing the result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ * @exception errno=EMCM_LECLOSED if ledger is not open
+ * @exception errno=EINVAL if ovl is NULL
+*/
+int le_ovl_init(LEOVL *ovl)
+{
+   if (ovl == NULL) {
+      set_errno(EINVAL);
+      return VERROR;
+   }
+
+   memset(ovl, 0, sizeof(LEOVL));
+   ovl->base = le_acquire();
+   if (ovl->base == NULL) {
+      set_errno(EMCM_LECLOSED);
+      return VERROR;
+   }
+
+   return VEOK;
+}  /* end le_ovl_init() */
+
+/**
+ * Add a ledger transaction to a ledger overlay. The transaction is kept
+ * only if the affected ledger entry remains valid, so an overlay never
+ * holds a delta that le_update() would reject. Transactions of equal
+ * address tag and code are applied in the order they were added.
+ * @note Each addition is an insert into the sorted delta. Use
+ * le_ovl_addv() to add the many ledger transactions of a block.
+ * @param ovl Pointer to ledger overlay
+ * @param lt Pointer to ledger transaction to add
+ * @return (int) value representing the result
+ * @retval VEBAD2 on rejected transaction; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ * @exception errno=EINVAL if ovl or lt is NULL
+ * @exception errno=EMCM_LECLOSED if ovl is not initialized
+*/
+int le_ovl_add(LEOVL *ovl, const LTRAN *lt)
+{
+   LENTRY le;
+   LTRAN *delta;
+   size_t idx, cap;
+   int ecode;
+
+   if (ovl == NULL || lt == NULL) {
+      set_errno(EINVAL);
+      return VERROR;
+   }
+   if (ovl->base == NULL) {
+      set_errno(EMCM_LECLOSED);
+      return VERROR;
+   }
+
+   /* grow delta as required */
+   if (ovl->count == ovl->cap) {
+      cap = ovl->cap ? ovl->cap * 2 : 64;
+      delta = realloc(ovl->delta, cap * sizeof(LTRAN));
+      if (delta == NULL) return VERROR;
+      ovl->delta = delta;
+      ovl->cap = cap;
+   }
+
+   /* insert after equal transactions, then check resulting entry */
+   idx = le_ovl_bound(ovl, lt, 0);
+   memmove(&(ovl->delta[idx + 1]), &(ovl->delta[idx]),
+      (ovl->count - idx) * sizeof(LTRAN));
+   memcpy(&(ovl->delta[idx]), lt, sizeof(LTRAN));
+   ovl->count++;
+   ecode = le_ovl_entry(ovl, ADDR_TAG_PTR(lt->addr), &le);
+   if (ecode != VEOK) {
+      /* undo insert */
+      ovl->count--;
+      memmove(&(ovl->delta[idx]), &(ovl->delta[idx + 1]),
+         (ovl->count - idx) * sizeof(LTRAN));
+   }
+
+   return ecode;
+}  /* end le_ovl_add() */
+
+/**
+ * Add an array of ledger transactions to a ledger overlay, as if by
+ * le_ovl_add() in array order, but with a single sort and merge into the
+ * delta. Every ledger entry affected is checked once, afterwards, and
+ * the array is kept only if all remain valid, else the delta is left
+ * unchanged.
+ * @param ovl Pointer to ledger overlay
+ * @param lt Pointer to array of ledger transactions to add
+ * @param count Number of ledger transactions in array
+ * @return (int) value representing the result
+ * @retval VEBAD2 on rejected transactions; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ * @exception errno=EINVAL if ovl or lt is NULL
+ * @exception errno=EMCM_LECLOSED if ovl is not initialized
+*/
+int le_ovl_addv(LEOVL *ovl, const LTRAN *lt, size_t count)
+{
+   LENTRY le;
+   LTRAN *sorted, *delta, *prev;
+   size_t j, prevcount;
+   int ecode;
+
+   if (ovl == NULL || (lt == NULL && count)) {
+      set_errno(EINVAL);
+      return VERROR;
+   }
+   if (ovl->base == NULL) {
+      set_errno(EMCM_LECLOSED);
+      return VERROR;
+   }
+   if (count == 0) return VEOK;
+
+   /* sort a copy of the array, then merge after the (older) delta */
+   sorted = malloc(count * sizeof(LTRAN));
+   delta = malloc((ovl->count + count) * sizeof(LTRAN));
+   if (sorted == NULL || delta == NULL) {
+      if (sorted) free(sorted);
+      if (delta) free(delta);
+      return VERROR;
+   }
+   memcpy(sorted, lt, count * sizeof(LTRAN));
+   le_ovl_sort(sorted, delta, count);
+   le_ovl_merge(ovl->delta, ovl->count, sorted, count, delta);
+
+   /* check each ledger entry affected, against the merged delta */
+   prev = ovl->delta;
+   prevcount = ovl->count;
+   ovl->delta = delta;
+   ovl->count += count;
+   for (ecode = VEOK, j = 0; ecode == VEOK && j < count; j++) {
+      if (j > 0 && addr_tag_equal(sorted[j].addr, sorted[j - 1].addr)) {
+         continue;
+      }
+      ecode = le_ovl_entry(ovl, ADDR_TAG_PTR(sorted[j].addr), &le);
+   }
+   free(sorted);
+   if (ecode != VEOK) {
+      /* restore delta */
+      free(delta);
+      ovl->delta = prev;
+      ovl->count = prevcount;
+      return ecode;
+   }
+   if (prev) free(prev);
+   ovl->cap = ovl->count;
+
+   return VEOK;
+}  /* end le_ovl_addv() */
+
+/**
+ * Search for ledger address through a ledger overlay. If found, le is
+ * filled with ledger entry data as it would be after le_ovl_commit().
+ * Lookups are by address tag, so len MUST cover at least the tag.
+ * @param ovl Pointer to ledger overlay
+ * @param addr Address data to search for
+ * @param le Pointer to place found ledger entry
+ * @param len Length of address data to search
+ * @return (int) value representing found result
+ * @retval 0 on not found; check errno for details
+ * @retval 1 on found; check le pointer for ledger data
+ * @exception errno=EMCM_LECLOSED if ovl is not initialized
+ * @exception errno=EINVAL if ovl, addr or le is NULL, or len is short
+ * @exception errno=0 if address is not found
+*/
+int le_ovl_find(LEOVL *ovl, const word8 *addr, LENTRY *le, word16 len)
+{
+   LENTRY lentry;
+
+   if (ovl == NULL || addr == NULL || le == NULL || len < ADDR_TAG_LEN) {
+      set_errno(EINVAL);
+      return 0;
+   }
+   if (ovl->base == NULL) {
+      set_errno(EMCM_LECLOSED);
+      return 0;
+   }
+
+   /* clamp search length to ledger address length */
+   if (len > ADDR_LEN) len = ADDR_LEN;
+
+   if (le_ovl_entry(ovl, ADDR_TAG_PTR(addr), &lentry) != VEOK) return 0;
+   /* address may differ beyond tag, or not exist at all */
+   if (iszero(lentry.addr, ADDR_LEN) || memcmp(addr, lentry.addr, len)) {
+      set_errno(0);
+      return 0;
+   }
+   memcpy(le, &lentry, sizeof(LENTRY));
+
+   return 1;
+}  /* end le_ovl_find() */
+
+/**
+ * Commit a ledger overlay to the ledger with le_update(), via a ledger
+ * transaction file, and discard the overlay on success. Fails without touching
+ * the ledger if the overlay base is no longer the current ledger version.
+ * @param ovl Pointer to ledger overlay
+ * @param ltfname Filename of the Ledger transaction file to write
+ * @return (int) value representing the commit result
+ * @retval VEBAD2 on malicious; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ * @exception errno=EINVAL if ovl or ltfname is NULL
+ * @exception errno=EMCM_LESTALE if ledger was updated since le_ovl_init()
+*/
+int le_ovl_commit(LEOVL *ovl, const char *ltfname)
+{
+   FILE *fp;
+   LESNAP *snap;
+   int ecode;
+
+   if (ovl == NULL || ltfname == NULL) {
+      set_errno(EINVAL);
+      return VERROR;
+   }
+
+   /* overlay MUST apply to the current ledger version */
+   snap = le_acquire();
+   le_release(snap);
+   if (ovl->base == NULL || snap != ovl->base) {
+      set_errno(EMCM_LESTALE);
+      return VERROR;
+   }
+
+   /* nothing to commit */
+   if (ovl->count == 0) {
+      le_ovl_discard(ovl);
+      return VEOK;
+   }
+
+   /* write delta as (sorted) ledger transaction file */
+   fp = fopen(ltfname, "wb");
+   if (fp == NULL) return VERROR;
+   if (fwrite(ovl->delta, sizeof(LTRAN), ovl->count, fp) != ovl->count) {
+      fclose(fp);
+      remove(ltfname);
+      return VERROR;
+   }
+   fclose(fp);
+
+   ecode = le_update(ltfname);
+   if (ecode == VEOK) le_ovl_discard(ovl);
+
+   return ecode;
+}  /* end le_ovl_commit() */
+
+/**
+ * Discard a ledger overlay, freeing its delta and releasing its base
+ * ledger snapshot. The ledger is not modified.
+ * @param ovl Pointer to ledger overlay
+*/
+void le_ovl_discard(LEOVL *ovl)
+{
+   if (ovl == NULL) return;
+   if (ovl->delta) free(ovl->delta);
+   le_release(ovl->base);
+   memset(ovl, 0, sizeof(LEOVL));
+}  /* end le_ovl_discard() */
 
 /**
  * Extract a ledger from a LEGACY neogenesis block. Checks sort.
@@ -464,7 +1410,10 @@ ERROR_CLEANUP:
 }  /* end le_extract_legacy() */
 
 /**
- * Extract a ledger from a neo-genesis block. Checks sort.
+ * Extract a ledger from a neo-genesis block. Checks sort. The ledger is
+ * written to a temporary file, which replaces the ledger file only on
+ * success. The leaf-hash sidecar of the neo-genesis block, if valid, is
+ * carried over.
  * @param ngfile Filename of the neo-genesis block
  * @param lefile Filename of the ledger
  * @return (int) value representing extraction result
@@ -477,10 +1426,15 @@ int le_extract(const char *ngfile, const char *lefile)
    NGHEADER ngh;           /* buffer for neo-genesis header */
    FILE *fp = NULL;        /* block FILE pointer*/
    FILE *lfp = NULL;       /* ledger FILE pointer */
+   FILE *lhfp;             /* leaf-hash sidecar FILE pointer */
+   char lhfile[FILENAME_MAX];
+   char lename[FILENAME_MAX];
    long long llen, lbytes;
    size_t j, lcount;
    word8 prev[ADDR_LEN];   /* ledger address sort check */
 
+   snprintf(lename, sizeof(lename), "%s.tmp", lefile);
+
    /* open neogensis file */
    fp = fopen(ngfile, "rb");
    if (fp == NULL) return VERROR;
@@ -502,8 +1456,8 @@ int le_extract(const char *ngfile, const char *lefile)
       goto ERROR_CLEANUP;
    }
 
-   /* open output ledger file */
-   lfp = fopen(lefile, "wb");
+   /* open temporary output ledger file */
+   lfp = fopen(lename, "wb");
    if (lfp == NULL) {
       fclose(fp);
       return VERROR;
@@ -524,8 +1478,24 @@ int le_extract(const char *ngfile, const char *lefile)
       /* write hashed ledger entries to ledger file */
       if (fwrite(&le, sizeof(LENTRY), 1, lfp) != 1) goto ERROR_CLEANUP;
    }  /* end for() */
-   fclose(lfp);
    fclose(fp);
+   fp = NULL;
+   if (fclose(lfp) != 0) {
+      lfp = NULL;
+      goto ERROR_CLEANUP;
+   }
+   lfp = NULL;
+
+   /* replace ledger file -- invalidates leaf-hash sidecar */
+   remove(le_lhname(lefile, lhfile));
+   if (rename(lename, lefile) != 0) goto ERROR_CLEANUP;
+
+   /* carry over leaf-hash sidecar of neogenesis file, if valid */
+   lhfp = le_lhopen(ngfile, sizeof(NGHEADER), lcount);
+   if (lhfp != NULL) {
+      le_lhcopy(lhfp, lefile, lcount);
+      fclose(lhfp);
+   }
 
    /* ledger extracted */
    return VEOK;
@@ -538,6 +1508,7 @@ RDERR_CLEANUP:
 ERROR_CLEANUP:
    if (lfp) fclose(lfp);
    if (fp) fclose(fp);
+   remove(lename);
 
    return VERROR;
 }  /* end le_extract() */
@@ -558,7 +1529,9 @@ void print_n_bytes(const char *msg, const void *data, size_t len)
  * Update the ledger by applying deltas from a ledger transaction file.
  * Ledger transaction file is sorted by addr+code, '-' comes before 'A'.
  * Ledger file is kept sorted on addr. Ledger file must have been opened
- * with le_open().
+ * with le_open(). The updated ledger is published as a new ledger
+ * version; snapshots of the previous version remain readable until
+ * released.
  * @param ltfname Filename of the Ledger transaction (deltas) file
  * @return (int) value representing the update result
  * @retval VEBAD2 on malicious; check errno for details
@@ -571,7 +1544,15 @@ int le_update(const char *ltfname)
    LENTRY le, le_prev;     /* for ledger entry and sequence check data */
    LTRAN lt, lt_prev;      /* for ledger tran and sequence check data */
    FILE *fp, *lefp, *ltfp; /* output, ledger, and ltran file pointers */
-   word8 hold, empty;
+   FILE *lhfp, *lhout;     /* leaf-hash sidecar input, output pointers */
+   SHA256_CTX lhctx;       /* digest of leaf-hash sidecar output */
+   char lhfile[FILENAME_MAX], lhupdate[FILENAME_MAX];
+   word8 lh[HASHLEN], lh_hold[HASHLEN];   /* leaf hash of ledger entry */
+   word8 lstate[HASHLEN];  /* ledger state commitment */
+   word8 bnum[8];          /* block number of updated ledger */
+   word8 hold, empty, touched, fresh, known;
+   LESNAP *snap;
+   long long offset;
    int compare, ecode;
 
    /* sort the ledger transaction file */
@@ -579,17 +1560,34 @@ int le_update(const char *ltfname)
    if (ecode != 0) return VERROR;
 
    /* init for error handling */
-   fp = lefp = ltfp = NULL;
+   fp = lefp = ltfp = lhfp = lhout = NULL;
+   le_lhname("ledger.update", lhupdate);
+
+   /* ledger state commitment is updated with deltas, where known */
+   snap = le_acquire();
+   known = (snap != NULL);
+   if (known) memcpy(lstate, snap->lstate, HASHLEN);
+   le_release(snap);
 
    /* open and read ledger */
    lefp = fopen(Lefile, "rb");
    if (lefp == NULL) goto ERROR_CLEANUP;
-   if (fseek64(lefp, 0LL, SEEK_SET) != 0) return VERROR;
+   if (fseek64(lefp, 0LL, SEEK_END) != 0) goto ERROR_CLEANUP;
+   offset = ftell64(lefp);
+   if (offset == (-1)) goto ERROR_CLEANUP;
+   if (fseek64(lefp, 0LL, SEEK_SET) != 0) goto ERROR_CLEANUP;
    if (fread(&le, sizeof(LENTRY), 1, lefp) != 1) {
-      if (ferror(lefp)) return VERROR;
+      if (ferror(lefp)) goto ERROR_CLEANUP;
       /* allow empty ledger file */
       fclose(lefp);
       lefp = NULL;
+   } else {
+      /* leaf hashes of unchanged entries are carried over, if valid */
+      lhfp = le_lhopen(Lefile, 0LL, (size_t) offset / sizeof(LENTRY));
+      if (lhfp && fread(lh, HASHLEN, 1, lhfp) != 1) {
+         fclose(lhfp);
+         lhfp = NULL;
+      }
    }
    /* open and read initial ledger transaction */
    ltfp = fopen(ltfname, "rb");
@@ -602,8 +1600,12 @@ int le_update(const char *ltfname)
    /* generate temporary filename and open as new ledger */
    fp = fopen("ledger.update", "wb");
    if (fp == NULL) goto ERROR_CLEANUP;
+   /* ... and leaf-hash sidecar (optional) */
+   lhout = fopen(lhupdate, "wb");
+   sha256_init(&lhctx);
 
    /* iterate through files while either files are NOT EOF */
+   touched = fresh = 0;
    for (hold = 0, empty = 1; lefp != NULL || ltfp != NULL; ) {
 
       /* check ledger transaction file is open for processing */
@@ -623,18 +1625,26 @@ int le_update(const char *ltfname)
             /* hold ledger entry while associated file is open */
             if (lefp != NULL) {
                memcpy(&le_hold, &le, sizeof(LENTRY));
+               memcpy(lh_hold, lh, HASHLEN);
                hold = 1;
             }
             /* clear ledger entry data */
             memset(&le, 0, sizeof(LENTRY));
             /* convert address from implicit tag */
             addr_from_implicit(ADDR_TAG_PTR(lt.addr), le.addr);
+            fresh = 1;
             /* set compare for ledger transaction processing */
             compare = 0;
          }  /* end if (compare > 0 || lefp == NULL) */
 
          /* while ledger entry compares EQUAL TO ledger transaction... */
          while (compare == 0) {
+            /* remove existing ledger entry from ledger state */
+            if (!touched && !fresh) {
+               if (lhfp == NULL) sha256(&le, sizeof(LENTRY), lh);
+               lstate_update(lstate, lh, 1);
+            }
+            touched = 1;
             /* apply ledger transaction */
             switch (lt.trancode[0]) {
                case 'H':
@@ -688,6 +1698,21 @@ int le_update(const char *ltfname)
       if (compare < 0 || ltfp == NULL) {
          /* write ledger entry to output */
          if (fwrite(&le, sizeof(LENTRY), 1, fp) != 1) goto ERROR_CLEANUP;
+         /* write leaf hash -- rehash touched entries only */
+         if (touched || (lhout != NULL && lhfp == NULL)) {
+            sha256(&le, sizeof(LENTRY), lh);
+         }
+         /* add touched ledger entry to ledger state */
+         if (touched) lstate_update(lstate, lh, 0);
+         if (lhout != NULL) {
+            sha256_update(&lhctx, lh, HASHLEN);
+            if (fwrite(lh, HASHLEN, 1, lhout) != 1) {
+               fclose(lhout);
+               lhout = NULL;
+               remove(lhupdate);
+            }
+         }
+         touched = fresh = 0;
          /* flag output not empty */
          empty = 0;
          /* if ledger entry file open... */
@@ -695,6 +1720,7 @@ int le_update(const char *ltfname)
             /* copy ledger hold to ledger entry, OR... */
             if (hold) {
                memcpy(&le, &le_hold, sizeof(LENTRY));
+               memcpy(lh, lh_hold, HASHLEN);
                hold = 0;
                continue;
             }
@@ -707,6 +1733,11 @@ int le_update(const char *ltfname)
                lefp = NULL;
                continue;
             }
+            /* ... and its leaf hash */
+            if (lhfp && fread(lh, HASHLEN, 1, lhfp) != 1) {
+               fclose(lhfp);
+               lhfp = NULL;
+            }
             /* check sort -- MUST BE ascending, NO duplicates */
             if (addr_compare(le_prev.addr, le.addr) >= 0) {
                set_errno(EMCM_LESORT);
@@ -717,20 +1748,40 @@ int le_update(const char *ltfname)
    }  /* end while () */
    /* cleanup -- lefp, ltfp already closed */
    fclose(fp);
+   fp = NULL;
+   if (lhfp) fclose(lhfp);
+   lhfp = NULL;
+   /* append digest of leaf hashes, bound to the ledger, to sidecar */
+   if (lhout) {
+      ecode = le_lhbind(&lhctx, "ledger.update");
+      sha256_final(&lhctx, lh);
+      if (ecode != VEOK || fwrite(lh, HASHLEN, 1, lhout) != 1) {
+         fclose(lhout);
+         lhout = NULL;
+         remove(lhupdate);
+      } else fclose(lhout);
+   }
 
    /* empty ledger check */
    if (empty) {
       set_errno(EMCM_LEEMPTY);
+      remove(lhupdate);
       return VERROR;
    }
 
-   /* close / replace ledger */
-   le_close();
+   /* replace ledger file -- readers hold the previous version open;
+    * the old sidecar goes first, so no sidecar can outlive its ledger */
+   remove(le_lhname(Lefile, lhfile));
    remove(Lefile);
-   if (rename("ledger.update", Lefile) != 0) return VERROR;
+   if (rename("ledger.update", Lefile) != 0) {
+      remove(lhupdate);
+      return VERROR;
+   }
+   if (lhout && rename(lhupdate, lhfile) != 0) remove(lhupdate);
 
-   /* return result of reopen ledger */
-   return le_open(Lefile);
+   /* publish new ledger version (for the block being applied) */
+   add64(Cblocknum, One, bnum);
+   return le_load(Lefile, bnum, known ? lstate : NULL);
 
    /* cleanup / error handling */
 ERROR_CLEANUP:
@@ -741,6 +1792,11 @@ DROP_CLEANUP:
 CLEANUP:
    if (lefp) fclose(lefp);
    if (ltfp) fclose(ltfp);
+   if (lhfp) fclose(lhfp);
+   if (lhout) {
+      fclose(lhout);
+      remove(lhupdate);
+   }
    if (fp) {
       fclose(fp);
       remove("ledger.update");
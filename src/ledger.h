@@ -12,6 +12,8 @@
 
 #define _FILE_OFFSET_BITS  64 /* for 64-bit off_t stdio */
 #include "types.h"
+#include "extthrd.h"
+#include <stdio.h>
 
 #ifndef LEBUFSZ
    /**
@@ -21,6 +23,51 @@
    #define LEBUFSZ ( 1 << 26 ) /* 64M */
 #endif
 
+/**
+ * Ledger snapshot. A refcounted, read-only version of the ledger file.
+ * Acquire with le_acquire() and release with le_release().
+*/
+typedef struct LESNAP {
+   FILE *fp;               /**< ledger file of this version */
+   long long count;        /**< number of ledger entries */
+   word8 bnum[8];          /**< block number the ledger reflects */
+   word32 version;         /**< ledger version, incremented per publish */
+   word8 lstate[HASHLEN];  /**< ledger state commitment, see le_lstate() */
+   unsigned refs;          /**< references, including one while current */
+   Mutex lock;             /**< serializes seek/read on fp */
+   struct LESNAP *next;    /**< next retired version */
+} LESNAP;
+
+/**
+ * Ledger overlay. A sorted delta of ledger transactions layered over a
+ * ledger snapshot, without touching the ledger file. Initialize with
+ * le_ovl_init(), then le_ovl_commit() or le_ovl_discard().
+*/
+typedef struct {
+   LESNAP *base;           /**< ledger snapshot the delta applies to */
+   LTRAN *delta;           /**< ledger transactions, sorted by tag+code */
+   size_t count;           /**< number of ledger transactions in delta */
+   size_t cap;             /**< allocated ledger transactions in delta */
+} LEOVL;
+
+#ifndef LESTATELEN
+   /**
+    * Number of per-block ledger state commitments kept by le_lstate().
+   */
+   #define LESTATELEN   256
+#endif
+
+#ifndef LEHASH_EXT
+   /**
+    * Filename extension of the leaf-hash sidecar of a ledger file. The
+    * sidecar holds the sha256() of each LENTRY, in ledger order, followed
+    * by a digest, the sha256() of all leaf hashes, and is maintained by
+    * le_update() and le_extract(). Any other writer of a ledger file MUST
+    * move or remove its sidecar alongside.
+   */
+   #define LEHASH_EXT ".lh"
+#endif
+
 /* global variables */
 extern word32 Sanctuary;
 extern word32 Lastday;
@@ -38,11 +85,25 @@ void addr_from_wots(const void *wots, void *addr);
 int addr_tag_compare(const void *a, const void *b);
 int addr_tag_equal(const void *a, const void *b);
 int addr_tag_readfile(void *tag, const char *filename);
+char *le_lhname(const char *fname, char *lhfile);
+FILE *le_lhopen(const char *fname, long long offset, size_t count);
+int le_lhwrite(const char *fname, const word8 *hashes, size_t count);
 int le_open(const char *lefile);
 void le_close(void);
+LESNAP *le_acquire(void);
+void le_release(LESNAP *snap);
+int le_snap_find(LESNAP *snap, const word8 *addr, LENTRY *le, word16 len);
 int le_extract_legacy(const char *ngfile);
 int le_extract(const char *ngfile, const char *lefile);
 int le_find(const word8 *addr, LENTRY *le, word16 len);
+int le_lstate(const word8 *bnum, word8 *lstate);
+size_t le_findv(LENTRY *le, size_t count);
+int le_ovl_init(LEOVL *ovl);
+int le_ovl_add(LEOVL *ovl, const LTRAN *lt);
+int le_ovl_addv(LEOVL *ovl, const LTRAN *lt, size_t count);
+int le_ovl_find(LEOVL *ovl, const word8 *addr, LENTRY *le, word16 len);
+int le_ovl_commit(LEOVL *ovl, const char *ltfname);
+void le_ovl_discard(LEOVL *ovl);
 int le_renew(void);
 int le_update(const char *ltfname);
 int tag_compare(const void *a, const void *b);
@@ -0,0 +1,325 @@
+/**
+ * @private
+ * @headerfile local.h <local.h>
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+#ifndef MOCHIMO_LOCAL_C
+#define MOCHIMO_LOCAL_C  /* include guard */
+
+
+#include "local.h"
+
+/* internal support */
+#include "error.h"
+#include "global.h"
+#include "tx.h"
+
+/* external support */
+#include <string.h>
+#include <poll.h>         /* for poll() */
+#include <sys/ioctl.h>    /* for ioctl() */
+#include <sys/stat.h>     /* for chmod(), lstat() */
+#include <sys/un.h>       /* for struct sockaddr_un */
+#ifdef __linux__
+   #include <linux/sockios.h>   /* for SIOCOUTQ */
+#endif
+#include "extlib.h"
+#include "extinet.h"
+
+/* local session, with a (partial) request packet */
+typedef struct {
+   NODE node;        /* session node; request packet is assembled in tx */
+   size_t len;       /* bytes of (partial) request packet received */
+   time_t stamp;     /* time of last progress on a partial request */
+} LOCALSESSION;
+
+/* local socket path, listening socket and sessions */
+static char Localpath[sizeof(((struct sockaddr_un *) 0)->sun_path)];
+static SOCKET Localsd = INVALID_SOCKET;
+static LOCALSESSION Localsession[LOCALMAX];
+
+/**
+ * @private
+ * Close a local session and release its slot.
+ * @param sp Pointer to LOCALSESSION
+*/
+static void local__drop(LOCALSESSION *sp)
+{
+   pdebug("%s closed", sp->node.id);
+   sock_close(sp->node.sd);
+   sp->node.sd = INVALID_SOCKET;
+}  /* end local__drop() */
+
+/**
+ * @private
+ * Check a local session has room in its socket send buffer for a reply.
+ * Every request is answered with a single packet, so a reply that fits
+ * is sent without waiting on the client. Queued bytes are taken from
+ * SIOCOUTQ (Linux), SO_NWRITE (Apple) or FIONWRITE (BSD); elsewhere,
+ * a writable socket is taken to have room, at best effort.
+ * @param sp Pointer to LOCALSESSION
+ * @return (int) 1 if a reply packet fits, else 0
+*/
+static int local__room(LOCALSESSION *sp)
+{
+   socklen_t optlen;
+   int queued, sndbuf;
+
+   optlen = sizeof(sndbuf);
+   if (getsockopt(sp->node.sd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen)) {
+      return 0;
+   }
+#if defined(SIOCOUTQ)
+   if (ioctl(sp->node.sd, SIOCOUTQ, &queued) != 0) return 0;
+#elif defined(SO_NWRITE)
+   optlen = sizeof(queued);
+   if (getsockopt(sp->node.sd, SOL_SOCKET, SO_NWRITE, &queued, &optlen)) {
+      return 0;
+   }
+#elif defined(FIONWRITE)
+   if (ioctl(sp->node.sd, FIONWRITE, &queued) != 0) return 0;
+#else
+   {
+      struct pollfd pfd = { .fd = sp->node.sd, .events = POLLOUT };
+
+      if (poll(&pfd, 1, 0) != 1 || !(pfd.revents & POLLOUT)) return 0;
+      queued = 0;
+   }
+#endif
+
+   return (size_t) sndbuf >= (size_t) queued + (2 * sizeof(TX));
+}  /* end local__room() */
+
+/**
+ * @private
+ * Receive (the remainder of) a request packet on a local session,
+ * without waiting. A partial packet is kept in the session.
+ * @param sp Pointer to LOCALSESSION
+ * @return (int) value representing receive result
+ * @retval VEWAITING when the request packet is incomplete
+ * @retval VEBAD on a bad packet
+ * @retval VERROR on end of session, or socket error
+ * @retval VEOK when a request packet is received
+*/
+static int local__recv(LOCALSESSION *sp)
+{
+   word8 *pkt;
+   size_t len;
+   int count;
+
+   pkt = (word8 *) &(sp->node.tx);
+   /* header first, then packet data and trailer, as implied by header */
+   len = TXHDRLEN;
+   if (sp->len >= TXHDRLEN) len += get16(sp->node.tx.len) + TXTLRLEN;
+   while (sp->len < len) {
+      count = (int) recv(sp->node.sd, pkt + sp->len, len - sp->len, 0);
+      if (count < 0 && sock_waiting(sock_errno)) return VEWAITING;
+      if (count <= 0) return VERROR;
+      if (sp->len == 0) time(&(sp->stamp));
+      sp->len += (size_t) count;
+      if (sp->len == TXHDRLEN) len += get16(sp->node.tx.len) + TXTLRLEN;
+   }
+   sp->len = 0;
+
+   return recv_tx_check(&(sp->node));
+}  /* end local__recv() */
+
+/**
+ * @private
+ * Serve a single request received on a local session.
+ * Replies are sent in request order; a failed request is answered with
+ * OP_NACK and does not end the session.
+ * @param np Pointer to NODE of local session, containing the request
+ * @return (int) value representing operation result
+ * @retval VERROR on error sending reply; check errno for details
+ * @retval VEOK on success
+*/
+static int local__request(NODE *np)
+{
+   TX *tx;
+   int opcode;
+
+   tx = &np->tx;
+   opcode = get16(tx->opcode);
+   pdebug("%s got opcode = %d", np->id, opcode);
+
+   switch (opcode) {
+      case OP_HELLO: {
+         /* optional handshake assigns the IDs of the session */
+         np->id1 = get16(tx->id1);
+         np->id2 = rand16();
+         snprintf(np->id, sizeof(np->id), "local %.02x~%.02x",
+            np->id1, np->id2);
+         put16(tx->len, 0);
+         return send_op(np, OP_HELLO_ACK);
+      }
+      case OP_TX: {
+         Nlogins++;  /* raw TX in */
+         if (process_tx(np) != VEOK) break;
+         /* acknowledge accepted transaction */
+         put16(tx->len, 0);
+         return send_op(np, OP_TX);
+      }
+      case OP_BALANCE: {
+         if (send_balance(np) != 0) return VERROR;
+         /* send_balance() is silent on unknown addresses */
+         if (get16(tx->opcode) != OP_BALANCE) return VEOK;
+         put16(tx->len, 0);
+         return send_op(np, OP_SEND_BAL);
+      }
+      case OP_BALANCE_BATCH: {
+         if (!(Cbits & C_BATCH)) {
+            set_errno(EMCM_OPCODE);
+            break;
+         }
+         return send_balance_batch(np) ? VERROR : VEOK;
+      }
+      case OP_HASH: if (send_hash(np) == VEOK) return VEOK; break;
+      case OP_IDENTIFY: return send_identify(np);
+      case OP_GET_IPL: return send_ipl(np);
+      default: set_errno(EMCM_OPCODE);
+   }  /* end switch (opcode) */
+
+   /* request failed, keep session */
+   return send_nack(np, errno);
+}  /* end local__request() */
+
+/**
+ * Open the local interface at a UNIX domain socket path. An existing
+ * socket file at path is replaced; any other existing file is left
+ * alone, and the interface is not opened. Access to the local interface is
+ * restricted to the owner and group of the socket file (mode 0660).
+ * @param path Filesystem path of the UNIX domain socket
+ * @return (int) value representing operation result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+*/
+int local_init(const char *path)
+{
+   struct sockaddr_un addr;
+   struct stat st;
+   int j;
+
+   if (path == NULL || strlen(path) >= sizeof(addr.sun_path)) {
+      set_errno(EINVAL);
+      return VERROR;
+   }
+   for (j = 0; j < LOCALMAX; j++) Localsession[j].node.sd = INVALID_SOCKET;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   Localsd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (Localsd == INVALID_SOCKET) return VERROR;
+   /* replace stale socket file (only), and restrict access before listen() */
+   if (lstat(path, &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) {
+         set_errno(EEXIST);
+         goto FAIL;
+      }
+      remove(path);
+   }
+   if (bind(Localsd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+      goto FAIL;
+   }
+   strcpy(Localpath, path);
+   if (chmod(path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP) != 0) goto FAIL;
+   if (sock_set_nonblock(Localsd) == SOCKET_ERROR) goto FAIL;
+   if (listen(Localsd, LOCALMAX) != 0) goto FAIL;
+
+   plog("Local interface at %s", path);
+   return VEOK;
+
+FAIL:
+   local_close();
+   return VERROR;
+}  /* end local_init() */
+
+/**
+ * Service the local interface. Accepts new local sessions and serves up
+ * to LOCALPIPE waiting requests of each session, without waiting on any
+ * session. Partial requests are kept until complete; requests are left
+ * waiting while a session's client does not read its replies. Sessions
+ * that end, send a bad packet, stall a partial request for STD_TIMEOUT
+ * seconds, or fail to send a reply, are closed.
+ * Called from the server loop.
+ * @return (int) number of requests served
+*/
+int local_service(void)
+{
+   LOCALSESSION *sp;
+   SOCKET sd;
+   int j, n, served;
+
+   if (Localsd == INVALID_SOCKET) return 0;
+
+   /* accept new sessions, while there is a free slot */
+   for (j = 0; j < LOCALMAX; j++) {
+      sp = &Localsession[j];
+      if (sp->node.sd != INVALID_SOCKET) continue;
+      sd = accept(Localsd, NULL, NULL);
+      if (sd == INVALID_SOCKET) break;
+      if (sock_set_nonblock(sd) == SOCKET_ERROR) {
+         sock_close(sd);
+         break;
+      }
+      memset(sp, 0, sizeof(LOCALSESSION));
+      sp->node.sd = sd;
+      snprintf(sp->node.id, sizeof(sp->node.id), "local %.02x~%.02x", 0, 0);
+      pdebug("%s connected...", sp->node.id);
+   }
+
+   /* serve pipelined requests of each session */
+   for (served = j = 0; j < LOCALMAX; j++) {
+      sp = &Localsession[j];
+      for (n = 0; sp->node.sd != INVALID_SOCKET && n < LOCALPIPE; n++) {
+         if (!local__room(sp)) break;
+         switch (local__recv(sp)) {
+            case VEWAITING: n = LOCALPIPE; continue;
+            case VEOK: break;
+            default: local__drop(sp); continue;
+         }
+         if (local__request(&(sp->node)) != VEOK) {
+            local__drop(sp);
+            continue;
+         }
+         served++;
+      }
+      /* partial requests are completed within STD_TIMEOUT */
+      if (sp->node.sd != INVALID_SOCKET && sp->len &&
+            difftime(time(NULL), sp->stamp) >= STD_TIMEOUT) {
+         local__drop(sp);
+      }
+   }
+
+   return served;
+}  /* end local_service() */
+
+/**
+ * Close the local interface, all local sessions, and remove the socket
+ * file from the filesystem.
+*/
+void local_close(void)
+{
+   int j;
+
+   if (Localsd != INVALID_SOCKET) {
+      for (j = 0; j < LOCALMAX; j++) {
+         if (Localsession[j].node.sd != INVALID_SOCKET) {
+            local__drop(&Localsession[j]);
+         }
+      }
+      sock_close(Localsd);
+      Localsd = INVALID_SOCKET;
+   }
+   if (*Localpath) {
+      remove(Localpath);
+      *Localpath = '\0';
+   }
+}  /* end local_close() */
+
+/* end include guard */
+#endif
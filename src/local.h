@@ -0,0 +1,54 @@
+/**
+ * @file local.h
+ * @brief Mochimo local (UNIX domain socket) interface support.
+ * @details Co-located services may submit transactions and query the node
+ * over a UNIX domain socket, rather than the public port. Local sessions
+ * use the same TX packet framing and opcodes as the network protocol, but:
+ * - access is controlled by filesystem permissions of the socket file
+ * - sessions are persistent, and the OP_HELLO handshake is optional
+ *   (without it, packet IDs of a session are zero)
+ * - requests may be pipelined; replies are sent in request order
+ * - requests are served by the server, without the pinklist, rate
+ *   limits or a child process per request, and without waiting on a
+ *   session (partial requests are buffered per session)
+ * <br/>Supported opcodes are OP_TX, OP_BALANCE, OP_BALANCE_BATCH,
+ * OP_HASH, OP_IDENTIFY and OP_GET_IPL. OP_TX is acknowledged with an
+ * empty OP_TX, OP_BALANCE of an unknown address is answered with an empty
+ * OP_SEND_BAL, and all other opcodes (or failures) are answered OP_NACK.
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+/* include guard */
+#ifndef MOCHIMO_LOCAL_H
+#define MOCHIMO_LOCAL_H
+
+
+/* mochimo support */
+#include "network.h"
+
+#ifndef LOCALMAX
+/** Maximum number of concurrent local sessions */
+#define LOCALMAX     16
+#endif
+
+#ifndef LOCALPIPE
+/** Maximum number of (pipelined) requests served per session, per pass */
+#define LOCALPIPE    32
+#endif
+
+/* C/C++ compatible function prototypes */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int local_init(const char *path);
+int local_service(void);
+void local_close(void);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+/* end include guard */
+#endif
@@ -0,0 +1,191 @@
+/**
+ * @private
+ * @headerfile lzc.h <lzc.h>
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+/* include guard */
+#ifndef MOCHIMO_LZC_C
+#define MOCHIMO_LZC_C
+
+
+#include "lzc.h"
+#include <string.h>
+
+#define LZC_HASHBITS    12    /* match finder hash table bits */
+#define LZC_MINMATCH    4     /* minimum match length */
+#define LZC_MAXOFFSET   0xffff
+
+/**
+ * @private
+ * Write a length extension. Returns pointer past the extension,
+ * or NULL if output is exhausted.
+*/
+static word8 *lzc_putlen(word8 *op, const word8 *oend, size_t len)
+{
+   for ( ; len >= 255; len -= 255) {
+      if (op >= oend) return NULL;
+      *op++ = 255;
+   }
+   if (op >= oend) return NULL;
+   *op++ = (word8) len;
+
+   return op;
+}  /* end lzc_putlen() */
+
+/**
+ * @private
+ * Write a sequence of literals and a match. A match length of zero
+ * writes the last sequence (literals only). Returns pointer past the
+ * sequence, or NULL if output is exhausted.
+*/
+static word8 *lzc_putseq(word8 *op, const word8 *oend, const word8 *lit,
+   size_t litlen, size_t offset, size_t mlen)
+{
+   word8 *token;
+
+   if (op >= oend) return NULL;
+   token = op++;
+   *token = (word8) ((litlen < 15 ? litlen : 15) << 4);
+   if (litlen >= 15) {
+      op = lzc_putlen(op, oend, litlen - 15);
+      if (op == NULL) return NULL;
+   }
+   if ((size_t) (oend - op) < litlen) return NULL;
+   memcpy(op, lit, litlen);
+   op += litlen;
+   /* last sequence has no match */
+   if (mlen == 0) return op;
+
+   mlen -= LZC_MINMATCH;
+   *token |= (word8) (mlen < 15 ? mlen : 15);
+   if (oend - op < 2) return NULL;
+   *op++ = (word8) (offset & 0xff);
+   *op++ = (word8) (offset >> 8);
+   if (mlen >= 15) op = lzc_putlen(op, oend, mlen - 15);
+
+   return op;
+}  /* end lzc_putseq() */
+
+/**
+ * @private
+ * Read a length extension, adding to len. Returns 1 on success, or 0 if
+ * input is exhausted.
+*/
+static int lzc_getlen(const word8 **ip, const word8 *iend, size_t *len)
+{
+   word8 b;
+
+   do {
+      if (*ip >= iend) return 0;
+      b = *(*ip)++;
+      *len += b;
+   } while (b == 255);
+
+   return 1;
+}  /* end lzc_getlen() */
+
+/**
+ * Compress data into a buffer.
+ * @param in Pointer to data to compress
+ * @param inlen Length of data to compress, in bytes
+ * @param out Pointer to buffer to place compressed data
+ * @param outlen Length of output buffer, in bytes
+ * @return (size_t) length of compressed data, or zero if compressed data
+ * does not fit in the output buffer
+*/
+size_t lzc_compress(const void *in, size_t inlen, void *out, size_t outlen)
+{
+   size_t table[1 << LZC_HASHBITS];
+   const word8 *ip;
+   word8 *op, *oend;
+   size_t pos, anchor, cand, mlen;
+   word32 seq, h;
+
+   ip = (const word8 *) in;
+   op = (word8 *) out;
+   oend = op + outlen;
+   memset(table, 0, sizeof(table));
+
+   /* find matches with a single entry hash table of recent positions */
+   for (pos = anchor = 0; pos + LZC_MINMATCH <= inlen; ) {
+      memcpy(&seq, ip + pos, sizeof(seq));
+      h = (word32) (seq * 2654435761U) >> (32 - LZC_HASHBITS);
+      cand = table[h];
+      table[h] = pos;
+      if (cand < pos && pos - cand <= LZC_MAXOFFSET &&
+            memcmp(ip + cand, ip + pos, LZC_MINMATCH) == 0) {
+         /* extend match and write sequence */
+         mlen = LZC_MINMATCH;
+         while (pos + mlen < inlen && ip[cand + mlen] == ip[pos + mlen]) {
+            mlen++;
+         }
+         op = lzc_putseq(op, oend, ip + anchor, pos - anchor, pos - cand,
+            mlen);
+         if (op == NULL) return 0;
+         pos += mlen;
+         anchor = pos;
+      } else pos++;
+   }
+   /* write remaining literals as last sequence */
+   op = lzc_putseq(op, oend, ip + anchor, inlen - anchor, 0, 0);
+   if (op == NULL) return 0;
+
+   return (size_t) (op - (word8 *) out);
+}  /* end lzc_compress() */
+
+/**
+ * Decompress data into a buffer. Malformed input, including input that
+ * decompresses beyond the length of the output buffer, is rejected.
+ * @param in Pointer to compressed data
+ * @param inlen Length of compressed data, in bytes
+ * @param out Pointer to buffer to place decompressed data
+ * @param outlen Length of output buffer, in bytes
+ * @return (size_t) length of decompressed data, or LZC_ERROR
+*/
+size_t lzc_decompress
+   (const void *in, size_t inlen, void *out, size_t outlen)
+{
+   const word8 *ip, *iend;
+   word8 *op, *oend;
+   size_t litlen, mlen, offset;
+   word8 token;
+
+   ip = (const word8 *) in;
+   iend = ip + inlen;
+   op = (word8 *) out;
+   oend = op + outlen;
+
+   while (ip < iend) {
+      /* read literals */
+      token = *ip++;
+      litlen = token >> 4;
+      if (litlen == 15 && !lzc_getlen(&ip, iend, &litlen)) return LZC_ERROR;
+      if ((size_t) (iend - ip) < litlen) return LZC_ERROR;
+      if ((size_t) (oend - op) < litlen) return LZC_ERROR;
+      memcpy(op, ip, litlen);
+      ip += litlen;
+      op += litlen;
+      /* last sequence ends input */
+      if (ip == iend) break;
+
+      /* read and copy match -- may overlap */
+      if (iend - ip < 2) return LZC_ERROR;
+      offset = (size_t) ip[0] | ((size_t) ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t) (op - (word8 *) out)) {
+         return LZC_ERROR;
+      }
+      mlen = token & 15;
+      if (mlen == 15 && !lzc_getlen(&ip, iend, &mlen)) return LZC_ERROR;
+      mlen += LZC_MINMATCH;
+      if ((size_t) (oend - op) < mlen) return LZC_ERROR;
+      for ( ; mlen; mlen--, op++) *op = *(op - offset);
+   }
+
+   return (size_t) (op - (word8 *) out);
+}  /* end lzc_decompress() */
+
+/* end include guard */
+#endif
@@ -0,0 +1,42 @@
+/**
+ * @file lzc.h
+ * @brief Mochimo LZ compression support.
+ * @details A small, fast, byte oriented LZ77 codec for compressing
+ * network file transfers. Compressed data is a series of sequences:
+ * - token byte (high nibble: literal length, low nibble: match length - 4)
+ * - literal length extension bytes (when literal length nibble is 15)
+ * - literals
+ * - 2 byte (little endian) match offset (omitted in the last sequence)
+ * - match length extension bytes (when match length nibble is 15)
+ * <br/>Extension bytes are added to the nibble value, and continue
+ * while the extension byte is 255.
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+/* include guard */
+#ifndef MOCHIMO_LZC_H
+#define MOCHIMO_LZC_H
+
+
+#include <stddef.h>  /* for size_t */
+#include "extint.h"  /* for word types */
+
+/** Return value of lzc_decompress() on malformed input */
+#define LZC_ERROR    ((size_t) (-1))
+
+/* C/C++ compatible function prototypes */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t lzc_compress(const void *in, size_t inlen, void *out, size_t outlen);
+size_t lzc_decompress
+   (const void *in, size_t inlen, void *out, size_t outlen);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+/* end include guard */
+#endif
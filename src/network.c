@@ -18,24 +18,27 @@
 #include "sync.h"
 #include "parallel.h"
 #include "ledger.h"
+#include "lzc.h"
 #include "global.h"
 #include "error.h"
 
 /* external support */
 #include <string.h>
+#include <signal.h>
 #include "exttime.h"
 #include "extthrd.h"
 #include "extmath.h"
 #include "extlib.h"
+#include "extio.h"
 #include "extinet.h"
 #include "crc16.h"
+#include "sha256.h"
 
 #define valid_op(op)  ((op) >= FIRST_OP && (op) <= LAST_OP)
-#define crowded(op)   (Nonline > (MAXNODES - 5) && (op) != OP_FOUND)
 #define can_fork_tx() (Nonline <= (MAXNODES - 5))
 
-#define TXHDRLEN 124
-#define TXTLRLEN 4
+#define LSTATECHECK 4   /* peers compared by check_lstate() */
+#define CXHDRLEN 3     /* compressed frame header, flags + length */
 
 NODE Nodes[MAXNODES];   /* data structure for connected NODE's */
 NODE *Hi_node = Nodes;  /* points one beyond last logged in NODE */
@@ -43,6 +46,8 @@ word32 Nrecvs;          /* number of receive errors */
 word32 Nsends;          /* number of send errors */
 word32 Nrecverrs;       /* number of receive errors */
 word32 Nsenderrs;       /* number of send errors */
+word32 Ncrowded[SLOTCLASSES];  /* children suppressed, by slot class */
+word32 Nevicted[SLOTCLASSES];  /* children evicted, by slot class */
 
 /**
  * Is called after initial accept() or connect()
@@ -69,9 +74,113 @@ NODE *getslot(NODE *np)
    pdebug("added NODE %d", (int) (newnp - Nodes));
    if (newnp >= Hi_node) Hi_node = newnp + 1;
    memcpy(newnp, np, sizeof(NODE));
+   time(&(newnp->stamp));
    return newnp;
 }  /* end getslot() */
 
+/**
+ * Get the slot value class of a child serving a peer's request. Block
+ * announcements, and requests of proven peers, are valued. A peer is
+ * proven by SLOTPROVEN successful connections initiated by this node,
+ * which (unlike Rplist[] membership) a peer cannot assign itself.
+ * @param ip Peer ip of request
+ * @param opcode Operation code of request
+ * @return (int) slot value class, SLOT_HIGH or SLOT_LOW
+ */
+int slotclass(word32 ip, int opcode)
+{
+   PDBENTRY *pp;
+
+   if (opcode == OP_FOUND || opcode == OP_MBLOCK) return SLOT_HIGH;
+   pp = pdb_find(ip);
+   if (pp && pp->good >= SLOTPROVEN && pp->bad < PDBMAXBAD) return SLOT_HIGH;
+
+   return SLOT_LOW;
+}  /* end slotclass() */
+
+/**
+ * @private
+ * Evict the longest running child of the lowest slot value class, below
+ * a slot value class. The child ceases its transfer on SIGTERM (which
+ * clears Running), and the slot is freed when the child is reaped.
+ * @param value Slot value class of child requiring a slot
+ * @return (int) 1 if a child was signaled for eviction, else 0
+ */
+static int evict(int value)
+{
+   NODE *np, *victim;
+
+   for (victim = NULL, np = Nodes; np < Hi_node; np++) {
+      if (np->pid == 0 || np->slot >= value) continue;
+      if (victim == NULL || np->slot < victim->slot ||
+            (np->slot == victim->slot && np->stamp < victim->stamp)) {
+         victim = np;
+      }
+   }
+   if (victim == NULL) return 0;
+
+   pdebug("evicting %s, pid = %d", victim->id, (int) victim->pid);
+   Nevicted[victim->slot]++;
+   victim->slot = SLOT_EVICTED;
+   kill(victim->pid, SIGTERM);
+
+   return 1;
+}  /* end evict() */
+
+/**
+ * @private
+ * Check for space in Nodes[] for a child serving a request. Children of
+ * low value requests may not use the last SLOTRESERVE slots. When there
+ * is no space, a valued request evicts a child of a low value request,
+ * and is served while Nodes[] has a free slot (the evicted child holds
+ * its slot until reaped). OP_FOUND is never suppressed.
+ * @param np Pointer to NODE of request; np->slot is set
+ * @param opcode Operation code of request
+ * @return (int) 1 if child should be suppressed, else 0
+ */
+static int crowded(NODE *np, int opcode)
+{
+   int limit;
+
+   np->slot = (word8) slotclass(np->ip, opcode);
+   limit = MAXNODES - 5;
+   if (np->slot == SLOT_LOW) limit -= SLOTRESERVE;
+   if (Nonline <= limit || opcode == OP_FOUND) return 0;
+   if (np->slot == SLOT_HIGH && evict(SLOT_HIGH) && Nonline < MAXNODES) {
+      return 0;
+   }
+   Ncrowded[np->slot]++;
+
+   return 1;
+}  /* end crowded() */
+
+/**
+ * Check the concurrency budget of an opcode's rate limit class against
+ * children in Nodes[] serving the same class. Increments Nthrottled[].
+ * @param opcode Operation code of the child to be created
+ * @return (int) 1 if the class has no concurrency budget left, else 0
+ */
+int rlbusy(int opcode)
+{
+   NODE *np;
+   word32 count;
+   int rlc;
+
+   if (Norlimit) return 0;
+
+   rlc = rlclass(opcode);
+   if (rlc == RL_NONE || Rlconcur[rlc] == 0) return 0;
+
+   /* count children serving rate limit class */
+   for (count = 0, np = Nodes; np < Hi_node; np++) {
+      if (np->pid && rlclass(get16(np->tx.opcode)) == rlc) count++;
+   }
+   if (count < Rlconcur[rlc]) return 0;
+
+   Nthrottled[rlc]++;
+   return 1;
+}  /* end rlbusy() */
+
 /* Mark NODE np in Nodes[] empty by setting np->pid to zero.
  * Adjust Nonline and Hi_node.
  * Caller must close np->sd if needed.
@@ -164,13 +273,28 @@ int recv_tx(NODE *np, double timeout)
       }  /* end switch */
    }  /* end for (n... */
 
+   return recv_tx_check(np);
+}  /* end recv_tx() */
+
+/**
+ * Check a packet received in NODE *np, as the raw bytes of a TX packet,
+ * i.e. with crc16 and trailer following the packet buffer data.
+ * Called by recv_tx(), and by receivers assembling packets themselves.
+ * Returns: VEOK (0) = good, else error code. */
+int recv_tx_check(NODE *np)
+{
+   size_t len;
+   TX *tx;
+
+   tx = &(np->tx);
    /* shift crc16 and trailer to correct position in TX struct */
    memmove(tx->crc16, tx->buffer + get16(tx->len), 4);
 
    /* compute crc16 checksum and verify packet integrity */
-   if (get16(tx->crc16) != crc16(tx, len - TXTLRLEN)) {
+   len = TXHDRLEN + get16(tx->len);
+   if (get16(tx->crc16) != crc16(tx, len)) {
       pdebug("%s *** CRC16 mismatch, 0x%" P16X " != 0x%" P16X,
-         np->id, get16(tx->crc16), crc16(tx, TXHDRLEN + len));
+         np->id, get16(tx->crc16), crc16(tx, len));
       Nrecverrs++;
       return VEBAD;
    }
@@ -201,33 +325,104 @@ int recv_tx(NODE *np, double timeout)
    /* packet recv'd */
    Nrecvs++;
    return VEOK;
-}  /* end recv_tx() */
+}  /* end recv_tx_check() */
 
 /**
- * Receive packets from NODE *np, and write to file, fname.
- * SOCKET np->sd is set non-blocking, ready to recv data.
- * Returns: VEOK (0) = good, else error code. */
-int recv_file(NODE *np, char *fname)
+ * @private
+ * Receive compressed OP_SEND_FILE frames from NODE *np, and write file
+ * data to fp. The content hash of the last frame is verified against the
+ * (decompressed) file data.
+ * @param np Pointer to NODE, connected and requested
+ * @param fp Pointer to FILE to write file data
+ * @param fname Filename of file, for logging
+ * @return (int) value representing operation result
+ * @retval VEBAD on malformed frame or content hash mismatch
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+*/
+static int recv_file__cx(NODE *np, FILE *fp, const char *fname)
 {
+   SHA256_CTX ctx;
    TX *tx;
-   FILE *fp;
-   time_t prevtime;
-   word16 len;
+   word8 hash[HASHLEN];
+   word8 *data, *src;
+   size_t len, rawlen;
+   word8 flags;
+   int ecode;
 
-   /* init recv_file() */
-   time(&prevtime);
    tx = &(np->tx);
-
-   /* open file for writing recv'd data */
-   fp = fopen(fname, "wb");
-   if (fp == NULL) {
-      perrno("(%s, %s) fopen() failed", np->id, fname);
-      return VERROR;
+   data = malloc(CXFRAMELEN);
+   if (data == NULL) return VERROR;
+
+   sha256_init(&ctx);
+   /* cease transfer on SIGTERM */
+   ecode = VERROR;
+   while (Running && (ecode = recv_tx(np, STD_TIMEOUT)) == VEOK) {
+      ecode = VEBAD;
+      /* check recv'd packet and frame header */
+      if (get16(tx->opcode) != OP_SEND_FILE) {
+         pdebug("(%s, %s) *** invalid opcode", np->id, fname);
+         break;
+      }
+      len = get16(tx->len);
+      if (len < CXHDRLEN) break;
+      flags = tx->buffer[0];
+      rawlen = get16(tx->buffer + 1);
+      len -= CXHDRLEN;
+      if (flags & CXF_LAST) {
+         if (len < HASHLEN) break;
+         len -= HASHLEN;
+      }
+      if (rawlen > CXFRAMELEN) break;
+      /* decompress (or use stored) frame data */
+      src = tx->buffer + CXHDRLEN;
+      if (flags & CXF_LZC) {
+         if (lzc_decompress(src, len, data, rawlen) != rawlen) {
+            pdebug("(%s, %s) *** bad frame", np->id, fname);
+            break;
+         }
+         src = data;
+      } else if (len != rawlen) break;
+      sha256_update(&ctx, src, rawlen);
+      if (rawlen && fwrite(src, rawlen, 1, fp) != 1) {
+         pdebug("(%s, %s) *** I/O error", np->id, fname);
+         ecode = VERROR;
+         break;
+      }
+      /* check content hash on last frame */
+      if (flags & CXF_LAST) {
+         sha256_final(&ctx, hash);
+         if (memcmp(hash, tx->buffer + CXHDRLEN + len, HASHLEN) == 0) {
+            ecode = VEOK;
+         } else pdebug("(%s, %s) *** content hash mismatch", np->id, fname);
+         break;
+      }
    }
+   free(data);
 
-   /* receive packets and write */
-   pdebug("(%s, %s) receiving...", np->id, fname);
-   while (recv_tx(np, STD_TIMEOUT) == VEOK) {
+   return ecode;
+}  /* end recv_file__cx() */
+
+/**
+ * @private
+ * Receive OP_SEND_FILE packets, or compressed frames, from NODE *np,
+ * and write file data to fp, until EOF.
+ * @param np Pointer to NODE, connected and requested
+ * @param fp Pointer to FILE to write file data
+ * @param fname Filename of file, for logging
+ * @return (int) VEOK on success, else error code
+*/
+static int recv_file__fp(NODE *np, FILE *fp, const char *fname)
+{
+   TX *tx;
+   word16 len;
+
+   tx = &(np->tx);
+   if (np->cxbits & Cxbits & CX_COMPRESS) {
+      return recv_file__cx(np, fp, fname);
+   }
+   /* cease transfer on SIGTERM */
+   while (Running && recv_tx(np, STD_TIMEOUT) == VEOK) {
       /* check recv'd packet */
       if (get16(tx->opcode) != OP_SEND_FILE) {
          pdebug("(%s, %s) *** invalid opcode", np->id, fname);
@@ -239,17 +434,41 @@ int recv_file(NODE *np, char *fname)
          break;
       }
       /* check EOF */
-      if (len < sizeof(tx->buffer)) {
-         fclose(fp);
-         pdebug("(%s, %s) EOF", np->id, fname);
-         return VEOK;
-      } /* end if EOF */
+      if (len < sizeof(tx->buffer)) return VEOK;
    }  /* end for */
+
+   return VERROR;
+}  /* end recv_file__fp() */
+
+/**
+ * Receive packets from NODE *np, and write to file, fname.
+ * Packets are compressed frames where negotiated with CX_COMPRESS.
+ * SOCKET np->sd is set non-blocking, ready to recv data.
+ * Returns: VEOK (0) = good, else error code. */
+int recv_file(NODE *np, char *fname)
+{
+   FILE *fp;
+   int ecode;
+
+   /* open file for writing recv'd data */
+   fp = fopen(fname, "wb");
+   if (fp == NULL) {
+      perrno("(%s, %s) fopen() failed", np->id, fname);
+      return VERROR;
+   }
+
+   /* receive packets and write */
+   pdebug("(%s, %s) receiving...", np->id, fname);
+   ecode = recv_file__fp(np, fp, fname);
    fclose(fp);
+   if (ecode == VEOK) {
+      pdebug("(%s, %s) EOF", np->id, fname);
+      return VEOK;
+   }
    /* delete partial downloads */
    remove(fname);
 
-   return VERROR;
+   return ecode;
 }  /* end recv_file() */
 
 /**
@@ -363,32 +582,92 @@ int send_nack(NODE *np, int errnum)
 }  /* end send_nack() */
 
 /**
- * Send packets to NODE *np, and write to file, fname.
- * SOCKET np->sd is set non-blocking, ready to recv data.
- * Set fname NULL send np->tx.blocknum request.
- * Returns: VEOK (0) = good, else error code. */
-int send_file(NODE *np, char *fname)
+ * @private
+ * Send file data from fp to NODE *np as compressed OP_SEND_FILE frames.
+ * Frame data is compressed where smaller, and where decompression is
+ * verified, else stored. The last frame carries the content hash.
+ * @param np Pointer to NODE, connected and requested
+ * @param fp Pointer to FILE to read file data
+ * @param fname Filename of file, for logging
+ * @return (int) VEOK on success, else error code
+*/
+static int send_file__cx(NODE *np, FILE *fp, const char *fname)
+{
+   SHA256_CTX ctx;
+   TX *tx;
+   word8 *data, *check, *frame;
+   size_t count, n;
+   word8 flags;
+   int ecode;
+
+   tx = &(np->tx);
+   frame = tx->buffer + CXHDRLEN;
+   data = malloc(CXFRAMELEN * 2);
+   if (data == NULL) return VERROR;
+   check = data + CXFRAMELEN;
+
+   sha256_init(&ctx);
+   do {
+      /* read file data and break on error */
+      count = fread(data, 1, CXFRAMELEN, fp);
+      if (count != CXFRAMELEN && ferror(fp)) {
+         perr("(%s, %s) *** I/O error", np->id, fname);
+         ecode = VERROR;
+         break;
+      }
+      sha256_update(&ctx, data, count);
+      /* compress frame data where smaller and verified, else store */
+      flags = CXF_LZC;
+      n = count ? lzc_compress(data, count, frame, count - 1) : 0;
+      if (n == 0 || lzc_decompress(frame, n, check, count) != count ||
+            memcmp(check, data, count) != 0) {
+         memcpy(frame, data, count);
+         flags = 0;
+         n = count;
+      }
+      /* append content hash to last frame */
+      if (count != CXFRAMELEN) {
+         sha256_final(&ctx, frame + n);
+         flags |= CXF_LAST;
+         n += HASHLEN;
+      }
+      /* send frame and break on EOF */
+      tx->buffer[0] = flags;
+      put16(tx->buffer + 1, (word16) count);
+      put16(tx->len, (word16) (CXHDRLEN + n));
+      ecode = send_op(np, OP_SEND_FILE);
+      if (flags & CXF_LAST) {
+         pdebug("(%s, %s) EOF", np->id, fname);
+         break;
+      }
+      /* Make upload bandwidth dynamic. */
+      if (Nonline > 1) millisleep(Nonline - 1);
+      /* cease transfer on SIGTERM, e.g. evicted child */
+      if (!Running) ecode = VERROR;
+   } while (ecode == VEOK);
+   free(data);
+
+   return ecode;
+}  /* end send_file__cx() */
+
+/**
+ * @private
+ * Send file data from fp to NODE *np, as OP_SEND_FILE packets, or
+ * compressed frames, until EOF.
+ * @param np Pointer to NODE, connected and requested
+ * @param fp Pointer to FILE to read file data
+ * @param fname Filename of file, for logging
+ * @return (int) VEOK on success, else error code
+*/
+static int send_file__fp(NODE *np, FILE *fp, const char *fname)
 {
-   char dummy[FILENAME_MAX];
-   char bcfname[22];
    size_t count;
    int ecode;
-   FILE *fp;
    TX *tx;
 
-   /* init send_file() */
    tx = &(np->tx);
-   if (fname == NULL) {
-      bnum2fname(tx->blocknum, bcfname);
-      fname = path_join(dummy, Bcdir, bcfname);
-   }
-   pdebug("(%s, %s) sending...", np->id, fname);
-
-   /* open file for writing recv'd data */
-   fp = fopen(fname, "rb");
-   if (fp == NULL) {
-      pdebug("(%s, %s) cannot send file", np->id, fname);
-      return VERROR;
+   if (np->cxbits & Cxbits & CX_COMPRESS) {
+      return send_file__cx(np, fp, fname);
    }
    /* read and send packets */
    do {
@@ -408,12 +687,113 @@ int send_file(NODE *np, char *fname)
       }
       /* Make upload bandwidth dynamic. */
       if (Nonline > 1) millisleep(Nonline - 1);
+      /* cease transfer on SIGTERM, e.g. evicted child */
+      if (!Running) ecode = VERROR;
    } while (ecode == VEOK);
+
+   return ecode;
+}  /* end send_file__fp() */
+
+/**
+ * Send packets to NODE *np, and write to file, fname.
+ * Packets are compressed frames where negotiated with CX_COMPRESS.
+ * SOCKET np->sd is set non-blocking, ready to recv data.
+ * Set fname NULL send np->tx.blocknum request.
+ * Returns: VEOK (0) = good, else error code. */
+int send_file(NODE *np, char *fname)
+{
+   char dummy[FILENAME_MAX];
+   char bcfname[22];
+   int ecode;
+   FILE *fp;
+
+   /* init send_file() */
+   if (fname == NULL) {
+      bnum2fname(np->tx.blocknum, bcfname);
+      fname = path_join(dummy, Bcdir, bcfname);
+   }
+   pdebug("(%s, %s) sending...", np->id, fname);
+
+   /* open file for writing recv'd data */
+   fp = fopen(fname, "rb");
+   if (fp == NULL) {
+      pdebug("(%s, %s) cannot send file", np->id, fname);
+      return VERROR;
+   }
+   ecode = send_file__fp(np, fp, fname);
    /* cleanup */
    fclose(fp);
    return ecode;
 }  /* end send_file() */
 
+/**
+ * Send the remainder of block np->tx.blocknum to NODE *np, in response
+ * to a ranged OP_GET_BLOCK request. The request buffer contains
+ * { 8 byte offset, 32 byte hash of the first offset bytes } of a
+ * partial download, and is answered with an OP_GET_BLOCK packet of the
+ * accepted 8 byte offset, followed by file data from that offset. Any
+ * prefix that is not a prefix of the block is sent from zero.
+ * @param np Pointer to NODE, connected and requested
+ * @return (int) VEOK on success, else error code
+*/
+int send_file_range(NODE *np)
+{
+   SHA256_CTX ctx;
+   char fname[FILENAME_MAX];
+   char bcfname[22];
+   word8 hash[HASHLEN];
+   long long offset, len;
+   size_t count;
+   int ecode;
+   FILE *fp;
+   TX *tx;
+
+   /* init send_file_range() */
+   tx = &(np->tx);
+   bnum2fname(tx->blocknum, bcfname);
+   path_join(fname, Bcdir, bcfname);
+   put64(&offset, tx->buffer);
+   memcpy(hash, tx->buffer + 8, HASHLEN);
+   pdebug("(%s, %s) sending from %lld...", np->id, fname, offset);
+
+   fp = fopen(fname, "rb");
+   if (fp == NULL) {
+      pdebug("(%s, %s) cannot send file", np->id, fname);
+      return VERROR;
+   }
+   /* verify prefix of partial download, else send from zero */
+   if (fseek64(fp, 0LL, SEEK_END) != 0) goto ERROR_CLEANUP;
+   if (offset < 0 || ftell64(fp) < offset) offset = 0;
+   if (fseek64(fp, 0LL, SEEK_SET) != 0) goto ERROR_CLEANUP;
+   sha256_init(&ctx);
+   for (len = offset; len > 0; len -= (long long) count) {
+      count = sizeof(tx->buffer);
+      if (len < (long long) count) count = (size_t) len;
+      if (fread(tx->buffer, count, 1, fp) != 1) goto ERROR_CLEANUP;
+      sha256_update(&ctx, tx->buffer, count);
+   }
+   sha256_final(&ctx, tx->buffer);
+   if (memcmp(tx->buffer, hash, HASHLEN) != 0) {
+      pdebug("(%s, %s) prefix mismatch", np->id, fname);
+      offset = 0;
+      if (fseek64(fp, 0LL, SEEK_SET) != 0) goto ERROR_CLEANUP;
+   }
+
+   /* acknowledge offset, and send remainder */
+   put64(tx->buffer, &offset);
+   put16(tx->len, 8);
+   ecode = send_op(np, OP_GET_BLOCK);
+   if (ecode == VEOK) ecode = send_file__fp(np, fp, fname);
+   fclose(fp);
+
+   return ecode;
+
+ERROR_CLEANUP:
+   perrno("(%s, %s) *** I/O error", np->id, fname);
+   fclose(fp);
+   return VERROR;
+}  /* end send_file_range() */
+
 /**
  * Send a ledger.dat balance query to np.
  * Called from gettx() OP_BALANCE
@@ -444,44 +824,174 @@ int send_balance(NODE *np)
    return 0;  /* success */
 } /* end send_balance() */
 
-/* Send our recent peer list to NODE np in response to OP_GETIPL.
- * Called from execute().
- */
-int send_ipl(NODE *np)
+/**
+ * Send a batch of ledger.dat balance queries to np.
+ * Called from gettx() OP_BALANCE_BATCH
+ * layout:
+ * on entry:
+ *     np->tx.buffer    array of ADDR_LEN addresses (or tags) to query
+ * on return:
+ *     np->tx.buffer    array of LENTRY's found, in address order
+ *
+ * Returns 1 on I/O errors, else 0.
+*/
+int send_balance_batch(NODE *np)
 {
-   word32 count;
+   LENTRY le[BATCHLEN];
+   size_t j, count, found;
 
-   /* count peers in Rplist */
-   for (count = 0; count < RPLISTLEN; count++) {
-      if (Rplist[count] == 0) break;
+   count = get16(np->tx.len) / ADDR_LEN;
+   if (count > BATCHLEN) count = BATCHLEN;
+
+   /* sort queries for a single pass through the ledger */
+   memset(le, 0, count * sizeof(LENTRY));
+   for (j = 0; j < count; j++) {
+      memcpy(le[j].addr, np->tx.buffer + (j * ADDR_LEN), ADDR_LEN);
    }
-   /* limit count to space available in buffer size */
-   if (count > (sizeof(np->tx.buffer) / sizeof(word32))) {
-      count = (sizeof(np->tx.buffer) / sizeof(word32));
+   qsort(le, count, sizeof(LENTRY), addr_compare);
+   le_findv(le, count);
+
+   /* pack found entries into reply */
+   for (found = j = 0; j < count; j++) {
+      if (iszero(le[j].balance, 8)) continue;
+      memcpy(np->tx.buffer + (found * sizeof(LENTRY)), &le[j], sizeof(LENTRY));
+      found++;
    }
-   /* copy recent peer list to TX */
-   memcpy(np->tx.buffer, Rplist, sizeof(word32) * count);
-   put16(np->tx.len, sizeof(word32) * count);
-   return send_op(np, OP_SEND_IPL);  /* send ip list */
-}
+   put16(np->tx.len, (word16) (found * sizeof(LENTRY)));
+   send_op(np, OP_SEND_BAL);
 
-/* Process OP_HASH.  Return VEOK on success, else VERROR.
- * Called by gettx().
- */
-int send_hash(NODE *np)
+   Nbalance += count;
+   return 0;  /* success */
+} /* end send_balance_batch() */
+
+/**
+ * @private
+ * Response cache entry of an OP_HASH request.
+*/
+typedef struct {
+   word8 bnum[8];          /* block number */
+   word8 bhash[HASHLEN];   /* block hash of trailer */
+   word8 valid;            /* set when entry is filled */
+} RCHASH;
+
+/* Response cache of hot read-only opcodes, valid for one chain tip.
+ * Filled by the parent process, and shared with children by fork(). */
+static word8 Rctip[HASHLEN];           /* Cblockhash of cached responses */
+static RCHASH Rchash[RCHASHLEN];       /* OP_HASH block hashes */
+static char Rcident[256];              /* OP_IDENTIFY response */
+static word16 Rcidentlen;
+static BTRAILER Rctftail[NTFRANGE];    /* OP_TF tail of tfile.dat */
+static word32 Rctffirst, Rctfcount;
+
+/**
+ * @private
+ * Drop all cached responses, where the chain tip has changed since they
+ * were cached. Responses are only ever cached for the current tip.
+*/
+static void rcache__check(void)
 {
-   BTRAILER bt;
-   char fname[FILENAME_MAX];
-   char bcfname[21];
+   if (memcmp(Rctip, Cblockhash, HASHLEN) == 0) return;
+   memset(Rchash, 0, sizeof(Rchash));
+   Rcidentlen = 0;
+   Rctfcount = 0;
+   memcpy(Rctip, Cblockhash, HASHLEN);
+}  /* end rcache__check() */
 
-   bnum2fname(np->tx.blocknum, bcfname);
-   path_join(fname, Bcdir, bcfname);
-   if (read_trailer(&bt, fname) != VEOK) {
+/**
+ * @private
+ * Get the block hash of a block number, from the response cache, else
+ * from the trailer of the block file (cached for next time).
+ * @param bnum Block number of block hash
+ * @param bhash Pointer to place block hash
+ * @return (int) VEOK on success, else VERROR
+*/
+static int rcache__hash(const word8 bnum[8], word8 bhash[HASHLEN])
+{
+   BTRAILER bt;
+   RCHASH *rc;
+   char fname[FILENAME_MAX];
+   char bcfname[21];
+
+   rcache__check();
+   rc = &Rchash[bnum[0] % RCHASHLEN];
+   if (!rc->valid || cmp64(rc->bnum, bnum) != 0) {
+      bnum2fname((word8 *) bnum, bcfname);
+      path_join(fname, Bcdir, bcfname);
+      if (read_trailer(&bt, fname) != VEOK) return VERROR;
+      memcpy(rc->bnum, bnum, 8);
+      memcpy(rc->bhash, bt.bhash, HASHLEN);
+      rc->valid = 1;
+   }
+   memcpy(bhash, rc->bhash, HASHLEN);
+
+   return VEOK;
+}  /* end rcache__hash() */
+
+/**
+ * @private
+ * Load the last (up to) NTFRANGE trailers of "tfile.dat" into the
+ * response cache, for OP_TF tail requests, if not already cached.
+ * Call before fork() of the child answering OP_TF.
+*/
+static void rcache__tftail(void)
+{
+   long long len;
+   FILE *fp;
+
+   rcache__check();
+   if (Rctfcount) return;
+   fp = fopen("tfile.dat", "rb");
+   if (fp == NULL) return;
+   if (fseek64(fp, 0LL, SEEK_END) == 0 && (len = ftell64(fp)) > 0) {
+      len /= (long long) sizeof(BTRAILER);
+      Rctfcount = len < NTFRANGE ? (word32) len : NTFRANGE;
+      Rctffirst = (word32) (len - Rctfcount);
+      if (fseek64(fp, (long long) Rctffirst * sizeof(BTRAILER),
+            SEEK_SET) != 0 ||
+            fread(Rctftail, sizeof(BTRAILER), Rctfcount, fp) != Rctfcount) {
+         Rctfcount = 0;
+      }
+   }
+   fclose(fp);
+}  /* end rcache__tftail() */
+
+/* Send our recent peer list to NODE np in response to OP_GETIPL.
+ * Called from execute().
+ */
+int send_ipl(NODE *np)
+{
+   word32 count;
+
+   /* count peers in Rplist */
+   for (count = 0; count < RPLISTLEN; count++) {
+      if (Rplist[count] == 0) break;
+   }
+   /* limit count to space available in buffer size */
+   if (count > (sizeof(np->tx.buffer) / sizeof(word32))) {
+      count = (sizeof(np->tx.buffer) / sizeof(word32));
+   }
+   /* copy recent peer list to TX */
+   memcpy(np->tx.buffer, Rplist, sizeof(word32) * count);
+   put16(np->tx.len, sizeof(word32) * count);
+   return send_op(np, OP_SEND_IPL);  /* send ip list */
+}
+
+/* Process OP_HASH.  Return VEOK on success, else VERROR.
+ * Called by gettx().
+ */
+int send_hash(NODE *np)
+{
+   /* copy (cached) hash of tx.blocknum to TX */
+   if (rcache__hash(np->tx.blocknum, np->tx.buffer) != VEOK) {
       return VERROR;
    }
-   /* copy hash of tx.blocknum to TX */
-   memcpy(np->tx.buffer, bt.bhash, HASHLEN);
    put16(np->tx.len, HASHLEN);
+   /* ... and ledger state commitment, if understood and known */
+   if ((np->tx.version[1] & C_LSTATE) && (Cbits & C_LSTATE)) {
+      if (le_lstate(np->tx.blocknum, np->tx.buffer + HASHLEN) == VEOK) {
+         put16(np->tx.len, HASHLEN * 2);
+      }
+   }
    return send_op(np, OP_HASH);  /* send back to peer */
 }  /* end send_hash() */
 
@@ -493,14 +1003,26 @@ int send_tf(NODE *np)
    int status;
    word32 first, count;
    char cmd[128], fname[32];
+   FILE *fp;
 
    sprintf(fname, "tf%u.tmp", (int) getpid());
 
    first = get32(np->tx.blocknum);      /* first trailer to send */
    count = get32(&np->tx.blocknum[4]);  /* count of trailers to send */
 
-   /* limit tfile extract to 1000 trailers */
-   if(count > 1000) return VERROR;
+   /* limit tfile extract to NTFRANGE trailers */
+   if(count > NTFRANGE) return VERROR;
+   /* send tail requests from the (inherited) response cache */
+   if (Rctfcount && first >= Rctffirst &&
+         first - Rctffirst + (word64) count <= Rctfcount) {
+      fp = fmemopen(&Rctftail[first - Rctffirst],
+         count * sizeof(BTRAILER), "rb");
+      if (fp != NULL) {
+         status = send_file__fp(np, fp, "tfile.dat");
+         fclose(fp);
+         return status;
+      }
+   }
    sprintf(cmd, "dd if=tfile.dat of=%s bs=%u skip=%u count=%u 2>/dev/null",
                 fname, (int) sizeof(BTRAILER), first, count);
    system(cmd);
@@ -512,23 +1034,354 @@ int send_tf(NODE *np)
 
 int send_identify(NODE *np)
 {
-   /* copy recent peer list to TX */
-   sprintf((char *) np->tx.buffer, "Sanctuary=%u,Lastday=%u,Mfee=%u",
-           Sanctuary, Lastday, Myfee[0]);
-   put16(np->tx.len, (word16) strlen((char *) np->tx.buffer));
+   word8 lstate[HASHLEN];
+   char *cp;
+   int j;
+
+   /* (re)build cached identity, per chain tip */
+   rcache__check();
+   if (Rcidentlen == 0) {
+      sprintf(Rcident, "Sanctuary=%u,Lastday=%u,Mfee=%u",
+              Sanctuary, Lastday, Myfee[0]);
+      /* append ledger state commitment of current block, if known */
+      if (le_lstate(Cblocknum, lstate) == VEOK) {
+         cp = Rcident + strlen(Rcident);
+         cp += sprintf(cp, ",Lstate=");
+         for (j = 0; j < HASHLEN; j++) cp += sprintf(cp, "%02x", lstate[j]);
+      }
+      Rcidentlen = (word16) strlen(Rcident);
+   }
+   /* copy identity to TX */
+   memcpy(np->tx.buffer, Rcident, Rcidentlen + 1);
+   put16(np->tx.len, Rcidentlen);
    return send_op(np, OP_IDENTIFY);
 }
 
-/* Creates child to send OP_FOUND to all recent peers */
+/**
+ * @private
+ * Get the Merkle layer depth of neogenesis chunks for a ledger.
+ * @param lcount Number of ledger entries in neogenesis block
+ * @return (unsigned) layer depth, such that (1 << depth) <= lcount
+*/
+static unsigned ng_depth(size_t lcount)
+{
+   unsigned depth;
+
+   for (depth = 0; depth < NGDEPTH_MAX; depth++) {
+      if ((lcount >> depth) * sizeof(LENTRY) <= NGCHUNKLEN) break;
+      if (((size_t) 2 << depth) > lcount) break;
+   }
+
+   return depth;
+}  /* end ng_depth() */
+
+/**
+ * @private
+ * Open a neogenesis block of the blockchain directory, and check header.
+ * @param bnum Block number of neogenesis block
+ * @param fname Pointer to buffer of FILENAME_MAX for block filename
+ * @param lcount Pointer to place number of ledger entries
+ * @return (FILE *) neogenesis block positioned at the first ledger entry,
+ * or NULL on error
+*/
+static FILE *ng_open(word8 *bnum, char *fname, size_t *lcount)
+{
+   NGHEADER ngh;
+   FILE *fp;
+   char bcfname[21];
+   word64 lbytes;
+
+   if (bnum[0] != 0) return NULL;  /* not a neogenesis block */
+   bnum2fname(bnum, bcfname);
+   path_join(fname, Bcdir, bcfname);
+   fp = fopen(fname, "rb");
+   if (fp == NULL) return NULL;
+   if (fread(&ngh, sizeof(NGHEADER), 1, fp) != 1) goto FAIL;
+   if (get32(ngh.hdrlen) != sizeof(NGHEADER)) goto FAIL;
+   put64(&lbytes, ngh.lbytes);
+   if (lbytes < sizeof(LENTRY) || lbytes % sizeof(LENTRY)) goto FAIL;
+   *lcount = (size_t) (lbytes / sizeof(LENTRY));
+
+   return fp;
+
+FAIL:
+   fclose(fp);
+   return NULL;
+}  /* end ng_open() */
+
+/**
+ * Send the Merkle layer of a neogenesis block ledger to np.
+ * Called by child -- execute() OP_NG_LAYER
+ * layout:
+ * on entry:
+ *     np->tx.blocknum    neogenesis block number
+ * on return:
+ *     np->tx.buffer      [8 byte lbytes][(1 << depth) chunk sub-roots]
+ *
+ * Returns VEOK on success, else VERROR.
+*/
+int send_nglayer(NODE *np)
+{
+   LENTRY le;
+   FILE *fp, *lhfp;
+   char fname[FILENAME_MAX];
+   word64 lbytes;
+   word8 *mtree;
+   size_t lcount, count, offset, idx, j;
+   unsigned depth;
+   int ecode;
+
+   fp = ng_open(np->tx.blocknum, fname, &lcount);
+   if (fp == NULL) return VERROR;
+   depth = ng_depth(lcount);
+
+   /* chunk ranges tile the ledger in order -- index 0 is the largest */
+   mtree = malloc(merkle_range(lcount, depth, 0, &offset) * HASHLEN);
+   if (mtree == NULL) {
+      fclose(fp);
+      return VERROR;
+   }
+   /* leaf hashes, if available, save hashing the ledger */
+   lhfp = le_lhopen(fname, sizeof(NGHEADER), lcount);
+
+   /* compute sub-root of each chunk */
+   ecode = VEOK;
+   for (idx = 0; ecode == VEOK && idx < ((size_t) 1 << depth); idx++) {
+      count = merkle_range(lcount, depth, idx, &offset);
+      for (j = 0; j < count; j++) {
+         if (fread(&le, sizeof(LENTRY), 1, fp) != 1) {
+            ecode = VERROR;
+            break;
+         }
+         if (lhfp && fread(mtree + (j * HASHLEN), HASHLEN, 1, lhfp) == 1) {
+            continue;
+         }
+         sha256(&le, sizeof(LENTRY), mtree + (j * HASHLEN));
+      }
+      merkle_root(mtree, count, np->tx.buffer + 8 + (idx * HASHLEN));
+   }
+   /* cleanup */
+   if (lhfp) fclose(lhfp);
+   free(mtree);
+   fclose(fp);
+   if (ecode != VEOK) return ecode;
+
+   lbytes = (word64) lcount * sizeof(LENTRY);
+   put64(np->tx.buffer, &lbytes);
+   put16(np->tx.len, (word16) (8 + (((size_t) 1 << depth) * HASHLEN)));
+   return send_op(np, OP_NG_LAYER);
+}  /* end send_nglayer() */
+
+/**
+ * Send the ledger entries of a neogenesis block chunk to np.
+ * Called by child -- execute() OP_GET_NGCHUNK
+ * layout:
+ * on entry:
+ *     np->tx.blocknum    neogenesis block number
+ *     np->tx.buffer      [1 byte layer depth][2 byte chunk index]
+ * on return:
+ *     OP_SEND_FILE packets of chunk ledger entries
+ *
+ * Returns VEOK on success, else VERROR.
+*/
+int send_ngchunk(NODE *np)
+{
+   FILE *fp;
+   char fname[FILENAME_MAX];
+   size_t lcount, count, offset, idx, len;
+   unsigned depth;
+   int ecode;
+
+   if (get16(np->tx.len) < 3) return VERROR;
+   depth = np->tx.buffer[0];
+   idx = get16(np->tx.buffer + 1);
+
+   fp = ng_open(np->tx.blocknum, fname, &lcount);
+   if (fp == NULL) return VERROR;
+   /* chunk MUST be of the advertised layer */
+   if (depth != ng_depth(lcount) || idx >= ((size_t) 1 << depth)) {
+      fclose(fp);
+      return VERROR;
+   }
+   count = merkle_range(lcount, depth, idx, &offset);
+   if (fseek64(fp, (long long) (sizeof(NGHEADER) + (offset * sizeof(LENTRY))),
+         SEEK_SET) != 0) {
+      fclose(fp);
+      return VERROR;
+   }
+
+   /* read and send packets -- short packet indicates EOF */
+   count *= sizeof(LENTRY);
+   do {
+      len = count < sizeof(np->tx.buffer) ? count : sizeof(np->tx.buffer);
+      if (len && fread(np->tx.buffer, len, 1, fp) != 1) {
+         perr("(%s, %s) *** I/O error", np->id, fname);
+         ecode = VERROR;
+         break;
+      }
+      count -= len;
+      put16(np->tx.len, (word16) len);
+      ecode = send_op(np, OP_SEND_FILE);
+      /* Make upload bandwidth dynamic. */
+      if (Nonline > 1) millisleep(Nonline - 1);
+      /* cease transfer on SIGTERM, e.g. evicted child */
+      if (!Running) ecode = VERROR;
+   } while (ecode == VEOK && len == sizeof(np->tx.buffer));
+   fclose(fp);
+
+   return ecode;
+}  /* end send_ngchunk() */
+
+/**
+ * Process OP_GET_MMRPROOF. Send an MMR proof of the trailer at
+ * np->tx.blocknum, against the number of trailers in the request buffer
+ * (or all trailers, when zero or absent). Called by gettx().
+ * Returns VEOK on success, else VERROR.
+*/
+int send_mmrproof(NODE *np)
+{
+   word8 count[8];
+   size_t len;
+
+   memset(count, 0, 8);
+   if (get16(np->tx.len) >= 8) memcpy(count, np->tx.buffer, 8);
+   len = mmr_proof("tfile.dat", np->tx.blocknum, count, np->tx.buffer);
+   if (len == 0) return VERROR;
+   put16(np->tx.len, (word16) len);
+
+   return send_op(np, OP_GET_MMRPROOF);
+}  /* end send_mmrproof() */
+
+/**
+ * @private
+ * Send OP_FOUND, with a packet buffer of trailer proof, to recent peers.
+ * @param tx Pointer to TX containing trailer proof
+ * @param len Length of packet buffer
+ * @param plist Pointer to place list of (shuffled) recent peers
+ * @return (int) number of peers in list
+*/
+static int send_found__peers(TX *tx, word16 len, word32 plist[RPLISTLEN])
+{
+   NODE node;
+   int count, i;
+
+   /* build peerlist with Rplist (shuffled) */
+   memset(plist, 0, sizeof(word32) * RPLISTLEN);
+   shufflenz(Rplist, sizeof(*Rplist), RPLISTLEN);
+   count = loadpeers(plist, RPLISTLEN, Rplist, RPLISTLEN);
+
+   /* Send found message to peerlist */
+   for(i = 0; i < count && Running; i++) {
+      if(plist[i] == 0) break;
+      if(callserver(&node, plist[i]) != VEOK) continue;
+      memcpy(&node.tx, tx, sizeof(TX));  /* copy in tfile proof */
+      put16(node.tx.len, len);
+      send_op(&node, OP_FOUND);
+      sock_close(node.sd);
+   }
+
+   return count;
+}  /* end send_found__peers() */
+
+/**
+ * Check an OP_FOUND packet is an early relay, marked FOUND_EARLY.
+ * An early relayer serves the advertised block only once its own
+ * update of the block completes.
+ * @param tx Pointer to OP_FOUND packet
+ * @return (int) 1 if packet is an early relay, else 0
+*/
+int found_early(TX *tx)
+{
+   word16 len;
+
+   len = get16(tx->len);
+   return (len % sizeof(BTRAILER)) == 1 && tx->buffer[len - 1] == FOUND_EARLY;
+}  /* end found_early() */
+
+/**
+ * Creates child to relay OP_FOUND of a received block to all recent
+ * peers, before full validation of the block. The block trailer MUST
+ * extend our chain, at the expected difficulty, with valid PoW. The
+ * relayed trailer proof is followed by the FOUND_EARLY marker.
+ * @note Pseudo-blocks and neogenesis blocks are not relayed early.
+ * @note As send_found(), the child exits VEBAD on ledger state divergence.
+ * @param fname Filename of received block
+ * @return (int) value representing operation result
+ * @retval VEBAD on invalid block trailer
+ * @retval VERROR on error, or block not relayed early
+ * @retval VEOK on relay child created
+ */
+int send_found_early(char *fname)
+{
+   word32 plist[RPLISTLEN];
+   BTRAILER bt, prev_bt;
+   char bnumhex[17];
+   word8 bnum[8];
+   size_t count;
+   int len;
+   TX tx;
+
+   if (read_trailer(&bt, fname) != VEOK) return VERROR;
+   if (read_trailer(&prev_bt, "tfile.dat") != VEOK) return VERROR;
+   if (get32(bt.tcount) == 0) return VERROR;
+   /* check linkage, difficulty and PoW */
+   if (validate_trailer(&bt, &prev_bt) != VEOK ||
+         get32(bt.difficulty) != Difficulty || validate_pow(&bt) != VEOK) {
+      pdebug("early relay trailer validation failure");
+      return VEBAD;
+   }
+
+   if (Found_pid) {
+      pdebug("send_found() is already running -- rerun it.");
+      stop_found();
+   }
+
+   Found_pid = fork();
+   if(Found_pid == -1) {
+      Found_pid = 0;
+      return VERROR;  /* fork() failed */
+   }
+   if(Found_pid) return VEOK;          /* parent returns */
+
+   /* in child -- advertise received block, in child only */
+   show("found");
+   memcpy(Prevhash, Cblockhash, HASHLEN);
+   memcpy(Cblockhash, bt.bhash, HASHLEN);
+   put64(Cblocknum, bt.bnum);
+   add_weight(Weight, bt.difficulty[0]);
+   pdebug("send_found_early(0x%s)", bnum2hex(Cblocknum, bnumhex));
+
+   /* get proof from tfile.dat (!!! (NTFTX - 2) ) and received trailer */
+   if (sub64(prev_bt.bnum, CL64_32(NTFTX - 2), bnum)) memset(bnum, 0, 8);
+   count = read_tfile(tx.buffer, bnum, NTFTX - 1, "tfile.dat");
+   memcpy(tx.buffer + (count * sizeof(BTRAILER)), &bt, sizeof(BTRAILER));
+   count++;
+   /* ... and mark early relay */
+   tx.buffer[count * sizeof(BTRAILER)] = FOUND_EARLY;
+   len = send_found__peers(&tx, (word16) ((count * sizeof(BTRAILER)) + 1),
+      plist);
+
+   /* check ledger state of previous block (peers have it) */
+   if (check_lstate(plist, len, prev_bt.bnum, LSTATECHECK) == VEBAD) {
+      perr("ledger state of 0x%s differs from most peers!",
+         bnum2hex(prev_bt.bnum, bnumhex));
+      exit(VEBAD);
+   }
+
+   exit(0);
+}  /* end send_found_early() */
+
+/* Creates child to send OP_FOUND to all recent peers.
+ * The child exits VEBAD if the ledger state of the previous block
+ * differs from most peers, for the server to resync. */
 int send_found(void)
 {
    word32 plist[RPLISTLEN];
-   NODE node;
    BTRAILER bt;
    char fname[FILENAME_MAX];
    char bcfname[21];
    char bnumhex[17];
-   int ecode, count, len, i;
+   int ecode, count, len;
    TX tx;
    word8 bnum[8];
 
@@ -573,25 +1426,33 @@ bad:
    /* get proof from tfile.dat (!!! (NTFTX - 1) ) */
    if (sub64(Cblocknum, CL64_32(NTFTX - 1), bnum)) memset(bnum, 0, 8);
    count = read_tfile(tx.buffer, bnum, NTFTX, "tfile.dat");
-
-   /* build peerlist with Rplist (shuffled) */
-   memset(plist, 0, sizeof(plist));
-   shufflenz(Rplist, sizeof(*Rplist), RPLISTLEN);
-   len = loadpeers(plist, RPLISTLEN, Rplist, RPLISTLEN);
-
-   /* Send found message to peerlist */
-   for(i = 0; i < len && Running; i++) {
-      if(plist[i] == 0) break;
-      if(callserver(&node, plist[i]) != VEOK) continue;
-      memcpy(&node.tx, &tx, sizeof(TX));  /* copy in tfile proof */
-      put16(node.tx.len, (word16) count * sizeof(BTRAILER));
-      send_op(&node, OP_FOUND);
-      sock_close(node.sd);
+   len = send_found__peers(&tx, (word16) count * sizeof(BTRAILER), plist);
+
+   /* check ledger state of previous block (peers have it) */
+   if (sub64(Cblocknum, One, bnum) == 0) {
+      if (check_lstate(plist, len, bnum, LSTATECHECK) == VEBAD) {
+         perr("ledger state of 0x%s differs from most peers!",
+            bnum2hex(bnum, bnumhex));
+         exit(VEBAD);
+      }
    }
 
    exit(0);
 }  /* end send_found() */
 
+/**
+ * @private
+ * Get the extended capability bits of a handshake packet.
+ * @param tx Pointer to OP_HELLO, or OP_HELLO_ACK, packet
+ * @param marker CXHELLO, or CXHELLO_ACK, as expected of packet
+ * @return (word8) extended capability bits, or zero if none
+*/
+static word8 hello_cxbits(const TX *tx, word8 marker)
+{
+   if (get16(tx->len) < 2 || tx->buffer[0] != marker) return 0;
+   return tx->buffer[1];
+}
+
 /**
  * Call peer and complete Three-Way handshake */
 int callserver(NODE *np, word32 ip)
@@ -615,6 +1476,10 @@ int callserver(NODE *np, word32 ip)
    np->id1 = rand16();
    id1 = (word8) (np->id1 >> 8);
    put16(np->tx.opcode, OP_HELLO);
+   /* ... with extended capability bits */
+   np->tx.buffer[0] = CXHELLO;
+   np->tx.buffer[1] = Cxbits;
+   put16(np->tx.len, 2);
    snprintf(np->id, sizeof(np->id), "%.15s %.02x~%.02x", ipaddr, id1, id2);
    if (send_tx(np, 1) != VEOK) {
       pdebug("%s failed to send handshake", np->id);
@@ -634,6 +1499,12 @@ int callserver(NODE *np, word32 ip)
       pdebug("%s *** handshake ID mismatch", np->id);
       goto FAIL_BAD3WAY;
    }
+   /* extended capabilities -- older peers echo CXHELLO */
+   np->cxbits = hello_cxbits(&(np->tx), CXHELLO_ACK);
+   put16(np->tx.len, 0);
+   /* note peer's advertised chain tip, and connection history */
+   tip_update(np->ip, &(np->tx));
+   pdb_good(np->ip);
 
    /* success -- made a new friend */
    return VEOK;
@@ -642,12 +1513,15 @@ int callserver(NODE *np, word32 ip)
 FAIL_BAD3WAY:
    sock_close(np->sd);
    np->sd = INVALID_SOCKET;
+   pdb_bad(ip);
    return VEBAD;
 FAIL_ERR3WAY:
    sock_close(np->sd);
    np->sd = INVALID_SOCKET;
+   pdb_bad(ip);
    return VERROR;
 FAIL_ERRSOCK:
+   pdb_bad(ip);
    return VERROR;
 }  /* end callserver() */
 
@@ -673,11 +1547,205 @@ int get_tx(NODE *np, word32 ip, word16 opcode)
    return ecode;
 }  /* end get_tx() */
 
+/**
+ * @private
+ * Check an operation code may be requested in a single round trip.
+ * Only idempotent queries, answered with a single packet, qualify.
+ * @param opcode Operation code to check
+ * @return 1 if opcode qualifies, else 0
+*/
+static int oneshot_op(int opcode)
+{
+   switch (opcode) {
+      case OP_BALANCE:        /* fallthrough */
+      case OP_BALANCE_BATCH:  /* fallthrough */
+      case OP_HASH:           /* fallthrough */
+      case OP_GET_IPL:        /* fallthrough */
+      case OP_IDENTIFY:       return 1;
+   }
+   return 0;
+}
+
+/**
+ * Query a peer for a single packet response, in a single round trip.
+ * The request is sent with the OP_HELLO of the handshake, as
+ * { CXONESHOT, Cxbits, opcode, request buffer }, and the random id1 of
+ * the handshake binds the response to the request. Peers without
+ * CX_ONESHOT acknowledge the OP_HELLO instead, and are sent the request
+ * after the handshake, as usual.
+ * @param np Pointer to NODE to place response
+ * @param ip IPv4 address of peer
+ * @param opcode Operation code of request (idempotent queries only)
+ * @param bnum Block number of request, or NULL for none
+ * @param buf Pointer to request buffer, or NULL for none
+ * @param len Length of request buffer, in bytes
+ * @return (int) value representing operation result
+ * @retval VEBAD on bad handshake, or unbound response
+ * @retval VERROR on error, or unqualified request
+ * @retval VEOK on success
+*/
+int get_oneshot(NODE *np, word32 ip, word16 opcode, const void *bnum,
+   const void *buf, word16 len)
+{
+   char ipaddr[16];  /* for threadsafe ntoa() usage */
+   TX *tx;
+   int ecode;
+
+   if (!oneshot_op(opcode) || len > (WORD16_MAX - TXTLRLEN - 4)) {
+      return VERROR;
+   }
+
+   /* init get_oneshot() */
+   tx = &(np->tx);
+   ntoa(&ip, ipaddr);
+   memset(np, 0, sizeof(NODE));   /* clear structure */
+   np->ip = ip;
+   np->id1 = rand16();
+   if (np->id1 == 0) np->id1 = 1;  /* zero binds nothing */
+   snprintf(np->id, sizeof(np->id), "%.15s %.02x~00",
+      ipaddr, (word8) (np->id1 >> 8));
+   np->sd = sock_connect_ip(ip, Dstport, INIT_TIMEOUT);
+   if (np->sd == INVALID_SOCKET) {
+      pdebug("%s failed to connect", np->id);
+      pdb_bad(ip);
+      return VERROR;
+   }
+
+   /* send request with OP_HELLO */
+   put16(tx->opcode, OP_HELLO);
+   if (bnum) put64(tx->blocknum, bnum);
+   tx->buffer[0] = CXONESHOT;
+   tx->buffer[1] = Cxbits;
+   put16(tx->buffer + 2, opcode);
+   if (buf) memcpy(tx->buffer + 4, buf, len);
+   put16(tx->len, len + 4);
+   ecode = send_tx(np, 1);
+   if (ecode == VEOK) ecode = recv_tx(np, INIT_TIMEOUT);
+   if (ecode != VEOK) {
+      pdebug("%s *** single-shot not recv'd", np->id);
+      ecode = VERROR;
+      goto cleanup;
+   }
+   np->id2 = get16(tx->id2);
+   snprintf(np->id, sizeof(np->id), "%.15s %.02x~%.02x",
+      ipaddr, (word8) (np->id1 >> 8), (word8) np->id2);
+   if (get16(tx->id1) != np->id1) {
+      pdebug("%s *** single-shot ID mismatch", np->id);
+      ecode = VEBAD;
+      goto cleanup;
+   }
+   /* peers without CX_ONESHOT acknowledge -- resend request */
+   if (get16(tx->opcode) == OP_HELLO_ACK) {
+      pdebug("%s single-shot acknowledged, resending...", np->id);
+      tip_update(np->ip, tx);
+      if (bnum) put64(tx->blocknum, bnum);
+      if (buf) memcpy(tx->buffer, buf, len);
+      put16(tx->len, len);
+      ecode = send_op(np, opcode);
+      if (ecode == VEOK) ecode = recv_tx(np, STD_TIMEOUT);
+      if (ecode != VEOK) goto cleanup;
+   } else tip_update(np->ip, tx);
+
+   /* success */
+   pdb_good(ip);
+
+cleanup:
+   if (ecode != VEOK) pdb_bad(ip);
+   sock_close(np->sd);
+   np->sd = INVALID_SOCKET;
+
+   return ecode;
+}  /* end get_oneshot() */
+
+/**
+ * @private
+ * Resume a download of a block into fname, with a ranged OP_GET_BLOCK
+ * request. See send_file_range(). Any existing file data is offered as
+ * a partial download, and is kept only where the peer accepts it as a
+ * prefix of the block. Data received before an error is kept, for the
+ * next attempt, except where a compressed frame fails verification.
+ * @param np Pointer to NODE, connected, with OP_GET_BLOCK request
+ * @param fname Filename of (partial) download
+ * @return (int) VEOK on success, else error code
+*/
+static int get_file__range(NODE *np, char *fname)
+{
+   SHA256_CTX ctx;
+   long long offset, start;
+   size_t count;
+   int ecode;
+   FILE *fp;
+   TX *tx;
+
+   /* open partial download, else create */
+   tx = &(np->tx);
+   fp = fopen(fname, "r+b");
+   if (fp == NULL) fp = fopen(fname, "w+b");
+   if (fp == NULL) {
+      perrno("(%s, %s) fopen() failed", np->id, fname);
+      return VERROR;
+   }
+
+   /* offer partial download, by length and hash */
+   sha256_init(&ctx);
+   for (offset = 0; ; offset += (long long) count) {
+      count = fread(tx->buffer, 1, sizeof(tx->buffer), fp);
+      if (count == 0) break;
+      sha256_update(&ctx, tx->buffer, count);
+   }
+   if (ferror(fp)) {
+      perrno("(%s, %s) *** I/O error", np->id, fname);
+      fclose(fp);
+      return VERROR;
+   }
+   sha256_final(&ctx, tx->buffer + 8);
+   put64(tx->buffer, &offset);
+   put16(tx->len, 8 + HASHLEN);
+   pdebug("(%s, %s) resuming from %lld...", np->id, fname, offset);
+   ecode = send_tx(np, STD_TIMEOUT);
+   if (ecode == VEOK) ecode = recv_tx(np, STD_TIMEOUT);
+   if (ecode != VEOK) goto CLEANUP;
+
+   /* check accepted offset -- never beyond our partial download */
+   put64(&start, tx->buffer);
+   if (get16(tx->opcode) != OP_GET_BLOCK || get16(tx->len) != 8 ||
+         start < 0 || start > offset) {
+      pdebug("(%s, %s) *** invalid range", np->id, fname);
+      ecode = VEBAD;
+      goto CLEANUP;
+   }
+
+#ifdef _WIN32
+   #define ftruncate(fd, len) _chsize_s(fd, len)
+#endif
+
+   /* discard the unaccepted part of the download, and resume */
+   if (ftruncate(fileno(fp), start) != 0 ||
+         fseek64(fp, start, SEEK_SET) != 0) {
+      perrno("(%s, %s) *** I/O error", np->id, fname);
+      ecode = VERROR;
+      goto CLEANUP;
+   }
+   ecode = recv_file__fp(np, fp, fname);
+   if (ecode == VEBAD) {
+      /* discard unverified data */
+      fflush(fp);
+      if (ftruncate(fileno(fp), start) != 0) ecode = VERROR;
+   }
+
+CLEANUP:
+   fclose(fp);
+   if (ecode == VEOK) pdebug("(%s, %s) EOF", np->id, fname);
+   return ecode;
+}  /* end get_file__range() */
+
 /**
  * Get a file from peer, ip, and store in fname.
  * Tfile is downloaded if bnum is set NULL, else block file.
  * The current "candidate" block file is requested, if bnum
  * is equal to the maximum block value, WORD64_MAX.
+ * Partial block downloads, from peers with CX_RANGE, are kept in fname
+ * and resumed by the next call. Callers MUST validate the block.
  * Returns VEOK (0) on good download, else error code. */
 int get_file(word32 ip, word8 *bnum, char *fname)
 {
@@ -698,7 +1766,42 @@ int get_file(word32 ip, word8 *bnum, char *fname)
       put64(node.tx.blocknum, node.tx.cblock);  /* for recv_file() */
       put16(node.tx.opcode, OP_GET_TFILE);
    }
-   /* send request for block number, and recv into fname */
+   /* send request for block number, and recv into fname... */
+   if (get16(node.tx.opcode) == OP_GET_BLOCK &&
+         (node.cxbits & Cxbits & CX_RANGE)) {
+      /* ... resuming partial downloads of capable peers */
+      ecode = get_file__range(&node, fname);
+   } else {
+      ecode = send_tx(&node, STD_TIMEOUT);
+      if (ecode == VEOK) ecode = recv_file(&node, fname);
+   }
+
+   /* cleanup */
+   sock_close(node.sd);
+   node.sd = INVALID_SOCKET;
+   return ecode;
+}  /* end get_file() */
+
+/**
+ * Get a range of trailers from the Tfile of ip. See send_tf().
+ * @param ip IPv4 address of peer
+ * @param first Block number of first trailer
+ * @param count Number of trailers, at most NTFRANGE
+ * @param fname Filename to place trailers
+ * @return (int) VEOK on success, else error code
+*/
+int get_tf(word32 ip, word32 first, word32 count, char *fname)
+{
+   int ecode;
+   NODE node;
+
+   /* initiate connection for trailer download */
+   ecode = callserver(&node, ip);
+   if (ecode) return ecode;
+   put32(node.tx.blocknum, first);
+   put32(node.tx.blocknum + 4, count);
+   put16(node.tx.opcode, OP_TF);
+   /* send request for trailers, and recv into fname */
    ecode = send_tx(&node, STD_TIMEOUT);
    if (ecode == VEOK) ecode = recv_file(&node, fname);
 
@@ -706,31 +1809,290 @@ int get_file(word32 ip, word8 *bnum, char *fname)
    sock_close(node.sd);
    node.sd = INVALID_SOCKET;
    return ecode;
-}  /* end get_file() */
+}  /* end get_tf() */
 
 /**
- * Get an ip list from ip, and call addrecent() on the list.
- * Return VEOK if successful, else error code.
- * NOTE: DOES NOT call addrecent() when Rplist is full. */
-int get_ipl(NODE *np, word32 ip)
+ * @private
+ * Receive OP_SEND_FILE packets of an exact length from NODE *np.
+ * @param np Pointer to NODE, connected and requested
+ * @param buffer Pointer to place received data
+ * @param len Expected length of received data
+ * @return (int) VEOK on exact length received, else error code
+*/
+static int recv_buffer(NODE *np, word8 *buffer, size_t len)
 {
-   char ipaddr[16];  /* for threadsafe ntoa() usage */
+   TX *tx;
+   size_t n, total;
    int ecode;
 
-   pdebug("%s sending OP_GET_IPL...", ntoa(&ip, ipaddr));
+   tx = &(np->tx);
+   for (total = 0; (ecode = recv_tx(np, STD_TIMEOUT)) == VEOK; ) {
+      if (get16(tx->opcode) != OP_SEND_FILE) return VERROR;
+      n = get16(tx->len);
+      if (n > len - total) return VERROR;
+      memcpy(buffer + total, tx->buffer, n);
+      total += n;
+      /* check EOF */
+      if (n < sizeof(tx->buffer)) return total == len ? VEOK : VERROR;
+   }
+
+   return ecode;
+}  /* end recv_buffer() */
+
+/**
+ * @private
+ * Connect to a peer with the C_NGCHUNK capability and send a request.
+ * @param np Pointer to NODE to connect
+ * @param ip Peer to connect
+ * @param bnum Neogenesis block number to request
+ * @param opcode Request operation code
+ * @param data Pointer to request data, or NULL
+ * @param len Length of request data
+ * @return (int) VEOK on success, else error code
+*/
+static int call_ngchunk(NODE *np, word32 ip, const word8 *bnum,
+   word16 opcode, const word8 *data, word16 len)
+{
+   int ecode;
 
-   /* initiate connection with ip */
    ecode = callserver(np, ip);
-   if (ecode == VEOK) {
-      /* send OP_GET_IPL and receive single packet response */
-      ecode = send_op(np, OP_GET_IPL);
-      if (ecode == VEOK) ecode = recv_tx(np, STD_TIMEOUT);
-      /* cleanup */
+   if (ecode != VEOK) return ecode;
+   /* unknown opcodes get pinklisted -- check capability first */
+   if (!(np->tx.version[1] & C_NGCHUNK)) ecode = VERROR;
+   else {
+      put64(np->tx.blocknum, bnum);
+      if (len) memcpy(np->tx.buffer, data, len);
+      put16(np->tx.len, len);
+      ecode = send_op(np, opcode);
+   }
+   if (ecode != VEOK) {
       sock_close(np->sd);
       np->sd = INVALID_SOCKET;
    }
 
    return ecode;
+}  /* end call_ngchunk() */
+
+/**
+ * @private
+ * Get the Merkle layer of a neogenesis block from a quorum member. The
+ * layer depth, implied by the response length, MUST be the depth used by
+ * the peer for the advertised ledger length, and the layer MUST have the
+ * Merkle root of the block trailer. The ledger length is NOT authenticated.
+ * @param ip Quorum member to request
+ * @param bt Pointer to block trailer of neogenesis block
+ * @param layer Pointer to place layer of sub-roots
+ * @param lbytes Pointer to place ledger length
+ * @return (unsigned) layer depth plus one, or zero on error
+*/
+static unsigned get_nglayer(word32 ip, BTRAILER *bt, word8 *layer,
+   word64 *lbytes)
+{
+   NODE node;
+   word8 root[HASHLEN];
+   size_t lcount;
+   unsigned depth;
+   word16 len;
+   int ok;
+
+   if (call_ngchunk(&node, ip, bt->bnum, OP_NG_LAYER, NULL, 0)) return 0;
+   ok = 0;
+   depth = 0;
+   if (recv_tx(&node, STD_TIMEOUT) == VEOK
+         && get16(node.tx.opcode) == OP_NG_LAYER) {
+      len = get16(node.tx.len);
+      for (depth = 0; depth <= NGDEPTH_MAX; depth++) {
+         if (len == 8 + (((size_t) 1 << depth) * HASHLEN)) break;
+      }
+      put64(lbytes, node.tx.buffer);
+      lcount = (size_t) (*lbytes / sizeof(LENTRY));
+      /* layer MUST describe a bounded ledger of the block trailer */
+      if (depth <= NGDEPTH_MAX && *lbytes % sizeof(LENTRY) == 0
+            && lcount >= ((size_t) 1 << depth) && ng_depth(lcount) == depth
+            && (*lbytes >> depth) < NGCHUNKMAX) {
+         memcpy(layer, node.tx.buffer + 8, len - 8);
+         ok = (merkle_layer_root(layer, depth, root) == VEOK
+            && memcmp(root, bt->mroot, HASHLEN) == 0);
+      }
+      if (!ok) pdebug("%s *** bad NG layer", node.id);
+   }
+   sock_close(node.sd);
+
+   return ok ? depth + 1 : 0;
+}  /* end get_nglayer() */
+
+/**
+ * Get a neogenesis block in chunks, from several quorum members in
+ * parallel, and store in fname. A Merkle layer of chunk sub-roots is
+ * checked against the block trailer of bnum, in tfile.dat, and the
+ * (unauthenticated) ledger length of the layer is confirmed by a second
+ * quorum member, where available. Every chunk is checked against its
+ * sub-root before it is written in place. Quorum members serving chunks
+ * that fail verification are excluded, and pinklisted only where another
+ * quorum member serves the same chunk verified (proving the layer).
+ * The resulting block still requires ng_val().
+ * @param quorum Array of quorum members
+ * @param qlen Number of quorum members
+ * @param bnum Neogenesis block number to download
+ * @param fname Filename of output neogenesis block
+ * @return (int) VEOK on success, else error code
+*/
+int get_ngblock(word32 quorum[], word32 qlen, word8 *bnum, char *fname)
+{
+   static word8 layer[((size_t) 1 << NGDEPTH_MAX) * HASHLEN];
+   static word8 check[((size_t) 1 << NGDEPTH_MAX) * HASHLEN];
+   NGHEADER ngh;
+   BTRAILER bt;
+   FILE *fp;
+   word32 *peers;
+   word64 lbytes, cbytes;
+   size_t lcount, nchunks;
+   unsigned depth, cdepth;
+   word32 j, k;
+   int failed;
+
+   /* init */
+   lbytes = 0;
+   lcount = 0;
+   depth = 0;
+
+   /* neogenesis block trailer was validated with tfile.dat */
+   if (read_tfile(&bt, bnum, 1, "tfile.dat") != 1) return VERROR;
+   if (qlen == 0) return VERROR;
+   peers = malloc(qlen * sizeof(word32));
+   if (peers == NULL) return VERROR;
+   memcpy(peers, quorum, qlen * sizeof(word32));
+
+   /* get Merkle layer from the first capable quorum member... */
+   for (nchunks = 0, j = 0; nchunks == 0 && j < qlen && Running; j++) {
+      depth = get_nglayer(peers[j], &bt, layer, &lbytes);
+      if (depth-- == 0) continue;
+      /* ... confirmed by the next capable member (where available) */
+      for (cdepth = 0, k = j + 1; cdepth == 0 && k < qlen && Running; k++) {
+         cdepth = get_nglayer(peers[k], &bt, check, &cbytes);
+      }
+      if (cdepth && (cdepth - 1 != depth || cbytes != lbytes
+            || memcmp(check, layer, (size_t) HASHLEN << depth) != 0)) {
+         pdebug("NG layer mismatch, trying next...");
+         continue;
+      }
+      lcount = (size_t) (lbytes / sizeof(LENTRY));
+      nchunks = (size_t) 1 << depth;
+   }
+   if (nchunks == 0 || !Running) {
+      free(peers);
+      return VERROR;
+   }
+
+   /* prepare neogenesis block with header and trailer in place */
+   put32(ngh.hdrlen, sizeof(NGHEADER));
+   put64(ngh.lbytes, &lbytes);
+   fp = fopen(fname, "wb");
+   if (fp == NULL) {
+      free(peers);
+      return VERROR;
+   }
+   if (fwrite(&ngh, sizeof(NGHEADER), 1, fp) != 1
+         || fseek64(fp, (long long) (sizeof(NGHEADER) + lbytes), SEEK_SET)
+         || fwrite(&bt, sizeof(BTRAILER), 1, fp) != 1) {
+      fclose(fp);
+      remove(fname);
+      free(peers);
+      return VERROR;
+   }
+
+   /* download chunks in parallel -- one thread per quorum member */
+   plog("downloading %u NG chunks from %u peers...",
+      (unsigned) nchunks, (unsigned) qlen);
+   failed = 0;
+   OMP_PARALLEL_(for num_threads(qlen) schedule(dynamic))
+   for (word32 idx = 0; idx < nchunks; idx++) {
+      NODE node;
+      word8 *chunk, *mtree, request[3], subroot[HASHLEN];
+      word32 peer, tries, *suspect, nsuspect;
+      size_t count, offset, k;
+      int done, stop;
+
+      OMP_ATOMIC_(read)
+      stop = failed;
+      if (stop || !Running) continue;
+      count = merkle_range(lcount, depth, idx, &offset);
+      chunk = malloc(count * sizeof(LENTRY));
+      mtree = malloc(count * HASHLEN);
+      suspect = malloc(qlen * sizeof(word32));
+      nsuspect = 0;
+      request[0] = (word8) depth;
+      put16(request + 1, (word16) idx);
+      /* start with a different quorum member per chunk */
+      for (done = 0, tries = 0; chunk && mtree && suspect && tries < qlen;
+            tries++) {
+         OMP_CRITICAL_()
+         peer = peers[(idx + tries) % qlen];
+         if (peer == 0) continue;
+         if (call_ngchunk(&node, peer, bnum, OP_GET_NGCHUNK, request, 3)) {
+            continue;
+         }
+         if (recv_buffer(&node, chunk, count * sizeof(LENTRY)) != VEOK) {
+            sock_close(node.sd);
+            continue;
+         }
+         sock_close(node.sd);
+         /* verify chunk against sub-root of Merkle layer */
+         for (k = 0; k < count; k++) {
+            sha256(chunk + (k * sizeof(LENTRY)), sizeof(LENTRY),
+               mtree + (k * HASHLEN));
+         }
+         merkle_root(mtree, count, subroot);
+         if (memcmp(subroot, layer + (idx * HASHLEN), HASHLEN) != 0) {
+            /* exclude peer -- layer may be at fault until proven */
+            pdebug("%s *** bad NG chunk %u", node.id, (unsigned) idx);
+            suspect[nsuspect++] = peer;
+            OMP_CRITICAL_()
+            peers[(idx + tries) % qlen] = 0;
+            continue;
+         }
+         /* write chunk in place, and pinklist peers disproven by it */
+         OMP_CRITICAL_()
+         {
+            done = (fseek64(fp, (long long) (sizeof(NGHEADER)
+               + (offset * sizeof(LENTRY))), SEEK_SET) == 0
+               && fwrite(chunk, sizeof(LENTRY), count, fp) == count);
+            while (nsuspect) pinklist(suspect[--nsuspect]);
+         }
+         break;
+      }
+      if (!done) {
+         OMP_ATOMIC_(write)
+         failed = 1;
+      }
+      if (chunk) free(chunk);
+      if (mtree) free(mtree);
+      if (suspect) free(suspect);
+   }  /* end OMP_PARALLEL_() */
+
+   /* cleanup */
+   free(peers);
+   if (fclose(fp) != 0) failed = 1;
+   if (failed || !Running) {
+      remove(fname);
+      return VERROR;
+   }
+
+   return VEOK;
+}  /* end get_ngblock() */
+
+/**
+ * Get an ip list from ip, and call addrecent() on the list.
+ * Return VEOK if successful, else error code.
+ * NOTE: DOES NOT call addrecent() when Rplist is full. */
+int get_ipl(NODE *np, word32 ip)
+{
+   char ipaddr[16];  /* for threadsafe ntoa() usage */
+
+   pdebug("%s sending OP_GET_IPL...", ntoa(&ip, ipaddr));
+
+   /* send OP_GET_IPL and receive single packet response */
+   return get_oneshot(np, ip, OP_GET_IPL, NULL, NULL, 0);
 }  /* end get_ipl() */
 
 /**
@@ -745,29 +2107,30 @@ int get_hash(NODE *np, word32 ip, void *bnum, void *blockhash)
    char ipaddr[16];  /* for threadsafe ntoa() usage */
 
    pdebug("%s calling...", ntoa(&ip, ipaddr));
-   if (callserver(np, ip) != VEOK) return VERROR;
-
-   /* insert blocknum request */
    tx = &(np->tx);
-   if (bnum == NULL) {
+   if (bnum) {
+      /* known blocknum request in a single round trip */
+      ecode = get_oneshot(np, ip, OP_HASH, bnum, NULL, 0);
+      if (ecode != VEOK) return ecode;
+   } else {
+      if (callserver(np, ip) != VEOK) return VERROR;
+      /* insert blocknum request */
       pdebug("%s passing node's cblock to blocknum...", np->id);
       put64(tx->blocknum, tx->cblock);
-   } else put64(tx->blocknum, bnum);
-
-   /* perform OP_HASH request and receive -- close socket */
-   pdebug("%s sending OP_HASH...", np->id);
-   ecode = send_op(np, OP_HASH);
-   if (ecode != VEOK) return ecode;
-   ecode = recv_tx(np, STD_TIMEOUT);
-   if (ecode != VEOK) return ecode;
+      /* perform OP_HASH request and receive -- close socket */
+      pdebug("%s sending OP_HASH...", np->id);
+      ecode = send_op(np, OP_HASH);
+      if (ecode == VEOK) ecode = recv_tx(np, STD_TIMEOUT);
+      sock_close(np->sd);
+      np->sd = INVALID_SOCKET;
+      if (ecode != VEOK) return ecode;
+   }
 
-   /* cleanup -- check response */
-   sock_close(np->sd);
-   np->sd = INVALID_SOCKET;
+   /* check response */
    if (get16(tx->opcode) != OP_HASH) {
       pdebug("%s unexpected opcode...", np->id);
       return VERROR;
-   } else if (get16(tx->len) != HASHLEN) {
+   } else if (get16(tx->len) != HASHLEN && get16(tx->len) != HASHLEN * 2) {
       pdebug("%s unexpected len...", np->id);
       return VERROR;
    }
@@ -778,6 +2141,140 @@ int get_hash(NODE *np, word32 ip, void *bnum, void *blockhash)
    return VEOK;
 }  /* end get_hash() */
 
+/**
+ * Get a verified MMR proof of a trailer from ip. See mmr_proof().
+ * The caller MUST compare root, or weight, against a value it trusts.
+ * @param np Pointer to NODE to use for connection
+ * @param ip IPv4 address of peer
+ * @param bnum Block number of trailer to prove
+ * @param count Number of trailers to prove against
+ * @param bt Pointer to place proven trailer
+ * @param root Pointer to place MMR root hash of count trailers
+ * @param weight Pointer to place chain weight of count trailers
+ * @return (int) value representing operation result
+ * @retval VEBAD on bad proof, or proof of another trailer or count
+ * @retval VERROR on error, or peer without CX_MMR
+ * @retval VEOK on success
+ */
+int get_mmrproof(NODE *np, word32 ip, const word8 bnum[8],
+   const word8 count[8], BTRAILER *bt, word8 root[HASHLEN], word8 weight[32])
+{
+   TX *tx;
+   int ecode;
+
+   if (callserver(np, ip) != VEOK) return VERROR;
+
+   /* perform OP_GET_MMRPROOF request, only of capable peers */
+   tx = &(np->tx);
+   ecode = VERROR;
+   if (np->cxbits & CX_MMR) {
+      put64(tx->blocknum, bnum);
+      memcpy(tx->buffer, count, 8);
+      put16(tx->len, 8);
+      ecode = send_op(np, OP_GET_MMRPROOF);
+      if (ecode == VEOK) ecode = recv_tx(np, STD_TIMEOUT);
+   }
+   sock_close(np->sd);
+   np->sd = INVALID_SOCKET;
+   if (ecode != VEOK) return ecode;
+   if (get16(tx->opcode) != OP_GET_MMRPROOF) {
+      pdebug("%s unexpected opcode...", np->id);
+      return VERROR;
+   }
+
+   /* verify proof, and that it is of the requested trailer and count */
+   if (mmr_verify(tx->buffer, get16(tx->len), root, weight, NULL) != VEOK) {
+      pdebug("%s bad MMR proof...", np->id);
+      return VEBAD;
+   }
+   memcpy(bt, tx->buffer + 8, sizeof(BTRAILER));
+   if (memcmp(tx->buffer, count, 8) != 0 || cmp64(bt->bnum, bnum) != 0) {
+      pdebug("%s unexpected MMR proof...", np->id);
+      return VEBAD;
+   }
+
+   return VEOK;
+}  /* end get_mmrproof() */
+
+/**
+ * Get the ledger state commitment of a particular block number from ip.
+ * Place returned commitment in *lstate. See le_lstate().
+ * Return VEOK if successful, else error code. */
+int get_lstate(NODE *np, word32 ip, void *bnum, void *lstate)
+{
+   int ecode;
+
+   ecode = get_hash(np, ip, bnum, NULL);
+   if (ecode != VEOK) return ecode;
+   /* peer may not understand, or know, the commitment */
+   if (get16(np->tx.len) != HASHLEN * 2) return VERROR;
+   memcpy(lstate, np->tx.buffer + HASHLEN, HASHLEN);
+
+   return VEOK;
+}  /* end get_lstate() */
+
+/**
+ * Check the ledger state commitment of a block number against peers.
+ * At most count peers answering with a commitment are asked.
+ * @param plist Pointer to list of peers
+ * @param plen Number of peers in list
+ * @param bnum Block number of ledger state to check
+ * @param count Maximum number of commitments to compare
+ * @return (int) value representing check result
+ * @retval VEBAD if most answering peers hold a different ledger state
+ * @retval VERROR if no commitment could be compared
+ * @retval VEOK if the ledger state matches most answering peers
+ */
+int check_lstate(word32 plist[], int plen, void *bnum, int count)
+{
+   NODE node;
+   word8 lstate[HASHLEN], peerstate[HASHLEN];
+   int j, match, diff;
+
+   if (le_lstate(bnum, lstate) != VEOK) return VERROR;
+   for (match = diff = j = 0; j < plen && match + diff < count; j++) {
+      if (plist[j] == 0 || !Running) break;
+      if (get_lstate(&node, plist[j], bnum, peerstate) != VEOK) continue;
+      if (memcmp(lstate, peerstate, HASHLEN) == 0) match++;
+      else {
+         pdebug("%s ledger state differs", node.id);
+         diff++;
+      }
+   }
+   if (match + diff == 0) return VERROR;
+
+   return (diff > match) ? VEBAD : VEOK;
+}  /* end check_lstate() */
+
+/**
+ * @private
+ * Unwrap a single-shot request from the OP_HELLO packet of a handshake.
+ * Only capable nodes unwrap qualifying requests bound to a non-zero id1,
+ * leaving the packet as the request, as if sent after the handshake.
+ * @param np Pointer to NODE with OP_HELLO packet
+ * @return 1 if packet was unwrapped, else 0
+*/
+static int gettx__oneshot(NODE *np)
+{
+   TX *tx;
+   word16 len, opcode;
+
+   tx = &(np->tx);
+   len = get16(tx->len);
+   if (!(Cxbits & CX_ONESHOT) || np->id1 == 0) return 0;
+   if (len < 4 || tx->buffer[0] != CXONESHOT) return 0;
+   opcode = get16(tx->buffer + 2);
+   if (!oneshot_op(opcode)) return 0;
+
+   /* unwrap request */
+   np->cxbits = tx->buffer[1];
+   memmove(tx->buffer, tx->buffer + 4, len - 4);
+   put16(tx->len, len - 4);
+   put16(tx->opcode, opcode);
+
+   return 1;
+}  /* end gettx__oneshot() */
+
 /**
  * Handle an incoming packets from the Mochimo network. Reads a TX structure
  * from SOCKET sd.  Handles 3-way handshake and validates crc and id's.
@@ -827,7 +2324,20 @@ int gettx(NODE *np, SOCKET sd)
    np->id2 = id2 = rand16();
    np->id1 = id1 = get16(tx->id1);
    snprintf(np->id, sizeof(np->id), "%.15s %.02x~%.02x", ipaddr, id1, id2);
+   /* single-shot requests skip the rest of the handshake */
+   if (gettx__oneshot(np)) {
+      opcode = get16(tx->opcode);
+      pdebug("%s got single-shot opcode = %d", np->id, opcode);
+      goto request;
+   }
    put16(tx->opcode, OP_HELLO_ACK);
+   /* exchange extended capabilities, only with capable peers */
+   np->cxbits = hello_cxbits(tx, CXHELLO);
+   if (get16(tx->len) >= 2 && tx->buffer[0] == CXHELLO) {
+      tx->buffer[0] = CXHELLO_ACK;
+      tx->buffer[1] = Cxbits;
+      put16(tx->len, 2);
+   }
    if (send_tx(np, 1) != VEOK) return VERROR;
 
    /* how can I help you? */
@@ -839,6 +2349,16 @@ int gettx(NODE *np, SOCKET sd)
    opcode = get16(tx->opcode);  /* execute() will check opcode */
    pdebug("%s got opcode = %d  status = %d", np->id, opcode, status);
    if (!valid_op(opcode)) goto bad1;  /* she was a bad girl */
+request:
+   /* note peer's advertised chain tip */
+   tip_update(np->ip, tx);
+
+   /* check request quotas before doing any work */
+   if (ratelimited(np->ip, opcode)) {
+      pdebug("%s throttled, opcode = %d", np->id, opcode);
+      send_op(np, OP_BUSY);
+      return 1;
+   }
 
    /* check simple responses */
    switch (opcode) {
@@ -846,6 +2366,7 @@ int gettx(NODE *np, SOCKET sd)
          /* only add those that "optin" */
          if (tx->version[1] & C_OPTIN) {
             addrecent(np->ip);
+            pdb_add(np->ip, np->ip);
          }
          send_ipl(np);
          return 1;
@@ -879,11 +2400,22 @@ int gettx(NODE *np, SOCKET sd)
          break;
       }
       case OP_BALANCE:     send_balance(np); return 1;
+      case OP_BALANCE_BATCH: {
+         if (Cbits & C_BATCH) send_balance_batch(np);
+         return 1;
+      }
       case OP_RESOLVE:     /* send_resolve(np); */ return 1;
       case OP_GET_CBLOCK:  /* fallthrough */
       case OP_MBLOCK:      if (!Allowpush) return 1; break;
+      case OP_NG_LAYER:    /* fallthrough */
+      case OP_GET_NGCHUNK: if (!(Cbits & C_NGCHUNK)) return 1; break;
       case OP_HASH:        send_hash(np); return 1;
+      case OP_GET_MMRPROOF: {
+         if (Cxbits & CX_MMR) send_mmrproof(np);
+         return 1;
+      }
       case OP_IDENTIFY:    send_identify(np); return 1;
+      case OP_TF:          rcache__tftail(); break;  /* for child */
       case OP_BUSY:        /* fallthrough */
       case OP_NACK:        /* fallthrough */
       case OP_HELLO_ACK:   return 1;
@@ -891,7 +2423,13 @@ int gettx(NODE *np, SOCKET sd)
    }
 
    /* If too many children in too small a space... */
-   if (crowded(opcode)) return 1;  /* suppress child unless OP_FOUND */
+   if (crowded(np, opcode)) return 1;  /* suppress child unless valued */
+   /* ... or too many children doing the same thing */
+   if (rlbusy(opcode)) {
+      pdebug("%s throttled (busy), opcode = %d", np->id, opcode);
+      send_op(np, OP_BUSY);
+      return 1;
+   }
    return VEOK;  /* success -- fork() child in server() */
 
 bad1: epinklist(np->ip);
@@ -979,6 +2517,8 @@ int scan_quorum
                peer = *((word32 *) &node.tx.buffer[len]);
                if (peer == 0 || pinklisted(peer)) continue;
                if (!isprivate(peer) || !Noprivate) result++;
+               /* remember advertised peer, and source */
+               pdb_add(peer, node.ip);
                /* add to network list */
                OMP_CRITICAL_()
                if (addpeer(peer, netplist, 1024, &netplistidx)) {
@@ -1033,6 +2573,7 @@ int refresh_ipl(void)
       ipp = (word32 *) node.tx.buffer;
       for( ; len > 0; ipp++, len -= 4) {
          if (*ipp == 0) continue;
+         pdb_add(*ipp, ip);  /* remember advertised peer, and source */
          if (Rplist[RPLISTLEN - 1]) break;
          addrecent(*ipp);
       }
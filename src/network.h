@@ -25,14 +25,27 @@
 #include "types.h"
 #include "peer.h"
 
+/* TX packet header and trailer lengths */
+#define TXHDRLEN     124
+#define TXTLRLEN     4
+
 /* The Node struct */
+/* child slot value classes */
+#define SLOT_LOW     0     /* unknown peers, e.g. scrapers */
+#define SLOT_HIGH    1     /* block announcers, and proven peers */
+#define SLOTCLASSES  2     /* number of slot value classes */
+#define SLOT_EVICTED SLOTCLASSES   /* child signaled for eviction */
+
 typedef struct {
    TX tx;               /* packet buffer */
    word32 ip;           /* source ip *//*
    word16 port;         // unused... */
    word16 id1, id2;     /* from tx handshake */
+   word8 cxbits;        /* extended capability bits, from tx handshake */
    char id[32];         /* "0.0.0.0 AB~EF" - for logging identification */
    pid_t pid;           /* process id of child -- zero if empty slot */
+   time_t stamp;        /* time child slot was taken */
+   word8 slot;          /* slot value class of child, see SLOT_* */
    SOCKET sd;
 } NODE;
 
@@ -43,6 +56,8 @@ extern word32 Nrecvs;
 extern word32 Nsends;
 extern word32 Nrecverrs;
 extern word32 Nsenderrs;
+extern word32 Ncrowded[SLOTCLASSES];
+extern word32 Nevicted[SLOTCLASSES];
 
 /* C/C++ compatible function prototypes */
 #ifdef __cplusplus
@@ -50,24 +65,42 @@ extern "C" {
 #endif
 
 NODE *getslot(NODE *np);
+int rlbusy(int opcode);
+int slotclass(word32 ip, int opcode);
 int freeslot(NODE *np);
 int child_status(NODE *np, pid_t pid, int status);
 int recv_tx(NODE *np, double timeout);
+int recv_tx_check(NODE *np);
 int recv_file(NODE *np, char *fname);
 int send_tx(NODE *np, double timeout);
 int send_op(NODE *np, int opcode);
 int send_nack(NODE *np, int errnum);
 int send_file(NODE *np, char *fname);
+int send_file_range(NODE *np);
 int send_balance(NODE *np);
+int send_balance_batch(NODE *np);
 int send_ipl(NODE *np);
 int send_hash(NODE *np);
 int send_tf(NODE *np);
 int send_identify(NODE *np);
+int send_nglayer(NODE *np);
+int send_ngchunk(NODE *np);
+int send_mmrproof(NODE *np);
+int found_early(TX *tx);
+int send_found_early(char *fname);
 int send_found(void);
 int callserver(NODE *np, word32 ip);
+int get_oneshot(NODE *np, word32 ip, word16 opcode, const void *bnum,
+   const void *buf, word16 len);
 int get_file(word32 ip, word8 *bnum, char *fname);
+int get_tf(word32 ip, word32 first, word32 count, char *fname);
+int get_ngblock(word32 quorum[], word32 qlen, word8 *bnum, char *fname);
 int get_ipl(NODE *np, word32 ip);
 int get_hash(NODE *np, word32 ip, void *bnum, void *blockhash);
+int get_lstate(NODE *np, word32 ip, void *bnum, void *lstate);
+int get_mmrproof(NODE *np, word32 ip, const word8 bnum[8],
+   const word8 count[8], BTRAILER *bt, word8 root[HASHLEN], word8 weight[32]);
+int check_lstate(word32 plist[], int plen, void *bnum, int count);
 int gettx(NODE *np, SOCKET sd);
 int scan_quorum
    (word32 quorum[], word32 qlen, void *hash, void *weight, void *bnum);
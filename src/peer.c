@@ -13,12 +13,15 @@
 
 /* internal support */
 #include "error.h"
+#include "parallel.h"
+#include "sha256.h"
 
 /* external support */
 #include <string.h>
 #include <stdlib.h>
 #include "extlib.h"
 #include "extinet.h"
+#include "extmath.h"
 
 /* Recent peers list */
 word32 Rplist[RPLISTLEN] = {0};
@@ -35,6 +38,23 @@ word32 Epinkidx = 0;
 word8 Nopinklist = 0;  /* disable pinklist IP's when set */
 word8 Noprivate = 0;   /* filter out private IP's when set v.28 */
 
+/* per-peer token buckets, by opcode class (see RL_* classes) */
+RLENTRY Rlimit[RLIMITLEN];
+/* chain tips last advertised by peers */
+TIPENTRY Tips[TIPSLEN];
+/* peer database, bucketed by address group and source group */
+PDBENTRY Peerdb[PDBBUCKETS][PDBBUCKETSZ];
+static word32 Pdbsalt;  /* secret bucket salt -- persists with database */
+/* requests per minute (zero is unlimited) */
+word32 Rlquota[RLCLASSES] = { 60, 120, 12, 120, 30, 120, 120 };
+/* requests in a single burst */
+word32 Rlburst[RLCLASSES] = { 20, 30, 4, 30, 10, 30, 72 };
+/* concurrent children (zero is unlimited) */
+word32 Rlconcur[RLCLASSES] = { 0, 0, 0, 0, 8, 16, 0 };
+/* throttled requests */
+word32 Nthrottled[RLCLASSES];
+word8 Norlimit = 0;    /* disable rate limiting when set */
+
 /**
  * Search a list[] of 32-bit unsigned integers for a non-zero value.
  * A zero value marks the end of list (zero cannot be in the list).
@@ -345,5 +365,446 @@ void purge_epoch(void)
    Epinkidx = 0;
 }
 
+/**
+ * Get the rate limit class of an opcode.
+ * @param opcode Operation code to classify
+ * @return (int) rate limit class, or RL_NONE if not rate limited
+ */
+int rlclass(int opcode)
+{
+   switch (opcode) {
+      case OP_TX:          return RL_TX;
+      case OP_BALANCE:     /* fallthrough */
+      case OP_BALANCE_BATCH: /* fallthrough */
+      case OP_RESOLVE:     return RL_BALANCE;
+      case OP_GET_IPL:     return RL_IPL;
+      case OP_HASH:        /* fallthrough */
+      case OP_IDENTIFY:    return RL_HASH;
+      case OP_TF:          /* fallthrough */
+      case OP_GET_TFILE:   return RL_TF;
+      case OP_GET_MMRPROOF: return RL_MMR;
+      case OP_GET_BLOCK:   /* fallthrough */
+      case OP_GET_CBLOCK:  /* fallthrough */
+      case OP_NG_LAYER:    /* fallthrough */
+      case OP_GET_NGCHUNK: /* fallthrough */
+      case OP_MBLOCK:      return RL_BLOCK;
+      default:             return RL_NONE;
+   }
+}  /* end rlclass() */
+
+/**
+ * Get the name of a rate limit class.
+ * @param rlc Rate limit class
+ * @return (char *) name of rate limit class, or "none"
+ */
+char *rlclass2str(int rlc)
+{
+   static char *names[RLCLASSES] = {
+      "tx", "balance", "ipl", "hash", "tf", "block", "mmr"
+   };
+
+   if (rlc < 0 || rlc >= RLCLASSES) return "none";
+   return names[rlc];
+}  /* end rlclass2str() */
+
+/**
+ * @private
+ * Find the rate limit entry of a peer. When not found, the least
+ * recently used entry is recycled with full buckets for the peer.
+ * @param ip Peer ip to find
+ * @param now Current time, for initialization of recycled entries
+ * @return (RLENTRY *) pointer to rate limit entry of peer
+ */
+static RLENTRY *rlentry(word32 ip, time_t now)
+{
+   RLENTRY *rp, *oldest;
+   int rlc;
+
+   /* find peer entry, noting the least recently used */
+   oldest = Rlimit;
+   for (rp = Rlimit; rp < &Rlimit[RLIMITLEN]; rp++) {
+      if (rp->ip == ip) return rp;
+      if (rp->stamp < oldest->stamp) oldest = rp;
+   }
+
+   /* recycle least recently used entry */
+   oldest->ip = ip;
+   oldest->stamp = now;
+   for (rlc = 0; rlc < RLCLASSES; rlc++) {
+      oldest->tokens[rlc] = Rlburst[rlc] * RLUNIT;
+   }
+
+   return oldest;
+}  /* end rlentry() */
+
+/**
+ * Check (and consume) a peer's request allowance for an opcode. Each
+ * peer holds a token bucket per opcode class, refilled at Rlquota[]
+ * tokens per minute, up to a maximum of Rlburst[] tokens. A request
+ * consumes a single token from the bucket of its opcode class.
+ * @param ip Peer ip making the request
+ * @param opcode Operation code of the request
+ * @return (int) value representing rate limit result
+ * @retval 1 if request exceeds quota; request should be dropped
+ * @retval 0 if request is permitted
+ */
+int ratelimited(word32 ip, int opcode)
+{
+   RLENTRY *rp;
+   time_t now;
+   word32 elapsed, cap;
+   int rlc;
+
+   if (Norlimit) return 0;
+
+   /* check opcode class is rate limited */
+   rlc = rlclass(opcode);
+   if (rlc == RL_NONE || Rlquota[rlc] == 0) return 0;
+
+   /* find peer and refill buckets for time elapsed */
+   time(&now);
+   rp = rlentry(ip, now);
+   elapsed = (now > rp->stamp) ? (word32) (now - rp->stamp) : 0;
+   if (elapsed) {
+      rp->stamp = now;
+      for (int c = 0; c < RLCLASSES; c++) {
+         cap = Rlburst[c] * RLUNIT;
+         /* NOTE: quota of 1 token/minute refills 1 fraction/second */
+         if (elapsed >= cap) rp->tokens[c] = cap;
+         else rp->tokens[c] += elapsed * Rlquota[c];
+         if (rp->tokens[c] > cap) rp->tokens[c] = cap;
+      }
+   }
+
+   /* consume token, or throttle */
+   if (rp->tokens[rlc] < RLUNIT) {
+      Nthrottled[rlc]++;
+      return 1;
+   }
+   rp->tokens[rlc] -= RLUNIT;
+
+   return 0;
+}  /* end ratelimited() */
+
+/**
+ * Update the chain tip of a peer, as advertised in a TX packet. When not
+ * found, the least recently seen entry is recycled for the peer.
+ * @note OP_TX packets do not advertise chain weight, and are ignored.
+ * @param ip Peer ip of advertisement
+ * @param tx Pointer to TX packet received from peer
+ */
+void tip_update(word32 ip, const TX *tx)
+{
+   TIPENTRY *tp, *oldest;
+
+   if (ip == 0 || get16(tx->opcode) == OP_TX) return;
+
+   OMP_CRITICAL_()
+   {
+      /* find peer entry, noting the least recently seen */
+      oldest = Tips;
+      for (tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+         if (tp->ip == ip) break;
+         if (tp->stamp < oldest->stamp) oldest = tp;
+      }
+      if (tp == &Tips[TIPSLEN]) tp = oldest;
+      /* store advertised chain tip */
+      tp->ip = ip;
+      put64(tp->bnum, tx->cblock);
+      memcpy(tp->bhash, tx->cblockhash, HASHLEN);
+      memcpy(tp->phash, tx->pblockhash, HASHLEN);
+      memcpy(tp->weight, tx->weight, 32);
+      time(&(tp->stamp));
+   }  /* end OMP_CRITICAL_() */
+}  /* end tip_update() */
+
+/**
+ * Build a quorum from recently seen peer chain tips, as an alternative to
+ * a network scan with scan_quorum(). Quorum members advertised the highest
+ * chain weight, and the same block hash, within maxage seconds.
+ * @param quorum Pointer to place quorum members, or NULL to count
+ * @param qlen Maximum number of quorum members
+ * @param hash Pointer to place highest block hash (may be NULL)
+ * @param weight Pointer to place highest chain weight (may be NULL)
+ * @param bnum Pointer to place highest block number (may be NULL)
+ * @param maxage Maximum age, in seconds, of a peer chain tip
+ * @return (int) number of quorum members
+ */
+int tip_quorum(word32 quorum[], word32 qlen, void *hash, void *weight,
+   void *bnum, time_t maxage)
+{
+   TIPENTRY *tp, *high;
+   time_t now;
+   word32 count;
+
+   /* find highest recent chain tip */
+   time(&now);
+   high = NULL;
+   for (tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+      if (tp->ip == 0 || now - tp->stamp > maxage) continue;
+      if (pinklisted(tp->ip)) continue;
+      if (high == NULL || cmp256(tp->weight, high->weight) > 0) high = tp;
+   }
+   if (high == NULL) return 0;
+
+   /* qualify recent peers on the highest chain tip */
+   if (quorum) memset(quorum, 0, sizeof(word32) * qlen);
+   for (count = 0, tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+      if (quorum && count >= qlen) break;
+      if (tp->ip == 0 || now - tp->stamp > maxage) continue;
+      if (pinklisted(tp->ip)) continue;
+      if (cmp256(tp->weight, high->weight) != 0) continue;
+      if (memcmp(tp->bhash, high->bhash, HASHLEN) != 0) continue;
+      if (quorum) quorum[count] = tp->ip;
+      count++;
+   }
+
+   /* set highest hash, weight and block number */
+   if (hash) memcpy(hash, high->bhash, HASHLEN);
+   if (weight) memcpy(weight, high->weight, 32);
+   if (bnum) put64(bnum, high->bnum);
+
+   return (int) count;
+}  /* end tip_quorum() */
+
+/**
+ * Print the chain tips last advertised by peers.
+ */
+void print_tips(void)
+{
+   TIPENTRY *tp;
+   time_t now;
+
+   time(&now);
+   for (tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+      if (tp->ip == 0) continue;
+      printf("   %-15.15s 0x%s 0x...%s %lds\n", ntoa(&(tp->ip), NULL),
+         bnum2hex(tp->bnum, NULL), weight2hex(tp->weight, NULL),
+         (long) (now - tp->stamp));
+   }
+
+   printf("\n");
+}  /* end print_tips() */
+
+/**
+ * @private
+ * Get the peer database bucket of a peer. Peers of the same /16 address
+ * group, advertised by the same /16 source group, share a bucket, and
+ * each source group is limited to PDBSRCBUCKETS buckets, so a flood of
+ * addresses from few sources cannot displace the rest of the database.
+ * @param ip Peer ip
+ * @param source ip of advertising peer, or zero
+ * @return (PDBENTRY *) pointer to first entry of bucket
+ */
+static PDBENTRY *pdb_bucket(word32 ip, word32 source)
+{
+   word8 data[8], hash[HASHLEN];
+
+   /* select source group bucket for address group... */
+   if (Pdbsalt == 0) Pdbsalt = ((word32) rand16() << 16) | rand16() | 1;
+   put32(data, Pdbsalt);
+   memcpy(data + 4, &ip, 2);
+   sha256(data, 6, hash);
+   /* ... from the (salted) buckets of the source group */
+   data[4] = ((word8 *) &source)[0];
+   data[5] = ((word8 *) &source)[1];
+   data[6] = (word8) (get32(hash) % PDBSRCBUCKETS);
+   sha256(data, 7, hash);
+
+   return Peerdb[get32(hash) % PDBBUCKETS];
+}  /* end pdb_bucket() */
+
+/**
+ * Find a peer in the peer database.
+ * @param ip Peer ip to find
+ * @return (PDBENTRY *) pointer to entry of peer, or NULL if not found
+ */
+PDBENTRY *pdb_find(word32 ip)
+{
+   PDBENTRY *pp;
+
+   if (ip == 0) return NULL;
+   for (pp = Peerdb[0]; pp < Peerdb[PDBBUCKETS]; pp++) {
+      if (pp->ip == ip) return pp;
+   }
+
+   return NULL;
+}  /* end pdb_find() */
+
+/**
+ * Add an advertised peer to the peer database. When the bucket of the
+ * peer is full, the entry of a bad, or the oldest unproven, peer is
+ * evicted; entries of proven peers are never evicted for new peers.
+ * @param ip Peer ip to add
+ * @param source ip of advertising peer, or zero (e.g. peer list files)
+ * @return (int) value representing operation result
+ * @retval VERROR if peer was rejected, or no entry could be evicted
+ * @retval VEOK if peer was added, or already known
+ */
+int pdb_add(word32 ip, word32 source)
+{
+   PDBENTRY *pp, *bucket, *victim;
+   int ecode;
+
+   if (ip == 0 || pinklisted(ip)) return VERROR;
+   if (Noprivate && isprivate(ip)) return VERROR;
+
+   ecode = VEOK;
+   OMP_CRITICAL_((peerdb))
+   {
+      if (pdb_find(ip) == NULL) {
+         /* find free entry, else least valuable entry, of bucket */
+         bucket = pdb_bucket(ip, source);
+         for (victim = NULL, pp = bucket; pp < &bucket[PDBBUCKETSZ]; pp++) {
+            if (pp->ip == 0) {
+               victim = pp;
+               break;
+            }
+            if (pp->bad >= PDBMAXBAD) victim = pp;
+            else if (pp->good == 0 && (victim == NULL ||
+                  (victim->bad < PDBMAXBAD && pp->first < victim->first))) {
+               victim = pp;
+            }
+         }
+         if (victim == NULL) ecode = VERROR;
+         else {
+            memset(victim, 0, sizeof(PDBENTRY));
+            victim->ip = ip;
+            victim->source = source;
+            victim->first = (word32) time(NULL);
+         }
+      }
+   }  /* end OMP_CRITICAL_() */
+
+   return ecode;
+}  /* end pdb_add() */
+
+/**
+ * Record a successful connection to a peer in the peer database.
+ * Unknown peers are added as their own source.
+ * @param ip Peer ip of connection
+ */
+void pdb_good(word32 ip)
+{
+   PDBENTRY *pp;
+
+   pdb_add(ip, ip);
+   OMP_CRITICAL_((peerdb))
+   {
+      pp = pdb_find(ip);
+      if (pp) {
+         if (pp->good < WORD16_MAX) pp->good++;
+         pp->bad = 0;
+         pp->last = pp->attempt = (word32) time(NULL);
+      }
+   }
+}  /* end pdb_good() */
+
+/**
+ * Record a failed connection to a peer in the peer database.
+ * @param ip Peer ip of connection
+ */
+void pdb_bad(word32 ip)
+{
+   PDBENTRY *pp;
+
+   OMP_CRITICAL_((peerdb))
+   {
+      pp = pdb_find(ip);
+      if (pp) {
+         if (pp->bad < WORD16_MAX) pp->bad++;
+         pp->attempt = (word32) time(NULL);
+      }
+   }
+}  /* end pdb_bad() */
+
+/**
+ * Sample peers from the peer database. Proven peers are sampled before
+ * unproven peers, in random order. Bad and pinklisted peers are skipped.
+ * @param list Pointer to place sampled peers
+ * @param len Maximum number of peers to sample
+ * @return (int) number of peers sampled
+ */
+int pdb_sample(word32 *list, int len)
+{
+   word32 proven[PDBBUCKETS * PDBBUCKETSZ];
+   word32 unproven[PDBBUCKETS * PDBBUCKETSZ];
+   word32 np, nu;
+   PDBENTRY *pp;
+   int count;
+
+   for (np = nu = 0, pp = Peerdb[0]; pp < Peerdb[PDBBUCKETS]; pp++) {
+      if (pp->ip == 0 || pp->bad >= PDBMAXBAD || pinklisted(pp->ip)) {
+         continue;
+      }
+      if (pp->good) proven[np++] = pp->ip;
+      else unproven[nu++] = pp->ip;
+   }
+   if (np < PDBBUCKETS * PDBBUCKETSZ) proven[np] = 0;
+   if (nu < PDBBUCKETS * PDBBUCKETSZ) unproven[nu] = 0;
+   shuffle32(proven, np);
+   shuffle32(unproven, nu);
+
+   for (count = 0; count < len && (word32) count < np; count++) {
+      list[count] = proven[count];
+   }
+   for ( ; count < len && (word32) count < np + nu; count++) {
+      list[count] = unproven[count - np];
+   }
+
+   return count;
+}  /* end pdb_sample() */
+
+/**
+ * Save the peer database to disk.
+ * @param fname Filename of peer database
+ * @return (int) VEOK on success, else VERROR
+ */
+int pdb_save(char *fname)
+{
+   word8 salt[4];
+   FILE *fp;
+   int ecode;
+
+   pdebug("saving %s...", fname);
+   fp = fopen(fname, "wb");
+   if (fp == NULL) return VERROR;
+   put32(salt, Pdbsalt);
+   ecode = VEOK;
+   if (fwrite(salt, 4, 1, fp) != 1 ||
+         fwrite(Peerdb, sizeof(Peerdb), 1, fp) != 1) ecode = VERROR;
+   fclose(fp);
+   if (ecode != VEOK) remove(fname);
+
+   return ecode;
+}  /* end pdb_save() */
+
+/**
+ * Load the peer database from disk, replacing the peer database.
+ * @param fname Filename of peer database
+ * @return (int) VEOK on success, else VERROR
+ */
+int pdb_load(char *fname)
+{
+   static PDBENTRY db[PDBBUCKETS][PDBBUCKETSZ];
+   word8 salt[4];
+   FILE *fp;
+   int ecode;
+
+   fp = fopen(fname, "rb");
+   if (fp == NULL) return VERROR;
+   ecode = VERROR;
+   /* database MUST be of the same dimensions */
+   if (fread(salt, 4, 1, fp) == 1 && fread(db, sizeof(db), 1, fp) == 1 &&
+         fgetc(fp) == EOF && get32(salt) != 0) {
+      Pdbsalt = get32(salt);
+      memcpy(Peerdb, db, sizeof(Peerdb));
+      ecode = VEOK;
+   }
+   fclose(fp);
+
+   return ecode;
+}  /* end pdb_load() */
+
 /* end include guard */
 #endif
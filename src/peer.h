@@ -13,8 +13,52 @@
 #include "global.h"
 #include "types.h"
 
+/* system support */
+#include <time.h>
+
 #define addrecent(ip)   addpeer(ip, Rplist, RPLISTLEN, &Rplistidx)
 
+/* rate limit opcode classes */
+#define RL_NONE      (-1)  /* not rate limited, e.g. OP_FOUND */
+#define RL_TX        0     /* OP_TX */
+#define RL_BALANCE   1     /* OP_BALANCE, OP_BALANCE_BATCH, OP_RESOLVE */
+#define RL_IPL       2     /* OP_GET_IPL */
+#define RL_HASH      3     /* OP_HASH, OP_IDENTIFY */
+#define RL_TF        4     /* OP_TF, OP_GET_TFILE */
+#define RL_BLOCK     5     /* OP_GET_BLOCK, OP_GET_CBLOCK, OP_MBLOCK,
+                            * OP_NG_LAYER, OP_GET_NGCHUNK */
+#define RL_MMR       6     /* OP_GET_MMRPROOF -- sized for a bisection */
+#define RLCLASSES    7     /* number of rate limit classes */
+#define RLUNIT       60    /* token fractions; 1 token per minute == 1 */
+
+/* rate limit token buckets of a single peer */
+typedef struct {
+   word32 ip;                 /* peer ip -- zero if unused */
+   word32 tokens[RLCLASSES];  /* available tokens, in RLUNIT fractions */
+   time_t stamp;              /* time of last bucket refill */
+} RLENTRY;
+
+/* chain tip last advertised by a single peer */
+typedef struct {
+   word32 ip;              /* peer ip -- zero if unused */
+   word8 bnum[8];          /* advertised block number */
+   word8 bhash[HASHLEN];   /* advertised block hash */
+   word8 phash[HASHLEN];   /* advertised previous block hash */
+   word8 weight[32];       /* advertised chain weight */
+   time_t stamp;           /* time last seen */
+} TIPENTRY;
+
+/* peer database entry of a single peer */
+typedef struct {
+   word32 ip;              /* peer ip -- zero if unused */
+   word32 source;          /* ip of peer advertising this peer, or zero */
+   word32 first;           /* time first seen */
+   word32 last;            /* time of last successful connection */
+   word32 attempt;         /* time of last connection attempt */
+   word16 good;            /* successful connections */
+   word16 bad;             /* consecutive failed connections */
+} PDBENTRY;
+
 /* global variables */
 extern word32 Rplist[RPLISTLEN], Rplistidx;
 extern word32 Cpinklist[CPINKLEN], Cpinkidx;
@@ -22,6 +66,14 @@ extern word32 Lpinklist[LPINKLEN], Lpinkidx;
 extern word32 Epinklist[EPINKLEN], Epinkidx;
 extern word8 Nopinklist;
 extern word8 Noprivate;
+extern RLENTRY Rlimit[RLIMITLEN];
+extern word32 Rlquota[RLCLASSES];
+extern word32 Rlburst[RLCLASSES];
+extern word32 Rlconcur[RLCLASSES];
+extern word32 Nthrottled[RLCLASSES];
+extern word8 Norlimit;
+extern TIPENTRY Tips[TIPSLEN];
+extern PDBENTRY Peerdb[PDBBUCKETS][PDBBUCKETSZ];
 
 /* C/C++ compatible function prototypes */
 #ifdef __cplusplus
@@ -45,6 +97,20 @@ int lpinklist(word32 ip);
 int epinklist(word32 ip);
 void mergepinklists(void);
 void purge_epoch(void);
+int rlclass(int opcode);
+char *rlclass2str(int rlc);
+int ratelimited(word32 ip, int opcode);
+void tip_update(word32 ip, const TX *tx);
+int tip_quorum(word32 quorum[], word32 qlen, void *hash, void *weight,
+   void *bnum, time_t maxage);
+void print_tips(void);
+PDBENTRY *pdb_find(word32 ip);
+int pdb_add(word32 ip, word32 source);
+void pdb_good(word32 ip);
+void pdb_bad(word32 ip);
+int pdb_sample(word32 *list, int len);
+int pdb_save(char *fname);
+int pdb_load(char *fname);
 
 #ifdef __cplusplus
 }  /* end extern "C" */
@@ -0,0 +1,1106 @@
+/**
+ * @private
+ * @headerfile rpc.h <rpc.h>
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+#ifndef MOCHIMO_RPC_C
+#define MOCHIMO_RPC_C  /* include guard */
+
+
+#include "rpc.h"
+
+/* internal support */
+#include "error.h"
+#include "global.h"
+#include "ledger.h"
+#include "network.h"
+#include "peer.h"
+#include "tfile.h"
+#include "tx.h"
+
+/* external support */
+#include <signal.h>  /* for kill() */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>  /* for strncasecmp() */
+#include <time.h>
+#include <sys/wait.h>  /* for waitpid() */
+#include "extlib.h"
+#include "exttime.h"
+
+/* JSON-RPC 2.0 error codes */
+#define RPC_EPARSE   (-32700)    /* Parse error */
+#define RPC_EREQUEST (-32600)    /* Invalid Request */
+#define RPC_EMETHOD  (-32601)    /* Method not found */
+#define RPC_EPARAMS  (-32602)    /* Invalid params */
+#define RPC_ESERVER  (-32000)    /* Server error; see errno */
+
+/* worker process exit status */
+#define RPCW_OK      0  /* request served */
+#define RPCW_ERROR   1  /* session error */
+#define RPCW_TXOK    2  /* request served, and transaction accepted */
+#define RPCW_TXMQ    3  /* ... and transaction mirrored */
+
+/* JSON-RPC session */
+typedef struct {
+   SOCKET sd;              /* session socket -- INVALID_SOCKET if unused */
+   word32 ip;              /* client ip */
+   time_t last;            /* time of last activity */
+   pid_t pid;              /* worker process serving session, or zero */
+   char *out;              /* pending response data */
+   size_t outlen;          /* length of pending response data */
+   size_t outpos;          /* position of pending response data sent */
+   size_t outcap;          /* capacity of response data buffer */
+   size_t len;             /* length of request data */
+   int error;              /* response data allocation failure */
+   int close;              /* close after pending response data is sent */
+   int expect;             /* sent 100 Continue for the current request */
+   int txok;               /* transaction accepted (1), and mirrored (2) */
+   char buf[RPCBUFLEN + 1];   /* request data (+ nul terminator) */
+} RPCSESSION;
+
+/* JSON-RPC method handler */
+typedef struct {
+   const char *name;
+   int (*func)(RPCSESSION *sp, const char *params);
+   int heavy;  /* served by a worker process */
+} RPCMETHOD;
+
+/* listening socket, sessions, and node for transaction submission */
+static SOCKET Rpcsd = INVALID_SOCKET;
+static RPCSESSION Rpcsession[RPCMAX];
+static NODE Rpcnode;
+static int Rpcworkers;  /* number of worker processes */
+
+/**
+ * @private
+ * Ensure space for len more bytes of response data in a session. On
+ * allocation failure, the session error flag is set.
+ * @param sp Pointer to session
+ * @param len Number of bytes required
+ * @return (int) VEOK on success, else VERROR
+*/
+static int rpc__grow(RPCSESSION *sp, size_t len)
+{
+   size_t cap;
+   char *out;
+
+   if (sp->error) return VERROR;
+   if (sp->outlen + len <= sp->outcap) return VEOK;
+   for (cap = sp->outcap ? sp->outcap : 4096; cap < sp->outlen + len; ) {
+      cap *= 2;
+   }
+   out = realloc(sp->out, cap);
+   if (out == NULL) {
+      sp->error = 1;
+      return VERROR;
+   }
+   sp->out = out;
+   sp->outcap = cap;
+
+   return VEOK;
+}  /* end rpc__grow() */
+
+/**
+ * @private
+ * Append formatted response data to a session.
+ * @param sp Pointer to session
+ * @param fmt Format string, per printf()
+*/
+static void rpc__printf(RPCSESSION *sp, const char *fmt, ...)
+{
+   va_list args;
+   int len;
+
+   va_start(args, fmt);
+   len = vsnprintf(NULL, 0, fmt, args);
+   va_end(args);
+   if (len < 0 || rpc__grow(sp, (size_t) len + 1) != VEOK) return;
+   va_start(args, fmt);
+   vsnprintf(sp->out + sp->outlen, (size_t) len + 1, fmt, args);
+   va_end(args);
+   sp->outlen += (size_t) len;
+}  /* end rpc__printf() */
+
+/**
+ * @private
+ * Append binary data to a session, as hex characters.
+ * @param sp Pointer to session
+ * @param data Pointer to binary data
+ * @param len Length of binary data, in bytes
+*/
+static void rpc__hexraw(RPCSESSION *sp, const void *data, size_t len)
+{
+   static const char hexc[] = "0123456789abcdef";
+   const word8 *bp = (const word8 *) data;
+   char *cp;
+
+   if (rpc__grow(sp, len * 2) != VEOK) return;
+   cp = sp->out + sp->outlen;
+   for ( ; len; len--, bp++) {
+      *(cp++) = hexc[*bp >> 4];
+      *(cp++) = hexc[*bp & 15];
+   }
+   sp->outlen = (size_t) (cp - sp->out);
+}  /* end rpc__hexraw() */
+
+/**
+ * @private
+ * Append binary data to a session, as a JSON hex string.
+ * @param sp Pointer to session
+ * @param data Pointer to binary data
+ * @param len Length of binary data, in bytes
+*/
+static void rpc__hex(RPCSESSION *sp, const void *data, size_t len)
+{
+   rpc__printf(sp, "\"");
+   rpc__hexraw(sp, data, len);
+   rpc__printf(sp, "\"");
+}  /* end rpc__hex() */
+
+/**
+ * @private
+ * Append a string to a session, as a JSON string.
+ * @param sp Pointer to session
+ * @param str Pointer to nul terminated string
+*/
+static void rpc__str(RPCSESSION *sp, const char *str)
+{
+   rpc__printf(sp, "\"");
+   for ( ; *str; str++) {
+      if (*str == '"' || *str == '\\') rpc__printf(sp, "\\%c", *str);
+      else if ((unsigned char) *str < ' ') rpc__printf(sp, " ");
+      else rpc__printf(sp, "%c", *str);
+   }
+   rpc__printf(sp, "\"");
+}  /* end rpc__str() */
+
+/**
+ * @private
+ * Append a 64-bit value to a session, as a JSON number (or as a JSON
+ * string, for amounts that may exceed the precision of JSON numbers).
+ * @param sp Pointer to session
+ * @param value Pointer to 64-bit value
+ * @param quote Non-zero to append a JSON string
+*/
+static void rpc__u64(RPCSESSION *sp, const word8 value[8], int quote)
+{
+   word64 u64;
+
+   put64(&u64, value);
+   rpc__printf(sp, quote ? "\"%llu\"" : "%llu", (unsigned long long) u64);
+}  /* end rpc__u64() */
+
+/**
+ * @private
+ * Convert a hex character to its value.
+ * @param c Hex character
+ * @return (int) value of hex character, or -1 if not a hex character
+*/
+static int rpc__hexval(int c)
+{
+   if (c >= '0' && c <= '9') return c - '0';
+   if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+   if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+   return (-1);
+}  /* end rpc__hexval() */
+
+/**
+ * @private
+ * Skip JSON whitespace.
+ * @param p Pointer to JSON text
+ * @return (const char *) pointer to next non-whitespace character
+*/
+static const char *rpc__jsonws(const char *p)
+{
+   while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+
+   return p;
+}  /* end rpc__jsonws() */
+
+/**
+ * @private
+ * Find the end of a JSON value.
+ * @param p Pointer to start of JSON value
+ * @return (const char *) pointer past the end of the JSON value, or NULL
+ * if the JSON value is malformed
+*/
+static const char *rpc__jsonend(const char *p)
+{
+   int depth, instr;
+
+   if (*p == '{' || *p == '[' || *p == '"') {
+      /* strings, arrays and objects -- track nesting outside of strings */
+      for (depth = instr = 0; *p; p++) {
+         if (instr) {
+            if (*p == '\\' && p[1]) p++;
+            else if (*p == '"') {
+               instr = 0;
+               if (depth == 0) return p + 1;
+            }
+         } else if (*p == '"') instr = 1;
+         else if (*p == '{' || *p == '[') depth++;
+         else if (*p == '}' || *p == ']') {
+            if (--depth == 0) return p + 1;
+         }
+      }
+      return NULL;
+   }
+   /* numbers, true, false and null */
+   if (strchr("-0123456789tfn", *p) == NULL || *p == '\0') return NULL;
+   while (*p && strchr("+-.0123456789Eabcdeflnrstu", *p)) p++;
+
+   return p;
+}  /* end rpc__jsonend() */
+
+/**
+ * @private
+ * Find the value of a member of a JSON object. Member names are compared
+ * without unescaping.
+ * @param obj Pointer to JSON object
+ * @param key Name of member to find
+ * @return (const char *) pointer to member value, or NULL if not found
+*/
+static const char *rpc__jsonkey(const char *obj, const char *key)
+{
+   const char *p, *name, *end;
+   size_t keylen;
+
+   keylen = strlen(key);
+   p = rpc__jsonws(obj);
+   if (*p != '{') return NULL;
+   for (p = rpc__jsonws(p + 1); *p == '"'; p = rpc__jsonws(p + 1)) {
+      /* member name */
+      name = p;
+      end = rpc__jsonend(name);
+      if (end == NULL) return NULL;
+      /* member value */
+      p = rpc__jsonws(end);
+      if (*p != ':') return NULL;
+      p = rpc__jsonws(p + 1);
+      if ((size_t) (end - name) == keylen + 2 &&
+            strncmp(name + 1, key, keylen) == 0) return p;
+      end = rpc__jsonend(p);
+      if (end == NULL) return NULL;
+      p = rpc__jsonws(end);
+      if (*p != ',') return NULL;
+   }
+
+   return NULL;
+}  /* end rpc__jsonkey() */
+
+/**
+ * @private
+ * Find an element of a JSON array.
+ * @param arr Pointer to JSON array (may be NULL)
+ * @param idx Index of element to find
+ * @return (const char *) pointer to element, or NULL if not found
+*/
+static const char *rpc__jsonelem(const char *arr, int idx)
+{
+   const char *p;
+
+   if (arr == NULL || *arr != '[') return NULL;
+   p = rpc__jsonws(arr + 1);
+   if (*p == ']') return NULL;
+   for ( ; idx > 0; idx--) {
+      p = rpc__jsonend(p);
+      if (p == NULL) return NULL;
+      p = rpc__jsonws(p);
+      if (*p != ',') return NULL;
+      p = rpc__jsonws(p + 1);
+   }
+
+   return p;
+}  /* end rpc__jsonelem() */
+
+/**
+ * @private
+ * Decode a JSON hex string into binary data.
+ * @param p Pointer to JSON hex string (may be NULL)
+ * @param out Pointer to place binary data
+ * @param max Maximum length of binary data, in bytes
+ * @param len Pointer to place length of binary data, in bytes
+ * @return (int) VEOK on success, else VERROR
+*/
+static int rpc__jsonhex(const char *p, void *out, size_t max, size_t *len)
+{
+   word8 *bp = (word8 *) out;
+   int hi, lo;
+
+   if (p == NULL || *(p++) != '"') return VERROR;
+   if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+   for (*len = 0; *p != '"'; p += 2, (*len)++) {
+      if (*len >= max) return VERROR;
+      hi = rpc__hexval(p[0]);
+      lo = hi < 0 ? (-1) : rpc__hexval(p[1]);
+      if (lo < 0) return VERROR;
+      bp[*len] = (word8) ((hi << 4) | lo);
+   }
+
+   return VEOK;
+}  /* end rpc__jsonhex() */
+
+/**
+ * @private
+ * Decode a JSON block number, as a (decimal) number or string, or as a
+ * "0x" hex string.
+ * @param p Pointer to JSON block number (may be NULL)
+ * @param bnum Pointer to place 64-bit block number
+ * @return (int) VEOK on success, else VERROR
+*/
+static int rpc__jsonbnum(const char *p, word8 bnum[8])
+{
+   word64 value;
+   char *end;
+   int base;
+
+   if (p == NULL) return VERROR;
+   if (*p == '"') p++;
+   base = 10;
+   if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      base = 16;
+      p += 2;
+   }
+   if (rpc__hexval(*p) < 0 || (base == 10 && (*p < '0' || *p > '9'))) {
+      return VERROR;
+   }
+   errno = 0;
+   value = (word64) strtoull(p, &end, base);
+   if (errno == ERANGE) return VERROR;
+   if (*end != '"' && *end != ',' && *end != ']' &&
+         rpc__jsonws(end) == end) return VERROR;
+   put64(bnum, &value);
+
+   return VEOK;
+}  /* end rpc__jsonbnum() */
+
+/**
+ * @private
+ * Method getbalance [address] and resolvetag [tag]. The result is null
+ * if the address (or tag) is not found in the ledger.
+*/
+static int rpc__getbalance(RPCSESSION *sp, const char *params)
+{
+   LENTRY le;
+   word8 addr[ADDR_LEN];
+   size_t len;
+
+   if (rpc__jsonhex(rpc__jsonelem(params, 0), addr, ADDR_LEN, &len)) {
+      return RPC_EPARAMS;
+   }
+   if (len != ADDR_TAG_LEN && len != ADDR_LEN) return RPC_EPARAMS;
+   if (!le_find(addr, &le, (word16) len)) {
+      if (errno) return RPC_ESERVER;
+      rpc__printf(sp, "null");
+      return VEOK;
+   }
+
+   Nbalance++;
+   rpc__printf(sp, "{\"address\":");
+   rpc__hex(sp, le.addr, ADDR_LEN);
+   rpc__printf(sp, ",\"balance\":");
+   rpc__u64(sp, le.balance, 1);
+   rpc__printf(sp, "}");
+
+   return VEOK;
+}  /* end rpc__getbalance() */
+
+static int rpc__resolvetag(RPCSESSION *sp, const char *params)
+{
+   word8 tag[ADDR_TAG_LEN];
+   size_t len;
+
+   if (rpc__jsonhex(rpc__jsonelem(params, 0), tag, ADDR_TAG_LEN, &len) ||
+         len != ADDR_TAG_LEN) return RPC_EPARAMS;
+
+   return rpc__getbalance(sp, params);
+}  /* end rpc__resolvetag() */
+
+/**
+ * @private
+ * Method sendtx [tx]. The transaction is processed as an OP_TX request
+ * from the client. The result is the transaction ID.
+*/
+static int rpc__sendtx(RPCSESSION *sp, const char *params)
+{
+   TXENTRY txe;
+   TX *tx;
+   size_t len;
+   int mqcount;
+
+   /* prepare node, as if the transaction was received */
+   memset(&Rpcnode, 0, sizeof(Rpcnode));
+   tx = &(Rpcnode.tx);
+   Rpcnode.sd = INVALID_SOCKET;
+   Rpcnode.ip = sp->ip;
+   ntoa(&(Rpcnode.ip), Rpcnode.id);
+   if (rpc__jsonhex(rpc__jsonelem(params, 0), tx->buffer,
+         sizeof(tx->buffer), &len) != VEOK) return RPC_EPARAMS;
+   put16(tx->len, (word16) len);
+   put16(tx->opcode, OP_TX);
+
+   Nlogins++;  /* raw TX in */
+   mqcount = Mqcount;
+   if (process_tx(&Rpcnode) != VEOK) {
+      if (errno == 0) set_errno(EMCM_TXINVAL);
+      return RPC_ESERVER;
+   }
+   sp->txok = Mqcount != mqcount ? 2 : 1;
+   /* derive transaction ID, as process_tx() does */
+   if (tx_read(&txe, tx->buffer, len) != VEOK) return RPC_ESERVER;
+   memset(txe.tlr->nonce, 0, sizeof(txe.tlr->nonce));
+   tx_digest(&txe);
+
+   rpc__printf(sp, "{\"txid\":");
+   rpc__hex(sp, txe.digest_id, HASHLEN);
+   rpc__printf(sp, "}");
+
+   return VEOK;
+}  /* end rpc__sendtx() */
+
+/**
+ * @private
+ * Method getblock [bnum]. The result is the block file data, of blocks
+ * of at most RPCBLOCKMAX bytes (e.g. not most neogenesis blocks).
+*/
+static int rpc__getblock(RPCSESSION *sp, const char *params)
+{
+   word8 data[BUFSIZ];
+   char fname[FILENAME_MAX];
+   char bcfname[21];
+   word8 bnum[8];
+   long long len;
+   size_t count;
+   FILE *fp;
+
+   if (rpc__jsonbnum(rpc__jsonelem(params, 0), bnum)) return RPC_EPARAMS;
+   path_join(fname, Bcdir, bnum2fname(bnum, bcfname));
+   fp = fopen(fname, "rb");
+   if (fp == NULL) return RPC_ESERVER;
+   if (fseek64(fp, 0LL, SEEK_END) != 0 || (len = ftell64(fp)) < 0 ||
+         fseek64(fp, 0LL, SEEK_SET) != 0) {
+      fclose(fp);
+      return RPC_ESERVER;
+   }
+   if (len > RPCBLOCKMAX) {
+      fclose(fp);
+      set_errno(EFBIG);
+      return RPC_ESERVER;
+   }
+
+   rpc__printf(sp, "{\"bnum\":");
+   rpc__u64(sp, bnum, 0);
+   rpc__printf(sp, ",\"data\":\"");
+   while ((count = fread(data, 1, sizeof(data), fp)) > 0) {
+      rpc__hexraw(sp, data, count);
+   }
+   rpc__printf(sp, "\"}");
+   if (ferror(fp)) {
+      fclose(fp);
+      return RPC_ESERVER;
+   }
+   fclose(fp);
+
+   return VEOK;
+}  /* end rpc__getblock() */
+
+/**
+ * @private
+ * Method gettx [bnum, index]. The result is the transaction at index of
+ * the block, read by offset from the block's offset-table sidecar.
+*/
+static int rpc__gettx(RPCSESSION *sp, const char *params)
+{
+   TXENTRY txe;
+   char fname[FILENAME_MAX];
+   char bcfname[21];
+   word8 bnum[8], index[8];
+   int ecode;
+
+   if (rpc__jsonbnum(rpc__jsonelem(params, 0), bnum) ||
+         rpc__jsonbnum(rpc__jsonelem(params, 1), index) ||
+         get32(index + 4) != 0) return RPC_EPARAMS;
+   path_join(fname, Bcdir, bnum2fname(bnum, bcfname));
+   ecode = tx_ixread(&txe, fname, get32(index));
+   if (ecode == VEBAD) return RPC_EPARAMS;
+   if (ecode != VEOK) return RPC_ESERVER;
+
+   rpc__printf(sp, "{\"bnum\":");
+   rpc__u64(sp, bnum, 0);
+   rpc__printf(sp, ",\"index\":%lu", (unsigned long) get32(index));
+   rpc__printf(sp, ",\"txid\":");
+   rpc__hex(sp, txe.tx_id, HASHLEN);
+   rpc__printf(sp, ",\"tx\":");
+   rpc__hex(sp, txe.buffer, txe.tx_sz);
+   rpc__printf(sp, "}");
+
+   return VEOK;
+}  /* end rpc__gettx() */
+
+/**
+ * @private
+ * Method gettrailer [bnum]. The result is the block trailer, from Tfile.
+*/
+static int rpc__gettrailer(RPCSESSION *sp, const char *params)
+{
+   BTRAILER bt;
+   word8 bnum[8];
+
+   if (rpc__jsonbnum(rpc__jsonelem(params, 0), bnum)) return RPC_EPARAMS;
+   set_errno(0);
+   if (read_tfile(&bt, bnum, 1, "tfile.dat") != 1) {
+      if (errno == 0) set_errno(EMCM_BNUM);
+      return RPC_ESERVER;
+   }
+
+   rpc__printf(sp, "{\"phash\":");
+   rpc__hex(sp, bt.phash, HASHLEN);
+   rpc__printf(sp, ",\"bnum\":");
+   rpc__u64(sp, bt.bnum, 0);
+   rpc__printf(sp, ",\"mfee\":");
+   rpc__u64(sp, bt.mfee, 1);
+   rpc__printf(sp, ",\"tcount\":%lu", (unsigned long) get32(bt.tcount));
+   rpc__printf(sp, ",\"time0\":%lu", (unsigned long) get32(bt.time0));
+   rpc__printf(sp, ",\"difficulty\":%lu",
+      (unsigned long) get32(bt.difficulty));
+   rpc__printf(sp, ",\"mroot\":");
+   rpc__hex(sp, bt.mroot, HASHLEN);
+   rpc__printf(sp, ",\"nonce\":");
+   rpc__hex(sp, bt.nonce, HASHLEN);
+   rpc__printf(sp, ",\"stime\":%lu", (unsigned long) get32(bt.stime));
+   rpc__printf(sp, ",\"bhash\":");
+   rpc__hex(sp, bt.bhash, HASHLEN);
+   rpc__printf(sp, "}");
+
+   return VEOK;
+}  /* end rpc__gettrailer() */
+
+/**
+ * @private
+ * Method gettip []. The result is the chain tip of the node.
+*/
+static int rpc__gettip(RPCSESSION *sp, const char *params)
+{
+   (void) params;
+
+   rpc__printf(sp, "{\"bnum\":");
+   rpc__u64(sp, Cblocknum, 0);
+   rpc__printf(sp, ",\"bhash\":");
+   rpc__hex(sp, Cblockhash, HASHLEN);
+   rpc__printf(sp, ",\"phash\":");
+   rpc__hex(sp, Prevhash, HASHLEN);
+   rpc__printf(sp, ",\"weight\":");
+   rpc__hex(sp, Weight, 32);
+   rpc__printf(sp, ",\"difficulty\":%lu,\"txcount\":%lu}",
+      (unsigned long) Difficulty, (unsigned long) Txcount);
+
+   return VEOK;
+}  /* end rpc__gettip() */
+
+/**
+ * @private
+ * Method getpeers []. The result is the recent peers list, and the chain
+ * tips last advertised by peers.
+*/
+static int rpc__getpeers(RPCSESSION *sp, const char *params)
+{
+   TIPENTRY *tp;
+   char ipaddr[16];
+   time_t now;
+   int j;
+
+   (void) params;
+
+   rpc__printf(sp, "{\"recent\":[");
+   for (j = 0; j < RPLISTLEN && Rplist[j]; j++) {
+      rpc__printf(sp, "%s\"%s\"", j ? "," : "", ntoa(&Rplist[j], ipaddr));
+   }
+   rpc__printf(sp, "],\"tips\":[");
+   time(&now);
+   for (j = 0, tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+      if (tp->ip == 0) continue;
+      rpc__printf(sp, "%s{\"ip\":\"%s\",\"bnum\":", j++ ? "," : "",
+         ntoa(&(tp->ip), ipaddr));
+      rpc__u64(sp, tp->bnum, 0);
+      rpc__printf(sp, ",\"bhash\":");
+      rpc__hex(sp, tp->bhash, HASHLEN);
+      rpc__printf(sp, ",\"weight\":");
+      rpc__hex(sp, tp->weight, 32);
+      rpc__printf(sp, ",\"age\":%.0f}", difftime(now, tp->stamp));
+   }
+   rpc__printf(sp, "]}");
+
+   return VEOK;
+}  /* end rpc__getpeers() */
+
+/* JSON-RPC methods */
+static RPCMETHOD Rpcmethod[] = {
+   { "getbalance", rpc__getbalance, 0 },
+   { "resolvetag", rpc__resolvetag, 0 },
+   { "sendtx", rpc__sendtx, 1 },
+   { "getblock", rpc__getblock, 1 },
+   { "gettx", rpc__gettx, 1 },
+   { "gettrailer", rpc__gettrailer, 0 },
+   { "gettip", rpc__gettip, 0 },
+   { "getpeers", rpc__getpeers, 0 },
+   { NULL, NULL, 0 }
+};
+
+/**
+ * @private
+ * Find a JSON-RPC method by name.
+ * @param method Pointer to JSON string of method name (may be NULL)
+ * @return (RPCMETHOD *) pointer to method, or NULL if not found
+*/
+static RPCMETHOD *rpc__method(const char *method)
+{
+   RPCMETHOD *mp;
+   const char *end;
+
+   if (method == NULL || *method != '"') return NULL;
+   end = rpc__jsonend(method);
+   for (mp = Rpcmethod; mp->name && end; mp++) {
+      if ((size_t) (end - method) == strlen(mp->name) + 2 &&
+            strncmp(method + 1, mp->name, strlen(mp->name)) == 0) return mp;
+   }
+
+   return NULL;
+}  /* end rpc__method() */
+
+/**
+ * @private
+ * Append a JSON-RPC response to a JSON-RPC request body, to a session.
+ * @param sp Pointer to session
+ * @param body Pointer to nul terminated JSON-RPC request body
+*/
+static void rpc__jsonrpc(RPCSESSION *sp, const char *body)
+{
+   RPCMETHOD *mp;
+   const char *id, *method, *params, *end;
+   char message[128];
+   size_t result;
+   int ecode;
+
+   /* parse request object */
+   id = method = params = NULL;
+   body = rpc__jsonws(body);
+   end = rpc__jsonend(body);
+   if (*body != '{' || end == NULL || *rpc__jsonws(end)) {
+      ecode = *body == '[' ? RPC_EREQUEST : RPC_EPARSE;
+   } else {
+      id = rpc__jsonkey(body, "id");
+      method = rpc__jsonkey(body, "method");
+      params = rpc__jsonkey(body, "params");
+      ecode = method && *method == '"' ? RPC_EMETHOD : RPC_EREQUEST;
+      if (params && *params != '[') ecode = RPC_EPARAMS;
+   }
+
+   /* response object, echoing request id */
+   rpc__printf(sp, "{\"jsonrpc\":\"2.0\",\"id\":");
+   if (id && (end = rpc__jsonend(id))) {
+      rpc__printf(sp, "%.*s", (int) (end - id), id);
+   } else rpc__printf(sp, "null");
+   rpc__printf(sp, ",\"result\":");
+   result = sp->outlen;
+
+   /* call method */
+   if (ecode == RPC_EMETHOD && (mp = rpc__method(method)) != NULL) {
+      pdebug("rpc method %s", mp->name);
+      set_errno(0);
+      ecode = mp->func(sp, params);
+   }
+
+   /* replace result with error object on failure */
+   if (ecode != VEOK) {
+      sp->outlen = result - strlen("\"result\":");
+      rpc__printf(sp, "\"error\":{\"code\":%d,\"message\":", ecode);
+      switch (ecode) {
+         case RPC_EPARSE: rpc__str(sp, "Parse error"); break;
+         case RPC_EREQUEST: rpc__str(sp, "Invalid Request"); break;
+         case RPC_EMETHOD: rpc__str(sp, "Method not found"); break;
+         case RPC_EPARAMS: rpc__str(sp, "Invalid params"); break;
+         default: {
+            rpc__str(sp, mcm_strerror(errno, message, sizeof(message)));
+            rpc__printf(sp, ",\"data\":");
+            rpc__str(sp, mcm_strerrorname(errno, message, sizeof(message)));
+         }
+      }
+      rpc__printf(sp, "}");
+   }
+   rpc__printf(sp, "}");
+}  /* end rpc__jsonrpc() */
+
+/**
+ * @private
+ * Append an HTTP response to a session. The response body is the data
+ * appended after start, and the response header is inserted before it.
+ * @param sp Pointer to session
+ * @param start Offset of response body in pending response data
+ * @param status HTTP status line, e.g. "200 OK"
+*/
+static void rpc__respond(RPCSESSION *sp, size_t start, const char *status)
+{
+   char header[256];
+   size_t bodylen;
+   int len;
+
+   bodylen = sp->outlen - start;
+   len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\n"
+      "Content-Type: application/json\r\nContent-Length: %lu\r\n"
+      "Connection: %s\r\n%s\r\n", status, (unsigned long) bodylen,
+      sp->close ? "close" : "keep-alive",
+      strncmp(status, "405", 3) == 0 ? "Allow: POST\r\n" : "");
+   if (rpc__grow(sp, (size_t) len) != VEOK) return;
+   memmove(sp->out + start + len, sp->out + start, bodylen);
+   memcpy(sp->out + start, header, (size_t) len);
+   sp->outlen += (size_t) len;
+}  /* end rpc__respond() */
+
+/**
+ * @private
+ * Close a session and release its slot.
+ * @param sp Pointer to session
+*/
+static void rpc__drop(RPCSESSION *sp)
+{
+   char ipaddr[16];
+
+   pdebug("rpc %s closed", ntoa(&(sp->ip), ipaddr));
+   sock_close(sp->sd);
+   sp->sd = INVALID_SOCKET;
+   free(sp->out);
+   sp->out = NULL;
+   sp->outcap = 0;
+}  /* end rpc__drop() */
+
+/**
+ * @private
+ * Send pending response data of a session, without blocking.
+ * @param sp Pointer to session
+ * @return (int) VEOK on success, else VERROR
+*/
+static int rpc__flush(RPCSESSION *sp)
+{
+   int count;
+
+   while (sp->outpos < sp->outlen) {
+      count = send(sp->sd, sp->out + sp->outpos,
+         sp->outlen - sp->outpos, 0);
+      if (count < 0 && sock_waiting(sock_errno)) return VEOK;
+      if (count <= 0) return VERROR;
+      sp->outpos += (size_t) count;
+      time(&(sp->last));
+   }
+   sp->outpos = sp->outlen = 0;
+
+   return VEOK;
+}  /* end rpc__flush() */
+
+/**
+ * @private
+ * Serve a JSON-RPC request of a heavy method in a worker process. The
+ * worker sends the response, and exits with a status the server loop
+ * applies to the session (and transaction counters) in rpc_service().
+ * Pending response data of the session must already be sent.
+ * @param sp Pointer to session
+ * @param body Pointer to nul terminated JSON-RPC request body
+ * @return (int) VEOK in the server loop, if the worker was created,
+ * else VERROR; the worker does not return
+*/
+static int rpc__worker(RPCSESSION *sp, const char *body)
+{
+   int j;
+
+   sp->pid = fork();
+   if (sp->pid == -1) {
+      sp->pid = 0;
+      return VERROR;
+   }
+   if (sp->pid) {
+      Rpcworkers++;
+      return VEOK;
+   }
+
+   /* in worker -- release everything but the session socket */
+   sock_close(Rpcsd);
+   for (j = 0; j < RPCMAX; j++) {
+      if (&Rpcsession[j] == sp) continue;
+      if (Rpcsession[j].sd != INVALID_SOCKET) sock_close(Rpcsession[j].sd);
+   }
+   sp->txok = 0;
+   rpc__jsonrpc(sp, body);
+   rpc__respond(sp, 0, "200 OK");
+   /* send response, while the client reads it */
+   time(&(sp->last));
+   while (!sp->error && rpc__flush(sp) == VEOK && sp->outlen) {
+      if (difftime(time(NULL), sp->last) > RPCIDLE) break;
+      millisleep(1);
+   }
+   if (sp->error || sp->outlen) exit(RPCW_ERROR);
+   if (sp->txok) exit(sp->txok == 2 ? RPCW_TXMQ : RPCW_TXOK);
+   exit(RPCW_OK);
+}  /* end rpc__worker() */
+
+/**
+ * @private
+ * Serve the next (complete) HTTP request in the request data of a session.
+ * @param sp Pointer to session
+ * Requests of heavy methods are served by a worker process, once pending
+ * response data is sent and while there are less than RPCWORKERS.
+ * @param sp Pointer to session
+ * @return (size_t) number of bytes of request data consumed, or zero if
+ * the next request is incomplete, or waits on a worker
+*/
+static size_t rpc__http(RPCSESSION *sp)
+{
+   RPCMETHOD *mp;
+   char *cp, *line, *end, *body, save;
+   size_t hdrlen, clen, start;
+   int post, http11, chunked, expect;
+
+   /* wait for complete header */
+   sp->buf[sp->len] = '\0';
+   end = strstr(sp->buf, "\r\n\r\n");
+   if (end == NULL) {
+      if (sp->len < RPCBUFLEN) return 0;
+      sp->close = 1;
+      start = sp->outlen;
+      rpc__respond(sp, start, "431 Request Header Fields Too Large");
+      return sp->len;
+   }
+   body = end + 4;
+   hdrlen = (size_t) (body - sp->buf);
+
+   /* request line */
+   post = strncmp(sp->buf, "POST ", 5) == 0;
+   line = strstr(sp->buf, "\r\n");
+   http11 = line - sp->buf >= 8 && strncmp(line - 8, "HTTP/1.1", 8) == 0;
+   sp->close = !http11;
+
+   /* headers */
+   clen = 0;
+   chunked = expect = 0;
+   for (cp = line + 2; cp < end; cp = strstr(cp, "\r\n") + 2) {
+      if (strncasecmp(cp, "Content-Length:", 15) == 0) {
+         clen = strtoul(cp + 15, NULL, 10);
+      } else if (strncasecmp(cp, "Connection:", 11) == 0) {
+         line = (char *) rpc__jsonws(cp + 11);
+         if (strncasecmp(line, "close", 5) == 0) sp->close = 1;
+         if (strncasecmp(line, "keep-alive", 10) == 0) sp->close = 0;
+      } else if (strncasecmp(cp, "Expect:", 7) == 0) expect = 1;
+      else if (strncasecmp(cp, "Transfer-Encoding:", 18) == 0) chunked = 1;
+   }
+
+   /* wait for complete body -- of known length */
+   if (chunked) {
+      sp->close = 1;
+      start = sp->outlen;
+      rpc__respond(sp, start, "411 Length Required");
+      return sp->len;
+   }
+   if (clen > RPCBUFLEN - hdrlen) {
+      sp->close = 1;
+      start = sp->outlen;
+      rpc__respond(sp, start, "413 Payload Too Large");
+      return sp->len;
+   }
+   if (sp->len - hdrlen < clen) {
+      if (expect && !sp->expect) {
+         rpc__printf(sp, "HTTP/1.1 100 Continue\r\n\r\n");
+         sp->expect = 1;
+      }
+      return 0;
+   }
+   sp->expect = 0;
+
+   /* serve JSON-RPC request */
+   start = sp->outlen;
+   if (!post) rpc__respond(sp, start, "405 Method Not Allowed");
+   else {
+      save = body[clen];
+      body[clen] = '\0';
+      mp = rpc__method(rpc__jsonkey(body, "method"));
+      if (mp && mp->heavy) {
+         if (sp->outlen || Rpcworkers >= RPCWORKERS) {
+            body[clen] = save;
+            return 0;
+         }
+         if (rpc__worker(sp, body) == VEOK) {
+            body[clen] = save;
+            return hdrlen + clen;
+         }
+         /* serve in the server loop, without a worker */
+      }
+      rpc__jsonrpc(sp, body);
+      body[clen] = save;
+      rpc__respond(sp, start, "200 OK");
+   }
+
+   return hdrlen + clen;
+}  /* end rpc__http() */
+
+/**
+ * Open the JSON-RPC interface on a local address and port.
+ * @param addr Local address to listen on, e.g. "127.0.0.1"
+ * @param port Port number to listen on
+ * @return (int) value representing operation result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+*/
+int rpc_init(const char *addr, word16 port)
+{
+   struct sockaddr_in sin;
+   int j, reuse_addr;
+
+   for (j = 0; j < RPCMAX; j++) Rpcsession[j].sd = INVALID_SOCKET;
+
+   memset(&sin, 0, sizeof(sin));
+   sin.sin_family = AF_INET;
+   sin.sin_port = htons(port);
+   sin.sin_addr.s_addr = aton(addr);
+
+   Rpcsd = socket(AF_INET, SOCK_STREAM, 0);
+   if (Rpcsd == INVALID_SOCKET) return VERROR;
+   reuse_addr = 1;
+   setsockopt(Rpcsd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(int));
+   if (bind(Rpcsd, (struct sockaddr *) &sin, sizeof(sin)) != 0) goto FAIL;
+   if (sock_set_nonblock(Rpcsd) == SOCKET_ERROR) goto FAIL;
+   if (listen(Rpcsd, RPCMAX) != 0) goto FAIL;
+
+   plog("JSON-RPC interface at %s:%u", addr, (unsigned) port);
+   return VEOK;
+
+FAIL:
+   rpc_close();
+   return VERROR;
+}  /* end rpc_init() */
+
+/**
+ * Service the JSON-RPC interface. Accepts new sessions, while there are
+ * less than RPCMAX sessions, and serves up to RPCPIPE waiting requests of
+ * each session. Response data is sent without blocking, and no further
+ * requests of a session are served while its response data is pending,
+ * or while a worker process serves the session. Finished workers are
+ * reaped. Sessions that end, error, or stay idle for RPCIDLE seconds,
+ * are closed.
+ * Called from the server loop.
+ * @return (int) number of requests served
+*/
+int rpc_service(void)
+{
+   RPCSESSION *sp;
+   SOCKET sd;
+   size_t used;
+   time_t now;
+   pid_t pid;
+   int j, n, count, served, status;
+
+   if (Rpcsd == INVALID_SOCKET) return 0;
+   time(&now);
+
+   /* accept new sessions, while there is a free slot */
+   for (j = 0; j < RPCMAX; j++) {
+      sp = &Rpcsession[j];
+      if (sp->sd != INVALID_SOCKET) continue;
+      sd = accept(Rpcsd, NULL, NULL);
+      if (sd == INVALID_SOCKET) break;
+      if (sock_set_nonblock(sd) == SOCKET_ERROR) {
+         sock_close(sd);
+         break;
+      }
+      memset(sp, 0, sizeof(RPCSESSION) - sizeof(sp->buf));
+      sp->sd = sd;
+      sp->ip = get_sock_ip(sd);
+      sp->last = now;
+   }
+
+   /* serve pipelined requests of each session */
+   for (served = j = 0; j < RPCMAX; j++) {
+      sp = &Rpcsession[j];
+      if (sp->sd == INVALID_SOCKET) continue;
+      /* reap worker, and resume session */
+      if (sp->pid) {
+         pid = waitpid(sp->pid, &status, WNOHANG);
+         if (pid == 0) continue;
+         sp->pid = 0;
+         sp->last = now;
+         Rpcworkers--;
+         if (pid < 0 || !WIFEXITED(status)) status = RPCW_ERROR;
+         else status = WEXITSTATUS(status);
+         if (status == RPCW_TXOK || status == RPCW_TXMQ) {
+            Txcount++;
+            Nrec++;  /* total good TX received */
+            if (status == RPCW_TXMQ) Mqcount++;
+         }
+         if (status == RPCW_ERROR || sp->close) {
+            rpc__drop(sp);
+            continue;
+         }
+      }
+      if (rpc__flush(sp) != VEOK) {
+         rpc__drop(sp);
+         continue;
+      }
+      /* read available request data */
+      if (!sp->close && sp->len < RPCBUFLEN) {
+         count = recv(sp->sd, sp->buf + sp->len, RPCBUFLEN - sp->len, 0);
+         if (count > 0) {
+            sp->len += (size_t) count;
+            sp->last = now;
+         } else if (count == 0 || !sock_waiting(sock_errno)) {
+            rpc__drop(sp);
+            continue;
+         }
+      }
+      for (n = 0; n < RPCPIPE && sp->outlen < RPCBUFLEN && !sp->close; n++) {
+         used = rpc__http(sp);
+         if (used == 0) break;
+         sp->len -= used;
+         memmove(sp->buf, sp->buf + used, sp->len);
+         served++;
+         if (sp->pid) break;
+      }
+      /* send (or start sending) responses, unless a worker serves */
+      if (sp->pid) continue;
+      if (sp->error || rpc__flush(sp) != VEOK ||
+            (sp->close && sp->outlen == 0) ||
+            (sp->outlen == 0 && difftime(now, sp->last) > RPCIDLE)) {
+         rpc__drop(sp);
+      }
+   }
+
+   return served;
+}  /* end rpc_service() */
+
+/**
+ * Close the JSON-RPC interface, and all sessions. Worker processes are
+ * terminated, and reaped.
+*/
+void rpc_close(void)
+{
+   RPCSESSION *sp;
+   int j;
+
+   if (Rpcsd == INVALID_SOCKET) return;
+   for (j = 0; j < RPCMAX; j++) {
+      sp = &Rpcsession[j];
+      if (sp->pid) {
+         kill(sp->pid, SIGTERM);
+         waitpid(sp->pid, NULL, 0);
+         sp->pid = 0;
+         Rpcworkers--;
+      }
+      if (sp->sd != INVALID_SOCKET) rpc__drop(sp);
+   }
+   sock_close(Rpcsd);
+   Rpcsd = INVALID_SOCKET;
+}  /* end rpc_close() */
+
+/* end include guard */
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file rpc.h
+ * @brief Mochimo JSON-RPC (HTTP/1.1) interface support.
+ * @details An optional, embedded JSON-RPC 2.0 server, for integrations
+ * that would otherwise speak the binary TX packet protocol (or run a
+ * proxy that does). Requests are HTTP/1.1 POST requests (of any path)
+ * with a JSON-RPC request object body. Connections are kept alive (unless
+ * the client asks otherwise), and pipelined requests are answered in
+ * request order. Sessions are served from the server loop, directly from
+ * node structures, with at most RPCMAX concurrent sessions. Heavy methods
+ * (getblock, gettx, sendtx) are served by at most RPCWORKERS worker processes,
+ * and getblock serves blocks of at most RPCBLOCKMAX bytes.
+ * <br/>Supported methods, and params:
+ * - getbalance [address]: address is a hex address (or hex tag)
+ * - resolvetag [tag]: tag is a hex tag
+ * - sendtx [tx]: tx is a hex transaction, validated with process_tx()
+ * - getblock [bnum]: bnum is a block number, or "0x" hex string
+ * - gettx [bnum, index]: index is a transaction index of the block
+ * - gettrailer [bnum]: bnum is a block number, or "0x" hex string
+ * - gettip []: chain tip of the node
+ * - getpeers []: recent peers, and chain tips advertised by peers
+ * <br/>Block numbers are returned as numbers, amounts are returned as
+ * (decimal) strings and binary data is returned as hex strings.
+ * @copyright Adequate Systems LLC, 2018-2022. All Rights Reserved.
+ * <br />For license information, please refer to ../LICENSE.md
+*/
+
+/* include guard */
+#ifndef MOCHIMO_RPC_H
+#define MOCHIMO_RPC_H
+
+
+/* extended-c support */
+#include "extinet.h"
+
+/* mochimo support */
+#include "types.h"
+
+#ifndef RPCMAX
+/** Maximum number of concurrent JSON-RPC sessions */
+#define RPCMAX       8
+#endif
+
+#ifndef RPCPIPE
+/** Maximum number of (pipelined) requests served per session, per pass */
+#define RPCPIPE      8
+#endif
+
+#ifndef RPCBUFLEN
+/** Request buffer length of a session; fits a hex encoded transaction */
+#define RPCBUFLEN    ( (2 * WORD16_MAX) + 4096 )
+#endif
+
+#ifndef RPCWORKERS
+/** Maximum number of concurrent worker processes, serving heavy methods */
+#define RPCWORKERS   2
+#endif
+
+#ifndef RPCBLOCKMAX
+/** Maximum length, in bytes, of a block served by method getblock */
+#define RPCBLOCKMAX  ( 1 << 24 )
+#endif
+
+#ifndef RPCIDLE
+/** Seconds before an idle session is closed */
+#define RPCIDLE      30
+#endif
+
+/* C/C++ compatible function prototypes */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int rpc_init(const char *addr, word16 port);
+int rpc_service(void);
+void rpc_close(void);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+/* end include guard */
+#endif
@@ -22,8 +22,10 @@
 #include "error.h"
 #include "bval.h"
 #include "bup.h"
+#include "peer.h"
 
 /* external support */
+#include "exttime.h"
 #include "extthrd.h"
 #include "extmath.h"
 #include "extlib.h"
@@ -91,6 +93,7 @@ int catchup(word32 plist[], word32 count)
 {
    void (*SIGTERM_old)(int);
    void (*SIGINT_old)(int);
+   FILENAME fname_part = {0};
    FILENAME fname_dl = {0};
    FILENAME fname = {0};
    word8 bnum[8];
@@ -113,15 +116,19 @@ int catchup(word32 plist[], word32 count)
       if (SYNC_interrupt_signal_) break;
       bnum2hex(bnum, fname_dl);
       bnum2fname(bnum, fname);
+      snprintf(fname_part, sizeof(fname_part), "%s.part", fname_dl);
       sub64(bnum, ONE64, bnum);
+      remove(fname_part);
       remove(fname_dl);
       remove(fname);
+      fname_part[0] = 0;
       fname_dl[0] = 0;
       fname[0] = 0;
    }
 
    /* download/validate/update blocks from args */
-   OMP_PARALLEL_(private(bnum, fname, fname_dl) num_threads(count))
+   OMP_PARALLEL_(private(bnum, fname, fname_dl, fname_part) \
+      num_threads(count))
    {  /* ... parallel block update handling */
       word32 peer = plist[OMP_THREADNUM];
       int ecode = VEOK;
@@ -137,7 +144,10 @@ int catchup(word32 plist[], word32 count)
                {
                   pdebug("get_file(%s, %s) incomplete...",
                      ntoa(&peer, (char[16]){0}), fname_dl);
-                  remove(fname_dl);
+                  /* keep partial download for resume by another peer */
+                  snprintf(fname_part, sizeof(fname_part), "%s.part",
+                     fname_dl);
+                  if (rename(fname_dl, fname_part) != 0) remove(fname_dl);
                   count--;
                }
                break;
@@ -162,9 +172,21 @@ int catchup(word32 plist[], word32 count)
                if (ecode != VEOK) {
                   perrno("b_update(%s) FAILURE", fname);
                   remove(fname);
+                  /* ... and any partial download of the bad block */
+                  bnum2hex(bnum, fname_dl);
+                  snprintf(fname_part, sizeof(fname_part), "%s.part",
+                     fname_dl);
+                  remove(fname_part);
+                  fname_dl[0] = 0;
                   count--;
                   break;
                }
+               /* remove any partial download of block */
+               bnum2hex(bnum, fname_dl);
+               snprintf(fname_part, sizeof(fname_part), "%s.part",
+                  fname_dl);
+               remove(fname_part);
+               fname_dl[0] = 0;
                /* check for next block */
                add64(Cblocknum, One, bnum);
                bnum2fname(bnum, fname);
@@ -178,8 +200,10 @@ int catchup(word32 plist[], word32 count)
                   bnum2hex(bnum, fname_dl);
                   bnum2fname(bnum, fname);
                }
-               /* reserve download file(name) */
-               ftouch(fname_dl);
+               /* reserve download file(name), resuming any partial */
+               snprintf(fname_part, sizeof(fname_part), "%s.part",
+                  fname_dl);
+               if (rename(fname_part, fname_dl) != 0) ftouch(fname_dl);
             }
          }  /* end OMP_CRITICAL_() */
       }  /* end while (!SYNC_interrupt_signal_... */
@@ -198,13 +222,139 @@ int catchup(word32 plist[], word32 count)
    return VEOK;
 }  /* end catchup() */
 
+/**
+ * @private
+ * Compare the hash of a block of a peer with the trailer of our Tfile.
+ * @param ip IPv4 address of peer
+ * @param bnum Block number to compare
+ * @return (int) 1 on match, 0 on mismatch, or (-1) on error
+ */
+static int resync__match(word32 ip, word32 bnum)
+{
+   NODE node;
+   BTRAILER bt;
+   word8 bnum8[8], hash[HASHLEN];
+
+   put64(bnum8, CL64_32(bnum));
+   if (read_tfile(&bt, bnum8, 1, "tfile.dat") != 1) return (-1);
+   if (get_hash(&node, ip, bnum8, hash) != VEOK) return (-1);
+
+   return memcmp(hash, bt.bhash, HASHLEN) == 0;
+}  /* end resync__match() */
+
+/**
+ * @private
+ * Build a Tfile, "tfile.tmp", of a peer's chain from our Tfile and the
+ * peer's trailers after our last common ancestor. The common ancestor,
+ * no more than NTFSUFFIX trailers below the lower of our, and the peer's,
+ * highest block number, is found by binary search over OP_HASH probes.
+ * Only the divergent suffix is downloaded, with OP_TF requests, paced
+ * to the peer's RL_TF quota beyond its burst. Any failure to download or
+ * append a range fails the build; only a short final range is accepted.
+ * @note The suffix is NOT validated; validate trailers from common.
+ * @param ip IPv4 address of peer
+ * @param highbnum Highest block number of peer
+ * @param common Pointer to place number of common trailers
+ * @return (int) VEOK on success, else VERROR if a full Tfile download
+ * is required
+ */
+static int resync__tfile(word32 ip, const word8 highbnum[8], word32 *common)
+{
+   BTRAILER *buffer, bt;
+   word8 bnum[8];
+   word32 lo, hi, mid, first, count, delay, retry, j;
+   long long len;
+   size_t n;
+   FILE *fp;
+   int match;
+
+   buffer = NULL;
+
+   /* incremental resync of a (32-bit) chain, on an existing Tfile */
+   if (highbnum[4] || highbnum[5] || highbnum[6] || highbnum[7]) {
+      return VERROR;
+   }
+   if (read_trailer(&bt, "tfile.dat") != VEOK) return VERROR;
+   hi = get32(bt.bnum) < get32(highbnum) ? get32(bt.bnum) : get32(highbnum);
+   lo = hi > NTFSUFFIX ? hi - NTFSUFFIX : 0;
+
+   /* find the highest common trailer -- lowest candidate MUST match */
+   if ((match = resync__match(ip, hi)) < 0) return VERROR;
+   if (!match) {
+      if (resync__match(ip, lo) != 1) return VERROR;
+      while (Running && hi - lo > 1) {
+         mid = lo + ((hi - lo) / 2);
+         if ((match = resync__match(ip, mid)) < 0) return VERROR;
+         if (match) lo = mid;
+         else hi = mid;
+      }
+      hi = lo;
+   }
+   if (!Running || hi >= get32(highbnum)) return VERROR;
+   plog("common ancestor block 0x%" P32x " with %s", hi, ntoa(&ip, NULL));
+
+   /* copy our Tfile up to common ancestor */
+   put64(bnum, CL64_32(hi));
+   remove("tfile.tmp" MMR_EXT);
+   if (fcopy("tfile.dat", "tfile.tmp") != VEOK) return VERROR;
+   fcopy("tfile.dat" MMR_EXT, "tfile.tmp" MMR_EXT);  /* trimmed with tfile */
+   if (trim_tfile("tfile.tmp", bnum) != VEOK) goto FAIL;
+
+   /* download and append divergent suffix -- requests beyond the RL_TF
+    * burst of the peer are paced to its quota, and retried when refused */
+   buffer = malloc(NTFRANGE * sizeof(BTRAILER));
+   if (buffer == NULL) goto FAIL;
+   for (j = 0, first = hi + 1; first <= get32(highbnum); first += count) {
+      count = get32(highbnum) - first + 1;
+      if (count > NTFRANGE) count = NTFRANGE;
+      delay = Rlquota[RL_TF] ? 60000 / Rlquota[RL_TF] : 1000;
+      if (j++ >= Rlburst[RL_TF]) millisleep(delay);
+      for (retry = 0; Running; retry++, delay *= 2) {
+         if (get_tf(ip, first, count, "tf.tmp") == VEOK) break;
+         if (retry >= 3) goto FAIL;
+         pdebug("get_tf(0x%" P32x ") retry in %" P32u "ms", first, delay);
+         millisleep(delay);
+      }
+      if (!Running) goto FAIL;
+      fp = fopen("tf.tmp", "rb");
+      if (fp == NULL) goto FAIL;
+      n = 0;
+      if (fseek64(fp, 0LL, SEEK_END) == 0 && (len = ftell64(fp)) > 0 &&
+            len % sizeof(BTRAILER) == 0 && len / sizeof(BTRAILER) <= count) {
+         rewind(fp);
+         n = fread(buffer, sizeof(BTRAILER), len / sizeof(BTRAILER), fp);
+      }
+      fclose(fp);
+      if (n == 0 || get32(buffer->bnum) != first) goto FAIL;
+      if (append_tfile(buffer, n, "tfile.tmp") != VEOK) goto FAIL;
+      /* short (final) range indicates end of peer's Tfile */
+      if (n < count) break;
+   }
+   remove("tf.tmp");
+   free(buffer);
+
+   *common = hi + 1;
+   return VEOK;
+
+FAIL:
+   free(buffer);
+   remove("tf.tmp");
+   remove("tfile.tmp");
+   remove("tfile.tmp" MMR_EXT);
+
+   return VERROR;
+}  /* end resync__tfile() */
+
 /**
  * Resynchronize blockchain up to network weight/bnum using quorum[qidx].
  * Returns VEOK on success, else restarts. */
 int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
 {
    char ipaddr[16], fname[FILENAME_MAX], bcfname[21];
+   BTRAILER bt;
    word8 bnum[8], weight[HASHLEN];
+   word32 common;
+   int ngvalid, trust;
 
    /* resync from quorum bnum must be higher than V30TRIGGER */
    if (cmp64(highbnum, CL64_32(V30TRIGGER)) < 0) {
@@ -213,10 +363,29 @@ int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
    }
 
    show("gettfile");  /* get tfile */
-   pdebug("fetching tfile.dat from %s", ntoa(&quorum[0], ipaddr));
-   pdebug("... this is a large file, please be patient !!!");
-   while(Running && *quorum) {
+   memset(weight, 0, sizeof(weight));
+   common = 0;
+   /* try divergent suffix of tfile, from common ancestor... */
+   if (resync__tfile(*quorum, highbnum, &common) == VEOK) {
+      remove("tfile.dat");
+      remove("tfile.dat" MMR_EXT);
+      if (rename("tfile.tmp", "tfile.dat") != 0) {
+         restart("gettfile rename tfile.tmp");  /* panic */
+      }
+      rename("tfile.tmp" MMR_EXT, "tfile.dat" MMR_EXT);
+      put64(bnum, CL64_32(common - 1));
+      if (weigh_tfile("tfile.dat", bnum, weight) != VEOK) {
+         restart("gettfile weigh common trailers");  /* panic */
+      }
+   } else common = 0;
+   /* ... else whole tfile, from one quorum member at a time */
+   if (common == 0) {
+      pdebug("fetching tfile.dat from %s", ntoa(&quorum[0], ipaddr));
+      pdebug("... this is a large file, please be patient !!!");
+   }
+   while(Running && *quorum && common == 0) {
       remove("tfile.dat");
+      remove("tfile.dat" MMR_EXT);
       if (get_file(*quorum, NULL, "tfile.tmp") == VEOK) {
          if (rename("tfile.tmp", "tfile.dat") == 0) break;
          perrno("failed to rename tfile.dat");
@@ -231,16 +400,33 @@ int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
    /* do some quick maths to estimate time for tfile validation */
    pdebug("validating tfile (est. %u seconds)...",
       (word32) (*((word64 *) highbnum) / 300 / OMP_MAX_THREADS));
-   if (validate_tfile("tfile.dat", bnum, weight, 0) != VEOK) {
+   if (validate_tfile("tfile.dat", bnum, weight, (int) common) != VEOK) {
       remove("tfile.dat.fail");
       rename("tfile.dat", "tfile.dat.fail");
-      perrno("validate_tfile(tfile.dat, 0x%s, 0x%s, 0) FAILURE",
-         bnum2hex(bnum, NULL), weight2hex(weight, NULL));
+      perrno("validate_tfile(tfile.dat, 0x%s, 0x%s, %u) FAILURE",
+         bnum2hex(bnum, NULL), weight2hex(weight, NULL), common);
       return VERROR;
-   } else if (validate_tfile_pow("tfile.dat", Trustblock) != VEOK) {
+   }
+   /* trust PoW of common trailers, assume-valid block and its ancestors */
+   trust = Trustblock;
+   if ((word32) trust < common) trust = (int) common;
+   remove("tfile.av");
+   if (!Fullverify && !iszero(Assumevalid, HASHLEN)) {
+      if (find_tfile("tfile.dat", Assumevalid, &bt) != VEOK) {
+         pwarn("assume-valid block not found in tfile, full verify...");
+      } else if (fcopy("tfile.dat", "tfile.av") != VEOK ||
+            trim_tfile("tfile.av", bt.bnum) != VEOK) {
+         perrno("failed to extract assume-valid trailers");
+         remove("tfile.av");
+      } else {
+         plog("assume-valid block 0x%s", bnum2hex(bt.bnum, NULL));
+         if ((word32) trust <= get32(bt.bnum)) trust = get32(bt.bnum) + 1;
+      }
+   }
+   if (validate_tfile_pow("tfile.dat", trust) != VEOK) {
       remove("tfile.pow.fail");
       rename("tfile.dat", "tfile.pow.fail");
-      perrno("validate_tfile_pow(tfile.dat, 0) FAILURE");
+      perrno("validate_tfile_pow(tfile.dat, %d) FAILURE", trust);
       return VERROR;
    }
    pdebug("tfile.dat is valid");
@@ -264,9 +450,26 @@ int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
    /* download neo-genesis block if no backup */
    if(!iszero(bnum, 8)) {  /* ... no need to download genesis block */
       plog("downloading neo-genesis block 0x%s", bnum2hex(bnum, NULL));
-      while(Running && *quorum) {
+      /* chunked download from capable quorum members, in parallel... */
+      show("getneo");
+      ngvalid = 0;
+      /* ... unless a previous run left this neo-genesis block, whole */
+      if (fexists("ngblock.dat")) {
+         if (ng_val("ngblock.dat", bnum) == VEOK) ngvalid = 1;
+         else remove("ngblock.dat");  /* stale, or partial */
+      }
+      if (!ngvalid &&
+            get_ngblock(quorum, *qidx, bnum, "ngblock.dat") == VEOK) {
+         show("checkneo");
+         if (ng_val("ngblock.dat", bnum) != VEOK) {
+            perrno("Bad NG block (chunked)");
+            remove("ngblock.dat");
+         } else ngvalid = 1;
+      }
+      /* ... else whole block, from one quorum member at a time */
+      while(Running && *quorum && !ngvalid) {
          show("getneo");
-         remove("ngblock.dat");
+         /* partial downloads are resumed from the next member */
          if (get_file(*quorum, bnum, "ngblock.dat") == VEOK) {
             show("checkneo");
             /* validate neogenesis block */
@@ -302,6 +505,7 @@ int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
       plog("catchup() encountered an error, restarting...");
       restart("catchup error");
    }
+   remove("tfile.av");  /* assume-valid trailers no longer needed */
 
    /* verify chain catchup */
    if (cmp64(Cblocknum, highbnum) < 0) {
@@ -331,6 +535,41 @@ int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum)
    return VEOK;
 }
 
+/**
+ * Resynchronize a running node from a quorum of recently seen peer chain
+ * tips (see tip_quorum()), rather than a network scan. The block
+ * constructor, and any block relay, is stopped as the chain is replaced.
+ * @param heavier Non-zero to resync only to a chain heavier than ours
+ * @return (int) value representing operation result
+ * @retval VERROR on insufficient quorum, or resync failure
+ * @retval VEOK on success
+ */
+int resync_tips(int heavier)
+{
+   word32 quorum[MAXQUORUM], qlen;
+   word8 hash[HASHLEN], weight[32], bnum[8];
+   int result;
+
+   qlen = (word32) tip_quorum(quorum, MAXQUORUM, hash, weight, bnum,
+      TIPMAXAGE);
+   if (qlen == 0 || qlen < Quorum) {
+      pdebug("insufficient quorum of recent peer tips");
+      return VERROR;
+   }
+   result = cmp256(weight, Weight);
+   if (result < 0 || (heavier && result == 0)) {
+      pdebug("recent peer tips are not heavier");
+      return VERROR;
+   }
+
+   plog("Resync from recent peer tips (0x%s)...", bnum2hex(bnum, NULL));
+   stop_bcon();
+   stop_found();
+   shuffle32(quorum, qlen);
+
+   return resync(quorum, &qlen, weight, bnum);
+}  /* end resync_tips() */
+
 /* Pull a divergent block chain and merge it into ours
  * rather than bailing out to contention!
  * Always returns VEOK to ignore contention.
@@ -370,7 +609,8 @@ int syncup(word32 splitblock, word8 *txcblock, word32 peerip)
    pdebug("Backing up TFILE, ledger.dat, and blocks...");
    system("mkdir -p split/");
    system("cp tfile.dat split/");
-   system("cp ledger.dat split/");
+   system("cp -p ledger.dat split/");
+   system("cp -p ledger.dat" LEHASH_EXT " split/ 2>/dev/null");
 
    put32(sblock + 4, 0);
    put32(sblock, splitblock);
@@ -464,7 +704,10 @@ badsyncup:
    pdebug("bad sync: restoring saved state...");
    le_close();
    system("mv split/tfile.dat .");
+   remove("tfile.dat" MMR_EXT);  /* trimmed with tfile -- rebuilt later */
    system("mv split/ledger.dat .");
+   remove("ledger.dat" LEHASH_EXT);
+   system("mv split/ledger.dat" LEHASH_EXT " . 2>/dev/null");
    system("rm -r split/");
    reset_chain();  /* reset Difficulty and others */
    le_open("ledger.dat");
@@ -472,6 +715,67 @@ badsyncup:
    return VEOK;
 }  /* end syncup() */
 
+/**
+ * @private
+ * Locate the split block of a deep fork with MMR proofs of a peer's
+ * trailers. The proof of the peer's advertised block MUST match the
+ * advertised block hash and weight, and the proof of every bisected
+ * trailer MUST match the same root, so that the split block is found
+ * in log2(Cblocknum) round trips of a few KB each -- within a single
+ * RL_MMR burst of the peer.
+ * @param np Pointer to NODE of peer (advertising OP_FOUND)
+ * @param splitblock Pointer to place first non-matching block number
+ * @return (int) value representing operation result
+ * @retval VEBAD if peer's proofs do not match its advertisement
+ * @retval VERROR on error
+ * @retval VEOK on success
+ */
+static int contention__mmr(NODE *np, word32 *splitblock)
+{
+   NODE node;
+   BTRAILER bt, our_bt;
+   word8 root[HASHLEN], weight[32], tiproot[HASHLEN], count[8], bnum[8];
+   word32 lo, hi, mid;
+   int ecode;
+
+   /* prove the advertised block, against all of peer's trailers */
+   add64(np->tx.cblock, One, count);
+   ecode = get_mmrproof(&node, np->ip, np->tx.cblock, count, &bt,
+      tiproot, weight);
+   if (ecode != VEOK) return ecode;
+   if (memcmp(bt.bhash, np->tx.cblockhash, HASHLEN) != 0 ||
+         memcmp(weight, np->tx.weight, 32) != 0) {
+      pdebug("MMR proof does not match advertisement");
+      return VEBAD;
+   }
+   if (get32(bt.tcount) && validate_pow(&bt) != VEOK) {
+      pdebug("MMR proof pow validation failure");
+      return VEBAD;
+   }
+
+   /* bisect for first non-matching trailer -- genesis always matches */
+   lo = 0;
+   hi = get32(Cblocknum) < get32(np->tx.cblock) ?
+      get32(Cblocknum) + 1 : get32(np->tx.cblock);
+   while (Running && hi - lo > 1) {
+      mid = lo + ((hi - lo) / 2);
+      put64(bnum, CL64_32(mid));
+      ecode = get_mmrproof(&node, np->ip, bnum, count, &bt, root, weight);
+      if (ecode != VEOK) return ecode;
+      if (memcmp(root, tiproot, HASHLEN) != 0) {
+         pdebug("MMR proof of 0x%" P32x " has another root", mid);
+         return VEBAD;
+      }
+      if (read_tfile(&our_bt, bnum, 1, "tfile.dat") != 1) return VERROR;
+      if (memcmp(&bt, &our_bt, sizeof(BTRAILER)) == 0) lo = mid;
+      else hi = mid;
+   }
+   if (!Running) return VERROR;
+   *splitblock = hi;
+
+   return VEOK;
+}  /* end contention__mmr() */
+
 /* Handle contention
  * Returns:  0 = nothing else to do
  *           1 = do fetch block with child
@@ -541,7 +845,13 @@ int contention(NODE *np)
    }
    if (memcmp(bt, our_bt, sizeof(BTRAILER)) != 0) {
       pdebug("Trailer mismatch");
-      return (-1);
+      /* fork is deeper than the tx proof -- locate split with MMR */
+      if (!(np->cxbits & Cxbits & CX_MMR)) return (-1);
+      result = contention__mmr(np, &splitblock);
+      if (result == VEBAD) pinklist(np->ip);
+      if (result != VEOK) return (result == VEBAD) ? 0 : (-1);
+      pdebug("MMR split at block 0x%" P32x, splitblock);
+      goto split;
    }
 
    /* compute previous weight for add_weight() */
@@ -585,6 +895,7 @@ int contention(NODE *np)
    }
 
    /* Proof is good so try to re-sync to peer */
+split:
    if(syncup(splitblock, tx->cblock, np->ip) != VEOK)  {
       pdebug("syncup() failure");
       return 0;
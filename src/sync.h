@@ -27,6 +27,7 @@ extern "C" {
 int reset_chain(void);
 int catchup(word32 plist[], word32 count);
 int resync(word32 quorum[], word32 *qidx, void *highweight, void *highbnum);
+int resync_tips(int heavier);
 int syncup(word32 splitblock, word8 *txcblock, word32 peerip);
 int contention(NODE *np);
 
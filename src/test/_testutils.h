@@ -1,4 +1,5 @@
 
+#include <string.h>
 #include "../types.h"
 
 char *Corephosts[] = {
@@ -42,6 +43,21 @@ LENTRY ledgerdata[10] = {
    { .addr = { 5, 6, 7, 8, 9 }, .balance = { 255, 255, 9 }}
 };
 
+/* build sorted dummy ledger of count entries, with implicit addresses
+ * (tag == hash), in ledger[], and write it to fname */
+int dummyledger(char *fname, LENTRY *ledger, size_t count)
+{
+   size_t j;
+
+   memset(ledger, 0, count * sizeof(LENTRY));
+   for (j = 0; j < count; j++) {
+      memset(ledger[j].addr, (int) (j * 2 + 1), ADDR_LEN);
+      ledger[j].balance[0] = (word8) (j + 1);
+   }
+
+   return write2file(fname, ledger, count * sizeof(LENTRY));
+}
+
 /* pseduo-block 0x1285f (75871) */
 word8 b1285f[4 + sizeof(BTRAILER)] = {
    0xb0, 0xdc, 0x58, 0xa1, 0x2e, 0x99, 0xdd, 0xd1, 0x01, 0xa9,
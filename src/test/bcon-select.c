@@ -0,0 +1,69 @@
+#include "_assert.h"
+#include "bcon.h"
+#include "extlib.h"
+
+#include <string.h>
+
+#define NTX 8
+
+/* fill transaction reference with source byte, fee and size */
+static void settx(BCTXPOS *txp, word8 src, word32 fee, size_t size)
+{
+   memset(txp, 0, sizeof(BCTXPOS));
+   memset(txp->src, src, ADDR_LEN);
+   put32(txp->fee, fee);
+   txp->size = size;
+}
+
+/* initialize transaction references (in reverse source order) */
+static void inittx(BCTXPOS *txp)
+{
+   settx(&txp[0], 8, 1000, 2000);
+   settx(&txp[1], 7, 500, 2000);
+   settx(&txp[2], 6, 4000, 4000);
+   settx(&txp[3], 5, 3000, 2000);
+   settx(&txp[4], 4, 500, 2000);
+   settx(&txp[5], 3, 2000, 2000);  /* duplicate, lower fee */
+   settx(&txp[6], 3, 2500, 2000);  /* duplicate, higher fee */
+   settx(&txp[7], 1, 100, 2000);   /* below MFEE */
+}
+
+int main()
+{  /* check b_select() limits, fee selection and source order */
+   BCTXPOS txp[NTX];
+   size_t j, n;
+
+   /* no limits: drops low fee and duplicate source, sorted by source */
+   inittx(txp);
+   n = b_select(txp, NTX, 0, 0, MFEE64);
+   ASSERT_EQ_MSG(n, 6, "should drop low fee and duplicate source");
+   for (j = 1; j < n; j++) {
+      ASSERT_LT_MSG(memcmp(txp[j - 1].src, txp[j].src, ADDR_LEN), 0,
+         "selection should be sorted by source address");
+   }
+   ASSERT_EQ_MSG(txp[0].src[0], 3, "lowest source should be first");
+   ASSERT_EQ_MSG(get32(txp[0].fee), 2500, "should keep highest fee dup");
+
+   /* transaction limit: keep highest fee per byte */
+   inittx(txp);
+   n = b_select(txp, NTX, 2, 0, MFEE64);
+   ASSERT_EQ_MSG(n, 2, "should limit transaction count");
+   ASSERT_EQ_MSG(txp[0].src[0], 3, "source 3 (2500/2000) is selected");
+   ASSERT_EQ_MSG(txp[1].src[0], 5, "source 5 (3000/2000) is selected");
+
+   /* byte limit: large transaction doesn't fit, smaller ones do */
+   inittx(txp);
+   n = b_select(txp, NTX, 0, 7000, MFEE64);
+   ASSERT_EQ_MSG(n, 3, "should limit transaction bytes");
+   ASSERT_EQ_MSG(txp[0].src[0], 3, "source 3 is selected");
+   ASSERT_EQ_MSG(txp[1].src[0], 5, "source 5 is selected");
+   ASSERT_EQ_MSG(txp[2].src[0], 8, "source 8 (1000/2000) is selected");
+
+   /* minimum fee limit */
+   inittx(txp);
+   n = b_select(txp, NTX, 0, 0, CL64_32(2500));
+   ASSERT_EQ_MSG(n, 3, "should exclude fees below minimum");
+   for (j = 0; j < n; j++) {
+      ASSERT_GE_MSG(get32(txp[j].fee), 2500, "fee should be >= minimum");
+   }
+}
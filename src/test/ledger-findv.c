@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "extprint.h"
+#include "_assert.h"
+#include "ledger.h"
+
+#include "_testutils.h"
+
+#define LEDGER "ledger.dat"
+#define NLE    8
+
+int main()
+{  /* check le_findv() batched sorted lookups, by address and tag */
+   LENTRY ledger[NLE], le[5];
+   size_t j;
+
+   set_print_level(0);
+
+   /* build sorted dummy ledger with implicit addresses (tag == hash) */
+   ASSERT_EQ(dummyledger(LEDGER, ledger, NLE), VEOK);
+
+   /* check ledger function called before le_open() */
+   memcpy(le[0].addr, ledger[0].addr, ADDR_LEN);
+   ASSERT_EQ_MSG(le_findv(le, 1), 0, "should fail before le_open()");
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+
+   /* sorted queries: full address, missing, tag only, missing, last */
+   memset(le, 0, sizeof(le));
+   memcpy(le[0].addr, ledger[1].addr, ADDR_LEN);
+   memset(le[1].addr, 4, ADDR_LEN);
+   memcpy(ADDR_TAG_PTR(le[2].addr), ADDR_TAG_PTR(ledger[4].addr),
+      ADDR_TAG_LEN);
+   memset(le[3].addr, 12, ADDR_LEN);
+   memcpy(le[4].addr, ledger[NLE - 1].addr, ADDR_LEN);
+   for (j = 0; j < 5; j++) memset(le[j].balance, 0xff, 8);
+   ASSERT_EQ_MSG(le_findv(le, 5), 3, "should find 3 of 5 addresses");
+   ASSERT_CMP_MSG(&le[0], &ledger[1], sizeof(LENTRY), "full address");
+   ASSERT_CMP_MSG(&le[2], &ledger[4], sizeof(LENTRY), "tag only address");
+   ASSERT_CMP_MSG(&le[4], &ledger[NLE - 1], sizeof(LENTRY), "last address");
+   ASSERT_EQ_MSG(iszero(le[1].balance, 8), 1, "missing has zero balance");
+   ASSERT_EQ_MSG(iszero(le[3].balance, 8), 1, "missing has zero balance");
+
+   /* cleanup */
+   le_close();
+   remove(LEDGER);
+}
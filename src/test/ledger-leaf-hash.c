@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include "extprint.h"
+#include "sha256.h"
+#include "_assert.h"
+#include "ledger.h"
+
+#include "_testutils.h"
+
+#define LEDGER    "ledger.dat"
+#define LEDGERLH  "ledger.dat" LEHASH_EXT
+#define LTRANFILE "ltran.dat"
+#define NLE       4
+
+/* check each leaf hash, and digest, of sidecar against ledger entries */
+static size_t check_leaf_hashes(void)
+{
+   SHA256_CTX ctx;
+   struct stat st;
+   FILE *fp, *lhfp;
+   LENTRY le;
+   word8 hash[HASHLEN], lhash[HASHLEN];
+   word64 bind[2];
+   size_t count;
+
+   ASSERT_NE((fp = fopen(LEDGER, "rb")), NULL);
+   ASSERT_NE((lhfp = fopen(LEDGERLH, "rb")), NULL);
+   sha256_init(&ctx);
+   for (count = 0; fread(&le, sizeof(LENTRY), 1, fp) == 1; count++) {
+      ASSERT_EQ(fread(lhash, HASHLEN, 1, lhfp), 1);
+      sha256(&le, sizeof(LENTRY), hash);
+      ASSERT_CMP_MSG(hash, lhash, HASHLEN, "leaf hash should match entry");
+      sha256_update(&ctx, lhash, HASHLEN);
+   }
+   /* ... digest is bound to ledger size and modification time */
+   ASSERT_EQ(stat(LEDGER, &st), 0);
+   bind[0] = (word64) st.st_size;
+   bind[1] = (word64) st.st_mtime;
+   sha256_update(&ctx, bind, sizeof(bind));
+   sha256_final(&ctx, hash);
+   ASSERT_EQ(fread(lhash, HASHLEN, 1, lhfp), 1);
+   ASSERT_CMP_MSG(hash, lhash, HASHLEN, "digest should match leaf hashes");
+   ASSERT_EQ_MSG(fread(lhash, HASHLEN, 1, lhfp), 0, "sidecar too long");
+   fclose(lhfp);
+   fclose(fp);
+
+   return count;
+}
+
+int main()
+{  /* check le_update() maintains the ledger leaf-hash sidecar */
+   struct utimbuf ut;
+   FILE *fp;
+   LENTRY ledger[NLE];
+   LTRAN lt[2];
+
+   set_print_level(0);
+
+   /* build sorted dummy ledger with implicit addresses (tag == hash) */
+   ASSERT_EQ(dummyledger(LEDGER, ledger, NLE), VEOK);
+   remove(LEDGERLH);
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+
+   /* credit an existing address and create a new one */
+   memset(lt, 0, sizeof(lt));
+   memcpy(lt[0].addr, ledger[1].addr, ADDR_LEN);
+   memset(lt[1].addr, 4, ADDR_LEN);
+   lt[0].trancode[0] = lt[1].trancode[0] = 'A';
+   lt[0].amount[0] = lt[1].amount[0] = 10;
+   ASSERT_NE((fp = fopen(LTRANFILE, "wb")), NULL);
+   ASSERT_EQ(fwrite(lt, sizeof(lt), 1, fp), 1);
+   fclose(fp);
+
+   /* first update builds sidecar without an existing one */
+   ASSERT_EQ(le_update(LTRANFILE), VEOK);
+   ASSERT_EQ_MSG(check_leaf_hashes(), NLE + 1, "sidecar after full hash");
+   ASSERT_NE_MSG((fp = le_lhopen(LEDGER, 0LL, NLE + 1)), NULL,
+      "sidecar should be valid");
+   fclose(fp);
+   ASSERT_EQ_MSG(le_lhopen(LEDGER, 0LL, NLE), NULL,
+      "sidecar should not match a different count");
+
+   /* second update carries over unchanged leaf hashes */
+   ASSERT_NE((fp = fopen(LTRANFILE, "wb")), NULL);
+   lt[1].amount[0] = 5;
+   ASSERT_EQ(fwrite(&lt[1], sizeof(LTRAN), 1, fp), 1);
+   fclose(fp);
+   ASSERT_EQ(le_update(LTRANFILE), VEOK);
+   ASSERT_EQ_MSG(check_leaf_hashes(), NLE + 1, "sidecar after carry over");
+
+   /* a sidecar is not trusted for a replaced ledger, of the same size */
+   ASSERT_NE((fp = fopen(LEDGER, "r+b")), NULL);
+   ASSERT_EQ(fseek(fp, sizeof(LENTRY) * 2 + ADDR_LEN, SEEK_SET), 0);
+   ASSERT_EQ(fputc(0xff, fp), 0xff);
+   fclose(fp);
+   ut.actime = ut.modtime = 1;
+   ASSERT_EQ(utime(LEDGER, &ut), 0);
+   ASSERT_EQ_MSG(le_lhopen(LEDGER, 0LL, NLE + 1), NULL,
+      "sidecar should not match a replaced ledger");
+   ASSERT_EQ(le_update(LTRANFILE), VEOK);
+   ASSERT_EQ_MSG(check_leaf_hashes(), NLE + 1, "sidecar after rebuild");
+
+   /* an interior leaf hash that does not match the digest is rejected */
+   ASSERT_NE((fp = fopen(LEDGERLH, "r+b")), NULL);
+   ASSERT_EQ(fseek(fp, HASHLEN * 2, SEEK_SET), 0);
+   ASSERT_EQ(fputc(0xff, fp), 0xff);
+   fclose(fp);
+   ASSERT_EQ_MSG(le_lhopen(LEDGER, 0LL, NLE + 1), NULL,
+      "sidecar should not match its digest");
+
+   /* cleanup */
+   le_close();
+   remove(LTRANFILE);
+   remove(LEDGERLH);
+   remove(LEDGER);
+}
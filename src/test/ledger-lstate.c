@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "extprint.h"
+#include "sha256.h"
+#include "_assert.h"
+#include "ledger.h"
+
+#include "_testutils.h"
+
+#define LEDGER    "ledger.dat"
+#define LTRANFILE "ltran.dat"
+#define NLE       4
+
+/* compute ledger state commitment of ledger file, the long way */
+static void lstate_of(const char *lefile, word8 *lstate)
+{
+   FILE *fp;
+   LENTRY le;
+   word8 hash[HASHLEN];
+   unsigned sum;
+   int j, carry;
+
+   memset(lstate, 0, HASHLEN);
+   ASSERT_NE((fp = fopen(lefile, "rb")), NULL);
+   while (fread(&le, sizeof(LENTRY), 1, fp) == 1) {
+      sha256(&le, sizeof(LENTRY), hash);
+      for (carry = 0, j = 0; j < HASHLEN; j++) {
+         sum = (unsigned) lstate[j] + hash[j] + carry;
+         lstate[j] = (word8) sum;
+         carry = (int) (sum >> 8);
+      }
+   }
+   fclose(fp);
+}
+
+int main()
+{  /* check le_update() maintains the ledger state commitment */
+   FILE *fp;
+   LENTRY ledger[NLE];
+   LTRAN lt[4];
+   word8 bnum[8], lstate[HASHLEN], expect[HASHLEN], prev[HASHLEN];
+
+   set_print_level(0);
+
+   /* build sorted dummy ledger with implicit addresses (tag == hash) */
+   ASSERT_EQ(dummyledger(LEDGER, ledger, NLE), VEOK);
+   remove("ledger.dat" LEHASH_EXT);
+
+   /* nothing known before le_open() */
+   memset(bnum, 0, sizeof(bnum));
+   ASSERT_EQ_MSG(le_lstate(bnum, lstate), VERROR, "not open");
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+   ASSERT_EQ(le_lstate(bnum, prev), VEOK);
+   lstate_of(LEDGER, expect);
+   ASSERT_CMP_MSG(prev, expect, HASHLEN, "commitment on open");
+
+   /* credit, new entry before held entry, debit, and new last entry */
+   memset(lt, 0, sizeof(lt));
+   memcpy(lt[0].addr, ledger[1].addr, ADDR_LEN);
+   lt[0].trancode[0] = 'A';
+   lt[0].amount[0] = 10;
+   memset(lt[1].addr, 4, ADDR_LEN);
+   lt[1].trancode[0] = 'A';
+   lt[1].amount[0] = 7;
+   memcpy(lt[2].addr, ledger[2].addr, ADDR_LEN);
+   lt[2].trancode[0] = '-';
+   lt[2].amount[0] = 3;
+   memset(lt[3].addr, 9, ADDR_LEN);
+   lt[3].trancode[0] = 'A';
+   lt[3].amount[0] = 1;
+   ASSERT_NE((fp = fopen(LTRANFILE, "wb")), NULL);
+   ASSERT_EQ(fwrite(lt, sizeof(lt), 1, fp), 1);
+   fclose(fp);
+   ASSERT_EQ(le_update(LTRANFILE), VEOK);
+
+   /* commitment of new block matches full recomputation */
+   bnum[0] = 1;
+   ASSERT_EQ(le_lstate(bnum, lstate), VEOK);
+   lstate_of(LEDGER, expect);
+   ASSERT_CMP_MSG(lstate, expect, HASHLEN, "commitment after update");
+   ASSERT_NE_MSG(memcmp(lstate, prev, HASHLEN), 0, "commitment changed");
+
+   /* previous block commitment is kept, future block is unknown */
+   bnum[0] = 0;
+   ASSERT_EQ(le_lstate(bnum, lstate), VEOK);
+   ASSERT_CMP_MSG(lstate, prev, HASHLEN, "previous commitment");
+   bnum[0] = 2;
+   ASSERT_EQ_MSG(le_lstate(bnum, lstate), VERROR, "future block");
+
+   /* second update removes entries with leaf hashes from the sidecar */
+   ASSERT_NE((fp = fopen(LTRANFILE, "wb")), NULL);
+   ASSERT_EQ(fwrite(&lt[3], sizeof(LTRAN), 1, fp), 1);
+   fclose(fp);
+   ASSERT_EQ(le_update(LTRANFILE), VEOK);
+   bnum[0] = 1;
+   ASSERT_EQ(le_lstate(bnum, lstate), VEOK);
+   lstate_of(LEDGER, expect);
+   ASSERT_CMP_MSG(lstate, expect, HASHLEN, "commitment with sidecar");
+
+   /* commitment on open ignores a sidecar not matching its digest */
+   le_close();
+   ASSERT_NE((fp = fopen("ledger.dat" LEHASH_EXT, "r+b")), NULL);
+   ASSERT_EQ(fseek(fp, HASHLEN, SEEK_SET), 0);
+   ASSERT_EQ(fputc(0xff, fp), 0xff);
+   fclose(fp);
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+   memset(bnum, 0, sizeof(bnum));
+   ASSERT_EQ(le_lstate(bnum, lstate), VEOK);
+   ASSERT_CMP_MSG(lstate, expect, HASHLEN, "commitment with bad sidecar");
+
+   /* cleanup */
+   le_close();
+   remove(LTRANFILE);
+   remove("ledger.dat" LEHASH_EXT);
+   remove(LEDGER);
+}
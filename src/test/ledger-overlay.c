@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "extprint.h"
+#include "_assert.h"
+#include "ledger.h"
+
+#include "_testutils.h"
+
+#define LEDGER    "ledger.dat"
+#define LTRANFILE "ltran.dat"
+#define NLE       4
+
+/* fill ledger transaction with address byte, code and amount */
+static void setlt(LTRAN *lt, int addr, char code, word8 amount)
+{
+   memset(lt, 0, sizeof(LTRAN));
+   memset(lt->addr, addr, ADDR_LEN);
+   lt->trancode[0] = (word8) code;
+   lt->amount[0] = amount;
+}
+
+int main()
+{  /* check le_ovl_*() lookups, rejection, discard and commit */
+   LENTRY ledger[NLE], le;
+   LTRAN lt, ltv[3];
+   LEOVL ovl;
+
+   set_print_level(0);
+
+   /* build sorted dummy ledger with implicit addresses (tag == hash) */
+   ASSERT_EQ(dummyledger(LEDGER, ledger, NLE), VEOK);
+
+   /* nothing to overlay before le_open() */
+   ASSERT_EQ_MSG(le_ovl_init(&ovl), VERROR, "should fail before le_open()");
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+   ASSERT_EQ(le_ovl_init(&ovl), VEOK);
+
+   /* credit existing, create new, debit (applied before credit) */
+   setlt(&lt, 3, 'A', 10);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   setlt(&lt, 4, 'A', 7);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   setlt(&lt, 3, '-', 2);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   ASSERT_EQ_MSG(ovl.count, 3, "overlay should hold 3 transactions");
+
+   /* invalid transactions are rejected and leave the delta unchanged */
+   setlt(&lt, 5, '-', 1);
+   ASSERT_EQ_MSG(le_ovl_add(&ovl, &lt), VEBAD2, "debit != balance");
+   ASSERT_EQ(errno, EMCM_LTDEBIT);
+   setlt(&lt, 6, '-', 0);
+   ASSERT_EQ_MSG(le_ovl_add(&ovl, &lt), VEBAD2, "new entry needs credit");
+   ASSERT_EQ(errno, EMCM_LTCREDIT);
+   ASSERT_EQ_MSG(ovl.count, 3, "overlay should still hold 3 transactions");
+
+   /* lookups through overlay; ledger is untouched */
+   ASSERT_EQ(le_ovl_find(&ovl, ledger[1].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 10, "debit then credit");
+   memset(lt.addr, 4, ADDR_LEN);
+   ASSERT_EQ(le_ovl_find(&ovl, lt.addr, &le, ADDR_TAG_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 7, "new entry visible in overlay");
+   ASSERT_EQ(le_ovl_find(&ovl, ledger[0].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 1, "untouched entry reads base");
+   memset(lt.addr, 6, ADDR_LEN);
+   ASSERT_EQ(le_ovl_find(&ovl, lt.addr, &le, ADDR_LEN), 0);
+   ASSERT_EQ(le_find(ledger[1].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 2, "ledger unchanged by overlay");
+   memset(lt.addr, 4, ADDR_LEN);
+   ASSERT_EQ(le_find(lt.addr, &le, ADDR_LEN), 0);
+
+   /* a batch is checked as a whole, and rejected as a whole */
+   setlt(&ltv[0], 5, 'A', 3);
+   setlt(&ltv[1], 4, 'A', 1);
+   setlt(&ltv[2], 6, '-', 0);
+   ASSERT_EQ_MSG(le_ovl_addv(&ovl, ltv, 3), VEBAD2, "batch rejected");
+   ASSERT_EQ(errno, EMCM_LTCREDIT);
+   ASSERT_EQ_MSG(ovl.count, 3, "rejected batch leaves delta unchanged");
+   setlt(&ltv[2], 5, '-', 3);
+   ASSERT_EQ_MSG(le_ovl_addv(&ovl, ltv, 3), VEOK, "batch as le_ovl_add()");
+   ASSERT_EQ_MSG(ovl.count, 6, "overlay should hold 6 transactions");
+   ASSERT_EQ(le_ovl_find(&ovl, ledger[2].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 3, "debit then credit, in batch");
+   memset(lt.addr, 4, ADDR_LEN);
+   ASSERT_EQ(le_ovl_find(&ovl, lt.addr, &le, ADDR_TAG_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 8, "batch merged with delta");
+
+   /* discard leaves ledger untouched */
+   le_ovl_discard(&ovl);
+   ASSERT_EQ(ovl.base, NULL);
+   ASSERT_EQ(le_find(ledger[1].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ(le.balance[0], 2);
+
+   /* commit applies the overlay to disk */
+   ASSERT_EQ(le_ovl_init(&ovl), VEOK);
+   setlt(&lt, 3, 'A', 10);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   setlt(&lt, 4, 'A', 7);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   ASSERT_EQ(le_ovl_commit(&ovl, LTRANFILE), VEOK);
+   ASSERT_EQ(le_find(ledger[1].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 12, "committed credit");
+   memset(lt.addr, 4, ADDR_LEN);
+   ASSERT_EQ(le_find(lt.addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 7, "committed new entry");
+
+   /* an overlay of a replaced ledger version cannot commit */
+   ASSERT_EQ(le_ovl_init(&ovl), VEOK);
+   setlt(&lt, 4, 'A', 1);
+   ASSERT_EQ(le_ovl_add(&ovl, &lt), VEOK);
+   le_close();
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+   ASSERT_EQ_MSG(le_ovl_commit(&ovl, LTRANFILE), VERROR, "stale commit");
+   ASSERT_EQ(errno, EMCM_LESTALE);
+   le_ovl_discard(&ovl);
+
+   /* cleanup */
+   le_close();
+   remove(LTRANFILE);
+   remove("ledger.dat" LEHASH_EXT);
+   remove(LEDGER);
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "extprint.h"
+#include "_assert.h"
+#include "ledger.h"
+
+#define LEDGER  "ledger.dat"
+#define LEDGER2 "ledger.next.dat"
+
+int main()
+{  /* check snapshots keep their ledger version across a republish */
+   FILE *fp;
+   LENTRY ledger[2], le;
+   LESNAP *snap, *snap2;
+
+   set_print_level(0);
+
+   /* build two versions of a one entry ledger */
+   memset(ledger, 0, sizeof(ledger));
+   memset(ledger[0].addr, 1, ADDR_LEN);
+   ledger[0].balance[0] = 1;
+   memcpy(&ledger[1], &ledger[0], sizeof(LENTRY));
+   ledger[1].balance[0] = 2;
+   ASSERT_NE((fp = fopen(LEDGER, "wb")), NULL);
+   ASSERT_EQ(fwrite(&ledger[0], sizeof(LENTRY), 1, fp), 1);
+   fclose(fp);
+   ASSERT_NE((fp = fopen(LEDGER2, "wb")), NULL);
+   ASSERT_EQ(fwrite(&ledger[1], sizeof(LENTRY), 1, fp), 1);
+   fclose(fp);
+
+   /* nothing to acquire before le_open() */
+   ASSERT_EQ_MSG(le_acquire(), NULL, "should not acquire before le_open()");
+   ASSERT_EQ(le_open(LEDGER), VEOK);
+   ASSERT_NE((snap = le_acquire()), NULL);
+
+   /* publish next version, then remove the first file from disk */
+   ASSERT_EQ(le_open(LEDGER2), VEOK);
+   remove(LEDGER);
+   ASSERT_NE((snap2 = le_acquire()), NULL);
+   ASSERT_NE_MSG(snap, snap2, "should acquire a new version");
+   ASSERT_GT_MSG(snap2->version, snap->version, "version should increase");
+
+   /* old readers see old version, new readers see new version */
+   ASSERT_EQ(le_snap_find(snap, ledger[0].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 1, "old snapshot should read old ledger");
+   ASSERT_EQ(le_snap_find(snap2, ledger[0].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 2, "new snapshot should read new ledger");
+   ASSERT_EQ(le_find(ledger[0].addr, &le, ADDR_LEN), 1);
+   ASSERT_EQ_MSG(le.balance[0], 2, "le_find() should read new ledger");
+   le_release(snap);
+   le_release(snap2);
+
+   /* snapshots outlive le_close() */
+   ASSERT_NE((snap = le_acquire()), NULL);
+   le_close();
+   ASSERT_EQ_MSG(le_acquire(), NULL, "should not acquire after le_close()");
+   ASSERT_EQ(le_find(ledger[0].addr, &le, ADDR_LEN), 0);
+   ASSERT_EQ(le_snap_find(snap, ledger[0].addr, &le, ADDR_LEN), 1);
+   le_release(snap);
+
+   /* cleanup */
+   remove(LEDGER2);
+}
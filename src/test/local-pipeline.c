@@ -0,0 +1,81 @@
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "_assert.h"
+#include "local.h"
+
+#include "_testutils.h"
+
+#define LOCALSOCK "local.sock"
+
+int main()
+{  /* check pipelined requests of a persistent local session */
+   static word8 pkt[sizeof(TX)];
+   static NODE node, pair;
+   struct sockaddr_un addr;
+   struct stat st;
+   int opcode[3] = { OP_IDENTIFY, OP_GET_TFILE, OP_GET_IPL };
+   int j, len, sv[2];
+
+   /* never replace a file that is not a socket */
+   ASSERT_EQ(write2file(LOCALSOCK, "keep", 4), VEOK);
+   ASSERT_EQ_MSG(local_init(LOCALSOCK), VERROR, "should refuse a file");
+   ASSERT_EQ_MSG(stat(LOCALSOCK, &st), 0, "file should be kept");
+   ASSERT_EQ(S_ISREG(st.st_mode), 1);
+   remove(LOCALSOCK);
+
+   ASSERT_EQ(local_init(LOCALSOCK), VEOK);
+   ASSERT_EQ(stat(LOCALSOCK, &st), 0);
+   ASSERT_EQ_MSG((st.st_mode & 0777), 0660, "socket should be owner/group");
+
+   /* connect a local session */
+   memset(&node, 0, sizeof(node));
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, LOCALSOCK);
+   node.sd = socket(AF_UNIX, SOCK_STREAM, 0);
+   ASSERT_NE(node.sd, INVALID_SOCKET);
+   ASSERT_EQ(connect(node.sd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+
+   /* optional handshake, then pipeline requests before any reply */
+   node.id1 = 0x1234;
+   put16(node.tx.len, 0);
+   ASSERT_EQ(send_op(&node, OP_HELLO), VEOK);
+   ASSERT_EQ(local_service(), 1);
+   ASSERT_EQ(recv_tx(&node, 1), VEOK);
+   ASSERT_EQ(get16(node.tx.opcode), OP_HELLO_ACK);
+   node.id2 = get16(node.tx.id2);
+   for (j = 0; j < 3; j++) {
+      put16(node.tx.len, 0);
+      ASSERT_EQ(send_op(&node, opcode[j]), VEOK);
+   }
+   ASSERT_EQ_MSG(local_service(), 3, "should serve pipelined requests");
+
+   /* replies are in request order, unsupported requests are NACK'd */
+   ASSERT_EQ(recv_tx(&node, 1), VEOK);
+   ASSERT_EQ(get16(node.tx.opcode), OP_IDENTIFY);
+   ASSERT_EQ(recv_tx(&node, 1), VEOK);
+   ASSERT_EQ_MSG(get16(node.tx.opcode), OP_NACK, "should NACK OP_GET_TFILE");
+   ASSERT_EQ(recv_tx(&node, 1), VEOK);
+   ASSERT_EQ(get16(node.tx.opcode), OP_SEND_IPL);
+
+   /* a partial request does not wait, and is served when complete */
+   ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+   memcpy(&pair, &node, sizeof(NODE));
+   pair.sd = sv[0];
+   put16(pair.tx.len, 0);
+   ASSERT_EQ(send_op(&pair, OP_IDENTIFY), VEOK);
+   ASSERT_GT((len = (int) recv(sv[1], pkt, sizeof(pkt), 0)), 10);
+   ASSERT_EQ(send(node.sd, pkt, 10, 0), 10);
+   ASSERT_EQ_MSG(local_service(), 0, "should not wait on partial request");
+   ASSERT_EQ(send(node.sd, pkt + 10, len - 10, 0), len - 10);
+   ASSERT_EQ_MSG(local_service(), 1, "should serve completed request");
+   ASSERT_EQ(recv_tx(&node, 1), VEOK);
+   ASSERT_EQ(get16(node.tx.opcode), OP_IDENTIFY);
+
+   /* cleanup */
+   sock_close(sv[0]);
+   sock_close(sv[1]);
+   sock_close(node.sd);
+   local_close();
+   ASSERT_NE_MSG(stat(LOCALSOCK, &st), 0, "socket file should be removed");
+}
@@ -0,0 +1,68 @@
+#include "_assert.h"
+#include "lzc.h"
+#include "types.h"
+#include "extlib.h"
+
+#include <string.h>
+
+#define DATALEN 40000
+
+/* compress and decompress data, checking the result matches */
+static size_t roundtrip(const word8 *data, size_t len, word8 *zbuf,
+   size_t zlen, word8 *out)
+{
+   size_t n;
+
+   n = lzc_compress(data, len, zbuf, zlen);
+   if (n == 0) return 0;
+   ASSERT_EQ_MSG(lzc_decompress(zbuf, n, out, len), len, "decompress len");
+   ASSERT_CMP_MSG(out, data, len, "decompressed data should match");
+
+   return n;
+}
+
+int main()
+{  /* check lzc_compress() and lzc_decompress() round trips and limits */
+   static word8 data[DATALEN], zbuf[DATALEN * 2], out[DATALEN];
+   static BTRAILER bt[DATALEN / sizeof(BTRAILER)];
+   size_t j, n;
+   word32 rnd;
+
+   /* empty, short and run length data */
+   ASSERT_EQ(roundtrip(data, 0, zbuf, sizeof(zbuf), out), 1);
+   memcpy(data, "abc", 3);
+   ASSERT_NE(roundtrip(data, 3, zbuf, sizeof(zbuf), out), 0);
+   memset(data, 'z', DATALEN);
+   n = roundtrip(data, DATALEN, zbuf, sizeof(zbuf), out);
+   ASSERT_LT_MSG(n, DATALEN / 100, "run length data should compress");
+
+   /* trailer-like data, with mostly-constant fields */
+   memset(bt, 0, sizeof(bt));
+   for (j = 0; j < DATALEN / sizeof(BTRAILER); j++) {
+      put32(bt[j].bnum, (word32) j);
+      put32(bt[j].difficulty, 30);
+      put32(bt[j].stime, 1600000000 + (word32) j * 337);
+   }
+   n = roundtrip((word8 *) bt, sizeof(bt), zbuf, sizeof(zbuf), out);
+   ASSERT_LT_MSG(n, sizeof(bt) / 4, "trailer data should compress");
+
+   /* pseudo-random data, doesn't fit when output must be smaller */
+   for (rnd = 1, j = 0; j < DATALEN; j++) {
+      rnd = rnd * 1103515245 + 12345;
+      data[j] = (word8) (rnd >> 16);
+   }
+   ASSERT_NE(roundtrip(data, DATALEN, zbuf, sizeof(zbuf), out), 0);
+   ASSERT_EQ_MSG(lzc_compress(data, DATALEN, zbuf, DATALEN - 1), 0,
+      "random data should not compress");
+
+   /* malformed input is rejected */
+   memset(data, 'z', DATALEN);
+   n = lzc_compress(data, DATALEN, zbuf, sizeof(zbuf));
+   ASSERT_EQ_MSG(lzc_decompress(zbuf, n, out, DATALEN - 1), LZC_ERROR,
+      "output overflow");
+   ASSERT_EQ_MSG(lzc_decompress(zbuf, n / 2, out, DATALEN), LZC_ERROR,
+      "truncated input");
+   zbuf[0] = 0x00;  /* no literals, so match offset is out of range */
+   ASSERT_EQ_MSG(lzc_decompress(zbuf, n, out, DATALEN), LZC_ERROR,
+      "bad offset");
+}
@@ -0,0 +1,75 @@
+#include "_assert.h"
+#include "network.h"
+
+#define PDBFILE "peers.dat"
+
+/* count used peer database buckets */
+static int used_buckets(void)
+{
+   int b, e, count;
+
+   for (count = b = 0; b < PDBBUCKETS; b++) {
+      for (e = 0; e < PDBBUCKETSZ; e++) {
+         if (Peerdb[b][e].ip) {
+            count++;
+            break;
+         }
+      }
+   }
+
+   return count;
+}
+
+int main()
+{  /* check pdb_add() eviction, pdb_sample() and persistence */
+   word32 good, source, ip, list[8];
+   word8 *bp;
+   int j, n;
+
+   good = aton("123.123.123.123");
+   source = aton("45.45.45.45");
+   remove(PDBFILE);
+
+   /* a proven peer */
+   ASSERT_EQ(pdb_add(good, 0), VEOK);
+   pdb_good(good);
+   ASSERT_NE(pdb_find(good), NULL);
+   ASSERT_EQ_MSG(pdb_find(good)->good, 1, "should record success");
+   ASSERT_EQ_MSG(pdb_add(0, 0), VERROR, "should reject zero ip");
+
+   /* flood from a single source is confined to few buckets */
+   bp = (word8 *) &ip;
+   for (j = 0; j < 4096; j++) {
+      bp[0] = 50 + (j % 100);
+      bp[1] = (word8) (j / 100);
+      bp[2] = (word8) j;
+      bp[3] = 1;
+      pdb_add(ip, source);
+   }
+   ASSERT_LE_MSG(used_buckets(), PDBSRCBUCKETS + 1,
+      "single source should fill few buckets");
+   ASSERT_NE_MSG(pdb_find(good), NULL, "proven peer should survive flood");
+
+   /* failures mark a bad peer, success restores it */
+   for (j = 0; j < PDBMAXBAD; j++) pdb_bad(good);
+   ASSERT_EQ_MSG(pdb_find(good)->bad, PDBMAXBAD, "should record failures");
+   n = pdb_sample(list, 8);
+   for (j = 0; j < n; j++) ASSERT_NE_MSG(list[j], good, "bad peer sampled");
+   pdb_good(good);
+   ASSERT_EQ_MSG(pdb_find(good)->bad, 0, "success should reset failures");
+
+   /* proven peers are sampled first */
+   ASSERT_EQ_MSG(pdb_sample(list, 8), 8, "should sample full list");
+   ASSERT_EQ_MSG(list[0], good, "proven peer should be sampled first");
+
+   /* save and load database */
+   ASSERT_EQ(pdb_save(PDBFILE), VEOK);
+   memset(Peerdb, 0, sizeof(Peerdb));
+   ASSERT_EQ(pdb_find(good), NULL);
+   ASSERT_EQ(pdb_load(PDBFILE), VEOK);
+   ASSERT_NE_MSG(pdb_find(good), NULL, "should load proven peer");
+   ASSERT_EQ(pdb_find(good)->good, 2);
+
+   /* cleanup */
+   remove(PDBFILE);
+}
@@ -0,0 +1,68 @@
+#include "_assert.h"
+#include "network.h"
+
+/* find the chain tip last advertised by a peer */
+static TIPENTRY *find_tip(word32 ip)
+{
+   TIPENTRY *tp;
+
+   for (tp = Tips; tp < &Tips[TIPSLEN]; tp++) {
+      if (tp->ip == ip) return tp;
+   }
+
+   return NULL;
+}
+
+int main()
+{  /* check tip_update() and tip_quorum() peer chain tip table */
+   TX tx;
+   TIPENTRY *tp;
+   word32 quorum[4], peer[4];
+   word8 hash[HASHLEN], weight[32], bnum[8];
+   int j;
+
+   for (j = 0; j < 4; j++) peer[j] = aton("123.123.123.123") + j;
+   memset(&tx, 0, sizeof(tx));
+   put16(tx.opcode, OP_HELLO_ACK);
+
+   /* nothing known before any exchange */
+   ASSERT_EQ_MSG(tip_quorum(quorum, 4, hash, weight, bnum, TIPMAXAGE), 0,
+      "should have no quorum without tips");
+
+   /* two peers on a heavy tip, one on a light tip */
+   tx.cblock[0] = 10;
+   tx.weight[0] = 20;
+   memset(tx.cblockhash, 0xaa, HASHLEN);
+   tip_update(peer[0], &tx);
+   tip_update(peer[1], &tx);
+   tx.cblock[0] = 9;
+   tx.weight[0] = 10;
+   memset(tx.cblockhash, 0xbb, HASHLEN);
+   tip_update(peer[2], &tx);
+   /* OP_TX packets carry no chain weight, and are ignored */
+   put16(tx.opcode, OP_TX);
+   tip_update(peer[3], &tx);
+   ASSERT_EQ_MSG(find_tip(peer[3]), NULL, "OP_TX should be ignored");
+
+   ASSERT_NE((tp = find_tip(peer[2])), NULL);
+   ASSERT_EQ_MSG(tp->bnum[0], 9, "tip should hold advertised bnum");
+   ASSERT_EQ_MSG(tip_quorum(quorum, 4, hash, weight, bnum, TIPMAXAGE), 2,
+      "quorum should hold peers on heaviest tip");
+   ASSERT_EQ_MSG(weight[0], 20, "should place highest weight");
+   ASSERT_EQ_MSG(bnum[0], 10, "should place highest bnum");
+   ASSERT_EQ_MSG(hash[0], 0xaa, "should place highest hash");
+   ASSERT_EQ_MSG(quorum[2], 0, "quorum should be terminated");
+   ASSERT_EQ_MSG(tip_quorum(quorum, 1, NULL, NULL, NULL, TIPMAXAGE), 1,
+      "quorum should be limited by qlen");
+   ASSERT_EQ_MSG(tip_quorum(NULL, 0, NULL, NULL, NULL, TIPMAXAGE), 2,
+      "should count quorum without list");
+
+   /* peer moves to light tip, and stale tips are not used */
+   put16(tx.opcode, OP_HELLO_ACK);
+   tip_update(peer[1], &tx);
+   ASSERT_EQ(tip_quorum(quorum, 4, NULL, NULL, NULL, TIPMAXAGE), 1);
+   find_tip(peer[0])->stamp -= TIPMAXAGE + 1;
+   ASSERT_EQ_MSG(tip_quorum(quorum, 4, NULL, weight, NULL, TIPMAXAGE), 2,
+      "stale tip should be ignored");
+   ASSERT_EQ_MSG(weight[0], 10, "should place recent weight");
+}
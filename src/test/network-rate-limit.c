@@ -0,0 +1,37 @@
+#include "_assert.h"
+#include "network.h"
+
+int main()
+{  /* check ratelimited() token buckets, by opcode class */
+   word32 peer, other;
+   word32 n;
+
+   peer = aton("123.123.123.123");
+   other = aton("123.123.123.124");
+
+   /* check opcode classes */
+   ASSERT_EQ(rlclass(OP_TX), RL_TX);
+   ASSERT_EQ(rlclass(OP_BALANCE), RL_BALANCE);
+   ASSERT_EQ(rlclass(OP_GET_BLOCK), RL_BLOCK);
+   ASSERT_EQ(rlclass(OP_GET_MMRPROOF), RL_MMR);
+   ASSERT_EQ(rlclass(OP_FOUND), RL_NONE);
+
+   /* a full burst of requests is permitted, then throttled */
+   Rlquota[RL_TX] = 1;
+   Rlburst[RL_TX] = 5;
+   for (n = 0; n < Rlburst[RL_TX]; n++) {
+      ASSERT_EQ_MSG(ratelimited(peer, OP_TX), 0, "burst should permit");
+   }
+   ASSERT_EQ_MSG(ratelimited(peer, OP_TX), 1, "should throttle after burst");
+   ASSERT_EQ_MSG(Nthrottled[RL_TX], 1, "should count throttled requests");
+   /* other classes and other peers keep their own allowance */
+   ASSERT_EQ_MSG(ratelimited(peer, OP_BALANCE), 0, "class should differ");
+   ASSERT_EQ_MSG(ratelimited(other, OP_TX), 0, "peer should differ");
+   /* unlimited opcodes, quotas and disabled rate limiting */
+   ASSERT_EQ_MSG(ratelimited(peer, OP_FOUND), 0, "OP_FOUND is unlimited");
+   Rlquota[RL_TX] = 0;
+   ASSERT_EQ_MSG(ratelimited(peer, OP_TX), 0, "zero quota is unlimited");
+   Rlquota[RL_TX] = 1;
+   Norlimit = 1;
+   ASSERT_EQ_MSG(ratelimited(peer, OP_TX), 0, "disabled rate limiting");
+}
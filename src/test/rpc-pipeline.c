@@ -0,0 +1,80 @@
+#include <string.h>
+#include "_assert.h"
+#include "rpc.h"
+
+#define RPCPORT   12345
+#define REQUEST(body) \
+   "POST / HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json" \
+   "\r\nContent-Length: " #body "\r\n\r\n"
+
+int main()
+{  /* check pipelined JSON-RPC requests of a kept-alive session */
+   static const char *request =
+      REQUEST(42) "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"gettip\"}"
+      REQUEST(42) "{\"jsonrpc\":\"2.0\",\"id\":\"a\",\"method\":\"nope\"}"
+      REQUEST(7) "{\"id\":1";
+   struct sockaddr_in addr;
+   char reply[4096], *cp;
+   SOCKET sd;
+   int j, len, count;
+
+   sock_startup();  /* enable socket support */
+   ASSERT_EQ(rpc_init("127.0.0.1", RPCPORT), VEOK);
+
+   /* connect and send all requests before any reply */
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(RPCPORT);
+   addr.sin_addr.s_addr = aton("127.0.0.1");
+   sd = socket(AF_INET, SOCK_STREAM, 0);
+   ASSERT_NE(sd, INVALID_SOCKET);
+   ASSERT_EQ(connect(sd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+   len = (int) strlen(request);
+   ASSERT_EQ(send(sd, request, len, 0), len);
+
+   /* serve and collect replies */
+   for (count = j = 0; j < 100 && count < 3; j++) {
+      count += rpc_service();
+      millisleep(10);
+   }
+   ASSERT_EQ_MSG(count, 3, "should serve pipelined requests");
+   len = (int) recv(sd, reply, sizeof(reply) - 1, 0);
+   ASSERT_GT(len, 0);
+   reply[len] = '\0';
+
+   /* replies are in request order, and keep the session alive */
+   ASSERT_NE((cp = strstr(reply, "\"id\":1,\"result\":{\"bnum\":")), NULL);
+   ASSERT_NE((cp = strstr(cp, "\"id\":\"a\",\"error\":{\"code\":-32601")),
+      NULL);
+   ASSERT_NE_MSG(strstr(cp, "\"id\":null,\"error\":{\"code\":-32700"), NULL,
+      "should report parse error");
+   ASSERT_EQ_MSG(strstr(reply, "Connection: close"), NULL,
+      "should keep session alive");
+
+   /* heavy methods are served by a worker, and keep the session alive */
+   request = REQUEST(60) "{\"jsonrpc\":\"2.0\",\"id\":2,"
+      "\"method\":\"getblock\",\"params\":[\"0x\"]}"
+      REQUEST(42) "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"gettip\"}";
+   len = (int) strlen(request);
+   ASSERT_EQ(send(sd, request, len, 0), len);
+   for (count = j = 0; j < 100 && count < 2; j++) {
+      count += rpc_service();
+      millisleep(10);
+   }
+   ASSERT_EQ_MSG(count, 2, "should serve requests after a worker");
+   for (len = j = 0; j < 100 && !strstr(reply, "\"id\":3"); j++) {
+      count = (int) recv(sd, reply + len, sizeof(reply) - 1 - len, 0);
+      if (count > 0) len += count;
+      reply[len] = '\0';
+      millisleep(10);
+   }
+   cp = strstr(reply, "\"id\":2,\"error\":{\"code\":-32602");
+   ASSERT_NE_MSG(cp, NULL, "should reject empty hex block number");
+   ASSERT_NE_MSG(strstr(cp, "\"id\":3,\"result\":"), NULL,
+      "should reply in request order");
+
+   /* cleanup */
+   sock_close(sd);
+   rpc_close();
+   sock_cleanup();
+}
@@ -0,0 +1,40 @@
+#include "_assert.h"
+#include "tfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TFILE "tfile.dat"
+#define NBT   8
+
+int main()
+{  /* check find_tfile() locates trailers by block hash */
+   BTRAILER tf[NBT], bt;
+   word8 bhash[HASHLEN];
+   FILE *fp;
+   size_t j;
+
+   /* build dummy tfile with unique block hashes */
+   memset(tf, 0, sizeof(tf));
+   for (j = 0; j < NBT; j++) {
+      put32(tf[j].bnum, (word32) j);
+      memset(tf[j].bhash, (int) (j + 1), HASHLEN);
+   }
+   ASSERT_NE((fp = fopen(TFILE, "wb")), NULL);
+   ASSERT_EQ(fwrite(tf, sizeof(tf), 1, fp), 1);
+   fclose(fp);
+
+   /* find first, middle and last trailers */
+   ASSERT_EQ(find_tfile(TFILE, tf[0].bhash, &bt), VEOK);
+   ASSERT_CMP_MSG(&bt, &tf[0], sizeof(BTRAILER), "first trailer");
+   ASSERT_EQ(find_tfile(TFILE, tf[NBT / 2].bhash, &bt), VEOK);
+   ASSERT_CMP_MSG(&bt, &tf[NBT / 2], sizeof(BTRAILER), "middle trailer");
+   ASSERT_EQ(find_tfile(TFILE, tf[NBT - 1].bhash, &bt), VEOK);
+   ASSERT_CMP_MSG(&bt, &tf[NBT - 1], sizeof(BTRAILER), "last trailer");
+
+   /* missing hash and missing file */
+   memset(bhash, 0xff, HASHLEN);
+   ASSERT_EQ_MSG(find_tfile(TFILE, bhash, &bt), VEBAD, "missing hash");
+   remove(TFILE);
+   ASSERT_EQ_MSG(find_tfile(TFILE, bhash, &bt), VERROR, "missing file");
+}
@@ -0,0 +1,39 @@
+#include "_assert.h"
+#include "tfile.h"
+#include "sha256.h"
+
+#include <string.h>
+
+#define MAXLEAVES 300
+
+int main()
+{  /* check merkle_range() sub-roots reduce to the merkle_root() */
+   static word8 leaves[MAXLEAVES * HASHLEN];
+   static word8 layer[((size_t) 1 << NGDEPTH_MAX) * HASHLEN];
+   word8 root[HASHLEN], lroot[HASHLEN];
+   size_t count, offset, next, n, j;
+   unsigned depth;
+
+   for (j = 0; j < MAXLEAVES; j++) {
+      sha256(&j, sizeof(j), leaves + (j * HASHLEN));
+   }
+
+   for (count = 1; count <= MAXLEAVES; count += (count < 20 ? 1 : 37)) {
+      merkle_root(leaves, count, root);
+      for (depth = 0; ((size_t) 1 << depth) <= count; depth++) {
+         if (depth > NGDEPTH_MAX) break;
+         /* ranges tile the leaves, in order, without gaps */
+         for (next = j = 0; j < ((size_t) 1 << depth); j++) {
+            n = merkle_range(count, depth, j, &offset);
+            ASSERT_EQ_MSG(offset, next, "ranges should be contiguous");
+            ASSERT_GT_MSG(n, 0, "ranges should not be empty");
+            merkle_root(leaves + (offset * HASHLEN), n,
+               layer + (j * HASHLEN));
+            next = offset + n;
+         }
+         ASSERT_EQ_MSG(next, count, "ranges should cover all leaves");
+         ASSERT_EQ(merkle_layer_root(layer, depth, lroot), VEOK);
+         ASSERT_CMP_MSG(lroot, root, HASHLEN, "layer root should match");
+      }
+   }
+}
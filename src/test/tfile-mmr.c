@@ -0,0 +1,100 @@
+#include "_assert.h"
+#include "tfile.h"
+#include "extlib.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define TFILE    "tfile.dat"
+#define TFILEMMR "tfile.dat" MMR_EXT
+#define NBT      300
+
+int main()
+{  /* check MMR sidecar roots, proofs and cumulative weights of a Tfile */
+   static BTRAILER tf[NBT];
+   static word8 proof[MMRPROOFLEN];
+   word8 root[HASHLEN], root2[HASHLEN], proot[HASHLEN];
+   word8 weight[32], weight2[32], pweight[32], cweight[32];
+   word8 bnum[8], count[8];
+   size_t j, len;
+   word64 n;
+
+   /* build dummy trailers, including neo-genesis (0x..ff) blocks */
+   memset(tf, 0, sizeof(tf));
+   for (j = 0; j < NBT; j++) {
+      put32(tf[j].bnum, (word32) j);
+      put32(tf[j].difficulty, (word32) (j % 23) + 1);
+      memset(tf[j].bhash, (int) j, HASHLEN);
+   }
+   remove(TFILE);
+   remove(TFILEMMR);
+
+   /* append singly, then in bulk */
+   for (j = 0; j < NBT / 2; j++) ASSERT_EQ(append_tfile(&tf[j], 1, TFILE), VEOK);
+   ASSERT_EQ(append_tfile(&tf[j], NBT - j, TFILE), VEOK);
+   ASSERT_EQ(mmr_root(TFILE, root, weight), VEOK);
+   ASSERT_EQ(weigh_tfile(TFILE, NULL, weight2), VEOK);
+   ASSERT_CMP_MSG(weight, weight2, 32, "root weight should be Tfile weight");
+
+   /* rebuilt sidecar should have the same root */
+   remove(TFILEMMR);
+   ASSERT_EQ(mmr_root(TFILE, root2, weight2), VEOK);
+   ASSERT_CMP_MSG(root, root2, HASHLEN, "rebuilt root should match");
+
+   /* every trailer proves membership and cumulative weight */
+   memset(count, 0, 8);
+   for (j = 0; j < NBT; j++) {
+      n = j;
+      put64(bnum, &n);
+      len = mmr_proof(TFILE, bnum, count, proof);
+      ASSERT_NE_MSG(len, 0, "proof should build");
+      ASSERT_EQ(mmr_verify(proof, len, proot, pweight, cweight), VEOK);
+      ASSERT_CMP_MSG(proot, root, HASHLEN, "proof should match root");
+      ASSERT_CMP_MSG(pweight, weight, 32, "proof should match weight");
+      ASSERT_EQ(weigh_tfile(TFILE, bnum, weight2), VEOK);
+      ASSERT_CMP_MSG(cweight, weight2, 32, "cumulative weight should match");
+   }
+
+   /* tampered trailer, or truncated proof, fails */
+   ((BTRAILER *) (proof + 8))->difficulty[0]++;
+   ASSERT_EQ(mmr_verify(proof, len, proot, pweight, NULL), VEOK);
+   ASSERT_NE_MSG(memcmp(proot, root, HASHLEN), 0, "tampered root differs");
+   ASSERT_EQ_MSG(mmr_verify(proof, len - 1, proot, pweight, NULL), VEBAD,
+      "truncated proof is malformed");
+
+   /* historic proof (of fewer trailers) matches root after trim */
+   n = NBT / 3;
+   put64(count, &n);
+   n = 7;
+   put64(bnum, &n);
+   len = mmr_proof(TFILE, bnum, count, proof);
+   ASSERT_NE(len, 0);
+   ASSERT_EQ(mmr_verify(proof, len, proot, pweight, NULL), VEOK);
+   n = NBT / 3 - 1;
+   put64(bnum, &n);
+   ASSERT_EQ(trim_tfile(TFILE, bnum), VEOK);
+   ASSERT_EQ(mmr_root(TFILE, root2, weight2), VEOK);
+   ASSERT_CMP_MSG(proot, root2, HASHLEN, "historic proof matches trim");
+   ASSERT_CMP_MSG(pweight, weight2, 32, "historic weight matches trim");
+   /* ... and extends back to the original root */
+   ASSERT_EQ(append_tfile(&tf[NBT / 3], NBT - NBT / 3, TFILE), VEOK);
+   ASSERT_EQ(mmr_root(TFILE, root2, NULL), VEOK);
+   ASSERT_CMP_MSG(root, root2, HASHLEN, "re-extended root should match");
+
+   /* out of range trailer */
+   memset(count, 0, 8);
+   n = NBT;
+   put64(bnum, &n);
+   ASSERT_EQ_MSG(mmr_proof(TFILE, bnum, count, proof), 0, "out of range");
+
+   /* proofs never (re)build a stale sidecar */
+   remove(TFILEMMR);
+   n = 7;
+   put64(bnum, &n);
+   ASSERT_EQ_MSG(mmr_proof(TFILE, bnum, count, proof), 0, "stale sidecar");
+   ASSERT_EQ_MSG(fopen(TFILEMMR, "rb"), NULL, "should not build sidecar");
+
+   /* cleanup */
+   remove(TFILEMMR);
+   remove(TFILE);
+}
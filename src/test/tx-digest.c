@@ -0,0 +1,36 @@
+#include "_assert.h"
+#include "tx.h"
+#include "sha256.h"
+
+int main()
+{  /* check tx_digest() matches independently hashed transaction data */
+   TXENTRY txe;
+   word8 buffer[TXLEN_DSK_MIN];
+   word8 message[HASHLEN], id[HASHLEN];
+   size_t j;
+
+   /* build pseudo-random (single destination) WOTS+ transaction */
+   for (j = 0; j < sizeof(buffer); j++) buffer[j] = (word8) (j * 7);
+   TXDAT_TYPE(buffer) = TXDAT_MDST;
+   TXDSA_TYPE(buffer) = TXDSA_WOTS;
+   buffer[2] = 0;  /* MDST_COUNT() == 1 */
+   ASSERT_EQ(tx_read(&txe, buffer, sizeof(buffer)), VEOK);
+   ASSERT_EQ_MSG(txe.digested, 0, "digests should not be cached on read");
+
+   /* hash message and id in separate passes */
+   sha256(txe.buffer, (size_t) txe.dsa - (size_t) txe.options, message);
+   sha256(txe.buffer, (size_t) txe.tlr->id - (size_t) txe.options, id);
+
+   /* compute single pass digests and compare */
+   tx_digest(&txe);
+   ASSERT_NE(txe.digested, 0);
+   ASSERT_CMP(txe.digest_message, message, HASHLEN);
+   ASSERT_CMP(txe.digest_id, id, HASHLEN);
+   /* tx_hash() should return cached digests */
+   memset(message, 0, HASHLEN);
+   memset(id, 0, HASHLEN);
+   tx_hash(&txe, TX_HASH_MESSAGE, message);
+   tx_hash(&txe, TX_HASH_ID, id);
+   ASSERT_CMP(txe.digest_message, message, HASHLEN);
+   ASSERT_CMP(txe.digest_id, id, HASHLEN);
+}
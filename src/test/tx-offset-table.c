@@ -0,0 +1,81 @@
+#include "_assert.h"
+#include "tx.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BCFILE "b0000000000000001.bc"
+#define NTX    3
+
+int main()
+{  /* check tx_ixread() with and without a valid offset-table sidecar */
+   static word8 buffer[NTX][TXLEN_DSK_MIN];
+   TXENTRY txe[NTX], txr;
+   TXIDX txidx[NTX];
+   BHEADER bh;
+   BTRAILER bt;
+   char ixfile[FILENAME_MAX];
+   long long offset;
+   FILE *fp;
+   size_t j, k;
+
+   /* build block file of pseudo-random (single destination) transactions */
+   memset(&bh, 0, sizeof(bh));
+   memset(&bt, 0, sizeof(bt));
+   put32(bh.hdrlen, sizeof(BHEADER));
+   put32(bt.tcount, NTX);
+   ASSERT_NE((fp = fopen(BCFILE, "wb")), NULL);
+   ASSERT_EQ(fwrite(&bh, sizeof(bh), 1, fp), 1);
+   for (j = 0; j < NTX; j++) {
+      for (k = 0; k < TXLEN_DSK_MIN; k++) {
+         buffer[j][k] = (word8) (k * (j + 3));
+      }
+      TXDAT_TYPE(buffer[j]) = TXDAT_MDST;
+      TXDSA_TYPE(buffer[j]) = TXDSA_WOTS;
+      buffer[j][2] = 0;  /* MDST_COUNT() == 1 */
+      ASSERT_EQ(tx_read(&txe[j], buffer[j], TXLEN_DSK_MIN), VEOK);
+      offset = ftell(fp);
+      put64(txidx[j].offset, &offset);
+      memcpy(txidx[j].tx_id, txe[j].tx_id, HASHLEN);
+      ASSERT_EQ(tx_fwrite(&txe[j], fp), VEOK);
+   }
+   ASSERT_EQ(fwrite(&bt, sizeof(bt), 1, fp), 1);
+   fclose(fp);
+
+   /* no sidecar: transactions are read by skipping */
+   remove(tx_ixname(BCFILE, ixfile));
+   ASSERT_EQ_MSG(tx_ixopen(BCFILE, NTX), NULL, "no sidecar to open");
+   ASSERT_EQ(tx_ixread(&txr, BCFILE, NTX - 1), VEOK);
+   ASSERT_CMP_MSG(txr.tx_id, txe[NTX - 1].tx_id, HASHLEN, "skip read");
+   ASSERT_EQ_MSG(tx_ixread(&txr, BCFILE, NTX), VEBAD, "index out of range");
+
+   /* valid sidecar: transactions are read at offset */
+   ASSERT_EQ(tx_ixwrite(BCFILE, txidx, NTX), VEOK);
+   ASSERT_NE((fp = tx_ixopen(BCFILE, NTX)), NULL);
+   fclose(fp);
+   for (j = 0; j < NTX; j++) {
+      ASSERT_EQ(tx_ixread(&txr, BCFILE, (word32) j), VEOK);
+      ASSERT_CMP_MSG(txr.tx_id, txe[j].tx_id, HASHLEN, "offset read");
+   }
+
+   /* corrupt interior entry is dropped, with its sidecar */
+   memcpy(txidx[1].offset, txidx[2].offset, 8);
+   ASSERT_EQ(tx_ixwrite(BCFILE, txidx, NTX), VEOK);
+   ASSERT_NE((fp = tx_ixopen(BCFILE, NTX)), NULL);
+   fclose(fp);
+   ASSERT_EQ(tx_ixread(&txr, BCFILE, 1), VEOK);
+   ASSERT_CMP_MSG(txr.tx_id, txe[1].tx_id, HASHLEN, "interior fallback");
+   ASSERT_EQ_MSG(fopen(ixfile, "rb"), NULL, "corrupt sidecar removed");
+
+   /* mismatched sidecar is ignored */
+   ASSERT_EQ_MSG(tx_ixopen(BCFILE, NTX - 1), NULL, "wrong tcount");
+   txidx[NTX - 1].tx_id[0] ^= 0xff;
+   ASSERT_EQ(tx_ixwrite(BCFILE, txidx, NTX), VEOK);
+   ASSERT_EQ_MSG(tx_ixopen(BCFILE, NTX), NULL, "wrong last tx_id");
+   ASSERT_EQ(tx_ixread(&txr, BCFILE, 1), VEOK);
+   ASSERT_CMP_MSG(txr.tx_id, txe[1].tx_id, HASHLEN, "fallback read");
+
+   /* cleanup */
+   remove(ixfile);
+   remove(BCFILE);
+}
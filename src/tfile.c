@@ -25,6 +25,7 @@
 #include "extmath.h"
 #include "extlib.h"
 #include "extio.h"
+#include "sha256.h"
 
 /* system support */
 #include <signal.h>
@@ -57,7 +58,486 @@ void add_weight(word8 weight[32], word8 difficulty)
 }  /* end add_weight() */
 
 /**
- * Append a series of Block Trailers to a file.
+ * @private
+ * Get the number of MMR nodes of a number of leaves.
+ * @param n Number of leaves
+ * @return (long long) number of MMR nodes
+ */
+static long long mmr_size(word64 n)
+{
+   long long size;
+
+   for (size = (long long) (n * 2); n; n &= n - 1) size--;
+
+   return size;
+}  /* end mmr_size() */
+
+/**
+ * @private
+ * Compute the MMR leaf of a Block Trailer. A leaf holds the sha256()
+ * of the trailer and the weight the trailer adds to the chain.
+ * @param bt Pointer to Block Trailer
+ * @param leaf Pointer to place MMR leaf
+ */
+static void mmr_leaf(const BTRAILER *bt, MMRNODE *leaf)
+{
+   sha256(bt, sizeof(BTRAILER), leaf->hash);
+   memset(leaf->weight, 0, sizeof(leaf->weight));
+   /* Let the neo-genesis (not the 0x..ff) add weight to the chain. */
+   if (bt->bnum[0] != 0xff) add_weight(leaf->weight, bt->difficulty[0]);
+}  /* end mmr_leaf() */
+
+/**
+ * @private
+ * Merge two MMR nodes into a parent. Parent weight is the sum of child
+ * weights, and the parent hash commits to both hashes and weights.
+ * @param left Pointer to left child node
+ * @param right Pointer to right child node
+ * @param parent Pointer to place parent node (may alias a child)
+ */
+static void mmr_merge(const MMRNODE *left, const MMRNODE *right,
+   MMRNODE *parent)
+{
+   SHA256_CTX ctx;
+   word8 weight[32];
+
+   sha256_init(&ctx);
+   sha256_update(&ctx, left, sizeof(MMRNODE));
+   sha256_update(&ctx, right, sizeof(MMRNODE));
+   multi_add(left->weight, right->weight, weight, 32);
+   sha256_final(&ctx, parent->hash);
+   memcpy(parent->weight, weight, 32);
+}  /* end mmr_merge() */
+
+/**
+ * @private
+ * Bag the peaks of an MMR into a root. The root hash commits to the
+ * number of leaves, and the root weight is the weight of all leaves.
+ * @param peaks Pointer to peaks, in order
+ * @param npeaks Number of peaks
+ * @param n Number of leaves
+ * @param root Pointer to place root node
+ */
+static void mmr_bag(const MMRNODE *peaks, int npeaks, word64 n,
+   MMRNODE *root)
+{
+   SHA256_CTX ctx;
+   MMRNODE bag;
+   word8 count[8];
+
+   memset(&bag, 0, sizeof(bag));
+   if (npeaks > 0) {
+      memcpy(&bag, &peaks[npeaks - 1], sizeof(MMRNODE));
+      while (--npeaks > 0) mmr_merge(&peaks[npeaks - 1], &bag, &bag);
+   }
+   put64(count, &n);
+   sha256_init(&ctx);
+   sha256_update(&ctx, count, 8);
+   sha256_update(&ctx, &bag, sizeof(MMRNODE));
+   sha256_final(&ctx, root->hash);
+   memcpy(root->weight, bag.weight, 32);
+}  /* end mmr_bag() */
+
+/**
+ * @private
+ * Read an MMR node from an MMR sidecar.
+ * @param fp Pointer to MMR sidecar FILE
+ * @param pos Position of MMR node
+ * @param node Pointer to place MMR node
+ * @return (int) VEOK on success, else VERROR
+ */
+static int mmr_read(FILE *fp, long long pos, MMRNODE *node)
+{
+   if (fseek64(fp, pos * (long long) sizeof(MMRNODE), SEEK_SET) != 0 ||
+         fread(node, sizeof(MMRNODE), 1, fp) != 1) {
+      if (!ferror(fp)) set_errno(EMCM_EOF);
+      return VERROR;
+   }
+
+   return VEOK;
+}  /* end mmr_read() */
+
+/**
+ * @private
+ * Read the peaks of an MMR of n leaves, in order.
+ * @param fp Pointer to MMR sidecar FILE
+ * @param n Number of leaves
+ * @param peaks Pointer to place (at most 64) peaks
+ * @return (int) number of peaks, or (-1) on error
+ */
+static int mmr_peaks(FILE *fp, word64 n, MMRNODE *peaks)
+{
+   long long pos;
+   int h, npeaks;
+
+   for (pos = 0, npeaks = 0, h = 63; h >= 0; h--) {
+      if (!((n >> h) & 1)) continue;
+      pos += (2LL << h) - 1;
+      if (mmr_read(fp, pos - 1, &peaks[npeaks++]) != VEOK) return (-1);
+   }
+
+   return npeaks;
+}  /* end mmr_peaks() */
+
+/**
+ * @private
+ * Push a leaf to the end of an MMR of n leaves. The MMR sidecar MUST be
+ * positioned at the end of the MMR, and is left there.
+ * @param fp Pointer to MMR sidecar FILE
+ * @param peaks Pointer to (at most 64) peaks of MMR, in order
+ * @param npeaks Pointer to number of peaks of MMR
+ * @param n Number of leaves, before push
+ * @param leaf Pointer to leaf to push
+ * @return (int) VEOK on success, else VERROR
+ */
+static int mmr_push(FILE *fp, MMRNODE *peaks, int *npeaks, word64 n,
+   const MMRNODE *leaf)
+{
+   MMRNODE node;
+
+   memcpy(&node, leaf, sizeof(MMRNODE));
+   if (fwrite(&node, sizeof(MMRNODE), 1, fp) != 1) return VERROR;
+   /* merge with left siblings of equal height */
+   for ( ; n & 1; n >>= 1) {
+      mmr_merge(&peaks[--(*npeaks)], &node, &node);
+      if (fwrite(&node, sizeof(MMRNODE), 1, fp) != 1) return VERROR;
+   }
+   memcpy(&peaks[(*npeaks)++], &node, sizeof(MMRNODE));
+
+   return VEOK;
+}  /* end mmr_push() */
+
+/**
+ * @private
+ * Open the MMR sidecar of a Tfile, for an MMR of n leaves. The sidecar
+ * size, and the last leaf, are checked against the Tfile.
+ * @param tfile Filename of Tfile
+ * @param n Number of leaves (trailers) expected of MMR
+ * @param mode Mode to open sidecar with ("rb" or "r+b")
+ * @return (FILE *) sidecar, or NULL if the sidecar does not exist or
+ * does not match
+ */
+static FILE *mmr_open(const char *tfile, word64 n, const char *mode)
+{
+   char mmrfile[FILENAME_MAX];
+   BTRAILER bt;
+   MMRNODE leaf, node;
+   word8 bnum[8];
+   FILE *fp;
+
+   snprintf(mmrfile, FILENAME_MAX, "%s%s", tfile, MMR_EXT);
+   fp = fopen(mmrfile, mode);
+   if (fp == NULL) return NULL;
+   if (fseek64(fp, 0LL, SEEK_END) != 0 ||
+         ftell64(fp) != mmr_size(n) * (long long) sizeof(MMRNODE)) {
+      goto FAIL;
+   }
+   if (n > 0) {
+      n--;
+      put64(bnum, &n);
+      if (read_tfile(&bt, bnum, 1, tfile) != 1) goto FAIL;
+      if (mmr_read(fp, mmr_size(n), &node) != VEOK) goto FAIL;
+      mmr_leaf(&bt, &leaf);
+      if (memcmp(&leaf, &node, sizeof(MMRNODE)) != 0) goto FAIL;
+   }
+
+   return fp;
+
+FAIL:
+   fclose(fp);
+
+   return NULL;
+}  /* end mmr_open() */
+
+/**
+ * @private
+ * Extend the MMR sidecar of a Tfile with appended Block Trailers.
+ * The sidecar is rebuilt from the Tfile if it does not match.
+ * @param tfile Filename of Tfile, after append
+ * @param bt Pointer to appended Block Trailers
+ * @param count Number of appended Block Trailers
+ * @return (int) VEOK on success, else VERROR
+ */
+static int mmr_extend(const char *tfile, const BTRAILER *bt, size_t count)
+{
+   char mmrfile[FILENAME_MAX];
+   MMRNODE peaks[64], leaf;
+   BTRAILER tft;
+   long long len;
+   word64 n;
+   FILE *fp, *tfp;
+   size_t j;
+   int npeaks, ecode;
+
+   /* determine number of trailers, before append */
+   tfp = fopen(tfile, "rb");
+   if (tfp == NULL) return VERROR;
+   ecode = fseek64(tfp, 0LL, SEEK_END);
+   len = ftell64(tfp);
+   if (ecode != 0 || len < 0) goto ERROR_CLEANUP;
+   n = (word64) len / sizeof(BTRAILER);
+   if (n < count) goto ERROR_CLEANUP;
+   n -= count;
+
+   /* extend matching sidecar... */
+   fp = mmr_open(tfile, n, "r+b");
+   if (fp != NULL) {
+      fclose(tfp);
+      npeaks = mmr_peaks(fp, n, peaks);
+      ecode = (npeaks < 0 || fseek64(fp, 0LL, SEEK_END) != 0);
+      for (j = 0; ecode == 0 && j < count; j++, n++) {
+         mmr_leaf(&bt[j], &leaf);
+         ecode = mmr_push(fp, peaks, &npeaks, n, &leaf);
+      }
+      fclose(fp);
+      return ecode ? VERROR : VEOK;
+   }
+
+   /* ... else rebuild sidecar from Tfile */
+   snprintf(mmrfile, FILENAME_MAX, "%s%s", tfile, MMR_EXT);
+   fp = fopen(mmrfile, "wb");
+   if (fp == NULL) goto ERROR_CLEANUP;
+   rewind(tfp);
+   for (n = 0, npeaks = 0; fread(&tft, sizeof(BTRAILER), 1, tfp) == 1; n++) {
+      mmr_leaf(&tft, &leaf);
+      if (mmr_push(fp, peaks, &npeaks, n, &leaf) != VEOK) break;
+   }
+   ecode = (ferror(tfp) || ferror(fp) || !feof(tfp));
+   fclose(fp);
+   fclose(tfp);
+   if (ecode) {
+      remove(mmrfile);
+      return VERROR;
+   }
+
+   return VEOK;
+
+ERROR_CLEANUP:
+   fclose(tfp);
+
+   return VERROR;
+}  /* end mmr_extend() */
+
+/**
+ * Build an MMR proof of a Block Trailer, in a Tfile of n trailers. The
+ * proof proves membership of the trailer in the chain, its cumulative
+ * weight, and the weight of the chain, against the MMR root of n leaves.
+ * Proof format is:
+ *    [8 byte n][BTRAILER][siblings, leaf to peak][other peaks, in order]
+ * where each sibling and peak is an MMRNODE.
+ * @param tfile Filename of Tfile
+ * @param bnum Block number of trailer to prove
+ * @param count Number of trailers of MMR to prove against, or zero for
+ * all trailers of Tfile
+ * @param proof Pointer to buffer to place proof, of MMRPROOFLEN bytes
+ * @return (size_t) length of proof, or zero on error; check errno
+ * @exception errno=EMCM_MMRSTALE if the sidecar does not match the Tfile
+ * @note The sidecar is only read, and never (re)built, so that proofs may
+ * be served while the Tfile is appended. See mmr_root().
+ */
+size_t mmr_proof(const char *tfile, const word8 bnum[8],
+   const word8 count[8], word8 *proof)
+{
+   MMRNODE *nodes;
+   long long pos, len;
+   word64 i, n, leaves;
+   FILE *fp, *tfp;
+   int h, k, own;
+   size_t nlen;
+
+   /* determine number of trailers of Tfile */
+   tfp = fopen(tfile, "rb");
+   if (tfp == NULL) return 0;
+   len = (fseek64(tfp, 0LL, SEEK_END) == 0) ? ftell64(tfp) : (-1);
+   fclose(tfp);
+   if (len < 0) return 0;
+   leaves = (word64) len / sizeof(BTRAILER);
+   put64(&n, count);
+   put64(&i, bnum);
+   if (n == 0) n = leaves;
+   if (n > leaves || i >= n) {
+      set_errno(EMCM_BNUM);
+      return 0;
+   }
+
+   /* open sidecar, read-only -- a stale sidecar fails the proof */
+   fp = mmr_open(tfile, leaves, "rb");
+   if (fp == NULL) {
+      set_errno(EMCM_MMRSTALE);
+      return 0;
+   }
+
+   /* place count and trailer */
+   put64(proof, &n);
+   if (read_tfile(proof + 8, bnum, 1, tfile) != 1) goto ERROR_CLEANUP;
+   nodes = (MMRNODE *) (proof + 8 + sizeof(BTRAILER));
+   nlen = 0;
+
+   /* find peak of leaf, while placing peaks to the left */
+   for (pos = 0, own = (-1), h = 63; h >= 0; h--) {
+      if (!((n >> h) & 1)) continue;
+      if (own < 0 && i < (1ULL << h)) {
+         own = h;
+         break;
+      }
+      i -= (1ULL << h);
+      pos += (2LL << h) - 1;
+      if (mmr_read(fp, pos - 1, &nodes[nlen++]) != VEOK) goto ERROR_CLEANUP;
+   }
+   /* ... insert siblings, from peak down to leaf, before left peaks */
+   memmove(&nodes[own], &nodes[0], nlen * sizeof(MMRNODE));
+   for (k = own; k > 0; k--) {
+      if ((i >> (k - 1)) & 1) {
+         /* leaf is right -- sibling is left subtree */
+         if (mmr_read(fp, pos + (1LL << k) - 2, &nodes[k - 1]) != VEOK) {
+            goto ERROR_CLEANUP;
+         }
+         pos += (1LL << k) - 1;
+      } else if (mmr_read(fp, pos + (2LL << k) - 3, &nodes[k - 1]) != VEOK) {
+         /* leaf is left -- sibling is right subtree */
+         goto ERROR_CLEANUP;
+      }
+   }
+   nlen += (size_t) own;
+   /* ... skip own peak, and place peaks to the right */
+   for (pos = 0, h = 63; h >= 0; h--) {
+      if (!((n >> h) & 1)) continue;
+      pos += (2LL << h) - 1;
+      if (h >= own) continue;
+      if (mmr_read(fp, pos - 1, &nodes[nlen++]) != VEOK) goto ERROR_CLEANUP;
+   }
+   fclose(fp);
+
+   return 8 + sizeof(BTRAILER) + (nlen * sizeof(MMRNODE));
+
+ERROR_CLEANUP:
+   fclose(fp);
+
+   return 0;
+}  /* end mmr_proof() */
+
+/**
+ * Get the MMR root of a Tfile. The sidecar is built as necessary.
+ * @param tfile Filename of Tfile
+ * @param root Pointer to place MMR root hash
+ * @param weight Pointer to place weight of Tfile (may be NULL)
+ * @return (int) VEOK on success, else VERROR
+ */
+int mmr_root(const char *tfile, word8 root[HASHLEN], word8 weight[32])
+{
+   MMRNODE peaks[64], node;
+   long long len;
+   word64 n;
+   FILE *fp;
+   int npeaks;
+
+   fp = fopen(tfile, "rb");
+   if (fp == NULL) return VERROR;
+   len = (fseek64(fp, 0LL, SEEK_END) == 0) ? ftell64(fp) : (-1);
+   fclose(fp);
+   if (len < 0) return VERROR;
+   n = (word64) len / sizeof(BTRAILER);
+
+   /* open sidecar, building as necessary */
+   fp = mmr_open(tfile, n, "rb");
+   if (fp == NULL) {
+      if (mmr_extend(tfile, NULL, 0) != VEOK) return VERROR;
+      fp = mmr_open(tfile, n, "rb");
+      if (fp == NULL) return VERROR;
+   }
+   npeaks = mmr_peaks(fp, n, peaks);
+   fclose(fp);
+   if (npeaks < 0) return VERROR;
+
+   mmr_bag(peaks, npeaks, n, &node);
+   memcpy(root, node.hash, HASHLEN);
+   if (weight) memcpy(weight, node.weight, 32);
+
+   return VEOK;
+}  /* end mmr_root() */
+
+/**
+ * Verify an MMR proof of a Block Trailer, built by mmr_proof().
+ * The proof is well formed, and hashes to root; the caller MUST check
+ * root against a trusted (or previously obtained) root.
+ * @param proof Pointer to proof
+ * @param len Length of proof, in bytes
+ * @param root Pointer to place MMR root hash
+ * @param weight Pointer to place weight of chain (all n leaves)
+ * @param cweight Pointer to place cumulative weight of chain, up to
+ * and including the proven trailer (may be NULL)
+ * @return (int) value representing verification result
+ * @retval VEBAD on malformed proof; check errno for details
+ * @retval VEOK on success
+ */
+int mmr_verify(const word8 *proof, size_t len, word8 root[HASHLEN],
+   word8 weight[32], word8 cweight[32])
+{
+   MMRNODE peaks[64], node, sib;
+   const BTRAILER *bt;
+   const word8 *nodes;
+   word8 cw[32];
+   word64 i, n;
+   int h, k, own, npeaks;
+
+   if (len < 8 + sizeof(BTRAILER)) goto BAD;
+   put64(&n, proof);
+   bt = (const BTRAILER *) (proof + 8);
+   nodes = proof + 8 + sizeof(BTRAILER);
+   len -= 8 + sizeof(BTRAILER);
+   put64(&i, bt->bnum);
+   if (i >= n || len % sizeof(MMRNODE) != 0) goto BAD;
+
+   /* find height of leaf's peak, and index within */
+   for (own = (-1), npeaks = 0, h = 63; h >= 0; h--) {
+      if (!((n >> h) & 1)) continue;
+      npeaks++;
+      if (own < 0) {
+         if (i < (1ULL << h)) own = h;
+         else i -= (1ULL << h);
+      }
+   }
+   if (len / sizeof(MMRNODE) != (size_t) (own + npeaks - 1)) goto BAD;
+
+   /* climb from leaf to peak -- left siblings add cumulative weight */
+   mmr_leaf(bt, &node);
+   memcpy(cw, node.weight, 32);
+   for (k = 0; k < own; k++, nodes += sizeof(MMRNODE)) {
+      memcpy(&sib, nodes, sizeof(MMRNODE));
+      if ((i >> k) & 1) {
+         multi_add(cw, sib.weight, cw, 32);
+         mmr_merge(&sib, &node, &node);
+      } else mmr_merge(&node, &sib, &node);
+   }
+   /* place peaks in order -- left peaks add cumulative weight */
+   for (k = 0, h = 63; h >= 0; h--) {
+      if (!((n >> h) & 1)) continue;
+      if (h == own) {
+         memcpy(&peaks[k++], &node, sizeof(MMRNODE));
+         continue;
+      }
+      memcpy(&peaks[k], nodes, sizeof(MMRNODE));
+      nodes += sizeof(MMRNODE);
+      if (h > own) multi_add(cw, peaks[k].weight, cw, 32);
+      k++;
+   }
+
+   /* bag peaks into root */
+   mmr_bag(peaks, npeaks, n, &node);
+   memcpy(root, node.hash, HASHLEN);
+   memcpy(weight, node.weight, 32);
+   if (cweight) memcpy(cweight, cw, 32);
+
+   return VEOK;
+
+BAD:
+   set_errno(EMCM_MMRPROOF);
+   return VEBAD;
+}  /* end mmr_verify() */
+
+/**
+ * Append a series of Block Trailers to a file. The MMR sidecar of the
+ * Tfile is extended, or rebuilt, alongside.
  * @param bt Pointer to Block Trailer data to append
  * @param count Number of Block Trailers to append
  * @param tfile Filename of Tfile to append to
@@ -78,10 +558,49 @@ int append_tfile(const BTRAILER *bt, size_t count, const char *tfile)
    if (write_count != count) {
       return VERROR;
    }
+   /* MMR sidecar is a cache -- failures are recovered on next use */
+   if (mmr_extend(tfile, bt, count) != VEOK) {
+      perrno("failed to extend MMR of %s", tfile);
+   }
 
    return VEOK;
 }
 
+/**
+ * Find the Block Trailer of a block hash in a Tfile.
+ * @param tfile Filename of Tfile to search
+ * @param bhash Pointer to block hash to find
+ * @param bt Pointer to place the Block Trailer found
+ * @return (int) value representing operation result
+ * @retval VEBAD if block hash was not found; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int find_tfile(const char *tfile, const word8 bhash[HASHLEN], BTRAILER *bt)
+{
+   FILE *fp;
+   int ecode;
+
+   fp = fopen(tfile, "rb");
+   if (fp == NULL) return VERROR;
+
+   /* scan trailers for matching block hash */
+   ecode = VEBAD;
+   while (fread(bt, sizeof(BTRAILER), 1, fp) == 1) {
+      if (memcmp(bt->bhash, bhash, HASHLEN) == 0) {
+         ecode = VEOK;
+         break;
+      }
+   }
+   if (ecode != VEOK) {
+      if (ferror(fp)) ecode = VERROR;
+      else set_errno(EMCM_EOF);
+   }
+   fclose(fp);
+
+   return ecode;
+}  /* end find_tfile() */
+
 /**
  * Compute the sum of block rewards represented by a Tfile. Only trailers
  * with a non-zero transaction count are added to the rewards sum. A block
@@ -269,6 +788,66 @@ void merkle_root(const word8 *hashlist, size_t count, word8 *root)
    }
 }  /* end merkle_root() */
 
+/**
+ * Locate a node of the Merkle tree built by merkle_root(), by depth and
+ * index, as the range of leaf hashes it covers. Nodes at a depth are
+ * indexed left to right. Every node exists where (1 << depth) <= count.
+ * @param count Number of leaf hashes in the Merkle tree
+ * @param depth Depth of node, where 0 is the Merkle Root
+ * @param index Index of node at depth
+ * @param offset Pointer to place index of first leaf hash covered
+ * @return (size_t) number of leaf hashes covered by the node
+ */
+size_t merkle_range(size_t count, unsigned depth, size_t index,
+   size_t *offset)
+{
+   size_t left;
+
+   *offset = 0;
+   while (depth--) {
+      /* merkle_root() puts the larger half of a split on the left */
+      left = count - (count / 2);
+      if (index & ((size_t) 1 << depth)) {
+         *offset += left;
+         count -= left;
+      } else count = left;
+   }
+
+   return count;
+}  /* end merkle_range() */
+
+/**
+ * Compute the Merkle Root from a complete layer of Merkle tree nodes,
+ * such as the (1 << depth) sub-roots of merkle_range() ranges.
+ * @param layer Pointer to list of (1 << depth) node hashes
+ * @param depth Depth of layer, where 0 is the Merkle Root
+ * @param root Pointer to place Merkle Root hash
+ * @return (int) value representing operation result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int merkle_layer_root(const word8 *layer, unsigned depth, word8 *root)
+{
+   word8 *nodes;
+   size_t j, count;
+
+   count = (size_t) 1 << depth;
+   nodes = malloc(count * HASHLEN);
+   if (nodes == NULL) return VERROR;
+
+   /* every node above a complete layer has two children */
+   memcpy(nodes, layer, count * HASHLEN);
+   for ( ; count > 1; count /= 2) {
+      for (j = 0; j < count; j += 2) {
+         sha256(nodes + (j * HASHLEN), HASHLEN * 2, nodes + (j / 2 * HASHLEN));
+      }
+   }
+   memcpy(root, nodes, HASHLEN);
+   free(nodes);
+
+   return VEOK;
+}  /* end merkle_layer_root() */
+
 /**
  * Read Trailers from a Tfile into a buffer.
  * @param buffer Pointer to buffer to read Tfile data into
@@ -483,13 +1062,23 @@ ERROR_CLEANUP:
  */
 int trim_tfile(const char* tfile, const word8 highbnum[8])
 {
-   FILE *fp;
+   char mmrfile[FILENAME_MAX];
+   FILE *fp, *mfp;
    BTRAILER bt;
    long long seek;
+   word64 n;
+   int ecode;
 
    fp = fopen(tfile, "r+b");
    if (fp == NULL) return VERROR;
 
+   /* open matching MMR sidecar, before trim */
+   if (fseek64(fp, 0LL, SEEK_END) != 0 || (seek = ftell64(fp)) < 0) {
+      fclose(fp);
+      return VERROR;
+   }
+   mfp = mmr_open(tfile, (word64) seek / sizeof(BTRAILER), "r+b");
+
    /* determine seek position */
    put64(&seek, highbnum);
    seek = seek * sizeof(BTRAILER);
@@ -512,6 +1101,19 @@ int trim_tfile(const char* tfile, const word8 highbnum[8])
    /* truncate file at current position */
    if (ftruncate(fileno(fp), ftell64(fp)) != 0) goto ERROR_CLEANUP;
 
+   /* truncate MMR sidecar alongside, else remove */
+   ecode = (-1);
+   if (mfp != NULL) {
+      put64(&n, highbnum);
+      seek = mmr_size(n + 1) * (long long) sizeof(MMRNODE);
+      ecode = ftruncate(fileno(mfp), seek);
+      fclose(mfp);
+   }
+   if (ecode != 0) {
+      snprintf(mmrfile, FILENAME_MAX, "%s%s", tfile, MMR_EXT);
+      remove(mmrfile);
+   }
+
    /* cleanup */
    fclose(fp);
 
@@ -519,6 +1121,7 @@ int trim_tfile(const char* tfile, const word8 highbnum[8])
 
    /* cleanup / error handling */
 ERROR_CLEANUP:
+   if (mfp != NULL) fclose(mfp);
    fclose(fp);
 
    return VERROR;
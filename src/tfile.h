@@ -18,6 +18,39 @@
    #define NTFTX 54
 #endif
 
+/* maximum number of Tfile entries per OP_TF request */
+#ifndef NTFRANGE
+   #define NTFRANGE 1000
+#endif
+
+/* maximum number of Tfile entries fetched by an incremental resync */
+#ifndef NTFSUFFIX
+   #define NTFSUFFIX ( NTFRANGE * 16 )
+#endif
+
+#ifndef MMR_EXT
+   /**
+    * Filename extension of the MMR sidecar of a Tfile. The sidecar holds
+    * the nodes of a Merkle Mountain Range over the Tfile trailers, in
+    * post-order, and is maintained by append_tfile() and trim_tfile().
+    * Any other writer of a Tfile MUST remove its sidecar alongside.
+   */
+   #define MMR_EXT ".mmr"
+#endif
+
+/**
+ * MMR node. Leaves hold the sha256() of a trailer, and the weight the
+ * trailer adds to the chain. Parents hold the sha256() of both children,
+ * and the sum of child weights.
+ */
+typedef struct {
+   word8 hash[HASHLEN];    /**< node hash */
+   word8 weight[32];       /**< (256-bit) weight of leaves under node */
+} MMRNODE;
+
+/** Maximum length of an MMR proof, as built by mmr_proof() */
+#define MMRPROOFLEN  ( 8 + sizeof(BTRAILER) + (126 * sizeof(MMRNODE)) )
+
 /* ensure validity of NTFTX definition */
 #define NTFTX_SPACE  ( sizeof(((TX *) NULL)->buffer) / sizeof(BTRAILER) )
 STATIC_ASSERT(NTFTX <= NTFTX_SPACE, NTFTX_too_large_for_buffer);
@@ -29,9 +62,18 @@ extern "C" {
 
 void add_weight(word8 weight[32], word8 difficulty);
 int append_tfile(const BTRAILER *bt, size_t count, const char *file);
+int find_tfile(const char *tfile, const word8 bhash[HASHLEN], BTRAILER *bt);
 void get_mreward(word8 reward[8], const word8 bnum[8]);
 int get_tfrewards(const char *tfile, word8 rewards[8], const word8 bnum[8]);
 void merkle_root(const word8 *hashlist, size_t count, word8 *root);
+size_t merkle_range(size_t count, unsigned depth, size_t index,
+   size_t *offset);
+int merkle_layer_root(const word8 *layer, unsigned depth, word8 *root);
+size_t mmr_proof(const char *tfile, const word8 bnum[8],
+   const word8 count[8], word8 *proof);
+int mmr_root(const char *tfile, word8 root[HASHLEN], word8 weight[32]);
+int mmr_verify(const word8 *proof, size_t len, word8 root[HASHLEN],
+   word8 weight[32], word8 cweight[32]);
 size_t read_tfile
    (void *buffer, const word8 bnum[8], size_t count, const char *tfile);
 int read_trailer(BTRAILER *bt, const char *file);
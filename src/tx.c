@@ -18,6 +18,7 @@
 /* internal support */
 #include "wots.h"
 #include "ledger.h"
+#include "tfile.h"
 #include "global.h"
 #include "error.h"
 
@@ -28,6 +29,7 @@
 #include "exttime.h"
 #include "extmath.h"
 #include "extlib.h"
+#include "extio.h"
 #include <ctype.h>
 #include "crc16.h"
 #include "base58.h"
@@ -138,6 +140,9 @@ static void tx__init(TXENTRY *tx, const void *opts)
    tx->wots = &(tx->dsa->wots);
    tx->tx_nonce = tx->tlr->nonce;
    tx->tx_id = tx->tlr->id;
+
+   /* invalidate cached digests */
+   tx->digested = 0;
 }  /* end tx__init() */
 
 struct {
@@ -400,7 +405,195 @@ int tx_fwrite(const TXENTRY *tx, FILE *stream)
 }  /* end tx_fwrite() */
 
 /**
- * Hash a Transaction Entry, @a txe.
+ * Get the transaction offset-table sidecar filename of a block file.
+ * @param bcfile Filename of block file
+ * @param ixfile Pointer to buffer of FILENAME_MAX for sidecar filename
+ * @return (char *) ixfile
+ */
+char *tx_ixname(const char *bcfile, char *ixfile)
+{
+   snprintf(ixfile, FILENAME_MAX, "%s%s", bcfile, TXIDX_EXT);
+   return ixfile;
+}
+
+/**
+ * Open the transaction offset-table sidecar of a block file, for reading
+ * TXIDX entries in block order. Sidecar size, and the first and last
+ * entries, are checked against the transactions of the block file.
+ * @param bcfile Filename of block file
+ * @param tcount Number of transactions in block file
+ * @return (FILE *) sidecar positioned at the first entry, or NULL
+ * if the sidecar does not exist or does not match
+ */
+FILE *tx_ixopen(const char *bcfile, word32 tcount)
+{
+   TXENTRY txe;
+   TXIDX ix;
+   char ixfile[FILENAME_MAX];
+   long long offset, len;
+   FILE *fp, *ixfp;
+   word32 j;
+   int ok;
+
+   offset = len = 0;
+   if (tcount == 0) return NULL;
+   ixfp = fopen(tx_ixname(bcfile, ixfile), "rb");
+   if (ixfp == NULL) return NULL;
+   fp = fopen(bcfile, "rb");
+   if (fp == NULL) goto FAIL;
+
+   /* check sidecar size, and block file length */
+   ok = (fseek64(ixfp, 0LL, SEEK_END) == 0 &&
+      ftell64(ixfp) == (long long) tcount * (long long) sizeof(TXIDX) &&
+      fseek64(fp, 0LL, SEEK_END) == 0 && (len = ftell64(fp)) != (-1));
+   /* check first and last entries locate their transactions */
+   for (j = 0; ok && j < tcount; j += (tcount - 1)) {
+      ok = (fseek64(ixfp, (long long) j * sizeof(TXIDX), SEEK_SET) == 0 &&
+         fread(&ix, sizeof(TXIDX), 1, ixfp) == 1);
+      if (ok) {
+         put64(&offset, ix.offset);
+         if (j == 0) ok = (offset == (long long) sizeof(BHEADER));
+      }
+      ok = ok && (fseek64(fp, offset, SEEK_SET) == 0 &&
+         tx_fread(&txe, fp) == VEOK &&
+         memcmp(txe.tx_id, ix.tx_id, HASHLEN) == 0);
+      if (ok && j == tcount - 1) {
+         ok = (ftell64(fp) == len - (long long) sizeof(BTRAILER));
+      }
+      if (tcount == 1) break;
+   }
+   fclose(fp);
+   if (ok && fseek64(ixfp, 0LL, SEEK_SET) == 0) return ixfp;
+
+FAIL:
+   fclose(ixfp);
+
+   return NULL;
+}  /* end tx_ixopen() */
+
+/**
+ * Read a single transaction, by index, from a block file. The offset of
+ * the transaction is taken from the block's transaction offset-table
+ * sidecar, where valid, else preceding transactions are skipped. A
+ * sidecar entry that does not locate its transaction (by tx_id) is taken
+ * as a corrupt sidecar, which is removed.
+ * @param txe Pointer to Transaction Entry container
+ * @param bcfile Filename of block file to read from
+ * @param index Index of transaction in block
+ * @return (int) value representing the read result
+ * @retval VEBAD if index is out of range; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int tx_ixread(TXENTRY *txe, const char *bcfile, word32 index)
+{
+   BTRAILER bt;
+   TXIDX ix;
+   char ixfile[FILENAME_MAX];
+   long long offset;
+   FILE *fp, *ixfp;
+   word32 j;
+   int ecode;
+
+   if (read_trailer(&bt, bcfile) != VEOK) return VERROR;
+   if (index >= get32(bt.tcount)) {
+      set_errno(EMCM_EOF);
+      return VEBAD;
+   }
+   fp = fopen(bcfile, "rb");
+   if (fp == NULL) return VERROR;
+
+   /* read transaction at offset from sidecar... */
+   ecode = VERROR;
+   ixfp = tx_ixopen(bcfile, get32(bt.tcount));
+   if (ixfp != NULL) {
+      if (fseek64(ixfp, (long long) index * sizeof(TXIDX), SEEK_SET) == 0 &&
+            fread(&ix, sizeof(TXIDX), 1, ixfp) == 1) {
+         put64(&offset, ix.offset);
+         if (fseek64(fp, offset, SEEK_SET) == 0 &&
+               tx_fread(txe, fp) == VEOK &&
+               memcmp(txe->tx_id, ix.tx_id, HASHLEN) == 0) ecode = VEOK;
+      }
+      fclose(ixfp);
+      if (ecode != VEOK) {
+         pdebug("%s: corrupt sidecar entry %" P32u, bcfile, index);
+         remove(tx_ixname(bcfile, ixfile));
+      }
+   }
+   if (ecode != VEOK) {
+      /* ... or skip preceding transactions */
+      clearerr(fp);
+      ecode = VEOK;
+      if (fseek(fp, (long) sizeof(BHEADER), SEEK_SET) != 0) ecode = VERROR;
+      for (j = 0; ecode == VEOK && j < index; j++) {
+         ecode = tx_fread(txe, fp);
+      }
+      if (ecode == VEOK) ecode = tx_fread(txe, fp);
+   }
+   if (ecode != VEOK && !ferror(fp)) set_errno(EMCM_EOF);
+   fclose(fp);
+
+   return ecode;
+}  /* end tx_ixread() */
+
+/**
+ * Write the transaction offset-table sidecar of a block file.
+ * A partially written sidecar is removed.
+ * @param bcfile Filename of block file
+ * @param txidx Pointer to tcount TXIDX entries, in block order
+ * @param tcount Number of transactions in block file
+ * @return (int) value representing write result
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int tx_ixwrite(const char *bcfile, const TXIDX *txidx, word32 tcount)
+{
+   char ixfile[FILENAME_MAX];
+   FILE *ixfp;
+
+   ixfp = fopen(tx_ixname(bcfile, ixfile), "wb");
+   if (ixfp == NULL) return VERROR;
+   if (fwrite(txidx, sizeof(TXIDX), tcount, ixfp) != tcount) {
+      fclose(ixfp);
+      remove(ixfile);
+      return VERROR;
+   }
+   fclose(ixfp);
+
+   return VEOK;
+}  /* end tx_ixwrite() */
+
+/**
+ * Compute and cache both hashes of a Transaction Entry, @a txe, in a
+ * single pass. The shared prefix (header and data) is hashed once and
+ * the hash context is forked at the DSA boundary to finalize the message
+ * hash, while the original context continues to the ID hash. Cached
+ * digests are used by tx_hash() and MUST be recomputed after any change
+ * to transaction data (e.g. the nonce).
+ * @param txe Pointer to Transaction Entry data
+ */
+void tx_digest(TXENTRY *txe)
+{
+   SHA256_CTX ctx, fork;
+   size_t len;
+
+   /* hash shared prefix (excl. DSA + trailer) */
+   len = (size_t) txe->dsa - (size_t) txe->hdr->options;
+   sha256_init(&ctx);
+   sha256_update(&ctx, txe->buffer, len);
+   /* fork context at DSA boundary for the message hash */
+   memcpy(&fork, &ctx, sizeof(SHA256_CTX));
+   sha256_final(&fork, txe->digest_message);
+   /* continue context through DSA and nonce for the ID hash */
+   len = (size_t) txe->tlr->id - (size_t) txe->dsa;
+   sha256_update(&ctx, txe->dsa, len);
+   sha256_final(&ctx, txe->digest_id);
+
+   txe->digested = 1;
+}  /* end tx_digest() */
+
+/**
+ * Hash a Transaction Entry, @a txe. Uses cached digests where available.
  * @param txe Pointer to Transaction Entry data
  * @param type Type of transaction hash to generate
  * @param out Pointer to place finalized hash
@@ -411,11 +604,19 @@ void tx_hash(const TXENTRY *tx, tx_hash_t type, void *out)
 
    switch (type) {
       case TX_HASH_MESSAGE:
+         if (tx->digested) {
+            memcpy(out, tx->digest_message, HASHLEN);
+            return;
+         }
          /* transaction signature message hash (excl. DSA + trailer) */
          len = (size_t) tx->dsa - (size_t) tx->hdr->options;
          sha256(tx->buffer, len, out);
          return;
       case TX_HASH_ID:
+         if (tx->digested) {
+            memcpy(out, tx->digest_id, HASHLEN);
+            return;
+         }
          /* solved transaction hash (excl. trailer hash) */
          len = (size_t) tx->tlr->id - (size_t) tx->hdr->options;
          sha256(tx->buffer, len, out);
@@ -617,7 +818,7 @@ static int tx_val__wots(const TXENTRY *tx)
    src_addr = tx->hdr->src_addr;
    wots = tx->wots;
 
-   /* generate transaction signature message */
+   /* generate (or reuse cached) transaction signature message */
    tx_hash(tx, TX_HASH_MESSAGE, message);
 
    /* recreate WOTS+ public key from signature */
@@ -646,17 +847,16 @@ static int tx_val__wots(const TXENTRY *tx)
 }  /* end tx_val__wots() */
 
 /**
- * Validate transaction data, as if received directly from a wallet.
- * DOES NOT validate nonce or id. Requires an open ledger.
+ * Validate transaction data, with optional signature verification.
+ * @private
  * @param txe Pointer to Transaction Entry to validate
  * @param bnum Pointer to block number to validate against
- * @return (int) value representing validation result
- * @retval VEBAD2 on invalid signature; check errno for details
- * @retval VEBAD on bad transaction data; check errno for details
- * @retval VERROR on error; check errno for details
- * @retval VEOK on success
+ * @param mfee Pointer to minimum fee to validate against
+ * @param sigcheck Non-zero to verify the transaction signature
+ * @return (int) value representing validation result; see tx_val()
  */
-int tx_val(const TXENTRY *txe, const void *bnum, const void *mfee)
+static int tx_val__data
+   (TXENTRY *txe, const void *bnum, const void *mfee, int sigcheck)
 {
    LENTRY le;
    word8 total[8];
@@ -672,6 +872,9 @@ int tx_val(const TXENTRY *txe, const void *bnum, const void *mfee)
    send_total = txe->hdr->send_total;
    change_total = txe->hdr->change_total;
 
+   /* compute transaction digests (once) */
+   if (!txe->digested) tx_digest(txe);
+
    /* only non-zero block-to-live values are checked */
    if (!iszero(txe->tx_btl, 8)) {
       /* prepare block-to-live upper bound */
@@ -717,7 +920,7 @@ int tx_val(const TXENTRY *txe, const void *bnum, const void *mfee)
    switch (TXDSA_TYPE(txe->hdr)) {
       case TXDSA_WOTS:
          /* ... validate WOTS+ transaction data */
-         if (tx_val__wots(txe) != VEOK) return VEBAD2;
+         if (sigcheck && tx_val__wots(txe) != VEOK) return VEBAD2;
          break;
       default:
          set_errno(EMCM_TXDSA);
@@ -746,37 +949,55 @@ int tx_val(const TXENTRY *txe, const void *bnum, const void *mfee)
 
    /* transaction is valid */
    return VEOK;
+}  /* end tx_val__data() */
+
+/**
+ * Validate transaction data, as if received directly from a wallet.
+ * DOES NOT validate nonce or id. Requires an open ledger.
+ * @param txe Pointer to Transaction Entry to validate
+ * @param bnum Pointer to block number to validate against
+ * @return (int) value representing validation result
+ * @retval VEBAD2 on invalid signature; check errno for details
+ * @retval VEBAD on bad transaction data; check errno for details
+ * @retval VERROR on error; check errno for details
+ * @retval VEOK on success
+ */
+int tx_val(TXENTRY *txe, const void *bnum, const void *mfee)
+{
+   return tx_val__data(txe, bnum, mfee, 1);
 }  /* end tx_val() */
 
 /**
  * Validate transaction entry, as stored on chain. Requires an open ledger.
+ * Signature verification is skipped for assume-valid blocks only.
  * @param txe Pointer to transaction entry to validate
  * @param bnum Pointer to block number to validate against
+ * @param mfee Pointer to minimum fee to validate against
+ * @param assumed Non-zero if transaction is in an assume-valid block
  * @return (int) value representing validation result
  * @retval VEBAD2 on invalid signature; check errno for details
  * @retval VEBAD on bad transaction data; check errno for details
  * @retval VERROR on error; check errno for details
  * @retval VEOK on success
  */
-int txe_val(const TXENTRY *txe, const void *bnum, const void *mfee)
+int txe_val
+   (TXENTRY *txe, const void *bnum, const void *mfee, int assumed)
 {
-   word8 hash[HASHLEN];
-
    /* check nonce is zero */
    if (!iszero(txe->tx_nonce, 8)) {
       set_errno(EMCM_TXNONCE);
       return VEBAD2;
    }
 
-   /* check transaction ID hash is correct */
-   tx_hash(txe, TX_HASH_ID, hash);
-   if (memcmp(txe->tx_id, hash, HASHLEN) != 0) {
+   /* check transaction ID hash is correct -- digests are reused */
+   if (!txe->digested) tx_digest(txe);
+   if (memcmp(txe->tx_id, txe->digest_id, HASHLEN) != 0) {
       set_errno(EMCM_TXID);
       return VEBAD2;
    }
 
    /* return result of transaction data validation */
-   return tx_val(txe, bnum, mfee);
+   return tx_val__data(txe, bnum, mfee, !assumed);
 }  /* end txe_val() */
 
 /**
@@ -1188,7 +1409,8 @@ int mirror_tx(NODE *np)
  * Process a transaction received into a NODE structure's TX buffer.
  * Validate a TX, write clean TX to txq1.dat, and raw TX to
  * mirror queue, mq.dat.
- * Locks mq.lck while appending mq.dat.
+ * Locks txq1.lck while checking for conflicts and appending txq1.dat,
+ * and mq.lck while appending mq.dat.
  * @param np Pointer to NODE containing transaction to process
  * @return (int) value representing the result
  * @retval VEBAD2 on invalid signature; check errno for details
@@ -1202,7 +1424,7 @@ int process_tx(NODE *np)
    FILE *fp;
    TX *tx;
    int evilness;
-   int ecode;
+   int ecode, lockfd;
 
    show("tx");
 
@@ -1219,20 +1441,36 @@ int process_tx(NODE *np)
       return ecode;
    }
 
+   /* zero nonce before validation, so digests include it once */
+   memset(txe.tlr->nonce, 0, sizeof(txe.tlr->nonce));
+
    /* Validate addresses, fee, signature, source balance, and total. */
    evilness = tx_val(&txe, Cblocknum, Myfee);
    if(evilness) return evilness;
 
    /* place Transaction ID (hash) in trailer for Mesh API */
-   memset(txe.tlr->nonce, 0, sizeof(txe.tlr->nonce));
-   tx_hash(&txe, TX_HASH_ID, txe.tlr->id);
+   memcpy(txe.tlr->id, txe.digest_id, HASHLEN);
 
+   /* lock transaction queue -- other processes may queue, or merge */
+   lockfd = lock("txq1.lck", 20);
+   if (lockfd == -1) return VERROR;
+   /* ... check again for duplicates, queued while validating */
+   ecode = txcheck(txe.src_addr);
+   if (ecode != VEOK) {
+      unlock(lockfd);
+      Ndups++;
+      return ecode;
+   }
    fp = fopen("txq1.dat", "ab");
-   if (fp == NULL) return VERROR;
+   if (fp == NULL) {
+      unlock(lockfd);
+      return VERROR;
+   }
 
    /* write transaction (incl. nonce and id) to txq1.dat */
    ecode = tx_fwrite(&txe, fp);
-   fclose(fp);  /* close txq1.dat */
+   if (fclose(fp) != 0) ecode = VERROR;  /* close txq1.dat */
+   unlock(lockfd);  /* unlock transaction queue lock, txq1.lck */
    if (ecode != VEOK) return VERROR;
 
    Txcount++;
@@ -32,6 +32,24 @@ typedef enum {
    TX_HASH_ID,
 } tx_hash_t;
 
+#ifndef TXIDX_EXT
+   /**
+    * Filename extension of the transaction offset-table sidecar of a
+    * block file. The sidecar holds a TXIDX for each transaction, in block
+    * order, and is written by b_val(). It is a local cache only; blocks
+    * are never altered, and a missing or mismatched sidecar is ignored.
+   */
+   #define TXIDX_EXT ".txi"
+#endif
+
+/**
+ * Transaction offset-table entry, as stored in a block's sidecar.
+ */
+typedef struct {
+   word8 offset[8];        /**< file offset of transaction in block */
+   word8 tx_id[HASHLEN];   /**< transaction ID of transaction */
+} TXIDX;
+
 /* C/C++ compatible function prototypes */
 #ifdef __cplusplus
 extern "C" {
@@ -49,10 +67,16 @@ int tx_bot_process(void);
 
 int tx_fread(TXENTRY *tx, FILE *stream);
 int tx_fwrite(const TXENTRY *tx, FILE *stream);
+char *tx_ixname(const char *bcfile, char *ixfile);
+FILE *tx_ixopen(const char *bcfile, word32 tcount);
+int tx_ixread(TXENTRY *txe, const char *bcfile, word32 index);
+int tx_ixwrite(const char *bcfile, const TXIDX *txidx, word32 tcount);
+void tx_digest(TXENTRY *txe);
 void tx_hash(const TXENTRY *tx, tx_hash_t type, void *out);
 int tx_read(TXENTRY *tx, const void *buf, size_t bufsz);
-int tx_val(const TXENTRY *txe, const void *bnum, const void *mfee);
-int txe_val(const TXENTRY *txe, const void *bnum, const void *mfee);
+int tx_val(TXENTRY *txe, const void *bnum, const void *mfee);
+int txe_val
+   (TXENTRY *txe, const void *bnum, const void *mfee, int assumed);
 int txcheck(const word8 *src_addr);
 int txclean(const char *txfname, const char *bcfname);
 pid_t mgc(word32 ip);
@@ -28,11 +28,14 @@
 
 /* Adjustable Parameters */
 #define MAXNODES     37       /**< maximum number of connected nodes */
+#define SLOTRESERVE  8        /**< child slots reserved for valued peers */
+#define SLOTPROVEN   4        /**< outbound connections proving a peer */
 #define INIT_TIMEOUT 3        /**< initial timeout after accept() */
 #define STD_TIMEOUT  5        /**< connection timeout in callserver() */
 #define LQLEN        100      /**< listen() queue length */
 #define TXQUEBIG     32       /**< big enough to run bcon */
 #define MAXBLTX      32768    /**< max TX's in a block for bcon (~1M) */
+#define MAXBLBYTES   0x2000000  /**< max TX bytes in a block for bcon */
 #define STATUSFREQ   10       /**< status display interval sec. */
 #define CPINKLEN     100       /* maximum entries in pinklists */
 #define LPINKLEN     100
@@ -42,9 +45,21 @@
 #define RPLISTLEN    64       /**< recent peer list v.28 */
 #define TPLISTLEN    32       /**< trusted peer list */
 #define CRCLISTLEN   1024     /**< recent tx crc's */
+#define RLIMITLEN    256      /**< rate limited peers tracked */
+#define TIPSLEN      256      /**< peer chain tips tracked */
+#define TIPMAXAGE    300      /**< seconds a peer chain tip is recent */
+#define RCHASHLEN    64       /**< OP_HASH responses cached */
+#define PDBBUCKETS   64       /**< peer database buckets */
+#define PDBBUCKETSZ  16       /**< peer database entries per bucket */
+#define PDBSRCBUCKETS 8       /**< buckets available to a source group */
+#define PDBMAXBAD    3        /**< consecutive failures of a bad peer */
 #define MAXQUORUM    32       /**< for init */
 #define BCONFREQ     3        /**< Run con at least */
 #define CBITS        0        /**< 8 capability bits for TX */
+#define CXBITS       0        /**< 8 extended capability bits */
+#ifndef ASSUMEVALID
+#define ASSUMEVALID  { 0 }    /**< assume-valid block hash (0 = none) */
+#endif
 #define MFEE         500
 
 #define UBANDWIDTH   14300    /**< Dynamic upload bandwidth -- not zero */
@@ -215,6 +230,68 @@
 */
 #define C_LOGGING       16
 
+/**
+ * Capability bit for nodes answering batched balance queries. Indicates
+ * the capability to answer OP_BALANCE_BATCH requests.
+*/
+#define C_BATCH         32
+
+/**
+ * Capability bit for nodes serving chunked neogenesis block transfers.
+ * Indicates the capability to answer OP_NG_LAYER and OP_GET_NGCHUNK.
+*/
+#define C_NGCHUNK       64
+
+/**
+ * Capability bit for nodes exchanging ledger state commitments. Indicates
+ * the capability to read, and append, a ledger state commitment to the
+ * block hash of an OP_HASH response. See le_lstate().
+*/
+#define C_LSTATE        128
+
+/**
+ * Extended capability bit for nodes compressing file transfers. Indicates
+ * the capability to send, and receive, OP_SEND_FILE data as compressed
+ * frames. See send_file() and recv_file().
+ * @note Extended capability bits are exchanged in the packet buffer of
+ * OP_HELLO and OP_HELLO_ACK, as { CXHELLO, Cxbits } and
+ * { CXHELLO_ACK, Cxbits } respectively. Peers without extended
+ * capabilities echo, or ignore, the OP_HELLO buffer.
+*/
+#define CX_COMPRESS     1
+
+/**
+ * Extended capability bit for nodes maintaining a Merkle Mountain Range
+ * over their trailers. Indicates the capability to answer OP_GET_MMRPROOF.
+ * See mmr_proof().
+*/
+#define CX_MMR          2
+
+/**
+ * Extended capability bit for nodes answering single-shot requests.
+ * Indicates the capability to answer an idempotent query sent with the
+ * OP_HELLO of a handshake, as { CXONESHOT, Cxbits, opcode, request },
+ * in a single round trip. See get_oneshot().
+*/
+#define CX_ONESHOT      4
+
+/**
+ * Extended capability bit for nodes answering ranged block requests.
+ * Indicates the capability to resume a partial OP_GET_BLOCK download,
+ * from an offset, given a hash of the partial download.
+ * See send_file_range().
+*/
+#define CX_RANGE        8
+
+/** Marker of extended capability bits sent with OP_HELLO */
+#define CXHELLO         'Q'
+
+/** Marker of extended capability bits sent with OP_HELLO_ACK */
+#define CXHELLO_ACK     'A'
+
+/** Marker of a single-shot request sent with OP_HELLO */
+#define CXONESHOT       'R'
+
 /**
  * "Null" operation code. Not actively used by the node, but can indicate a
  * lack of socket initialization during packet transmission.
@@ -251,6 +328,17 @@
 */
 #define OP_FOUND        4
 
+/**
+ * Marker of an early relay of OP_FOUND. When following the trailer proof
+ * of an OP_FOUND packet, indicates the sender has validated the trailer,
+ * difficulty and PoW of the advertised block, but full validation of the
+ * block is still in progress. See send_found_early().
+*/
+#define FOUND_EARLY     'E'
+
+/** Retries, at one second intervals, of getting an early relayed block */
+#define FOUNDRETRY      5
+
 /**
  * Get blockchain file operation code. Indicates a request for a blockchain
  * file. The number block number should be indicated in the same TX packet.
@@ -329,6 +417,8 @@
  * Block hash operation code. Indicates either a request for the block hash
  * of a particular block number or that a TX packet contains the block hash
  * of a particular block number, as represented in the trailer file.
+ * Where both nodes have C_LSTATE, the block hash is followed by the
+ * ledger state commitment of the block number, if known.
 */
 #define OP_HASH         17
 
@@ -346,12 +436,87 @@
 */
 #define OP_IDENTIFY     19
 
+/**
+ * Batch balance operation code. Indicates a request for the current
+ * balances of up to BATCHLEN addresses, directly from the ledger file.
+ * The TX packet buffer contains an array of ADDR_LEN addresses; an
+ * address with a zero hash is resolved by tag only. The response is an
+ * OP_SEND_BAL packet with an array of LENTRY's, in ascending address
+ * order, for each address found. Only answered by nodes with C_BATCH.
+*/
+#define OP_BALANCE_BATCH   20
+
+/**
+ * Neogenesis Merkle layer operation code. Indicates either a request for,
+ * or that a TX packet contains, a layer of sub-roots of the ledger Merkle
+ * tree of the neogenesis block at blocknum. The response buffer contains
+ * the 8 byte ledger length (NGHEADER.lbytes) followed by the (1 << depth)
+ * sub-roots of the merkle_range() chunks at the layer depth, which is
+ * implied by the response length. Only answered by nodes with C_NGCHUNK.
+*/
+#define OP_NG_LAYER     21
+
+/**
+ * Get neogenesis chunk operation code. Indicates a request for the ledger
+ * entries of one merkle_range() chunk of the neogenesis block at blocknum.
+ * The TX packet buffer contains the 1 byte layer depth and the 2 byte
+ * chunk index. The response is sent as OP_SEND_FILE packets.
+ * Only answered by nodes with C_NGCHUNK.
+*/
+#define OP_GET_NGCHUNK  22
+
+/**
+ * Get MMR proof operation code. Indicates either a request for, or that a
+ * TX packet contains, a Merkle Mountain Range proof of the trailer at
+ * blocknum. The request buffer contains the 8 byte number of trailers
+ * (leaves) to prove against, where zero requests the current number of
+ * trailers. The response buffer contains the proof, see mmr_proof().
+ * Only answered by nodes with CX_MMR.
+*/
+#define OP_GET_MMRPROOF 23
+
 /**
  * Operation code boundary. Indicates the last valid operation code
  * that can be used after a successful 3-Way Handshake.
  * @note Update value when adding operation codes.
 */
-#define LAST_OP         19
+#define LAST_OP         23
+
+/**
+ * Maximum number of addresses per OP_BALANCE_BATCH request.
+*/
+#define BATCHLEN        ( WORD16_MAX / sizeof(LENTRY) )
+
+/**
+ * Maximum depth of an OP_NG_LAYER Merkle layer. The layer of sub-roots,
+ * and the ledger length, must fit a single TX packet buffer.
+*/
+#define NGDEPTH_MAX     10
+
+/**
+ * Target length, in bytes, of an OP_GET_NGCHUNK neogenesis chunk.
+ * Chunks are larger where the ledger exceeds (1 << NGDEPTH_MAX) chunks.
+*/
+#define NGCHUNKLEN      ( 1 << 20 )
+
+/**
+ * Maximum length, in bytes, of a neogenesis chunk accepted for download.
+ * Bounds the ledger length, of a neogenesis block, advertised by peers.
+*/
+#define NGCHUNKMAX      ( NGCHUNKLEN << 6 )
+
+/**
+ * Length, in bytes, of file data in each compressed OP_SEND_FILE frame.
+ * A frame is a 1 byte flags field, 2 byte data length and frame data.
+ * The frame flagged CXF_LAST appends the sha256() of all file data.
+*/
+#define CXFRAMELEN      0xff00
+
+/** Compressed frame flag, for frame data compressed with lzc_compress() */
+#define CXF_LZC         0x01
+
+/** Compressed frame flag, for the last frame of a file */
+#define CXF_LAST        0x80
 
 
 /* device types (DEVICE_CTX.type) */
@@ -558,6 +723,15 @@ STATIC_ASSERT(sizeof(TXTLR) == ( 8 + HASHLEN ), TXTLR_size);
  *
  * @property TXENTRY::tlr
  * Pointer to the Transaction Trailer structure within the buffer.
+ *
+ * @property TXENTRY::digest_message
+ * Cached transaction signature message hash (see tx_digest()).
+ *
+ * @property TXENTRY::digest_id
+ * Cached transaction ID hash (see tx_digest()).
+ *
+ * @property TXENTRY::digested
+ * Non-zero when cached transaction digests are valid.
  */
 typedef struct {
    /* (AVOID DIRECT USAGE) transaction buffer */
@@ -594,6 +768,12 @@ typedef struct {
    WOTSVAL *wots;
    word8 *tx_nonce;
    word8 *tx_id;
+
+   /* cached transaction digests */
+
+   word8 digest_message[HASHLEN];
+   word8 digest_id[HASHLEN];
+   word8 digested;
 } TXENTRY;
 /* assertion NOT required */
 